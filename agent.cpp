@@ -0,0 +1,545 @@
+// Trampoline keeps registers at rbx, pushed in this order, flags first:
+// rax, rcx, rdx, rsi, rdi, r8, r9, r10, r11, rbx. Offsets by index into
+// Global_ConditionRegisterNames, -1 - not saved there.
+static const int Global_AgentRegisterOffsets[] = {
+    40, 48, 0, 56, 64, 72, -1, -1, -1, 80, -1, -1,
+    32, 24, 16, 8,  -1, -1, -1, -1};
+#define AGENT_FLAGS_OFFSET 80
+#define AGENT_STACK_OFFSET (AGENT_FLAGS_OFFSET + 8 + 128) // Red zone is kept
+
+static inline void AgentEmit(std::vector<BYTE> *code,
+                             std::initializer_list<BYTE> bytes) {
+  code->insert(code->end(), bytes);
+}
+
+// Little endian
+static inline void AgentEmitValue(std::vector<BYTE> *code, DWORD64 value,
+                                  size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    code->push_back((BYTE)(value >> (i * 8)));
+  }
+}
+
+// Branch with rel32 patched once the target is known, returns where the
+// rel32 is
+static inline size_t AgentEmitBranch(std::vector<BYTE> *code,
+                                     std::initializer_list<BYTE> opcode) {
+  AgentEmit(code, opcode);
+  const size_t position = code->size();
+  AgentEmitValue(code, 0, 4);
+
+  return position;
+}
+
+static inline void AgentPatchBranch(std::vector<BYTE> *code, size_t position,
+                                    size_t target) {
+  const DWORD displacement = (DWORD)(target - (position + 4));
+  memcpy(code->data() + position, &displacement, sizeof(displacement));
+}
+
+static inline bool AgentIsReachable(const Backend *backend, DWORD64 from,
+                                    DWORD64 to) {
+  if (!backend->is_64bit) {
+    return true; // rel32 wraps around the 32-bit address space
+  }
+
+  const int64_t distance = (int64_t)(to - from);
+  return distance > -AGENT_MAX_DISTANCE && distance < AGENT_MAX_DISTANCE;
+}
+
+#ifndef _WIN32
+// Reads the memory through process_vm_readv of the target itself, so that an
+// unreadable address fails instead of crashing it. Address is on the stack,
+// the value replaces it.
+static void AgentEmitLoad(std::vector<BYTE> *code, BYTE size, bool is_signed,
+                          std::vector<size_t> *error_branches) {
+  AgentEmit(code, {0x58,                          // pop rax
+                   0x48, 0x83, 0xec, 0x28,        // sub rsp, 40
+                   0x48, 0x89, 0x44, 0x24, 0x10,  // mov [rsp+16], rax
+                   0x48, 0xc7, 0x44, 0x24, 0x20}); // mov qword [rsp+32], 0
+  AgentEmitValue(code, 0, 4);
+  AgentEmit(code, {0x48, 0x8d, 0x4c, 0x24, 0x20,  // lea rcx, [rsp+32]
+                   0x48, 0x89, 0x0c, 0x24,        // mov [rsp], rcx
+                   0x48, 0xc7, 0x44, 0x24, 0x08}); // mov qword [rsp+8], size
+  AgentEmitValue(code, size, 4);
+  AgentEmit(code, {0x48, 0xc7, 0x44, 0x24, 0x18}); // mov qword [rsp+24], size
+  AgentEmitValue(code, size, 4);
+  AgentEmit(code, {0xb8}); // mov eax, SYS_getpid
+  AgentEmitValue(code, AGENT_SYS_GETPID, 4);
+  AgentEmit(code, {0x0f, 0x05,                   // syscall
+                   0x89, 0xc7,                   // mov edi, eax
+                   0x48, 0x89, 0xe6,             // mov rsi, rsp
+                   0xba, 0x01, 0x00, 0x00, 0x00, // mov edx, 1
+                   0x4c, 0x8d, 0x54, 0x24, 0x10, // lea r10, [rsp+16]
+                   0x41, 0xb8, 0x01, 0x00, 0x00, 0x00, // mov r8d, 1
+                   0x45, 0x31, 0xc9,                   // xor r9d, r9d
+                   0xb8}); // mov eax, SYS_process_vm_readv
+  AgentEmitValue(code, AGENT_SYS_PROCESS_VM_READV, 4);
+  AgentEmit(code, {0x0f, 0x05,             // syscall
+                   0x48, 0x83, 0xf8, size}); // cmp rax, size
+  error_branches->push_back(AgentEmitBranch(code, {0x0f, 0x85})); // jne
+
+  // Value at [rsp+32] into rax
+  switch (size) {
+  case 1:
+    is_signed ? AgentEmit(code, {0x48, 0x0f, 0xbe, 0x44, 0x24, 0x20})
+              : AgentEmit(code, {0x0f, 0xb6, 0x44, 0x24, 0x20});
+    break;
+  case 2:
+    is_signed ? AgentEmit(code, {0x48, 0x0f, 0xbf, 0x44, 0x24, 0x20})
+              : AgentEmit(code, {0x0f, 0xb7, 0x44, 0x24, 0x20});
+    break;
+  case 4:
+    is_signed ? AgentEmit(code, {0x48, 0x63, 0x44, 0x24, 0x20})
+              : AgentEmit(code, {0x8b, 0x44, 0x24, 0x20});
+    break;
+  default:
+    AgentEmit(code, {0x48, 0x8b, 0x44, 0x24, 0x20});
+    break;
+  }
+
+  AgentEmit(code, {0x48, 0x83, 0xc4, 0x28, // add rsp, 40
+                   0x50});                 // push rax
+}
+#endif
+
+// Compiles the condition bytecode into code that keeps the evaluation stack
+// on the machine stack and leaves the result on top of it. "base" - address
+// of code[0] in the target. Unreadable memory and division by zero branch to
+// "error_branches".
+static bool AgentCompileCondition(const Condition &condition, DWORD64 address,
+                                  DWORD64 hits_address, DWORD64 base,
+                                  std::vector<BYTE> *code,
+                                  std::vector<size_t> *error_branches) {
+  const BYTE *bytecode = condition.code.data();
+  const size_t size = condition.code.size();
+
+  // Machine code offset of every bytecode offset, for the forward jumps
+  std::vector<size_t> offsets(size + 1);
+  std::vector<std::pair<size_t, size_t>> jumps; // rel32, bytecode target
+
+  size_t i = 0;
+  while (i < size) {
+    offsets[i] = code->size();
+    const ConditionOp op = (ConditionOp)bytecode[i++];
+
+    switch (op) {
+    case ConditionOp::PUSH_CONSTANT: {
+      DWORD64 value;
+      memcpy(&value, bytecode + i, sizeof(value));
+      i += sizeof(value);
+
+      AgentEmit(code, {0x48, 0xb8}); // mov rax, value
+      AgentEmitValue(code, value, 8);
+      AgentEmit(code, {0x50}); // push rax
+    } break;
+    case ConditionOp::PUSH_REGISTER: {
+      const BYTE index = bytecode[i++];
+      const int offset = Global_AgentRegisterOffsets[index];
+      if (offset >= 0) {
+        AgentEmit(code, {0xff, 0x73, (BYTE)offset}); // push [rbx+offset]
+        break;
+      }
+
+      const char *name = Global_ConditionRegisterNames[index];
+      if (!strcmp(name, "ebp")) {
+        AgentEmit(code, {0x55}); // push rbp
+      } else if (!strcmp(name, "eip")) {
+        AgentEmit(code, {0x48, 0xb8}); // mov rax, address
+        AgentEmitValue(code, address, 8);
+        AgentEmit(code, {0x50});
+      } else if (!strcmp(name, "segcs")) {
+        AgentEmit(code, {0x48, 0x8c, 0xc8, 0x50}); // mov rax, cs
+      } else if (!strcmp(name, "segss")) {
+        AgentEmit(code, {0x48, 0x8c, 0xd0, 0x50}); // mov rax, ss
+      } else if (name[0] == 'r' && name[1] == '1' && name[2] >= '2') {
+        // r12 - r15 aren't touched by the trampoline
+        AgentEmit(code, {0x41, (BYTE)(0x54 + name[2] - '2')}); // push r1x
+      } else if (!strcmp(name, "esp")) {
+        AgentEmit(code, {0x48, 0x8d, 0x83}); // lea rax, [rbx+offset]
+        AgentEmitValue(code, AGENT_STACK_OFFSET, 4);
+        AgentEmit(code, {0x50});
+      } else {
+        return false;
+      }
+    } break;
+    case ConditionOp::PUSH_FRAME:
+      // Only the debugger walks the stack, evaluated there
+      return false;
+    case ConditionOp::PUSH_HITS: {
+      // push [rip+rel32]
+      const DWORD64 next_address = base + code->size() + 6;
+      AgentEmit(code, {0xff, 0x35});
+      AgentEmitValue(code, hits_address - next_address, 4);
+    } break;
+    case ConditionOp::LOAD:
+    case ConditionOp::LOAD_SIGNED: {
+#ifdef _WIN32
+      // Windows has no stable syscall numbers to read memory without
+      // crashing on a bad address, the debugger evaluates these
+      return false;
+#else
+      const BYTE value_size = bytecode[i++];
+      AgentEmitLoad(code, value_size, op == ConditionOp::LOAD_SIGNED,
+                    error_branches);
+#endif
+    } break;
+    case ConditionOp::NEGATE:
+      AgentEmit(code, {0x48, 0xf7, 0x1c, 0x24}); // neg qword [rsp]
+      break;
+    case ConditionOp::NOT:
+      AgentEmit(code, {0x48, 0xf7, 0x14, 0x24}); // not qword [rsp]
+      break;
+    case ConditionOp::LOGICAL_NOT:
+    case ConditionOp::BOOL:
+      AgentEmit(code, {0x58,             // pop rax
+                       0x31, 0xc9,       // xor ecx, ecx
+                       0x48, 0x85, 0xc0, // test rax, rax
+                       0x0f, (BYTE)(op == ConditionOp::BOOL ? 0x95 : 0x94),
+                       0xc1,   // setne/sete cl
+                       0x51}); // push rcx
+      break;
+    case ConditionOp::JUMP_IF_ZERO:
+    case ConditionOp::JUMP_IF_NOT_ZERO: {
+      WORD offset;
+      memcpy(&offset, bytecode + i, sizeof(offset));
+      i += sizeof(offset);
+
+      // Jumps with 0 or 1 on the stack, goes on without it
+      const bool is_zero = op == ConditionOp::JUMP_IF_ZERO;
+      AgentEmit(code, {0x58,                               // pop rax
+                       0x48, 0x85, 0xc0,                   // test rax, rax
+                       (BYTE)(is_zero ? 0x75 : 0x74), 0x07, // jnz/jz over
+                       0x6a, (BYTE)(is_zero ? 0 : 1)});    // push 0/1
+      jumps.emplace_back(AgentEmitBranch(code, {0xe9}), i + offset);
+    } break;
+    default: {
+      AgentEmit(code, {0x59, 0x58}); // pop rcx, pop rax - b, a
+
+      BYTE compare = 0; // setcc opcode
+      switch (op) {
+      case ConditionOp::MULTIPLY:
+        AgentEmit(code, {0x48, 0x0f, 0xaf, 0xc1}); // imul rax, rcx
+        break;
+      case ConditionOp::DIVIDE:
+      case ConditionOp::REMAINDER: {
+        const bool is_divide = op == ConditionOp::DIVIDE;
+        AgentEmit(code, {0x48, 0x85, 0xc9}); // test rcx, rcx
+        error_branches->push_back(AgentEmitBranch(code, {0x0f, 0x84})); // jz
+
+        // INT64_MIN / -1 faults, same result as the debugger gets instead
+        AgentEmit(code, {0x48, 0x83, 0xf9, 0xff, // cmp rcx, -1
+                         0x75, (BYTE)(is_divide ? 5 : 4)});
+        is_divide ? AgentEmit(code, {0x48, 0xf7, 0xd8}) // neg rax
+                  : AgentEmit(code, {0x31, 0xc0});      // xor eax, eax
+        AgentEmit(code, {0xeb, (BYTE)(is_divide ? 5 : 8), // jmp over
+                         0x48, 0x99,                      // cqo
+                         0x48, 0xf7, 0xf9});              // idiv rcx
+        if (!is_divide) {
+          AgentEmit(code, {0x48, 0x89, 0xd0}); // mov rax, rdx
+        }
+      } break;
+      case ConditionOp::ADD:
+        AgentEmit(code, {0x48, 0x01, 0xc8});
+        break;
+      case ConditionOp::SUBTRACT:
+        AgentEmit(code, {0x48, 0x29, 0xc8});
+        break;
+      case ConditionOp::SHIFT_LEFT:
+        AgentEmit(code, {0x48, 0xd3, 0xe0}); // shl rax, cl
+        break;
+      case ConditionOp::SHIFT_RIGHT:
+        AgentEmit(code, {0x48, 0xd3, 0xf8}); // sar rax, cl
+        break;
+      case ConditionOp::AND:
+        AgentEmit(code, {0x48, 0x21, 0xc8});
+        break;
+      case ConditionOp::XOR:
+        AgentEmit(code, {0x48, 0x31, 0xc8});
+        break;
+      case ConditionOp::OR:
+        AgentEmit(code, {0x48, 0x09, 0xc8});
+        break;
+      case ConditionOp::LESS:
+        compare = 0x9c;
+        break;
+      case ConditionOp::LESS_EQUAL:
+        compare = 0x9e;
+        break;
+      case ConditionOp::GREATER:
+        compare = 0x9f;
+        break;
+      case ConditionOp::GREATER_EQUAL:
+        compare = 0x9d;
+        break;
+      case ConditionOp::EQUAL:
+        compare = 0x94;
+        break;
+      case ConditionOp::NOT_EQUAL:
+        compare = 0x95;
+        break;
+      default:
+        return false;
+      }
+
+      if (compare) {
+        AgentEmit(code, {0x31, 0xd2,             // xor edx, edx
+                         0x48, 0x39, 0xc8,       // cmp rax, rcx
+                         0x0f, compare, 0xc2,    // setcc dl
+                         0x48, 0x89, 0xd0});     // mov rax, rdx
+      }
+      AgentEmit(code, {0x50}); // push rax
+    } break;
+    }
+  }
+  offsets[size] = code->size();
+
+  for (const auto &jump : jumps) {
+    AgentPatchBranch(code, jump.first, offsets[jump.second]);
+  }
+
+  return true;
+}
+
+// Registers back as they were at the breakpoint, flags and the stack
+// included
+static void AgentEmitRestore(std::vector<BYTE> *code) {
+  AgentEmit(code, {0x48, 0x89, 0xdc, // mov rsp, rbx
+                   0x5b,             // pop rbx
+                   0x41, 0x5b, 0x41, 0x5a, 0x41, 0x59, 0x41, 0x58, // r11-r8
+                   0x5f, 0x5e, 0x5a, 0x59, 0x58, // rdi, rsi, rdx, rcx, rax
+                   0x9d,                         // popfq
+                   0x48, 0x8d, 0xa4, 0x24});     // lea rsp, [rsp+128]
+  AgentEmitValue(code, 128, 4);
+}
+
+// Hit counter followed by the code, for the site at "base" in the target
+static bool AgentBuildTrampoline(const Condition &condition,
+                                 const AgentSite &site, DWORD64 base,
+                                 DWORD64 hit_count, std::vector<BYTE> *code,
+                                 size_t *trap_offset, size_t *resume_offset) {
+  code->clear();
+  AgentEmitValue(code, hit_count, 8);
+
+  AgentEmit(code, {0x48, 0x8d, 0x64, 0x24, 0x80, // lea rsp, [rsp-128]
+                   0x9c,                         // pushfq
+                   0x50, 0x51, 0x52, 0x56, 0x57, // rax, rcx, rdx, rsi, rdi
+                   0x41, 0x50, 0x41, 0x51, 0x41, 0x52, 0x41, 0x53, // r8-r11
+                   0x53,                                           // rbx
+                   0x48, 0x89, 0xe3}); // mov rbx, rsp
+
+  // inc qword [rip+rel32] of the counter at "base"
+  AgentEmit(code, {0x48, 0xff, 0x05});
+  AgentEmitValue(code, base - (base + code->size() + 4), 4);
+
+  std::vector<size_t> true_branches;
+  if (!AgentCompileCondition(condition, site.address, base, base, code,
+                             &true_branches)) {
+    return false;
+  }
+
+  AgentEmit(code, {0x58, 0x48, 0x85, 0xc0}); // pop rax, test rax, rax
+  true_branches.push_back(AgentEmitBranch(code, {0x0f, 0x85})); // jnz
+
+  // False, runs the moved instructions and goes back
+  AgentEmitRestore(code);
+  *resume_offset = code->size();
+  code->insert(code->end(), site.code, site.code + site.length);
+  AgentEmit(code, {0xe9});
+  const DWORD64 next_address = base + code->size() + 4;
+  AgentEmitValue(code, site.address + site.length - next_address, 4);
+
+  // True, or the condition can't be evaluated here
+  for (size_t position : true_branches) {
+    AgentPatchBranch(code, position, code->size());
+  }
+  AgentEmitRestore(code);
+  *trap_offset = code->size();
+  AgentEmit(code, {0xcc});
+
+  return true;
+}
+
+
+// Trampoline memory within rel32 reach of the address
+static bool AgentAllocate(Agent *agent, Backend *backend, DWORD64 address,
+                          size_t size, DWORD64 *result) {
+  size = (size + 15) & ~(size_t)15;
+  if (size > AGENT_MEMORY_SIZE) {
+    return false;
+  }
+
+  for (auto &memory : agent->memory) {
+    if (memory.used_size + size <= AGENT_MEMORY_SIZE &&
+        AgentIsReachable(backend, memory.address, address)) {
+      *result = memory.address + memory.used_size;
+      memory.used_size += size;
+      return true;
+    }
+  }
+
+  // Free space next to the code is the usual case, anywhere else (0) is
+  // likely out of reach
+  static const int64_t offsets[] = {-0x1000000, -0x10000000, 0x10000000,
+                                    -0x40000000, 0x40000000, 0};
+  const DWORD64 base = address & ~(DWORD64)(AGENT_MEMORY_SIZE - 1);
+  for (int64_t offset : offsets) {
+    const DWORD64 hint = offset ? base + offset : 0;
+    if ((offset < 0 && hint > base) || (offset > 0 && hint < base) ||
+        (offset && hint < AGENT_MEMORY_SIZE)) {
+      continue;
+    }
+
+    DWORD64 memory_address;
+    if (!BackendAllocateMemory(backend, hint, AGENT_MEMORY_SIZE,
+                               &memory_address)) {
+      continue;
+    }
+    if (!AgentIsReachable(backend, memory_address, address)) {
+      agent->memory.push_back({memory_address, 0}); // For code next to it
+      continue;
+    }
+
+    agent->memory.push_back({memory_address, size});
+    *result = memory_address;
+    return true;
+  }
+
+  return false;
+}
+
+// Moves instructions from the breakpoint up to "end" at most into a new
+// trampoline. Sites that can't be moved are kept as failed, so that they
+// aren't tried again. "original_instruction" - under the int3 of the
+// breakpoint.
+static bool AgentAddSite(Agent *agent, MemoryCache *memory_cache,
+                         const Condition &condition, DWORD64 address,
+                         BYTE original_instruction, DWORD64 end,
+                         DWORD64 hit_count) {
+  AgentSite &site = agent->sites[address];
+  site = {};
+  site.address = address;
+  site.is_failed = true;
+
+  SIZE_T size = 0;
+  MemoryCacheRead(memory_cache, address, site.code, sizeof(site.code), &size);
+  if (size == 0 || !memory_cache->backend->is_64bit) {
+    return false;
+  }
+  site.code[0] = original_instruction;
+  size = (SIZE_T)std::min<DWORD64>(size, end - address);
+
+  // Whole instructions, that run the same anywhere
+  while (site.length < AGENT_JUMP_LENGTH) {
+    Instruction instruction;
+    if (!InstructionDecode(site.code + site.length, size - site.length,
+                           address + site.length, true, &instruction) ||
+        instruction.type != InstructionType::OTHER ||
+        instruction.is_relative || instruction.is_rip_relative) {
+      LOG_IMGUI(AgentAddSite, "Code at ", std::hex, address + site.length,
+                " can't be moved, the condition is evaluated on traps")
+      return false;
+    }
+
+    site.length += (BYTE)instruction.length;
+  }
+
+  // Size doesn't depend on where the code goes
+  std::vector<BYTE> code;
+  size_t trap_offset;
+  size_t resume_offset;
+  DWORD64 base;
+  if (!AgentBuildTrampoline(condition, site, address, hit_count, &code,
+                            &trap_offset, &resume_offset) ||
+      !AgentAllocate(agent, memory_cache->backend, address, code.size(),
+                     &base) ||
+      !AgentBuildTrampoline(condition, site, base, hit_count, &code,
+                            &trap_offset, &resume_offset)) {
+    LOG_IMGUI(AgentAddSite, "No trampoline for ", std::hex, address,
+              ", the condition is evaluated on traps")
+    return false;
+  }
+
+  if (!MemoryCacheWrite(memory_cache, base, code.data(), code.size())) {
+    return false;
+  }
+  BackendFlushInstructionCache(memory_cache->backend, base, code.size());
+
+  site.hits_address = base;
+  site.entry_address = base + sizeof(DWORD64);
+  site.trap_address = base + trap_offset;
+  site.resume_address = base + resume_offset;
+  site.is_failed = false;
+
+  return true;
+}
+
+// Jumps to the trampoline instead of the int3 of the breakpoint, counting on
+// from "hit_count"
+static bool AgentInstallSite(MemoryCache *memory_cache, AgentSite *site,
+                             DWORD64 hit_count) {
+  BYTE code[AGENT_MAX_LENGTH];
+  memset(code, 0xcc, sizeof(code)); // Leftovers of the moved instructions
+  code[0] = 0xe9;
+  const DWORD displacement =
+      (DWORD)(site->entry_address - (site->address + AGENT_JUMP_LENGTH));
+  memcpy(code + 1, &displacement, sizeof(displacement));
+
+  if (!MemoryCacheWrite(memory_cache, site->hits_address, &hit_count,
+                        sizeof(hit_count)) ||
+      !MemoryCacheWrite(memory_cache, site->address, code, site->length)) {
+    LOG_IMGUI(AgentInstallSite, "Unable to patch ", std::hex, site->address)
+    return false;
+  }
+  BackendFlushInstructionCache(memory_cache->backend, site->address,
+                               site->length);
+  site->is_installed = true;
+
+  return true;
+}
+
+static inline bool AgentReadHits(MemoryCache *memory_cache,
+                                 const AgentSite &site, DWORD64 *hit_count) {
+  return MemoryCacheRead(memory_cache, site.hits_address, hit_count,
+                         sizeof(*hit_count), NULL);
+}
+
+// Puts the int3 of the breakpoint back, "hit_count" gets the hits counted in
+// the target. The trampoline is kept for the next install.
+static bool AgentRemoveSite(MemoryCache *memory_cache, AgentSite *site,
+                            DWORD64 *hit_count) {
+  if (!site->is_installed) {
+    return true;
+  }
+
+  AgentReadHits(memory_cache, *site, hit_count);
+
+  BYTE code[AGENT_MAX_LENGTH];
+  memcpy(code, site->code, site->length);
+  code[0] = 0xcc;
+  if (!MemoryCacheWrite(memory_cache, site->address, code, site->length)) {
+    LOG_IMGUI(AgentRemoveSite, "Unable to restore ", std::hex, site->address)
+    return false;
+  }
+  BackendFlushInstructionCache(memory_cache->backend, site->address,
+                               site->length);
+  site->is_installed = false;
+
+  return true;
+}
+
+static inline AgentSite *AgentFindSite(Agent *agent, DWORD64 address) {
+  auto it = agent->sites.find(address);
+  return it != agent->sites.end() ? &it->second : NULL;
+}
+
+// Site whose trampoline trapped at the address, NULL for any other int3
+static const AgentSite *AgentFindTrap(const Agent *agent, DWORD64 address) {
+  for (const auto &it : agent->sites) {
+    if (!it.second.is_failed && it.second.trap_address == address) {
+      return &it.second;
+    }
+  }
+
+  return NULL;
+}
\ No newline at end of file
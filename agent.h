@@ -0,0 +1,39 @@
+#define AGENT_JUMP_LENGTH 5 // jmp rel32 written over the breakpoint
+#define AGENT_MAX_LENGTH (AGENT_JUMP_LENGTH + INSTRUCTION_MAX_LENGTH - 1)
+#define AGENT_MEMORY_SIZE 0x10000 // Trampoline memory, allocated at once
+#define AGENT_MAX_DISTANCE 0x7fff0000ll // rel32 reach, less the memory size
+
+// x86-64 Linux syscall numbers, used by the trampoline code to read memory.
+// Conditions that read memory aren't compiled into Windows targets.
+#define AGENT_SYS_GETPID 39
+#define AGENT_SYS_PROCESS_VM_READV 310
+
+// Conditional breakpoint evaluated in the target. Instructions under the
+// breakpoint are moved into a trampoline and a jump to it replaces them. The
+// trampoline counts the hit, runs the condition compiled to machine code and
+// traps only when it is true.
+struct AgentSite {
+  DWORD64 address;
+  DWORD64 entry_address;  // Of the trampoline, the jump goes there
+  DWORD64 trap_address;   // int3 of the trampoline, the condition is true
+  DWORD64 resume_address; // Moved instructions, then a jump back
+  DWORD64 hits_address;   // Hit counter, $hits of the condition
+  BYTE length;            // Of the moved instructions
+  BYTE code[AGENT_MAX_LENGTH]; // They, as the compiler emitted them
+  bool is_installed; // Jump is in place
+  bool is_failed;    // Can't be moved, int3 does the job
+};
+
+struct AgentMemory {
+  DWORD64 address;
+  DWORD64 used_size;
+};
+
+// Breakpoint conditions compiled into the target, x86-64 only, the ones that
+// can't be are evaluated by the debugger. Trampolines are never freed, a
+// thread may still be inside a removed one.
+struct Agent {
+  bool is_enabled;
+  std::vector<AgentMemory> memory;
+  std::unordered_map<DWORD64, AgentSite> sites; // By breakpoint address
+};
\ No newline at end of file
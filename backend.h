@@ -0,0 +1,143 @@
+enum class BackendEventType {
+  NONE, // Timed out, nothing to continue
+  CREATE_PROCESS,
+  EXIT_PROCESS,
+  CREATE_THREAD,
+  EXIT_THREAD,
+  LOAD_MODULE,
+  UNLOAD_MODULE,
+  BREAKPOINT,
+  SINGLE_STEP,
+  HARDWARE_BREAKPOINT, // Debug register slot triggered
+  EXCEPTION,
+  OUTPUT_STRING,
+  OTHER
+};
+
+struct BackendEvent {
+  BackendEventType type;
+  DWORD process_id;
+  DWORD thread_id;
+
+  // BREAKPOINT - address of the trap instruction, SINGLE_STEP, EXCEPTION,
+  // HARDWARE_BREAKPOINT - faulting instruction, OUTPUT_STRING - address of
+  // the string
+  DWORD64 address;
+
+  DWORD64 base_address; // CREATE_PROCESS, LOAD_MODULE, UNLOAD_MODULE
+  HANDLE file;          // CREATE_PROCESS, LOAD_MODULE, owned by the receiver
+  std::string path;     // CREATE_PROCESS, LOAD_MODULE, when known
+
+  DWORD size;      // OUTPUT_STRING, in bytes
+  bool is_unicode; // OUTPUT_STRING
+
+  DWORD code; // EXCEPTION - exception code or signal, EXIT_PROCESS - exit code
+  bool is_first_chance; // EXCEPTION
+
+  DWORD hardware_slots; // HARDWARE_BREAKPOINT - bit per triggered slot
+};
+
+#define BACKEND_DEBUG_REGISTER_COUNT 4 // DR0-DR3
+
+// DR7 bits of a debug register slot
+#define BACKEND_DEBUG_ENABLE(slot) (1ull << ((slot) * 2))
+#define BACKEND_DEBUG_ACCESS(slot, access) ((DWORD64)(access) << (16 + (slot) * 4))
+#define BACKEND_DEBUG_LENGTH(slot, length) ((DWORD64)(length) << (18 + (slot) * 4))
+
+#define BACKEND_TRAP_FLAG 0x100
+#define BACKEND_RESUME_FLAG 0x10000 // Execute slots don't trigger once
+
+#ifndef _WIN32
+#define INFINITE 0xFFFFFFFF // Timeout of BackendWaitForEvent, as on Windows
+#endif
+
+struct BackendMemoryRange {
+  DWORD64 address;
+  void *buffer;
+  SIZE_T size;
+  SIZE_T transferred_size;
+};
+
+#ifndef _WIN32
+// ptrace stops are per thread, the others run on unless they are stopped too
+struct BackendThread {
+  bool is_stopped;        // Registers can be read and written
+  bool is_stop_requested; // SIGSTOP from BackendStopThreads is on it's way
+  int pending_status;     // Stop that came instead, reported next, 0 - none
+  bool is_single_stepping; // Of the last continue
+  bool is_suspended; // By BackendSuspendThread, nothing else resumes it
+};
+#endif
+
+// Platform debugging API, everything the debugger thread does to the target
+// goes through it. All functions are called on the debugger thread only.
+struct Backend {
+  DWORD process_id;
+  DWORD thread_id; // Of the last event, stopped while it's handled
+  bool is_single_step; // Requested for the next continue
+  bool is_resume_flag;  // Same, skips an execute slot on the current address
+  bool is_holding_threads; // Same, the other threads don't run
+  bool is_suspending_thread; // Same, the event thread doesn't run
+  bool is_64bit;       // Instruction set of the target
+  DWORD64 syscall_count; // Memory and register calls, for statistics
+  DWORD64 flush_count;   // Instruction cache flushes, same
+
+  // Attached target is paused until it's threads and modules are reported
+  bool is_attaching;
+  std::chrono::steady_clock::time_point attach_time; // BackendAttach called
+
+  // Debug registers of every thread, as last set
+  DWORD64 debug_addresses[BACKEND_DEBUG_REGISTER_COUNT];
+  DWORD64 debug_control; // DR7, 0 - no slot is in use
+
+  // Called on the backend's event thread once an event may be waiting, so
+  // that the debugger thread can block on something else meanwhile. Set
+  // before the launch or attach, BackendWaitForEvent is called with a 0
+  // timeout then.
+  std::function<void()> OnEvent;
+
+#ifdef _WIN32
+  HANDLE process;
+  std::unordered_map<DWORD, HANDLE> threads; // Owned by the system
+  std::vector<HANDLE> held_threads; // Suspended for BackendHoldThreads
+  std::vector<DWORD> suspended_threads; // By BackendSuspendThread
+  bool is_loader_breakpoint_seen;
+
+  // Debug events can only be waited for and continued on the thread that
+  // started debugging. It waits while the target runs, other debug calls
+  // are passed to it, see BackendCallOnEventThread.
+  std::thread event_thread;
+  std::mutex event_mutex;
+  std::condition_variable event_condition;
+  std::function<void()> event_call; // Runs on the event thread next
+  bool is_call_done;
+  bool is_wait_requested; // For the next event, once the last one continued
+  bool is_event_waiting;  // In WaitForDebugEventEx
+  bool is_event_ready;    // "debug_event" waits to be taken
+  bool is_event_thread_stopping;
+  DEBUG_EVENT debug_event;
+  DWORD event_error; // Of WaitForDebugEventEx, if it failed
+#else
+  std::unordered_map<DWORD, BackendThread> threads;
+  DWORD running_thread_id; // Only one let run by BackendHoldThreads, 0 - all
+  int memory_file; // /proc/<pid>/mem, writes into read-only pages
+  DWORD64 syscall_address; // In the vDSO, runs syscalls for the target
+  bool is_create_process_reported;
+  // Reported before the next stop: after CREATE_PROCESS the threads and
+  // modules found, later modules that BackendOnLoadHook found
+  std::deque<BackendEvent> queued_events;
+  std::map<DWORD64, std::string> modules; // Reported ones, by base
+  DWORD64 load_hook_address; // int3 on _dl_debug_state, 0 - none
+  BYTE load_hook_byte; // Under the int3
+  // Stops of threads that weren't known yet, collected while others were
+  // waited for, see BackendWaitForAny
+  std::vector<std::pair<pid_t, int>> early_statuses;
+  std::string path;
+
+  // signalfd of SIGCHLD, it comes with every stop. Read by "event_thread"
+  // when there is OnEvent, by BackendWaitForEvent otherwise.
+  int signal_file;
+  std::thread event_thread;
+  std::atomic<bool> is_event_thread_stopping;
+#endif
+};
\ No newline at end of file
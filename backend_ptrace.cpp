@@ -0,0 +1,1491 @@
+#define BACKEND_MAX_IOV 1024 // IOV_MAX on Linux
+#define BACKEND_DEBUG_REGISTER(index)                                          \
+  (offsetof(struct user, u_debugreg) + (index) * sizeof(long))
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000 // Linux 4.17, older ones take a hint
+#endif
+
+// Absolute path of the executable, as maps has it. Empty on error.
+static std::string BackendGetExePath(pid_t pid) {
+  char exe_link[64];
+  snprintf(exe_link, sizeof(exe_link), "/proc/%d/exe", (int)pid);
+
+  char exe_path[PATH_MAX];
+  const ssize_t length = readlink(exe_link, exe_path, sizeof(exe_path) - 1);
+  return std::string(exe_path, std::max<ssize_t>(length, 0));
+}
+
+// Start of the first mapping of the executable, that is its load base
+static DWORD64 BackendGetImageBase(pid_t pid) {
+  const std::string exe_path = BackendGetExePath(pid);
+  if (exe_path.empty()) {
+    return 0;
+  }
+
+  char maps_path[64];
+  snprintf(maps_path, sizeof(maps_path), "/proc/%d/maps", (int)pid);
+
+  std::ifstream maps(maps_path);
+  std::string line;
+  while (std::getline(maps, line)) {
+    // start-end perms offset dev inode path
+    unsigned long long start, end, offset;
+    int path_offset = 0;
+    if (sscanf(line.c_str(), "%llx-%llx %*s %llx %*s %*s %n", &start, &end,
+               &offset, &path_offset) < 3 ||
+        path_offset == 0) {
+      continue;
+    }
+
+    if (offset == 0 && line.compare(path_offset, std::string::npos,
+                                    exe_path) == 0) {
+      return start;
+    }
+  }
+
+  return 0;
+}
+
+// Stops of traced threads come with SIGCHLD to the tracer. It's blocked, so
+// that it waits for the signal file instead of being delivered, in the
+// calling thread and the ones it starts later. "previous_mask" - to restore
+// in the child of a launch, unless NULL.
+static void BackendBlockChildSignal(sigset_t *previous_mask) {
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  pthread_sigmask(SIG_BLOCK, &mask, previous_mask);
+}
+
+// Readable while SIGCHLD is pending
+static int BackendOpenSignalFile() {
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  const int result = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (result < 0) {
+    LOG_IMGUI(BackendOpenSignalFile, "signalfd failed, error = ", errno)
+  }
+
+  return result;
+}
+
+// Signals come as one, however many threads stopped. Stops that come after
+// this raise it again.
+static void BackendReadSignals(Backend *backend) {
+  signalfd_siginfo info;
+  while (read(backend->signal_file, &info, sizeof(info)) == sizeof(info)) {
+  }
+}
+
+// Waits for SIGCHLD, not longer than the timeout, -1 - for as long as it
+// takes. Signals that come meanwhile wake the thread too.
+static void BackendWaitForSignal(Backend *backend, int timeout) {
+  pollfd signal_poll = {backend->signal_file, POLLIN, 0};
+  poll(&signal_poll, 1, timeout);
+  BackendReadSignals(backend);
+}
+
+// Calls OnEvent for every SIGCHLD, until BackendStopEventThread
+static void BackendRunEventThread(Backend *backend) {
+  while (!backend->is_event_thread_stopping) {
+    BackendWaitForSignal(backend, -1);
+    if (!backend->is_event_thread_stopping) {
+      backend->OnEvent();
+    }
+  }
+}
+
+static void BackendStartEventThread(Backend *backend) {
+  backend->is_event_thread_stopping = false;
+  if (backend->OnEvent && backend->signal_file >= 0) {
+    backend->event_thread = std::thread(BackendRunEventThread, backend);
+  }
+}
+
+// SIGCHLD sent to the thread itself ends it's wait
+static void BackendStopEventThread(Backend *backend) {
+  if (backend->event_thread.joinable()) {
+    backend->is_event_thread_stopping = true;
+    pthread_kill(backend->event_thread.native_handle(), SIGCHLD);
+    backend->event_thread.join();
+  }
+}
+
+// Mapped files that aren't objects, like ld.so.cache, are left out
+static bool BackendIsElfFile(const std::string &path) {
+  char magic[SELFMAG] = {};
+  std::ifstream file(path, std::ios::binary);
+  return file.read(magic, SELFMAG) && memcmp(magic, ELFMAG, SELFMAG) == 0;
+}
+
+// Shared objects mapped into the process, the executable is reported by
+// CREATE_PROCESS. Load base is the start of the first mapping of the file.
+// Ones that came or went since the last call are queued as events of the
+// thread.
+static void BackendQueueModules(Backend *backend, pid_t thread_id) {
+  char maps_path[64];
+  snprintf(maps_path, sizeof(maps_path), "/proc/%d/maps",
+           (int)backend->process_id);
+  const std::string exe_path =
+      BackendGetExePath((pid_t)backend->process_id);
+
+  std::map<DWORD64, std::string> modules;
+  std::set<std::string> paths;
+  std::ifstream maps(maps_path);
+  std::string line;
+  while (std::getline(maps, line)) {
+    unsigned long long start, end, offset;
+    int path_offset = 0;
+    if (sscanf(line.c_str(), "%llx-%llx %*s %llx %*s %*s %n", &start, &end,
+               &offset, &path_offset) < 3 ||
+        path_offset == 0 || offset != 0 || line[path_offset] != '/') {
+      continue;
+    }
+
+    std::string path = line.substr(path_offset);
+    if (path == exe_path || !paths.insert(path).second) {
+      continue;
+    }
+
+    // Files are checked once, when they are new
+    auto reported = backend->modules.find(start);
+    if ((reported != backend->modules.end() && reported->second == path) ||
+        BackendIsElfFile(path)) {
+      modules[start] = std::move(path);
+    }
+  }
+
+  BackendEvent event = {};
+  event.process_id = backend->process_id;
+  event.thread_id = thread_id;
+
+  // Unloads first, another object can be mapped at the same base
+  event.type = BackendEventType::UNLOAD_MODULE;
+  for (const auto &it : backend->modules) {
+    auto found = modules.find(it.first);
+    if (found == modules.end() || found->second != it.second) {
+      event.base_address = it.first;
+      backend->queued_events.push_back(event);
+    }
+  }
+
+  event.type = BackendEventType::LOAD_MODULE;
+  for (const auto &it : modules) {
+    auto found = backend->modules.find(it.first);
+    if (found == backend->modules.end() || found->second != it.second) {
+      event.base_address = it.first;
+      event.path = it.second;
+      backend->queued_events.push_back(event);
+    }
+  }
+
+  backend->modules.swap(modules);
+}
+
+// Offset of an exported function from the load base of the object, 0 if it
+// isn't there
+static DWORD64 BackendFindDynamicSymbol(const std::string &path,
+                                        const char *name) {
+  const int file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (file < 0) {
+    return 0;
+  }
+
+  struct stat status;
+  void *data = MAP_FAILED;
+  if (fstat(file, &status) == 0 &&
+      (size_t)status.st_size >= sizeof(Elf64_Ehdr)) {
+    data = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file,
+                0);
+  }
+  close(file);
+  if (data == MAP_FAILED) {
+    return 0;
+  }
+
+  const BYTE *begin = (const BYTE *)data;
+  const DWORD64 size = (DWORD64)status.st_size;
+  auto is_inside = [size](DWORD64 offset, DWORD64 length) {
+    return offset <= size && length <= size - offset;
+  };
+
+  DWORD64 result = 0;
+  const Elf64_Ehdr *header = (const Elf64_Ehdr *)begin;
+  if (memcmp(header->e_ident, ELFMAG, SELFMAG) == 0 &&
+      header->e_ident[EI_CLASS] == ELFCLASS64 &&
+      is_inside(header->e_phoff,
+                (DWORD64)header->e_phnum * sizeof(Elf64_Phdr)) &&
+      is_inside(header->e_shoff,
+                (DWORD64)header->e_shnum * sizeof(Elf64_Shdr))) {
+    // Load base is where the first segment is mapped
+    const Elf64_Phdr *segments = (const Elf64_Phdr *)(begin + header->e_phoff);
+    DWORD64 first_address = ~0ull;
+    for (size_t i = 0; i < header->e_phnum; ++i) {
+      if (segments[i].p_type == PT_LOAD) {
+        first_address =
+            std::min<DWORD64>(first_address, segments[i].p_vaddr & ~0xFFFull);
+      }
+    }
+
+    const Elf64_Shdr *sections = (const Elf64_Shdr *)(begin + header->e_shoff);
+    for (size_t i = 0; i < header->e_shnum && !result; ++i) {
+      const Elf64_Shdr &symbols = sections[i];
+      if (symbols.sh_type != SHT_DYNSYM || symbols.sh_link >= header->e_shnum ||
+          !is_inside(symbols.sh_offset, symbols.sh_size)) {
+        continue;
+      }
+
+      const Elf64_Shdr &strings = sections[symbols.sh_link];
+      if (!is_inside(strings.sh_offset, strings.sh_size)) {
+        continue;
+      }
+
+      const Elf64_Sym *symbol = (const Elf64_Sym *)(begin + symbols.sh_offset);
+      const Elf64_Sym *symbol_end = symbol + symbols.sh_size / sizeof(*symbol);
+      const char *names = (const char *)(begin + strings.sh_offset);
+      for (; symbol < symbol_end; ++symbol) {
+        const DWORD64 length = strings.sh_size - symbol->st_name;
+        if (symbol->st_value && symbol->st_name < strings.sh_size &&
+            strnlen(names + symbol->st_name, length) < length &&
+            strcmp(names + symbol->st_name, name) == 0) {
+          result = symbol->st_value - first_address;
+          break;
+        }
+      }
+    }
+  }
+
+  munmap(data, (size_t)size);
+  return result;
+}
+
+// The dynamic linker calls _dl_debug_state before and after it maps or
+// unmaps objects, for debuggers to set a breakpoint on (r_debug protocol).
+// It's just a ret, the int3 on it is handled by BackendOnLoadHook. Static
+// executables have no dynamic linker, they load nothing.
+static void BackendHookLoads(Backend *backend) {
+  char auxv_path[64];
+  snprintf(auxv_path, sizeof(auxv_path), "/proc/%d/auxv",
+           (int)backend->process_id);
+
+  // AT_BASE is the load base of the dynamic linker
+  DWORD64 interpreter_base = 0;
+  std::ifstream auxv(auxv_path, std::ios::binary);
+  DWORD64 entry[2];
+  while (auxv.read((char *)entry, sizeof(entry)) && entry[0] != AT_NULL) {
+    if (entry[0] == AT_BASE) {
+      interpreter_base = entry[1];
+    }
+  }
+
+  auto it = backend->modules.find(interpreter_base);
+  if (!interpreter_base || it == backend->modules.end()) {
+    return;
+  }
+
+  const DWORD64 offset = BackendFindDynamicSymbol(it->second,
+                                                  "_dl_debug_state");
+  if (!offset) {
+    LOG_IMGUI(BackendHookLoads, "No _dl_debug_state in ", it->second,
+              ", shared objects loaded later aren't reported")
+    return;
+  }
+
+  // Text isn't writable, ptrace writes it anyway
+  const DWORD64 address = interpreter_base + offset;
+  errno = 0;
+  const long word = ptrace(PTRACE_PEEKDATA, (pid_t)backend->process_id,
+                           (void *)address, NULL);
+  if (errno ||
+      ptrace(PTRACE_POKEDATA, (pid_t)backend->process_id, (void *)address,
+             (void *)((word & ~0xFFl) | 0xCC)) < 0) {
+    LOG_IMGUI(BackendHookLoads, "Unable to hook _dl_debug_state, error = ",
+              errno)
+    return;
+  }
+
+  backend->load_hook_address = address;
+  backend->load_hook_byte = (BYTE)word;
+}
+
+// Takes the int3 of BackendHookLoads out, with every thread stopped
+static void BackendUnhookLoads(Backend *backend) {
+  if (!backend->load_hook_address) {
+    return;
+  }
+
+  const pid_t pid = (pid_t)backend->process_id;
+  void *address = (void *)backend->load_hook_address;
+  errno = 0;
+  const long word = ptrace(PTRACE_PEEKDATA, pid, address, NULL);
+  if (!errno) {
+    ptrace(PTRACE_POKEDATA, pid, address,
+           (void *)((word & ~0xFFl) | backend->load_hook_byte));
+  }
+  backend->load_hook_address = 0;
+}
+
+static void BackendInitialize(Backend *backend, pid_t pid,
+                              const std::string &path) {
+  char memory_path[64];
+  snprintf(memory_path, sizeof(memory_path), "/proc/%d/mem", (int)pid);
+
+  backend->process_id = pid;
+  backend->thread_id = pid;
+  backend->is_single_step = false;
+  backend->is_resume_flag = false;
+  backend->is_holding_threads = false;
+  backend->is_suspending_thread = false;
+  backend->is_64bit = true; // 32 bit processes aren't supported
+  backend->syscall_count = 0;
+  backend->flush_count = 0;
+  backend->is_attaching = false;
+  backend->debug_control = 0;
+  backend->running_thread_id = 0;
+  backend->memory_file = open(memory_path, O_RDWR | O_CLOEXEC);
+  backend->syscall_address = 0;
+  backend->is_create_process_reported = false;
+  backend->path = path;
+  backend->signal_file = BackendOpenSignalFile();
+  backend->modules.clear();
+  backend->load_hook_address = 0;
+}
+
+static bool BackendLaunch(Backend *backend, const std::wstring &path) {
+  std::string filename(wcstombs(NULL, path.c_str(), 0), '\0');
+  wcstombs(&filename[0], path.c_str(), filename.size() + 1);
+
+  sigset_t previous_mask;
+  BackendBlockChildSignal(&previous_mask);
+
+  const pid_t pid = fork();
+  if (pid < 0) {
+    LOG_IMGUI(BackendLaunch, "fork failed, error = ", errno)
+    return false;
+  }
+
+  if (pid == 0) {
+    sigprocmask(SIG_SETMASK, &previous_mask, NULL);
+    ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+    execl(filename.c_str(), filename.c_str(), (char *)NULL);
+    _exit(127);
+  }
+
+  // Child stops with SIGTRAP right after exec
+  int status;
+  if (waitpid(pid, &status, 0) != pid || !WIFSTOPPED(status)) {
+    LOG_IMGUI(BackendLaunch, "Unable to start ", filename)
+    return false;
+  }
+
+  // New threads are traced from their start, each one stops on it's own
+  ptrace(PTRACE_SETOPTIONS, pid, NULL,
+         (void *)(long)(PTRACE_O_EXITKILL | PTRACE_O_TRACECLONE));
+
+  BackendInitialize(backend, pid, filename);
+  backend->threads[pid].is_stopped = true;
+  BackendQueueModules(backend, pid);
+  BackendHookLoads(backend);
+  BackendStartEventThread(backend);
+
+  return true;
+}
+
+// Next stop of a traced thread, whichever comes first. Ones of threads that
+// aren't in "thread_ids" are kept for BackendWaitForThread, so that a set of
+// threads stopping in parallel is collected in the order they stop. Returns
+// the thread, 0 on error.
+static pid_t BackendWaitForAny(Backend *backend,
+                               const std::set<pid_t> &thread_ids,
+                               int *status) {
+  while (true) {
+    ++backend->syscall_count;
+    const pid_t thread_id = waitpid(-1, status, __WALL);
+    if (thread_id < 0) {
+      LOG_IMGUI(BackendWaitForAny, "waitpid failed, error = ", errno)
+      return 0;
+    }
+
+    if (thread_ids.count(thread_id)) {
+      return thread_id;
+    }
+    backend->early_statuses.emplace_back(thread_id, *status);
+  }
+}
+
+// Next stop of the thread, it may have been collected already
+static bool BackendWaitForThread(Backend *backend, pid_t thread_id,
+                                 int *status) {
+  auto &early_statuses = backend->early_statuses;
+
+  for (auto it = early_statuses.begin(); it != early_statuses.end(); ++it) {
+    if (it->first == thread_id) {
+      *status = it->second;
+      early_statuses.erase(it);
+      return true;
+    }
+  }
+
+  return waitpid(thread_id, status, __WALL) == thread_id;
+}
+
+// Stops every thread of a running process. All listed threads are attached
+// before any of them is waited for, so that they stop in parallel, threads
+// started meanwhile are found on the next pass over the list. Reported like
+// a launch, followed by the threads and modules that were there, the process
+// doesn't run until they all are.
+static bool BackendAttach(Backend *backend, DWORD process_id) {
+  const pid_t pid = (pid_t)process_id;
+  const auto attach_time = std::chrono::steady_clock::now();
+
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/task", (int)pid);
+
+  BackendBlockChildSignal(NULL);
+
+  std::set<pid_t> failed_threads; // Exited since they were listed, mostly
+  std::vector<pid_t> attached_threads;
+  do {
+    attached_threads.clear();
+
+    DIR *task = opendir(path);
+    if (!task) {
+      LOG_IMGUI(BackendAttach, "Unable to list threads of ", pid,
+                ", error = ", errno)
+      break;
+    }
+    while (dirent *entry = readdir(task)) {
+      const pid_t thread_id = (pid_t)atoi(entry->d_name);
+      if (thread_id <= 0 ||
+          backend->threads.find(thread_id) != backend->threads.end() ||
+          failed_threads.count(thread_id)) {
+        continue;
+      }
+
+      if (ptrace(PTRACE_ATTACH, thread_id, NULL, NULL) < 0) {
+        if (thread_id == pid) {
+          LOG_IMGUI(BackendAttach, "Unable to attach to ", pid,
+                    ", error = ", errno)
+        }
+        failed_threads.insert(thread_id);
+        continue;
+      }
+      attached_threads.push_back(thread_id);
+    }
+    closedir(task);
+
+    std::set<pid_t> stopping_threads(attached_threads.begin(),
+                                     attached_threads.end());
+    while (!stopping_threads.empty()) {
+      int status;
+      const pid_t thread_id =
+          BackendWaitForAny(backend, stopping_threads, &status);
+      if (!thread_id) {
+        failed_threads.insert(stopping_threads.begin(),
+                              stopping_threads.end());
+        break;
+      }
+      stopping_threads.erase(thread_id);
+
+      if (!WIFSTOPPED(status)) {
+        failed_threads.insert(thread_id);
+        continue;
+      }
+
+      BackendThread &thread = backend->threads[thread_id];
+      thread.is_stopped = true;
+      if (WSTOPSIG(status) != SIGSTOP) {
+        // SIGSTOP of the attach comes after it
+        thread.pending_status = status;
+        thread.is_stop_requested = true;
+      }
+
+      // The process outlives the debugger, so no PTRACE_O_EXITKILL
+      ptrace(PTRACE_SETOPTIONS, thread_id, NULL,
+             (void *)(long)PTRACE_O_TRACECLONE);
+
+      if (thread_id != pid) {
+        BackendEvent event = {};
+        event.type = BackendEventType::CREATE_THREAD;
+        event.process_id = process_id;
+        event.thread_id = thread_id;
+        backend->queued_events.push_back(std::move(event));
+      }
+    }
+  } while (!attached_threads.empty());
+
+  if (backend->threads.find(pid) == backend->threads.end()) {
+    for (const auto &it : backend->threads) {
+      ptrace(PTRACE_DETACH, (pid_t)it.first, NULL, NULL);
+    }
+    backend->threads.clear();
+    backend->queued_events.clear();
+    return false;
+  }
+
+  BackendInitialize(backend, pid, BackendGetExePath(pid));
+  backend->is_attaching = true;
+  backend->attach_time = attach_time;
+  BackendQueueModules(backend, pid);
+  BackendHookLoads(backend);
+  BackendStartEventThread(backend);
+
+  LOG_IMGUI(BackendAttach, "Stopped ", backend->threads.size(),
+            " threads of ", pid, " in ",
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - attach_time)
+                .count(),
+            " us")
+
+  return true;
+}
+
+// Slots that triggered the last debug trap, DR6 is cleared for the next one
+static DWORD BackendReadDebugStatus(Backend *backend, pid_t thread_id) {
+  backend->syscall_count += 2;
+
+  errno = 0;
+  const long status = ptrace(PTRACE_PEEKUSER, thread_id,
+                             (void *)BACKEND_DEBUG_REGISTER(6), NULL);
+  if (errno) {
+    LOG_IMGUI(BackendReadDebugStatus, "PTRACE_PEEKUSER failed, error = ",
+              errno)
+    return 0;
+  }
+  ptrace(PTRACE_POKEUSER, thread_id, (void *)BACKEND_DEBUG_REGISTER(6), NULL);
+
+  return (DWORD)status & 0xf;
+}
+
+// Debug registers aren't inherited by new threads, so every one gets them
+// from here. The thread has to be stopped.
+static bool BackendWriteDebugRegisters(Backend *backend, pid_t thread_id) {
+  const DWORD64 *addresses = backend->debug_addresses;
+
+  // Kernel checks every DR7 write against the addresses, so slots are turned
+  // off before their addresses change
+  backend->syscall_count += BACKEND_DEBUG_REGISTER_COUNT + 2;
+  bool result =
+      ptrace(PTRACE_POKEUSER, thread_id, (void *)BACKEND_DEBUG_REGISTER(7),
+             NULL) == 0;
+  for (int i = 0; i < BACKEND_DEBUG_REGISTER_COUNT; ++i) {
+    if (ptrace(PTRACE_POKEUSER, thread_id, (void *)BACKEND_DEBUG_REGISTER(i),
+               (void *)addresses[i]) < 0) {
+      result = false;
+    }
+  }
+  if (ptrace(PTRACE_POKEUSER, thread_id, (void *)BACKEND_DEBUG_REGISTER(7),
+             (void *)backend->debug_control) < 0) {
+    result = false;
+  }
+
+  if (!result) {
+    LOG_IMGUI(BackendWriteDebugRegisters, "PTRACE_POKEUSER failed, error = ",
+              errno)
+  }
+
+  return result;
+}
+
+// New thread, stopped by it's first SIGSTOP
+static void BackendAddThread(Backend *backend, pid_t thread_id) {
+  BackendThread &thread = backend->threads[thread_id];
+  thread.is_stopped = true;
+
+  if (backend->debug_control) {
+    BackendWriteDebugRegisters(backend, thread_id);
+  }
+}
+
+// Thread stopped on the int3 of BackendHookLoads. The ret under it is run
+// here, modules that came or went are reported as events of the thread. A
+// single step is over after the ret. Without anything to report the thread
+// runs on, false is returned then.
+static bool BackendOnLoadHook(Backend *backend, pid_t thread_id,
+                              user_regs_struct *regs, bool is_single_stepping,
+                              BackendEvent *event) {
+  regs->rip = (DWORD64)ptrace(PTRACE_PEEKDATA, thread_id, (void *)regs->rsp,
+                              NULL);
+  regs->rsp += 8;
+  ptrace(PTRACE_SETREGS, thread_id, NULL, regs);
+  backend->syscall_count += 2;
+
+  BackendQueueModules(backend, thread_id);
+  if (is_single_stepping) {
+    BackendEvent step = {};
+    step.type = BackendEventType::SINGLE_STEP;
+    step.process_id = backend->process_id;
+    step.thread_id = thread_id;
+    step.address = regs->rip;
+    backend->queued_events.push_back(std::move(step));
+  }
+
+  if (backend->queued_events.empty()) {
+    backend->threads[thread_id].is_stopped = false;
+    ++backend->syscall_count;
+    ptrace(PTRACE_CONT, thread_id, NULL, NULL);
+    return false;
+  }
+
+  *event = std::move(backend->queued_events.front());
+  backend->queued_events.pop_front();
+  return true;
+}
+
+// Event of a wait status. False, if the stop was ours and the thread runs on.
+static bool BackendDecodeStatus(Backend *backend, pid_t thread_id, int status,
+                                BackendEvent *event) {
+  event->process_id = backend->process_id;
+  event->thread_id = thread_id;
+
+  if (WIFEXITED(status) || WIFSIGNALED(status)) {
+    backend->threads.erase(thread_id);
+    event->type = thread_id == (pid_t)backend->process_id
+                      ? BackendEventType::EXIT_PROCESS
+                      : BackendEventType::EXIT_THREAD;
+    event->code = WIFEXITED(status) ? WEXITSTATUS(status) : WTERMSIG(status);
+    return true;
+  }
+
+  if (!WIFSTOPPED(status)) {
+    event->type = BackendEventType::OTHER;
+    return true;
+  }
+
+  const int signal = WSTOPSIG(status);
+  if (signal == SIGSTOP &&
+      backend->threads.find(thread_id) == backend->threads.end()) {
+    // New thread, at times it stops before the clone event comes
+    BackendAddThread(backend, thread_id);
+    backend->thread_id = thread_id;
+    event->type = BackendEventType::CREATE_THREAD;
+    return true;
+  }
+
+  BackendThread &thread = backend->threads[thread_id];
+  thread.is_stopped = true;
+  backend->thread_id = thread_id;
+
+  if (signal == SIGSTOP && thread.is_stop_requested) {
+    // Came after the stop that was reported instead, a single step has not
+    // executed anything yet
+    thread.is_stop_requested = false;
+    thread.is_stopped = false;
+    ++backend->syscall_count;
+    ptrace(thread.is_single_stepping ? PTRACE_SINGLESTEP : PTRACE_CONT,
+           thread_id, NULL, NULL);
+    return false;
+  }
+  const bool is_single_stepping = thread.is_single_stepping;
+  thread.is_single_stepping = false;
+
+  user_regs_struct regs;
+  ++backend->syscall_count;
+  ptrace(PTRACE_GETREGS, thread_id, NULL, &regs);
+
+  if (signal != SIGTRAP) {
+    event->type = BackendEventType::EXCEPTION;
+    event->address = regs.rip;
+    event->code = signal;
+    event->is_first_chance = true;
+    return true;
+  }
+
+  if ((status >> 16) == PTRACE_EVENT_CLONE) {
+    unsigned long new_thread_id = 0;
+    ptrace(PTRACE_GETEVENTMSG, thread_id, NULL, &new_thread_id);
+    backend->syscall_count += 2;
+
+    // Reported as created once it stops, the clone is left stopped along
+    // with it and both run on from the continue
+    int new_status;
+    if (backend->threads.find((pid_t)new_thread_id) ==
+            backend->threads.end() &&
+        BackendWaitForThread(backend, (pid_t)new_thread_id, &new_status) &&
+        WIFSTOPPED(new_status)) {
+      BackendAddThread(backend, (pid_t)new_thread_id);
+      if (WSTOPSIG(new_status) != SIGSTOP) {
+        backend->threads[(pid_t)new_thread_id].pending_status = new_status;
+      }
+
+      event->type = BackendEventType::CREATE_THREAD;
+      event->thread_id = (DWORD)new_thread_id;
+      return true;
+    }
+
+    event->type = BackendEventType::OTHER;
+    return true;
+  }
+
+  // Other PTRACE_EVENT_* stops
+  if (status >> 16) {
+    event->type = BackendEventType::OTHER;
+    return true;
+  }
+
+  siginfo_t siginfo = {};
+  ptrace(PTRACE_GETSIGINFO, thread_id, NULL, &siginfo);
+
+  switch (siginfo.si_code) {
+  case SI_KERNEL:
+  case TRAP_BRKPT:
+    if (backend->load_hook_address &&
+        regs.rip - 1 == backend->load_hook_address) {
+      return BackendOnLoadHook(backend, thread_id, &regs, is_single_stepping,
+                               event);
+    }
+
+    // Instruction pointer is already past int3, report the int3 itself
+    event->type = BackendEventType::BREAKPOINT;
+    event->address = regs.rip - 1;
+    break;
+  case TRAP_TRACE:
+  case TRAP_HWBKPT:
+    event->type = BackendEventType::SINGLE_STEP;
+    event->address = regs.rip;
+
+    if (backend->debug_control) {
+      event->hardware_slots = BackendReadDebugStatus(backend, thread_id);
+      if (event->hardware_slots) {
+        event->type = BackendEventType::HARDWARE_BREAKPOINT;
+      }
+    }
+    break;
+  default:
+    event->type = BackendEventType::EXCEPTION;
+    event->address = regs.rip;
+    event->code = signal;
+    event->is_first_chance = true;
+    break;
+  }
+
+  return true;
+}
+
+// Returns false if the target can't be debugged anymore. On timeout returns
+// true with BackendEventType::NONE, INFINITE waits until there is an event.
+static bool BackendWaitForEvent(Backend *backend, BackendEvent *event,
+                                DWORD timeout) {
+  *event = {};
+
+  // The process is already stopped after exec or attach, report it like
+  // Windows does
+  if (!backend->is_create_process_reported) {
+    backend->is_create_process_reported = true;
+
+    event->type = BackendEventType::CREATE_PROCESS;
+    event->process_id = backend->process_id;
+    event->thread_id = backend->thread_id;
+    event->base_address = BackendGetImageBase(backend->process_id);
+    event->path = backend->path;
+
+    return true;
+  }
+
+  if (!backend->queued_events.empty()) {
+    *event = std::move(backend->queued_events.front());
+    backend->queued_events.pop_front();
+    backend->thread_id = event->thread_id;
+
+    return true;
+  }
+
+  // Stops are waited for through SIGCHLD, waitpid has no timeout
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+
+  while (true) {
+    // Stops that came while the threads were being stopped go first, their
+    // threads haven't run since. Held ones wait for the running thread.
+    int status = 0;
+    pid_t thread_id = 0;
+    for (auto &it : backend->threads) {
+      if (it.second.pending_status &&
+          (!backend->running_thread_id ||
+           it.first == backend->running_thread_id)) {
+        thread_id = (pid_t)it.first;
+        status = it.second.pending_status;
+        it.second.pending_status = 0;
+        break;
+      }
+    }
+
+    // Then the ones collected along with a stop of other threads
+    if (!thread_id && !backend->early_statuses.empty()) {
+      thread_id = backend->early_statuses.front().first;
+      status = backend->early_statuses.front().second;
+      backend->early_statuses.erase(backend->early_statuses.begin());
+    }
+
+    if (!thread_id) {
+      thread_id = waitpid(-1, &status, WNOHANG | __WALL);
+      if (thread_id < 0) {
+        LOG_IMGUI(BackendWaitForEvent, "waitpid failed, error = ", errno)
+        return false;
+      }
+    }
+
+    if (thread_id > 0) {
+      if (BackendDecodeStatus(backend, thread_id, status, event)) {
+        return true;
+      }
+      *event = {};
+      continue;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (!timeout || (timeout != INFINITE && now >= deadline)) {
+      return true;
+    }
+
+    BackendWaitForSignal(
+        backend,
+        timeout == INFINITE
+            ? -1
+            : (int)std::chrono::ceil<std::chrono::milliseconds>(deadline - now)
+                  .count());
+  }
+}
+
+// Stops every running thread, for all-stop and for the calls that need them
+// stopped. All of them are signalled, then their stops are collected as they
+// come. Stops that come instead of the SIGSTOP are reported later.
+static bool BackendStopThreads(Backend *backend) {
+  std::set<pid_t> stopping_threads;
+  for (auto &it : backend->threads) {
+    BackendThread &thread = it.second;
+    if (thread.is_stopped) {
+      continue;
+    }
+
+    if (!thread.is_stop_requested) {
+      ++backend->syscall_count;
+      syscall(SYS_tgkill, backend->process_id, it.first, SIGSTOP);
+      thread.is_stop_requested = true;
+    }
+    stopping_threads.insert((pid_t)it.first);
+  }
+
+  while (!stopping_threads.empty()) {
+    int status;
+    const pid_t thread_id =
+        BackendWaitForAny(backend, stopping_threads, &status);
+    if (!thread_id) {
+      LOG_IMGUI(BackendStopThreads, "Unable to stop ",
+                stopping_threads.size(), " threads")
+      return false;
+    }
+    stopping_threads.erase(thread_id);
+
+    BackendThread &thread = backend->threads[thread_id];
+    thread.is_stopped = true;
+    if (WIFSTOPPED(status) && WSTOPSIG(status) == SIGSTOP) {
+      thread.is_stop_requested = false;
+    } else {
+      thread.pending_status = status;
+    }
+  }
+
+  return true;
+}
+
+// Stopped threads run on, except the ones with a stop to report. Single
+// steps cut short by BackendStopThreads are taken again.
+static void BackendResumeThreads(Backend *backend) {
+  for (auto &it : backend->threads) {
+    BackendThread &thread = it.second;
+    if (!thread.is_stopped || thread.pending_status || thread.is_suspended) {
+      continue;
+    }
+
+    ++backend->syscall_count;
+    ptrace(thread.is_single_stepping ? PTRACE_SINGLESTEP : PTRACE_CONT,
+           (pid_t)it.first, NULL, NULL);
+    thread.is_stopped = false;
+  }
+}
+
+// Runs a stopped thread with the single step and resume flag requested for
+// it
+static bool BackendRunThread(Backend *backend, pid_t thread_id, int signal) {
+  if (backend->is_resume_flag) {
+    user_regs_struct regs;
+    ptrace(PTRACE_GETREGS, thread_id, NULL, &regs);
+    regs.eflags |= BACKEND_RESUME_FLAG;
+    ptrace(PTRACE_SETREGS, thread_id, NULL, &regs);
+    backend->syscall_count += 2;
+  }
+
+  bool result = true;
+  const auto request =
+      backend->is_single_step ? PTRACE_SINGLESTEP : PTRACE_CONT;
+  ++backend->syscall_count;
+  if (ptrace(request, thread_id, NULL, (void *)(long)signal) < 0) {
+    LOG_IMGUI(BackendContinue, "ptrace failed, error = ", errno)
+    result = false;
+  }
+
+  auto it = backend->threads.find(thread_id);
+  if (it != backend->threads.end()) {
+    it->second.is_stopped = false;
+    it->second.is_single_stepping = backend->is_single_step;
+  }
+  backend->is_single_step = false;
+  backend->is_resume_flag = false;
+
+  return result;
+}
+
+// Continues the event thread, and the others unless they are held
+static bool BackendContinue(Backend *backend, const BackendEvent &event,
+                            bool is_handled) {
+  // Threads of queued events stay stopped until they are all reported, the
+  // last one is of the thread to continue
+  if (!backend->queued_events.empty()) {
+    return true;
+  }
+
+  bool result = true;
+  auto it = backend->threads.find(event.thread_id);
+  if (backend->is_suspending_thread && it != backend->threads.end()) {
+    it->second.is_suspended = true;
+  } else if (event.type != BackendEventType::EXIT_PROCESS &&
+             event.type != BackendEventType::EXIT_THREAD) {
+    // Unhandled signals are delivered to the target
+    const int signal =
+        (event.type == BackendEventType::EXCEPTION && !is_handled)
+            ? event.code
+            : 0;
+
+    result = BackendRunThread(backend, event.thread_id, signal);
+  }
+  backend->is_single_step = false;
+  backend->is_resume_flag = false;
+  backend->is_suspending_thread = false;
+
+  if (backend->is_holding_threads) {
+    backend->is_holding_threads = false;
+    backend->running_thread_id = event.thread_id;
+    return result;
+  }
+  backend->running_thread_id = 0;
+
+  BackendResumeThreads(backend);
+
+  if (backend->is_attaching) {
+    backend->is_attaching = false;
+    LOG_IMGUI(BackendAttach, "All threads run again ",
+              std::chrono::duration_cast<std::chrono::milliseconds>(
+                  std::chrono::steady_clock::now() - backend->attach_time)
+                  .count(),
+              " ms after the attach")
+  }
+
+  return result;
+}
+
+// Event thread stays stopped from the next continue on, until
+// BackendResumeThread. The others aren't affected.
+static inline void BackendSuspendThread(Backend *backend) {
+  backend->is_suspending_thread = true;
+}
+
+// Runs a thread kept by BackendSuspendThread, with the single step, resume
+// flag and hold requested since. Called between events.
+static bool BackendResumeThread(Backend *backend, DWORD thread_id) {
+  auto it = backend->threads.find(thread_id);
+  if (it == backend->threads.end() || !it->second.is_suspended) {
+    return false;
+  }
+  it->second.is_suspended = false;
+
+  const bool result = BackendRunThread(backend, (pid_t)thread_id, 0);
+
+  // Others were stopped by BackendHoldThreads already
+  if (backend->is_holding_threads) {
+    backend->is_holding_threads = false;
+    backend->running_thread_id = thread_id;
+  }
+
+  return result;
+}
+
+// Trap after the next instruction of the event thread, applied on continue
+static inline void BackendSetSingleStep(Backend *backend) {
+  backend->is_single_step = true;
+}
+
+// Only the event thread runs on the next continue, the others are stopped
+// until the one after it
+static inline void BackendHoldThreads(Backend *backend) {
+  BackendStopThreads(backend);
+  backend->is_holding_threads = true;
+}
+
+// Lets the instruction at the current address run over it's execute slot,
+// applied on continue
+static inline void BackendSetResumeFlag(Backend *backend) {
+  backend->is_resume_flag = true;
+}
+
+// Debug registers of every thread, new ones get them as they start. Running
+// threads are stopped for it. "control" is DR7, slots without it's enable
+// bits are ignored.
+static bool BackendSetDebugRegisters(Backend *backend, const DWORD64 *addresses,
+                                     DWORD64 control) {
+  memcpy(backend->debug_addresses, addresses,
+         sizeof(backend->debug_addresses));
+  backend->debug_control = control;
+
+  std::vector<pid_t> running_threads;
+  for (const auto &it : backend->threads) {
+    if (!it.second.is_stopped) {
+      running_threads.push_back((pid_t)it.first);
+    }
+  }
+  if (!running_threads.empty()) {
+    BackendStopThreads(backend);
+  }
+
+  bool result = true;
+  for (const auto &it : backend->threads) {
+    if (!BackendWriteDebugRegisters(backend, (pid_t)it.first)) {
+      result = false;
+    }
+  }
+
+  for (pid_t thread_id : running_threads) {
+    auto it = backend->threads.find(thread_id);
+    if (it != backend->threads.end() && it->second.is_stopped &&
+        !it->second.pending_status) {
+      ++backend->syscall_count;
+      ptrace(it->second.is_single_stepping ? PTRACE_SINGLESTEP : PTRACE_CONT,
+             thread_id, NULL, NULL);
+      it->second.is_stopped = false;
+    }
+  }
+
+  return result;
+}
+
+// Reads all ranges with as few process_vm_readv calls as possible. A range
+// that can't be read doesn't stop the ones after it.
+static bool BackendReadMemoryRanges(Backend *backend,
+                                    BackendMemoryRange *ranges, size_t count) {
+  bool result = true;
+
+  iovec local[BACKEND_MAX_IOV];
+  iovec remote[BACKEND_MAX_IOV];
+
+  size_t first = 0;
+  while (first < count) {
+    const size_t batch_count = std::min<size_t>(count - first, BACKEND_MAX_IOV);
+
+    size_t requested_size = 0;
+    for (size_t i = 0; i < batch_count; ++i) {
+      BackendMemoryRange &range = ranges[first + i];
+      range.transferred_size = 0;
+
+      local[i].iov_base = range.buffer;
+      local[i].iov_len = range.size;
+      remote[i].iov_base = (void *)range.address;
+      remote[i].iov_len = range.size;
+      requested_size += range.size;
+    }
+
+    ++backend->syscall_count;
+    ssize_t read_size = process_vm_readv(backend->process_id, local,
+                                         batch_count, remote, batch_count, 0);
+    if (read_size < 0) {
+      read_size = 0;
+    }
+
+    // Reading stops at the first range that fails
+    size_t i = 0;
+    size_t remaining_size = read_size;
+    for (; i < batch_count && remaining_size >= ranges[first + i].size; ++i) {
+      ranges[first + i].transferred_size = ranges[first + i].size;
+      remaining_size -= ranges[first + i].size;
+    }
+
+    if ((size_t)read_size == requested_size) {
+      first += batch_count;
+      continue;
+    }
+
+    ranges[first + i].transferred_size = remaining_size;
+    result = false;
+    first += i + 1;
+  }
+
+  return result;
+}
+
+static bool BackendReadMemory(Backend *backend, DWORD64 address, void *buffer,
+                              SIZE_T size, SIZE_T *read_size) {
+  BackendMemoryRange range = {address, buffer, size, 0};
+  const bool result = BackendReadMemoryRanges(backend, &range, 1);
+  if (read_size) {
+    *read_size = range.transferred_size;
+  }
+
+  return result;
+}
+
+static bool BackendWriteMemory(Backend *backend, DWORD64 address,
+                               const void *buffer, SIZE_T size) {
+  iovec local = {(void *)buffer, size};
+  iovec remote = {(void *)address, size};
+  ++backend->syscall_count;
+  if (process_vm_writev(backend->process_id, &local, 1, &remote, 1, 0) ==
+      (ssize_t)size) {
+    return true;
+  }
+
+  // process_vm_writev honours page protection, code has to be patched
+  // through /proc/<pid>/mem
+  ++backend->syscall_count;
+  if (pwrite(backend->memory_file, buffer, size, (off_t)address) ==
+      (ssize_t)size) {
+    return true;
+  }
+
+  LOG_IMGUI(BackendWriteMemory, "Unable to write ", size, " bytes at ",
+            std::hex, address, ", error = ", std::dec, errno)
+  return false;
+}
+
+// syscall instruction of the vDSO fallback paths, 0 if there is none
+static DWORD64 BackendFindSyscall(Backend *backend) {
+  static const BYTE syscall_code[2] = {0x0f, 0x05};
+
+  if (backend->syscall_address) {
+    return backend->syscall_address;
+  }
+
+  char maps_path[64];
+  snprintf(maps_path, sizeof(maps_path), "/proc/%d/maps",
+           (int)backend->process_id);
+
+  std::ifstream maps(maps_path);
+  std::string line;
+  while (std::getline(maps, line)) {
+    unsigned long long start, end;
+    if (line.find("[vdso]") == std::string::npos ||
+        sscanf(line.c_str(), "%llx-%llx", &start, &end) != 2) {
+      continue;
+    }
+
+    std::vector<BYTE> code(end - start);
+    if (!BackendReadMemory(backend, start, code.data(), code.size(), NULL)) {
+      return 0;
+    }
+
+    auto it = std::search(code.begin(), code.end(), syscall_code,
+                          syscall_code + sizeof(syscall_code));
+    if (it != code.end()) {
+      backend->syscall_address = start + (it - code.begin());
+    }
+    break;
+  }
+
+  return backend->syscall_address;
+}
+
+// Readable, writable and executable memory in the target, at the address or
+// anywhere for 0. False, if it's taken. The main thread runs mmap for it with
+// a single step over the vDSO syscall instruction. Without one, it's written
+// over the current instruction for a moment, that other threads may run into.
+static bool BackendAllocateMemory(Backend *backend, DWORD64 address,
+                                  SIZE_T size, DWORD64 *result) {
+  const pid_t thread_id = backend->thread_id;
+  static const BYTE syscall_code[2] = {0x0f, 0x05};
+
+  backend->syscall_count += 4;
+
+  user_regs_struct saved_regs;
+  if (ptrace(PTRACE_GETREGS, thread_id, NULL, &saved_regs) < 0) {
+    LOG_IMGUI(BackendAllocateMemory, "Unable to inject mmap, error = ", errno)
+    return false;
+  }
+
+  const DWORD64 syscall_address = BackendFindSyscall(backend);
+  BYTE saved_code[sizeof(syscall_code)];
+  if (!syscall_address &&
+      (!BackendReadMemory(backend, saved_regs.rip, saved_code,
+                          sizeof(saved_code), NULL) ||
+       !BackendWriteMemory(backend, saved_regs.rip, syscall_code,
+                           sizeof(syscall_code)))) {
+    LOG_IMGUI(BackendAllocateMemory, "Unable to inject mmap, error = ", errno)
+    return false;
+  }
+
+  user_regs_struct regs = saved_regs;
+  if (syscall_address) {
+    regs.rip = syscall_address;
+  }
+  regs.orig_rax = -1; // Interrupted syscall isn't restarted by this one
+  regs.rax = SYS_mmap;
+  regs.rdi = address;
+  regs.rsi = size;
+  regs.rdx = PROT_READ | PROT_WRITE | PROT_EXEC;
+  regs.r10 = MAP_PRIVATE | MAP_ANONYMOUS;
+  if (address) {
+    regs.r10 |= MAP_FIXED_NOREPLACE;
+  }
+  regs.r8 = (unsigned long long)-1;
+  regs.r9 = 0;
+  ptrace(PTRACE_SETREGS, thread_id, NULL, &regs);
+
+  // Signals that arrive meanwhile are sent again once it's done
+  int pending_signal = 0;
+  int status = 0;
+  for (int i = 0; i < 8; ++i) {
+    backend->syscall_count += 2;
+    if (ptrace(PTRACE_SINGLESTEP, thread_id, NULL, NULL) < 0 ||
+        waitpid(thread_id, &status, __WALL) != thread_id ||
+        !WIFSTOPPED(status) || WSTOPSIG(status) == SIGTRAP) {
+      break;
+    }
+    pending_signal = WSTOPSIG(status);
+  }
+
+  const bool is_stopped = WIFSTOPPED(status) && WSTOPSIG(status) == SIGTRAP;
+  if (is_stopped) {
+    ptrace(PTRACE_GETREGS, thread_id, NULL, &regs);
+  }
+
+  if (!syscall_address) {
+    BackendWriteMemory(backend, saved_regs.rip, saved_code,
+                       sizeof(saved_code));
+  }
+  ptrace(PTRACE_SETREGS, thread_id, NULL, &saved_regs);
+  if (pending_signal) {
+    syscall(SYS_tgkill, backend->process_id, thread_id, pending_signal);
+  }
+
+  if (!is_stopped) {
+    LOG_IMGUI(BackendAllocateMemory, "mmap didn't finish in the target")
+    return false;
+  }
+
+  // Error codes are -4095..-1
+  if (regs.rax > (unsigned long long)-4096) {
+    return false;
+  }
+
+  // Kernels that ignore MAP_FIXED_NOREPLACE put it elsewhere
+  *result = regs.rax;
+
+  return true;
+}
+
+// x86 keeps instruction cache coherent with ptrace writes, only counted
+static inline void BackendFlushInstructionCache(Backend *backend,
+                                                DWORD64 address, SIZE_T size) {
+  (void)address;
+  (void)size;
+  ++backend->flush_count;
+}
+
+static bool BackendGetRegisters(Backend *backend, DWORD thread_id,
+                                Registers *registers) {
+  ++backend->syscall_count;
+
+  user_regs_struct regs;
+  if (ptrace(PTRACE_GETREGS, thread_id, NULL, &regs) < 0) {
+    LOG_IMGUI(BackendGetRegisters, "PTRACE_GETREGS failed, error = ", errno)
+    return false;
+  }
+
+  RegistersUpdateFromUserRegs(registers, regs);
+
+  return true;
+}
+
+#define BACKEND_XSAVE_SIZE 4096 // Enough for everything up to AVX-512
+#define BACKEND_XSAVE_HEADER_OFFSET 512
+#define BACKEND_XSAVE_AVX_OFFSET 576 // Standard form, the one ptrace uses
+#define BACKEND_XSAVE_AVX 0x4 // XSTATE_BV bit
+
+// x87, SSE and AVX state. The XSAVE area starts with the FXSAVE one, older
+// kernels and CPUs without XSAVE only have the latter.
+static bool BackendGetExtendedRegisters(Backend *backend, DWORD thread_id,
+                                        Registers *registers) {
+  ++backend->syscall_count;
+
+  alignas(64) BYTE xsave[BACKEND_XSAVE_SIZE];
+  iovec vector = {xsave, sizeof(xsave)};
+  if (ptrace(PTRACE_GETREGSET, thread_id, (void *)NT_X86_XSTATE, &vector) <
+      0) {
+    user_fpregs_struct fpregs;
+    if (ptrace(PTRACE_GETFPREGS, thread_id, NULL, &fpregs) < 0) {
+      LOG_IMGUI(BackendGetExtendedRegisters,
+                "PTRACE_GETFPREGS failed, error = ", errno)
+      return false;
+    }
+
+    RegistersReadFxsave(registers, (const BYTE *)&fpregs,
+                        REGISTERS_VECTOR_COUNT);
+    return true;
+  }
+
+  RegistersReadFxsave(registers, xsave, REGISTERS_VECTOR_COUNT);
+
+  const size_t ymm_size = sizeof(registers->ymm_high);
+  if (vector.iov_len >= BACKEND_XSAVE_AVX_OFFSET + ymm_size) {
+    DWORD64 features;
+    memcpy(&features, xsave + BACKEND_XSAVE_HEADER_OFFSET, sizeof(features));
+
+    // Upper halves that were never used aren't saved, they are zero
+    if (features & BACKEND_XSAVE_AVX) {
+      memcpy(registers->ymm_high, xsave + BACKEND_XSAVE_AVX_OFFSET, ymm_size);
+    } else {
+      memset(registers->ymm_high, 0, ymm_size);
+    }
+    registers->extended_state |= REGISTERS_AVX;
+  }
+
+  return true;
+}
+
+static bool BackendSetRegisters(Backend *backend, DWORD thread_id,
+                                const Registers &registers) {
+  backend->syscall_count += 2;
+
+  user_regs_struct regs;
+  if (ptrace(PTRACE_GETREGS, thread_id, NULL, &regs) < 0) {
+    LOG_IMGUI(BackendSetRegisters, "PTRACE_GETREGS failed, error = ", errno)
+    return false;
+  }
+
+  RegistersWriteToUserRegs(registers, &regs);
+
+  if (ptrace(PTRACE_SETREGS, thread_id, NULL, &regs) < 0) {
+    LOG_IMGUI(BackendSetRegisters, "PTRACE_SETREGS failed, error = ", errno)
+    return false;
+  }
+
+  return true;
+}
+
+// Signal to deliver on detach for a stop the debugger didn't get to, 0 for
+// it's own. A thread that trapped on an int3 that isn't there anymore goes
+// back to run the instruction under it.
+static int BackendGetDetachSignal(Backend *backend, pid_t thread_id,
+                                  int status) {
+  const int signal = WSTOPSIG(status);
+  if (signal != SIGTRAP) {
+    return signal == SIGSTOP ? 0 : signal;
+  }
+
+  if ((status >> 16) == PTRACE_EVENT_CLONE) {
+    // Clone stops on it's own, it's untraced along with the rest
+    unsigned long new_thread_id = 0;
+    ptrace(PTRACE_GETEVENTMSG, thread_id, NULL, &new_thread_id);
+
+    int new_status;
+    if (backend->threads.find((DWORD)new_thread_id) ==
+            backend->threads.end() &&
+        BackendWaitForThread(backend, (pid_t)new_thread_id, &new_status)) {
+      ptrace(PTRACE_DETACH, (pid_t)new_thread_id, NULL, NULL);
+    }
+    return 0;
+  }
+
+  siginfo_t siginfo = {};
+  user_regs_struct regs;
+  BYTE code = 0;
+  if (ptrace(PTRACE_GETSIGINFO, thread_id, NULL, &siginfo) == 0 &&
+      (siginfo.si_code == SI_KERNEL || siginfo.si_code == TRAP_BRKPT) &&
+      ptrace(PTRACE_GETREGS, thread_id, NULL, &regs) == 0 &&
+      BackendReadMemory(backend, regs.rip - 1, &code, 1, NULL) &&
+      code != 0xCC) {
+    --regs.rip;
+    ptrace(PTRACE_SETREGS, thread_id, NULL, &regs);
+  }
+
+  return 0;
+}
+
+// Lets every thread run on untraced. Breakpoints and debug registers have to
+// be taken out before. Called between events.
+static bool BackendDetach(Backend *backend) {
+  BackendStopThreads(backend);
+  BackendUnhookLoads(backend);
+
+  // SIGSTOP of BackendStopThreads that is still on it's way would stop a
+  // thread for good once nothing traces it. Those threads run until it comes,
+  // all at once, with the stop that came instead handled first.
+  std::vector<std::pair<pid_t, int>> signals; // To deliver on detach
+  for (auto &it : backend->threads) {
+    const pid_t thread_id = (pid_t)it.first;
+    const int status = it.second.pending_status;
+    if (status && !WIFSTOPPED(status)) {
+      continue;
+    }
+
+    int signal =
+        status ? BackendGetDetachSignal(backend, thread_id, status) : 0;
+    if (it.second.is_stop_requested) {
+      ptrace(PTRACE_CONT, thread_id, NULL, (void *)(long)signal);
+      signal = 0;
+    }
+    signals.emplace_back(thread_id, signal);
+  }
+
+  std::set<pid_t> stopping_threads;
+  for (auto &it : signals) {
+    if (backend->threads[it.first].is_stop_requested) {
+      stopping_threads.insert(it.first);
+    }
+  }
+  while (!stopping_threads.empty()) {
+    int status;
+    const pid_t thread_id =
+        BackendWaitForAny(backend, stopping_threads, &status);
+    if (!thread_id) {
+      break;
+    }
+
+    if (!WIFSTOPPED(status) || WSTOPSIG(status) == SIGSTOP) {
+      backend->threads[thread_id].is_stop_requested = false;
+      stopping_threads.erase(thread_id);
+    } else {
+      ptrace(PTRACE_CONT, thread_id, NULL,
+             (void *)(long)BackendGetDetachSignal(backend, thread_id,
+                                                  status));
+    }
+  }
+
+  bool result = true;
+  for (const auto &it : signals) {
+    if (ptrace(PTRACE_DETACH, it.first, NULL, (void *)(long)it.second) < 0) {
+      LOG_IMGUI(BackendDetach, "Unable to detach from ", it.first,
+                ", error = ", errno)
+      result = false;
+    }
+  }
+
+  // Threads that started meanwhile are stopped, waiting to be reported
+  for (const auto &it : backend->early_statuses) {
+    if (WIFSTOPPED(it.second)) {
+      ptrace(PTRACE_DETACH, it.first, NULL, NULL);
+    }
+  }
+
+  backend->threads.clear();
+  backend->queued_events.clear();
+  backend->modules.clear();
+  backend->early_statuses.clear();
+  close(backend->memory_file);
+  backend->memory_file = -1;
+
+  BackendStopEventThread(backend);
+  close(backend->signal_file);
+  backend->signal_file = -1;
+
+  return result;
+}
\ No newline at end of file
@@ -0,0 +1,806 @@
+static void BackendInitialize(Backend *backend, DWORD process_id,
+                              HANDLE process) {
+  backend->process_id = process_id;
+  backend->is_single_step = false;
+  backend->is_resume_flag = false;
+  backend->is_holding_threads = false;
+  backend->is_suspending_thread = false;
+#ifdef _WIN64
+  backend->is_64bit = true; // Same as the debugger, WOW64 isn't supported
+#else
+  backend->is_64bit = false;
+#endif
+  backend->syscall_count = 0;
+  backend->flush_count = 0;
+  backend->is_attaching = false;
+  backend->debug_control = 0;
+  backend->process = process;
+  backend->is_loader_breakpoint_seen = false;
+}
+
+// Waits for the next event once it's requested, then hands it over and
+// calls OnEvent. Calls of the debugger thread are run in between.
+static void BackendRunEventThread(Backend *backend) {
+  std::unique_lock<std::mutex> lock(backend->event_mutex);
+  while (true) {
+    backend->event_condition.wait(lock, [&]() {
+      return backend->event_call || backend->is_wait_requested ||
+             backend->is_event_thread_stopping;
+    });
+
+    if (backend->is_event_thread_stopping) {
+      return;
+    }
+
+    if (backend->event_call) {
+      auto call = std::move(backend->event_call);
+      backend->event_call = nullptr;
+      lock.unlock();
+      call();
+      lock.lock();
+      backend->is_call_done = true;
+      backend->event_condition.notify_all();
+      continue;
+    }
+
+    backend->is_wait_requested = false;
+    backend->is_event_waiting = true;
+    lock.unlock();
+
+    DEBUG_EVENT debug_event = {};
+    const bool is_received = WaitForDebugEventEx(&debug_event, INFINITE) != 0;
+    const DWORD error = is_received ? 0 : GetLastError();
+
+    lock.lock();
+    backend->is_event_waiting = false;
+    backend->is_event_ready = true;
+    backend->debug_event = debug_event;
+    backend->event_error = error;
+    backend->event_condition.notify_all();
+
+    if (backend->OnEvent) {
+      lock.unlock();
+      backend->OnEvent();
+      lock.lock();
+    }
+  }
+}
+
+static void BackendStartEventThread(Backend *backend) {
+  backend->event_call = nullptr;
+  backend->is_call_done = false;
+  backend->is_wait_requested = false;
+  backend->is_event_waiting = false;
+  backend->is_event_ready = false;
+  backend->is_event_thread_stopping = false;
+  backend->event_error = 0;
+  backend->event_thread = std::thread(BackendRunEventThread, backend);
+}
+
+static void BackendStopEventThread(Backend *backend) {
+  {
+    std::lock_guard<std::mutex> lock(backend->event_mutex);
+    backend->is_event_thread_stopping = true;
+  }
+  backend->event_condition.notify_all();
+  backend->event_thread.join();
+}
+
+// Runs the call on the event thread and returns once it's done. The event
+// thread has to be between waits, for an event to be continued or before
+// the first one.
+static void BackendCallOnEventThread(Backend *backend,
+                                     std::function<void()> call) {
+  std::unique_lock<std::mutex> lock(backend->event_mutex);
+  backend->event_call = std::move(call);
+  backend->is_call_done = false;
+  backend->event_condition.notify_all();
+  backend->event_condition.wait(lock,
+                                [&]() { return backend->is_call_done; });
+}
+
+// Event thread waits for the next event
+static void BackendRequestEvent(Backend *backend) {
+  {
+    std::lock_guard<std::mutex> lock(backend->event_mutex);
+    backend->is_wait_requested = true;
+  }
+  backend->event_condition.notify_all();
+}
+
+static bool BackendContinueEvent(Backend *backend, DWORD process_id,
+                                 DWORD thread_id, DWORD status) {
+  bool result;
+  BackendCallOnEventThread(backend, [&]() {
+    result = ContinueDebugEvent(process_id, thread_id, status) != 0;
+    if (!result) {
+      LOG_IMGUI(BackendContinue,
+                "ContinueDebugEvent failed, error = ", GetLastError())
+    }
+  });
+  BackendRequestEvent(backend);
+
+  return result;
+}
+
+static bool BackendLaunch(Backend *backend, const std::wstring &path) {
+  BackendStartEventThread(backend);
+
+  PROCESS_INFORMATION pi = {};
+  bool is_created;
+  BackendCallOnEventThread(backend, [&]() {
+    STARTUPINFOW si = {};
+    si.cb = sizeof(si);
+    is_created = CreateProcessW(path.c_str(), NULL, NULL, NULL, FALSE,
+                                DEBUG_ONLY_THIS_PROCESS, NULL, NULL, &si,
+                                &pi) != 0;
+    if (!is_created) {
+      LOG_IMGUI(BackendLaunch,
+                "CreateProcessW failed, error = ", GetLastError())
+    }
+  });
+  if (!is_created) {
+    BackendStopEventThread(backend);
+    return false;
+  }
+
+  BackendInitialize(backend, pi.dwProcessId, pi.hProcess);
+  backend->thread_id = pi.dwThreadId;
+  backend->threads[pi.dwThreadId] = pi.hThread;
+  BackendRequestEvent(backend);
+
+  return true;
+}
+
+// The system reports the process, it's threads and DLLs as if they were just
+// created, then breaks in a thread of it's own, that's where attach is over
+static bool BackendAttach(Backend *backend, DWORD process_id) {
+  const auto attach_time = std::chrono::steady_clock::now();
+
+  HANDLE process = OpenProcess(PROCESS_ALL_ACCESS, FALSE, process_id);
+  if (!process) {
+    LOG_IMGUI(BackendAttach, "OpenProcess failed, error = ", GetLastError())
+    return false;
+  }
+
+  BackendStartEventThread(backend);
+
+  bool is_attached;
+  BackendCallOnEventThread(backend, [&]() {
+    is_attached = DebugActiveProcess(process_id) != 0;
+    if (!is_attached) {
+      LOG_IMGUI(BackendAttach,
+                "DebugActiveProcess failed, error = ", GetLastError())
+      return;
+    }
+
+    // The process outlives the debugger, it's detached from on exit instead
+    DebugSetProcessKillOnExit(FALSE);
+  });
+  if (!is_attached) {
+    BackendStopEventThread(backend);
+    CloseHandle(process);
+    return false;
+  }
+
+  BackendInitialize(backend, process_id, process);
+  backend->thread_id = 0; // Known from the first event
+  backend->is_attaching = true;
+  backend->attach_time = attach_time;
+  BackendRequestEvent(backend);
+
+  return true;
+}
+
+// NULL, if the thread has exited or wasn't reported yet
+static inline HANDLE BackendGetThreadHandle(Backend *backend,
+                                            DWORD thread_id) {
+  auto it = backend->threads.find(thread_id);
+  return it != backend->threads.end() ? it->second : NULL;
+}
+
+static bool BackendWriteDebugRegisters(Backend *backend, HANDLE thread) {
+  backend->syscall_count += 3;
+
+  // Only the debug registers are written, a running thread is suspended for
+  // it
+  CONTEXT context = {};
+  context.ContextFlags = CONTEXT_DEBUG_REGISTERS;
+  context.Dr0 = (DWORD_PTR)backend->debug_addresses[0];
+  context.Dr1 = (DWORD_PTR)backend->debug_addresses[1];
+  context.Dr2 = (DWORD_PTR)backend->debug_addresses[2];
+  context.Dr3 = (DWORD_PTR)backend->debug_addresses[3];
+  context.Dr7 = (DWORD_PTR)backend->debug_control;
+  SuspendThread(thread);
+  const bool result = SetThreadContext(thread, &context) != 0;
+  ResumeThread(thread);
+  if (!result) {
+    LOG_IMGUI(BackendWriteDebugRegisters,
+              "SetThreadContext failed, error = ", GetLastError())
+    return false;
+  }
+
+  return true;
+}
+
+// Slots that triggered the last single step exception, DR6 is cleared for the
+// next one
+static DWORD BackendReadDebugStatus(Backend *backend, HANDLE thread) {
+  backend->syscall_count += 2;
+
+  CONTEXT context = {};
+  context.ContextFlags = CONTEXT_DEBUG_REGISTERS;
+  if (!GetThreadContext(thread, &context)) {
+    LOG_IMGUI(BackendReadDebugStatus,
+              "GetThreadContext failed, error = ", GetLastError())
+    return 0;
+  }
+
+  const DWORD slots = (DWORD)context.Dr6 & 0xf;
+  context.Dr6 = 0;
+  SetThreadContext(thread, &context);
+
+  return slots;
+}
+
+// Returns false if the target can't be debugged anymore. On timeout returns
+// true with BackendEventType::NONE, INFINITE waits until there is an event.
+static bool BackendWaitForEvent(Backend *backend, BackendEvent *event,
+                                DWORD timeout) {
+  *event = {};
+
+  DEBUG_EVENT debug_event;
+  {
+    std::unique_lock<std::mutex> lock(backend->event_mutex);
+    auto is_ready = [&]() { return backend->is_event_ready; };
+    if (timeout == INFINITE) {
+      backend->event_condition.wait(lock, is_ready);
+    } else if (!backend->event_condition.wait_for(
+                   lock, std::chrono::milliseconds(timeout), is_ready)) {
+      return true;
+    }
+
+    backend->is_event_ready = false;
+    if (backend->event_error) {
+      LOG_IMGUI(BackendWaitForEvent, "WaitForDebugEventEx failed, error = ",
+                backend->event_error)
+      return false;
+    }
+    debug_event = backend->debug_event;
+  }
+
+  event->process_id = debug_event.dwProcessId;
+  event->thread_id = debug_event.dwThreadId;
+  backend->thread_id = debug_event.dwThreadId;
+
+  switch (debug_event.dwDebugEventCode) {
+  case CREATE_PROCESS_DEBUG_EVENT: {
+    const auto &info = debug_event.u.CreateProcessInfo;
+    event->type = BackendEventType::CREATE_PROCESS;
+    event->base_address = (DWORD64)info.lpBaseOfImage;
+    event->file = info.hFile;
+    backend->threads.emplace(event->thread_id, info.hThread); // Attach
+  } break;
+  case EXIT_PROCESS_DEBUG_EVENT:
+    event->type = BackendEventType::EXIT_PROCESS;
+    event->code = debug_event.u.ExitProcess.dwExitCode;
+    break;
+  case CREATE_THREAD_DEBUG_EVENT: {
+    HANDLE thread = debug_event.u.CreateThread.hThread;
+    event->type = BackendEventType::CREATE_THREAD;
+    backend->threads[event->thread_id] = thread;
+
+    // Debug registers aren't inherited
+    if (backend->debug_control) {
+      BackendWriteDebugRegisters(backend, thread);
+    }
+  } break;
+  case EXIT_THREAD_DEBUG_EVENT:
+    event->type = BackendEventType::EXIT_THREAD;
+    backend->threads.erase(event->thread_id);
+    break;
+  case LOAD_DLL_DEBUG_EVENT: {
+    const auto &info = debug_event.u.LoadDll;
+    event->type = BackendEventType::LOAD_MODULE;
+    event->base_address = (DWORD64)info.lpBaseOfDll;
+    event->file = info.hFile;
+  } break;
+  case UNLOAD_DLL_DEBUG_EVENT:
+    event->type = BackendEventType::UNLOAD_MODULE;
+    event->base_address = (DWORD64)debug_event.u.UnloadDll.lpBaseOfDll;
+    break;
+  case OUTPUT_DEBUG_STRING_EVENT: {
+    const auto &info = debug_event.u.DebugString;
+    event->type = BackendEventType::OUTPUT_STRING;
+    event->address = (DWORD64)info.lpDebugStringData;
+    event->size = info.nDebugStringLength;
+    event->is_unicode = info.fUnicode != 0;
+  } break;
+  case EXCEPTION_DEBUG_EVENT: {
+    const auto &info = debug_event.u.Exception;
+    event->address = (DWORD64)info.ExceptionRecord.ExceptionAddress;
+    event->code = info.ExceptionRecord.ExceptionCode;
+    event->is_first_chance = info.dwFirstChance != 0;
+
+    switch (info.ExceptionRecord.ExceptionCode) {
+    case EXCEPTION_BREAKPOINT:
+      // The loader breaks once before anything runs, it is not ours
+      if (!backend->is_loader_breakpoint_seen) {
+        backend->is_loader_breakpoint_seen = true;
+
+        if (backend->is_attaching) {
+          backend->is_attaching = false;
+          LOG_IMGUI(BackendAttach, "Attached in ",
+                    std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() -
+                        backend->attach_time)
+                        .count(),
+                    " ms, ", backend->threads.size(), " threads")
+        }
+
+        // Loader starts the thread from it's initial context, debug registers
+        // set before are lost
+        HANDLE thread = BackendGetThreadHandle(backend, event->thread_id);
+        if (backend->debug_control && thread) {
+          BackendWriteDebugRegisters(backend, thread);
+        }
+
+        BackendContinueEvent(backend, event->process_id, event->thread_id,
+                             DBG_CONTINUE);
+        *event = {};
+        return true;
+      }
+
+      event->type = BackendEventType::BREAKPOINT;
+      break;
+    case EXCEPTION_SINGLE_STEP: {
+      event->type = BackendEventType::SINGLE_STEP;
+
+      // Debug register slots report as single steps too
+      HANDLE thread = BackendGetThreadHandle(backend, event->thread_id);
+      if (backend->debug_control && thread) {
+        event->hardware_slots = BackendReadDebugStatus(backend, thread);
+        if (event->hardware_slots) {
+          event->type = BackendEventType::HARDWARE_BREAKPOINT;
+        }
+      }
+    } break;
+    default:
+      event->type = BackendEventType::EXCEPTION;
+      break;
+    }
+  } break;
+  default:
+    event->type = BackendEventType::OTHER;
+    break;
+  }
+
+  return true;
+}
+
+// Debug events stop the whole process already, until it's continued
+static inline bool BackendStopThreads(Backend *backend) { return true; }
+
+// Single step and resume flag requested for the thread go into it's context
+static void BackendApplyFlags(Backend *backend, HANDLE thread) {
+  if (thread && (backend->is_single_step || backend->is_resume_flag)) {
+    CONTEXT context = {};
+    context.ContextFlags = CONTEXT_ALL;
+    GetThreadContext(thread, &context);
+    if (backend->is_single_step) {
+      context.EFlags |= BACKEND_TRAP_FLAG;
+    }
+    if (backend->is_resume_flag) {
+      context.EFlags |= BACKEND_RESUME_FLAG;
+    }
+    SetThreadContext(thread, &context);
+    backend->syscall_count += 2;
+  }
+  backend->is_single_step = false;
+  backend->is_resume_flag = false;
+}
+
+// Held ones run again from the continue after the one they were held for.
+// All but "thread_id" are held, if it was requested since.
+static void BackendUpdateHeldThreads(Backend *backend, DWORD thread_id) {
+  for (HANDLE held_thread : backend->held_threads) {
+    ResumeThread(held_thread);
+  }
+  backend->syscall_count += backend->held_threads.size();
+  backend->held_threads.clear();
+
+  if (backend->is_holding_threads) {
+    backend->is_holding_threads = false;
+
+    for (const auto &it : backend->threads) {
+      if (it.first != thread_id && SuspendThread(it.second) != (DWORD)-1) {
+        backend->held_threads.push_back(it.second);
+      }
+    }
+    backend->syscall_count += backend->threads.size();
+  }
+}
+
+static bool BackendContinue(Backend *backend, const BackendEvent &event,
+                            bool is_handled) {
+  HANDLE thread = BackendGetThreadHandle(backend, event.thread_id);
+  BackendApplyFlags(backend, thread);
+  BackendUpdateHeldThreads(backend, event.thread_id);
+
+  // Suspended before the process runs on, it stays where the event was
+  if (backend->is_suspending_thread && thread &&
+      SuspendThread(thread) != (DWORD)-1) {
+    backend->suspended_threads.push_back(event.thread_id);
+    ++backend->syscall_count;
+  }
+  backend->is_suspending_thread = false;
+
+  return BackendContinueEvent(backend, event.process_id, event.thread_id,
+                              is_handled ? DBG_CONTINUE
+                                         : DBG_EXCEPTION_NOT_HANDLED);
+}
+
+// Trap after the next instruction of the event thread, applied on continue
+static inline void BackendSetSingleStep(Backend *backend) {
+  backend->is_single_step = true;
+}
+
+// Only the event thread runs on the next continue
+static inline void BackendHoldThreads(Backend *backend) {
+  backend->is_holding_threads = true;
+}
+
+// Event thread stays stopped from the next continue on, until
+// BackendResumeThread. The others aren't affected.
+static inline void BackendSuspendThread(Backend *backend) {
+  backend->is_suspending_thread = true;
+}
+
+// Runs a thread kept by BackendSuspendThread, with the single step, resume
+// flag and hold requested since. Called between events.
+static bool BackendResumeThread(Backend *backend, DWORD thread_id) {
+  auto &suspended_threads = backend->suspended_threads;
+  auto it = std::find(suspended_threads.begin(), suspended_threads.end(),
+                      thread_id);
+  HANDLE thread = BackendGetThreadHandle(backend, thread_id);
+  if (it == suspended_threads.end() || !thread) {
+    return false;
+  }
+  suspended_threads.erase(it);
+
+  BackendApplyFlags(backend, thread);
+  BackendUpdateHeldThreads(backend, thread_id);
+
+  ++backend->syscall_count;
+  if (ResumeThread(thread) == (DWORD)-1) {
+    LOG_IMGUI(BackendResumeThread, "ResumeThread failed, error = ",
+              GetLastError())
+    return false;
+  }
+
+  return true;
+}
+
+// Lets the instruction at the current address run over it's execute slot,
+// applied on continue
+static inline void BackendSetResumeFlag(Backend *backend) {
+  backend->is_resume_flag = true;
+}
+
+// Debug registers of every thread, new ones get them as they start.
+// "control" is DR7, slots without it's enable bits are ignored.
+static bool BackendSetDebugRegisters(Backend *backend, const DWORD64 *addresses,
+                                     DWORD64 control) {
+  memcpy(backend->debug_addresses, addresses,
+         sizeof(backend->debug_addresses));
+  backend->debug_control = control;
+
+  bool result = true;
+  for (const auto &it : backend->threads) {
+    if (!BackendWriteDebugRegisters(backend, it.second)) {
+      result = false;
+    }
+  }
+
+  return result;
+}
+
+static bool BackendReadMemory(Backend *backend, DWORD64 address, void *buffer,
+                              SIZE_T size, SIZE_T *read_size) {
+  ++backend->syscall_count;
+
+  SIZE_T read_bytes = 0;
+  const bool result = ReadProcessMemory(backend->process, (void *)address,
+                                        buffer, size, &read_bytes) != 0;
+  if (read_size) {
+    *read_size = read_bytes;
+  }
+
+  return result;
+}
+
+// No vectored read on Windows, ranges are read one by one
+static bool BackendReadMemoryRanges(Backend *backend,
+                                    BackendMemoryRange *ranges, size_t count) {
+  bool result = true;
+  for (size_t i = 0; i < count; ++i) {
+    if (!BackendReadMemory(backend, ranges[i].address, ranges[i].buffer,
+                           ranges[i].size, &ranges[i].transferred_size)) {
+      result = false;
+    }
+  }
+
+  return result;
+}
+
+static bool BackendWriteMemory(Backend *backend, DWORD64 address,
+                               const void *buffer, SIZE_T size) {
+  ++backend->syscall_count;
+
+  SIZE_T written_bytes = 0;
+  return WriteProcessMemory(backend->process, (void *)address, buffer, size,
+                            &written_bytes) != 0;
+}
+
+// Readable, writable and executable memory in the target, at exactly the
+// address or anywhere for 0. False, if it's taken.
+static bool BackendAllocateMemory(Backend *backend, DWORD64 address,
+                                  SIZE_T size, DWORD64 *result) {
+  ++backend->syscall_count;
+
+  void *memory = VirtualAllocEx(backend->process, (void *)address, size,
+                                MEM_RESERVE | MEM_COMMIT,
+                                PAGE_EXECUTE_READWRITE);
+  if (!memory) {
+    return false;
+  }
+
+  *result = (DWORD64)memory;
+
+  return true;
+}
+
+static inline void BackendFlushInstructionCache(Backend *backend,
+                                                DWORD64 address, SIZE_T size) {
+  ++backend->syscall_count;
+  ++backend->flush_count;
+  FlushInstructionCache(backend->process, (void *)address, size);
+}
+
+static bool BackendGetRegisters(Backend *backend, DWORD thread_id,
+                                Registers *registers) {
+  ++backend->syscall_count;
+
+  CONTEXT context = {};
+  context.ContextFlags = CONTEXT_ALL;
+  HANDLE thread = BackendGetThreadHandle(backend, thread_id);
+  if (!thread || !GetThreadContext(thread, &context)) {
+    LOG_IMGUI(BackendGetRegisters,
+              "GetThreadContext failed, error = ", GetLastError())
+    return false;
+  }
+
+  RegistersUpdateFromContext(registers, context);
+
+  return true;
+}
+
+#ifdef _WIN64
+#define BACKEND_EXTENDED_CONTEXT CONTEXT_FLOATING_POINT // FltSave is FXSAVE
+#else
+#define BACKEND_EXTENDED_CONTEXT                                               \
+  (CONTEXT_FLOATING_POINT | CONTEXT_EXTENDED_REGISTERS)
+#endif
+
+// x87, SSE and AVX state. Context with the XSAVE area is variable sized, it
+// is asked for only when the system has AVX enabled.
+static bool BackendGetExtendedRegisters(Backend *backend, DWORD thread_id,
+                                        Registers *registers) {
+  ++backend->syscall_count;
+
+  HANDLE thread = BackendGetThreadHandle(backend, thread_id);
+  if (!thread) {
+    return false;
+  }
+
+  const bool is_avx = (GetEnabledXStateFeatures() & XSTATE_MASK_AVX) != 0;
+  const DWORD flags =
+      BACKEND_EXTENDED_CONTEXT | (is_avx ? CONTEXT_XSTATE : 0);
+
+  DWORD length = 0;
+  InitializeContext(NULL, flags, NULL, &length);
+  std::vector<BYTE> buffer(length);
+  CONTEXT *context;
+  if (!InitializeContext(buffer.data(), flags, &context, &length)) {
+    LOG_IMGUI(BackendGetExtendedRegisters,
+              "InitializeContext failed, error = ", GetLastError())
+    return false;
+  }
+  if (is_avx) {
+    SetXStateFeaturesMask(context, XSTATE_MASK_AVX);
+  }
+
+  if (!GetThreadContext(thread, context)) {
+    LOG_IMGUI(BackendGetExtendedRegisters,
+              "GetThreadContext failed, error = ", GetLastError())
+    return false;
+  }
+
+#ifdef _WIN64
+  RegistersReadFxsave(registers, (const BYTE *)&context->FltSave,
+                      REGISTERS_VECTOR_COUNT);
+#else
+  RegistersReadFxsave(registers, context->ExtendedRegisters, 8);
+#endif
+
+  DWORD64 features = 0;
+  DWORD ymm_length = 0;
+  const BYTE *ymm_high =
+      is_avx && GetXStateFeaturesMask(context, &features)
+          ? (const BYTE *)LocateXStateFeature(context, XSTATE_AVX, &ymm_length)
+          : NULL;
+  if (ymm_high) {
+    // Upper halves that were never used aren't saved, they are zero
+    memset(registers->ymm_high, 0, sizeof(registers->ymm_high));
+    if (features & XSTATE_MASK_AVX) {
+      memcpy(registers->ymm_high, ymm_high,
+             std::min<size_t>(ymm_length, sizeof(registers->ymm_high)));
+    }
+    registers->extended_state |= REGISTERS_AVX;
+  }
+
+  return true;
+}
+
+static bool BackendSetRegisters(Backend *backend, DWORD thread_id,
+                                const Registers &registers) {
+  backend->syscall_count += 2;
+
+  CONTEXT context = {};
+  context.ContextFlags = CONTEXT_ALL;
+  HANDLE thread = BackendGetThreadHandle(backend, thread_id);
+  if (!thread || !GetThreadContext(thread, &context)) {
+    LOG_IMGUI(BackendSetRegisters,
+              "GetThreadContext failed, error = ", GetLastError())
+    return false;
+  }
+
+  RegistersWriteToContext(registers, &context);
+
+  if (!SetThreadContext(thread, &context)) {
+    LOG_IMGUI(BackendSetRegisters,
+              "SetThreadContext failed, error = ", GetLastError())
+    return false;
+  }
+
+  return true;
+}
+
+// Continues the event that came and the ones already on their way, with
+// their threads suspended. Runs on the event thread.
+static void BackendDrainEvents(Backend *backend) {
+  DEBUG_EVENT debug_event = backend->debug_event;
+  bool is_event = backend->is_event_ready && !backend->event_error;
+  backend->is_event_ready = false;
+  if (!is_event) {
+    is_event = WaitForDebugEventEx(&debug_event, 0) != 0;
+  }
+
+  while (is_event) {
+    DWORD status = DBG_CONTINUE;
+
+    switch (debug_event.dwDebugEventCode) {
+    case CREATE_THREAD_DEBUG_EVENT: {
+      HANDLE thread = debug_event.u.CreateThread.hThread;
+      SuspendThread(thread);
+      backend->threads[debug_event.dwThreadId] = thread;
+    } break;
+    case EXIT_THREAD_DEBUG_EVENT:
+      backend->threads.erase(debug_event.dwThreadId);
+      break;
+    case LOAD_DLL_DEBUG_EVENT:
+      CloseHandle(debug_event.u.LoadDll.hFile);
+      break;
+    case EXCEPTION_DEBUG_EVENT: {
+      const auto &record = debug_event.u.Exception.ExceptionRecord;
+      const DWORD64 address = (DWORD64)record.ExceptionAddress;
+      HANDLE thread =
+          BackendGetThreadHandle(backend, debug_event.dwThreadId);
+
+      BYTE code = 0;
+      if (record.ExceptionCode == EXCEPTION_BREAKPOINT &&
+          BackendReadMemory(backend, address, &code, 1, NULL) &&
+          code != 0xCC && thread) {
+        CONTEXT context = {};
+        context.ContextFlags = CONTEXT_CONTROL;
+        GetThreadContext(thread, &context);
+#ifdef _WIN64
+        context.Rip = address;
+#else
+        context.Eip = (DWORD)address;
+#endif
+        SetThreadContext(thread, &context);
+      } else if (record.ExceptionCode != EXCEPTION_SINGLE_STEP) {
+        status = DBG_EXCEPTION_NOT_HANDLED;
+      }
+    } break;
+    }
+
+    ContinueDebugEvent(debug_event.dwProcessId, debug_event.dwThreadId,
+                       status);
+    is_event = WaitForDebugEventEx(&debug_event, 0) != 0;
+  }
+}
+
+// Lets the target run on without the debugger. Breakpoints and debug
+// registers have to be taken out before. Called between events, the ones
+// already on their way are continued here: a thread that trapped on an int3
+// that isn't there anymore goes back to run the instruction under it.
+static bool BackendDetach(Backend *backend) {
+  // Nothing runs while events are drained and single steps are cleared
+  for (const auto &it : backend->threads) {
+    SuspendThread(it.second);
+  }
+
+  // Event thread waits while the target runs. A break in a thread that the
+  // system starts in the process ends the wait, that thread exits on it's
+  // own once nothing debugs the process.
+  {
+    std::unique_lock<std::mutex> lock(backend->event_mutex);
+    if (backend->is_wait_requested || backend->is_event_waiting) {
+      if (!DebugBreakProcess(backend->process)) {
+        LOG_IMGUI(BackendDetach,
+                  "DebugBreakProcess failed, error = ", GetLastError())
+        lock.unlock();
+        for (const auto &it : backend->threads) {
+          ResumeThread(it.second);
+        }
+        return false;
+      }
+      backend->event_condition.wait(
+          lock, [&]() { return backend->is_event_ready; });
+    }
+  }
+  BackendCallOnEventThread(backend,
+                           [backend]() { BackendDrainEvents(backend); });
+
+  for (const auto &it : backend->threads) {
+    CONTEXT context = {};
+    context.ContextFlags = CONTEXT_CONTROL;
+    if (GetThreadContext(it.second, &context) &&
+        (context.EFlags & BACKEND_TRAP_FLAG)) {
+      context.EFlags &= ~BACKEND_TRAP_FLAG;
+      SetThreadContext(it.second, &context);
+    }
+  }
+
+  // Held and suspended threads run on with the rest
+  for (HANDLE thread : backend->held_threads) {
+    ResumeThread(thread);
+  }
+  backend->held_threads.clear();
+  for (DWORD thread_id : backend->suspended_threads) {
+    HANDLE thread = BackendGetThreadHandle(backend, thread_id);
+    if (thread) {
+      ResumeThread(thread);
+    }
+  }
+  backend->suspended_threads.clear();
+
+  bool result = true;
+  BackendCallOnEventThread(backend, [&]() {
+    if (!DebugActiveProcessStop(backend->process_id)) {
+      LOG_IMGUI(BackendDetach,
+                "DebugActiveProcessStop failed, error = ", GetLastError())
+      result = false;
+    }
+  });
+  BackendStopEventThread(backend);
+
+  for (const auto &it : backend->threads) {
+    ResumeThread(it.second);
+  }
+  backend->threads.clear();
+
+  return result;
+}
\ No newline at end of file
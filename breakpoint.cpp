@@ -1,54 +1,307 @@
-// TODO: Mb redesign function return error codes
-static Breakpoint CreateBreakpoint(HANDLE process, DWORD64 address,
-                                   BreakpointType type) {
-  Breakpoint result = {};
+static inline void BreakpointsQueueInsert(Breakpoints *breakpoints,
+                                          DWORD64 address,
+                                          BreakpointType type) {
+  breakpoints->patches.emplace_back(BreakpointPatch{address, type, true});
+}
+
+static inline void BreakpointsQueueRemove(Breakpoints *breakpoints,
+                                          DWORD64 address) {
+  breakpoints->patches.emplace_back(
+      BreakpointPatch{address, BreakpointType::USER, false});
+}
+
+static int BreakpointsFindFreeSlot(const Breakpoints *breakpoints) {
+  for (int i = 0; i < BACKEND_DEBUG_REGISTER_COUNT; ++i) {
+    if (!breakpoints->hardware_slots[i].is_used) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+// Writes the slots into the debug registers, if any of them changed
+static bool BreakpointsWriteDebugRegisters(Breakpoints *breakpoints,
+                                           Backend *backend) {
+  if (!breakpoints->is_hardware_changed) {
+    return true;
+  }
+  breakpoints->is_hardware_changed = false;
+
+  DWORD64 addresses[BACKEND_DEBUG_REGISTER_COUNT] = {};
+  DWORD64 control = 0;
+  for (int i = 0; i < BACKEND_DEBUG_REGISTER_COUNT; ++i) {
+    const HardwareSlot &slot = breakpoints->hardware_slots[i];
+    if (!slot.is_used) {
+      continue;
+    }
+
+    // Length bits are 00 - 1 byte, 01 - 2, 11 - 4, 10 - 8
+    static const BYTE lengths[9] = {0, 0, 1, 0, 3, 0, 0, 0, 2};
+
+    addresses[i] = slot.address;
+    control |= BACKEND_DEBUG_ENABLE(i) |
+               BACKEND_DEBUG_ACCESS(i, slot.access) |
+               BACKEND_DEBUG_LENGTH(i, lengths[slot.size]);
+  }
+
+  return BackendSetDebugRegisters(backend, addresses, control);
+}
+
+// Puts a queued patch of a user breakpoint into a debug register slot, or
+// frees the slot of a removed one. Returns false, if the patch is for memory.
+static bool BreakpointsApplyHardware(Breakpoints *breakpoints,
+                                     MemoryCache *memory_cache,
+                                     const BreakpointPatch &patch) {
+  auto &data = breakpoints->data;
+  auto it = data.find(patch.address);
+
+  if (!patch.is_insert) {
+    if (it == data.end() || it->second.hardware_slot < 0) {
+      return false;
+    }
+
+    breakpoints->hardware_slots[it->second.hardware_slot].is_used = false;
+    breakpoints->is_hardware_changed = true;
+    data.erase(it);
+    return true;
+  }
+
+  // Temporary breakpoints are gone after their first hit anyway
+  if (it != data.end() || patch.type != BreakpointType::USER) {
+    return false;
+  }
+
+  const int slot = BreakpointsFindFreeSlot(breakpoints);
+  if (slot < 0) {
+    return false;
+  }
+
+  // Kept for the code that overlays original bytes, nothing is patched
+  Breakpoint breakpoint = {};
+  if (!MemoryCacheRead(memory_cache, patch.address,
+                       &breakpoint.original_instruction, 1, NULL)) {
+    return false;
+  }
+  breakpoint.address = patch.address;
+  breakpoint.type = BreakpointType::USER;
+  breakpoint.hardware_slot = slot;
+  data.emplace(patch.address, breakpoint);
+
+  breakpoints->hardware_slots[slot] = {patch.address, BreakpointAccess::EXECUTE,
+                                       1, true};
+  breakpoints->is_hardware_changed = true;
+
+  return true;
+}
+
+// Patches queued entries that share a page, with one read, one write and one
+// instruction cache flush. "patches" are sorted with unique addresses.
+static bool BreakpointsApplyPage(Breakpoints *breakpoints,
+                                 MemoryCache *memory_cache,
+                                 const BreakpointPatch *patches,
+                                 size_t count) {
+  auto &data = breakpoints->data;
+
+  const DWORD64 first_address = patches[0].address;
+  const SIZE_T size = (SIZE_T)(patches[count - 1].address - first_address + 1);
+
+  BYTE original_instructions[MEMORY_CACHE_PAGE_SIZE];
+  if (!MemoryCacheRead(memory_cache, first_address, original_instructions,
+                       size, NULL)) {
+    LOG_IMGUI(ApplyBreakpoints, "Unable to read instructions at ", std::hex,
+              first_address)
+    return false;
+  }
+
+  BYTE instructions[MEMORY_CACHE_PAGE_SIZE];
+  memcpy(instructions, original_instructions, size);
 
-  BYTE instruction;
-  DWORD read_bytes;
-  if (!ReadProcessMemory(process, (void *)address, &instruction, 1,
-                         &read_bytes)) {
-    LOG_IMGUI(CreateBreakpoint,
-              "ReadProcessMemory failed, error = ", GetLastError())
-    return result;
+  bool is_changed = false;
+  for (size_t i = 0; i < count; ++i) {
+    const BreakpointPatch &patch = patches[i];
+    const SIZE_T offset = (SIZE_T)(patch.address - first_address);
+
+    auto it = data.find(patch.address);
+    if (patch.is_insert && it == data.end()) {
+      instructions[offset] = 0xcc;
+      is_changed = true;
+    } else if (!patch.is_insert && it != data.end()) {
+      instructions[offset] = it->second.original_instruction;
+      is_changed = true;
+    }
+  }
+
+  if (is_changed) {
+    if (!MemoryCacheWrite(memory_cache, first_address, instructions, size)) {
+      LOG_IMGUI(ApplyBreakpoints, "Unable to patch instructions at ",
+                std::hex, first_address)
+      return false;
+    }
+    BackendFlushInstructionCache(memory_cache->backend, first_address, size);
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    const BreakpointPatch &patch = patches[i];
+
+    auto it = data.find(patch.address);
+    if (!patch.is_insert) {
+      if (it != data.end()) {
+        data.erase(it);
+      }
+    } else if (it == data.end()) {
+      Breakpoint breakpoint = {};
+      breakpoint.address = patch.address;
+      breakpoint.original_instruction =
+          original_instructions[patch.address - first_address];
+      breakpoint.type = patch.type;
+      breakpoint.hardware_slot = -1;
+      data.emplace(patch.address, breakpoint);
+    } else if (patch.type == BreakpointType::USER) {
+      // Invisible breakpoint is already in place, just make it visible
+      it->second.type = BreakpointType::USER;
+    }
   }
 
-  BYTE original_instruction = instruction;
+  return true;
+}
 
-  instruction = 0xcc;
-  WriteProcessMemory(process, (void *)address, &instruction, 1, &read_bytes);
-  FlushInstructionCache(process, (void *)address, 1);
+// Writes all queued inserts and removes to the target, a page at a time, and
+// debug registers once. Inserting an existing breakpoint or removing a missing
+// one does nothing.
+static bool ApplyBreakpoints(Breakpoints *breakpoints,
+                             MemoryCache *memory_cache) {
+  auto &patches = breakpoints->patches;
 
-  result.original_instruction = original_instruction;
-  result.address = address;
-  result.type = type;
+  // Stable, so the last queued patch for an address wins
+  std::stable_sort(patches.begin(), patches.end(),
+                   [](const BreakpointPatch &a, const BreakpointPatch &b) {
+                     return a.address < b.address;
+                   });
+
+  std::vector<BreakpointPatch> unique_patches;
+  unique_patches.reserve(patches.size());
+  for (size_t i = 0; i < patches.size(); ++i) {
+    if (i + 1 < patches.size() &&
+        patches[i + 1].address == patches[i].address) {
+      continue;
+    }
+    if (BreakpointsApplyHardware(breakpoints, memory_cache, patches[i])) {
+      continue;
+    }
+    unique_patches.push_back(patches[i]);
+  }
+  patches.clear();
+
+  bool result = true;
+  for (size_t first = 0; first < unique_patches.size();) {
+    const DWORD64 page = unique_patches[first].address &
+                         ~(DWORD64)(MEMORY_CACHE_PAGE_SIZE - 1);
+
+    size_t last = first + 1;
+    while (last < unique_patches.size() &&
+           (unique_patches[last].address &
+            ~(DWORD64)(MEMORY_CACHE_PAGE_SIZE - 1)) == page) {
+      ++last;
+    }
+
+    if (!BreakpointsApplyPage(breakpoints, memory_cache,
+                              unique_patches.data() + first, last - first)) {
+      result = false;
+    }
+
+    first = last;
+  }
+
+  if (!BreakpointsWriteDebugRegisters(breakpoints, memory_cache->backend)) {
+    result = false;
+  }
 
   return result;
 }
 
-static inline bool BreakpointRestore(HANDLE process,
+// Turns a debug register breakpoint into an int3 one and frees it's slot
+static bool BreakpointsMoveToMemory(Breakpoints *breakpoints,
+                                    MemoryCache *memory_cache,
+                                    Breakpoint *breakpoint) {
+  if (breakpoint->hardware_slot < 0) {
+    return true;
+  }
+
+  if (!MemoryCacheWrite(memory_cache, breakpoint->address, "\xcc", 1)) {
+    LOG_IMGUI(BreakpointsMoveToMemory, "Unable to patch instruction at ",
+              std::hex, breakpoint->address)
+    return false;
+  }
+  BackendFlushInstructionCache(memory_cache->backend, breakpoint->address, 1);
+
+  breakpoints->hardware_slots[breakpoint->hardware_slot].is_used = false;
+  breakpoints->is_hardware_changed = true;
+  breakpoint->hardware_slot = -1;
+
+  return BreakpointsWriteDebugRegisters(breakpoints, memory_cache->backend);
+}
+
+// Data breakpoint in a free debug register slot. "size" is 1, 2, 4 or 8 (64
+// bit targets only), the address has to be aligned to it.
+static bool BreakpointsAddWatchpoint(Breakpoints *breakpoints, Backend *backend,
+                                     DWORD64 address, BYTE size,
+                                     BreakpointAccess access) {
+  if ((size != 1 && size != 2 && size != 4 && size != 8) ||
+      (size == 8 && !backend->is_64bit) || (address & (size - 1)) ||
+      access == BreakpointAccess::EXECUTE) {
+    LOG_IMGUI(BreakpointsAddWatchpoint, "Unsupported watchpoint of ",
+              (int)size, " bytes at ", std::hex, address)
+    return false;
+  }
+
+  const int slot = BreakpointsFindFreeSlot(breakpoints);
+  if (slot < 0) {
+    LOG_IMGUI(BreakpointsAddWatchpoint, "All ", BACKEND_DEBUG_REGISTER_COUNT,
+              " debug registers are in use")
+    return false;
+  }
+
+  breakpoints->hardware_slots[slot] = {address, access, size, true};
+  breakpoints->is_hardware_changed = true;
+
+  return BreakpointsWriteDebugRegisters(breakpoints, backend);
+}
+
+static bool BreakpointsRemoveWatchpoint(Breakpoints *breakpoints,
+                                        Backend *backend, DWORD64 address) {
+  for (auto &slot : breakpoints->hardware_slots) {
+    if (slot.is_used && slot.access != BreakpointAccess::EXECUTE &&
+        slot.address == address) {
+      slot.is_used = false;
+      breakpoints->is_hardware_changed = true;
+    }
+  }
+
+  return BreakpointsWriteDebugRegisters(breakpoints, backend);
+}
+
+static inline bool BreakpointRestore(MemoryCache *memory_cache,
                                      const Breakpoint &breakpoint) {
-  DWORD read_bytes;
-  if (!WriteProcessMemory(process, (void *)breakpoint.address,
-                          &breakpoint.original_instruction, 1, &read_bytes)) {
-    LOG_IMGUI(BreakpointRestore,
-              "WriteProcessMemory failed, error = ", GetLastError())
+  if (!MemoryCacheWrite(memory_cache, breakpoint.address,
+                        &breakpoint.original_instruction, 1)) {
+    LOG_IMGUI(BreakpointRestore, "Unable to restore instruction at ",
+              std::hex, breakpoint.address)
     return false;
   }
-  FlushInstructionCache(process, (void *)breakpoint.address, 1);
+  BackendFlushInstructionCache(memory_cache->backend, breakpoint.address, 1);
 
   return true;
 }
 
-static inline bool BreakpointRestore(HANDLE process, DWORD64 address,
-                                     BYTE instruction) {
-  DWORD read_bytes;
-  if (!WriteProcessMemory(process, (void *)address, &instruction, 1,
-                          &read_bytes)) {
-    LOG_IMGUI(BreakpointRestore,
-              "WriteProcessMemory failed, error = ", GetLastError())
+static inline bool BreakpointRestore(MemoryCache *memory_cache,
+                                     DWORD64 address, BYTE instruction) {
+  if (!MemoryCacheWrite(memory_cache, address, &instruction, 1)) {
+    LOG_IMGUI(BreakpointRestore, "Unable to restore instruction at ",
+              std::hex, address)
     return false;
   }
-  FlushInstructionCache(process, (void *)address, 1);
+  BackendFlushInstructionCache(memory_cache->backend, address, 1);
 
   return true;
 }
\ No newline at end of file
@@ -1,18 +1,32 @@
 enum class BreakpointType {
   USER,
-  INVISIBLE
+  TEMPORARY // Target of a step, removed once hit
+};
+
+// What a debug register slot triggers on, values are DR7 access bits
+enum class BreakpointAccess { EXECUTE = 0, WRITE = 1, READ_WRITE = 3 };
+
+struct HardwareSlot {
+  DWORD64 address;
+  BreakpointAccess access;
+  BYTE size; // 1, 2, 4 or 8, execute slots are 1
+  bool is_used;
 };
 
 struct Breakpoint {
   DWORD64 address;
   BYTE original_instruction;
   BreakpointType type;
+  int hardware_slot; // -1 - int3 in memory
+  DWORD64 hit_count; // Of user breakpoints, conditions are evaluated on each
 
   Breakpoint &operator=(const Breakpoint &other) {
     if (this != &other) {
       address = other.address;
       original_instruction = other.original_instruction;
       type = other.type;
+      hardware_slot = other.hardware_slot;
+      hit_count = other.hit_count;
     } else {
       assert(0);
     }
@@ -21,6 +35,21 @@ struct Breakpoint {
   }
 };
 
+// Queued insert or remove, written to the target by ApplyBreakpoints
+struct BreakpointPatch {
+  DWORD64 address;
+  BreakpointType type; // Insert only
+  bool is_insert;
+};
+
 struct Breakpoints {
   std::unordered_map<DWORD64, Breakpoint> data;
+  std::vector<std::string> pending_functions; // Until their module is indexed
+  std::vector<BreakpointPatch> patches;
+  std::unordered_map<DWORD64, Condition> conditions; // Of user breakpoints
+
+  // Taken by user breakpoints first, int3 is used when they run out.
+  // Watchpoints exist only here.
+  HardwareSlot hardware_slots[BACKEND_DEBUG_REGISTER_COUNT];
+  bool is_hardware_changed; // Since debug registers were written
 };
\ No newline at end of file
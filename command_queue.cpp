@@ -0,0 +1,54 @@
+static void DebuggerCommandQueuePush(DebuggerCommandQueue *command_queue,
+                                     DebuggerCommand command) {
+  {
+    std::lock_guard<std::mutex> lock(command_queue->mutex);
+    command_queue->commands.emplace_back(std::move(command));
+  }
+
+  command_queue->condition.notify_one();
+}
+
+// Blocks until there is a command
+static void DebuggerCommandQueuePop(DebuggerCommandQueue *command_queue,
+                                    DebuggerCommand *command) {
+  std::unique_lock<std::mutex> lock(command_queue->mutex);
+  command_queue->condition.wait(
+      lock, [&]() { return !command_queue->commands.empty(); });
+
+  *command = std::move(command_queue->commands.front());
+  command_queue->commands.pop_front();
+}
+
+static bool DebuggerCommandQueueTryPop(DebuggerCommandQueue *command_queue,
+                                       DebuggerCommand *command) {
+  std::lock_guard<std::mutex> lock(command_queue->mutex);
+  if (command_queue->commands.empty()) {
+    return false;
+  }
+
+  *command = std::move(command_queue->commands.front());
+  command_queue->commands.pop_front();
+
+  return true;
+}
+
+// Wakes DebuggerCommandQueueWait without a command, from any thread
+static void DebuggerCommandQueueWake(DebuggerCommandQueue *command_queue) {
+  {
+    std::lock_guard<std::mutex> lock(command_queue->mutex);
+    command_queue->is_woken = true;
+  }
+
+  command_queue->condition.notify_one();
+}
+
+// Blocks until there is a command or something woke the queue since the
+// last wait. Commands are left in the queue.
+static void DebuggerCommandQueueWait(DebuggerCommandQueue *command_queue) {
+  std::unique_lock<std::mutex> lock(command_queue->mutex);
+  command_queue->condition.wait(lock, [&]() {
+    return command_queue->is_woken || !command_queue->commands.empty();
+  });
+
+  command_queue->is_woken = false;
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+enum class DebuggerCommandType {
+  STEP_OVER,
+  STEP_IN,
+  STEP_OUT,
+  CONTINUE,
+  SET_BREAKPOINT,
+  REMOVE_BREAKPOINT,
+  SET_CONDITION,
+  ENABLE_AGENT,
+  SET_WATCHPOINT,
+  REMOVE_WATCHPOINT,
+  READ_MEMORY,
+  PRINT_CALLSTACK,
+  SELECT_THREAD,
+  SELECT_FRAME,
+  SET_NON_STOP,
+  DETACH,
+  QUIT
+};
+
+struct DebuggerCommand {
+  DebuggerCommandType type;
+  DWORD64 address; // Breakpoints, watchpoints, READ_MEMORY
+  size_t size;     // READ_MEMORY, SET_WATCHPOINT
+  BreakpointAccess access; // SET_WATCHPOINT
+  std::string text;        // SET_CONDITION, empty - removes it
+  bool is_enabled;         // ENABLE_AGENT, SET_NON_STOP
+  DWORD thread_id; // SELECT_THREAD, steps and CONTINUE in non-stop mode,
+                   // 0 - the selected one
+  DWORD frame_index; // SELECT_FRAME, into the selected thread's callstack
+
+  // READ_MEMORY, called on the debugger thread, empty on failure
+  std::function<void(const std::vector<BYTE> &)> OnMemoryRead;
+};
+
+// Commands from the UI thread to the debugger thread. While the target runs
+// the debugger thread is woken by it's events and indexed modules too.
+struct DebuggerCommandQueue {
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::deque<DebuggerCommand> commands;
+  bool is_woken; // See DebuggerCommandQueueWake
+};
\ No newline at end of file
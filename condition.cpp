@@ -0,0 +1,516 @@
+// Names are kept from the x86 days, they mean the full 64 bit registers.
+// Indices are compiled into conditions, new ones go to the end.
+static const char *Global_ConditionRegisterNames[] = {
+    "edi", "esi", "ebx",   "edx",    "ecx", "eax", "ebp", "eip",
+    "segcs", "eflags", "esp", "segss", "r8", "r9", "r10", "r11",
+    "r12", "r13", "r14", "r15"};
+static DWORD64 Registers::*const Global_ConditionRegisters[] = {
+    &Registers::Rdi,   &Registers::Rsi,    &Registers::Rbx, &Registers::Rdx,
+    &Registers::Rcx,   &Registers::Rax,    &Registers::Rbp, &Registers::Rip,
+    &Registers::SegCs, &Registers::EFlags, &Registers::Rsp, &Registers::SegSs,
+    &Registers::R8,    &Registers::R9,     &Registers::R10, &Registers::R11,
+    &Registers::R12,   &Registers::R13,    &Registers::R14, &Registers::R15};
+
+// CodeView numbers of the registers locals are relative to, SYMFLAG_REGREL
+// symbols have them in SYMBOL_INFO::Register. Some x86 ones are shared with
+// x64 code, that has the 64 bit registers in the CV_AMD64_* range.
+static const struct {
+  ULONG cv_register;
+  const char *name;
+} Global_ConditionCvRegisters[] = {
+    {17, "eax"},  {18, "ecx"},  {19, "edx"},  {20, "ebx"}, // CV_REG_EAX
+    {21, "esp"},  {22, "ebp"},  {23, "esi"},  {24, "edi"},
+    {328, "eax"}, {329, "ebx"}, {330, "ecx"}, {331, "edx"}, // CV_AMD64_RAX
+    {332, "esi"}, {333, "edi"}, {334, "ebp"}, {335, "esp"},
+    {336, "r8"},  {337, "r9"},  {338, "r10"}, {339, "r11"},
+    {340, "r12"}, {341, "r13"}, {342, "r14"}, {343, "r15"}};
+
+struct ConditionBinary {
+  const char *text;
+  int precedence; // Higher binds tighter
+  ConditionOp op;
+};
+
+// Longer operators first, so that "<<" isn't taken for "<"
+static const ConditionBinary Global_ConditionBinaries[] = {
+    {"||", 1, ConditionOp::JUMP_IF_NOT_ZERO},
+    {"&&", 2, ConditionOp::JUMP_IF_ZERO},
+    {"==", 6, ConditionOp::EQUAL},
+    {"!=", 6, ConditionOp::NOT_EQUAL},
+    {"<=", 7, ConditionOp::LESS_EQUAL},
+    {">=", 7, ConditionOp::GREATER_EQUAL},
+    {"<<", 8, ConditionOp::SHIFT_LEFT},
+    {">>", 8, ConditionOp::SHIFT_RIGHT},
+    {"|", 3, ConditionOp::OR},
+    {"^", 4, ConditionOp::XOR},
+    {"&", 5, ConditionOp::AND},
+    {"<", 7, ConditionOp::LESS},
+    {">", 7, ConditionOp::GREATER},
+    {"+", 9, ConditionOp::ADD},
+    {"-", 9, ConditionOp::SUBTRACT},
+    {"*", 10, ConditionOp::MULTIPLY},
+    {"/", 10, ConditionOp::DIVIDE},
+    {"%", 10, ConditionOp::REMAINDER}};
+
+struct ConditionParser {
+  const std::string *text;
+  size_t position;
+  const ConditionResolve *resolve;
+  std::vector<BYTE> *code;
+  int depth; // Of the evaluation stack at the current point of the code
+  bool is_frame_relative;
+  std::string error;
+};
+
+// Register by it's name, case insensitive. -1 if there is none.
+static int ConditionFindRegister(const std::string &name) {
+  const int count = (int)(sizeof(Global_ConditionRegisterNames) /
+                          sizeof(Global_ConditionRegisterNames[0]));
+  for (int i = 0; i < count; ++i) {
+    const char *register_name = Global_ConditionRegisterNames[i];
+    if (name.size() == strlen(register_name) &&
+        std::equal(name.begin(), name.end(), register_name,
+                   [](char a, char b) { return tolower(a) == b; })) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+// Register of a CodeView register number, -1 if conditions don't have it
+static int ConditionFindCvRegister(ULONG cv_register) {
+  for (const auto &it : Global_ConditionCvRegisters) {
+    if (it.cv_register == cv_register) {
+      return ConditionFindRegister(it.name);
+    }
+  }
+
+  return -1;
+}
+
+static bool ConditionError(ConditionParser *parser, const char *message) {
+  if (parser->error.empty()) {
+    parser->error = std::string(message) + " at " +
+                    std::to_string(parser->position + 1);
+  }
+
+  return false;
+}
+
+static void ConditionSkipSpaces(ConditionParser *parser) {
+  const std::string &text = *parser->text;
+  while (parser->position < text.size() && isspace(text[parser->position])) {
+    ++parser->position;
+  }
+}
+
+// Skips the token, if the text continues with it
+static bool ConditionAccept(ConditionParser *parser, const char *token) {
+  ConditionSkipSpaces(parser);
+
+  const size_t length = strlen(token);
+  if (parser->text->compare(parser->position, length, token) != 0) {
+    return false;
+  }
+
+  parser->position += length;
+  return true;
+}
+
+// Stack effect of the op, pushes are checked against CONDITION_MAX_STACK
+static bool ConditionEmit(ConditionParser *parser, ConditionOp op,
+                          int stack_change) {
+  parser->depth += stack_change;
+  if (parser->depth > CONDITION_MAX_STACK) {
+    return ConditionError(parser, "Expression is too deep");
+  }
+
+  parser->code->push_back((BYTE)op);
+  return true;
+}
+
+static bool ConditionEmitConstant(ConditionParser *parser, DWORD64 value) {
+  if (!ConditionEmit(parser, ConditionOp::PUSH_CONSTANT, 1)) {
+    return false;
+  }
+
+  BYTE bytes[sizeof(value)];
+  memcpy(bytes, &value, sizeof(value));
+  parser->code->insert(parser->code->end(), bytes, bytes + sizeof(bytes));
+
+  return true;
+}
+
+static bool ConditionEmitRegister(ConditionParser *parser, int index) {
+  if (!ConditionEmit(parser, ConditionOp::PUSH_REGISTER, 1)) {
+    return false;
+  }
+
+  parser->code->push_back((BYTE)index);
+  return true;
+}
+
+static bool ConditionEmitLoad(ConditionParser *parser, BYTE size,
+                              bool is_signed) {
+  if (!ConditionEmit(parser, is_signed ? ConditionOp::LOAD_SIGNED
+                                       : ConditionOp::LOAD,
+                     0)) {
+    return false;
+  }
+
+  parser->code->push_back(size);
+  return true;
+}
+
+static bool ConditionParseExpression(ConditionParser *parser,
+                                     int min_precedence);
+
+static bool ConditionParseName(ConditionParser *parser,
+                               const std::string &name) {
+  static const char *size_names[] = {"byte", "word", "dword", "qword"};
+  for (int i = 0; i < 4; ++i) {
+    if (name != size_names[i]) {
+      continue;
+    }
+
+    if (!ConditionAccept(parser, "[")) {
+      return ConditionError(parser, "Expected '['");
+    }
+    if (!ConditionParseExpression(parser, 1)) {
+      return false;
+    }
+    if (!ConditionAccept(parser, "]")) {
+      return ConditionError(parser, "Expected ']'");
+    }
+
+    return ConditionEmitLoad(parser, (BYTE)(1 << i), false);
+  }
+
+  if (name == "$hits") {
+    return ConditionEmit(parser, ConditionOp::PUSH_HITS, 1);
+  }
+
+  const int register_index = ConditionFindRegister(name);
+  if (register_index >= 0) {
+    return ConditionEmitRegister(parser, register_index);
+  }
+
+  ConditionVariable variable = {};
+  if (!*parser->resolve || !(*parser->resolve)(name, &variable)) {
+    return ConditionError(parser, ("Unknown name '" + name + "'").c_str());
+  }
+
+  if (variable.register_index == CONDITION_REGISTER_FRAME) {
+    parser->is_frame_relative = true;
+    if (!ConditionEmit(parser, ConditionOp::PUSH_FRAME, 1) ||
+        !ConditionEmitConstant(parser, variable.offset) ||
+        !ConditionEmit(parser, ConditionOp::ADD, -1)) {
+      return false;
+    }
+  } else if (variable.register_index >= 0) {
+    if (!ConditionEmitRegister(parser, variable.register_index) ||
+        !ConditionEmitConstant(parser, variable.offset) ||
+        !ConditionEmit(parser, ConditionOp::ADD, -1)) {
+      return false;
+    }
+  } else if (!ConditionEmitConstant(parser, variable.offset)) {
+    return false;
+  }
+
+  return ConditionEmitLoad(parser, variable.size, variable.is_signed);
+}
+
+static bool ConditionParsePrimary(ConditionParser *parser) {
+  const std::string &text = *parser->text;
+
+  ConditionSkipSpaces(parser);
+  if (parser->position == text.size()) {
+    return ConditionError(parser, "Unexpected end");
+  }
+
+  if (ConditionAccept(parser, "(")) {
+    if (!ConditionParseExpression(parser, 1)) {
+      return false;
+    }
+    if (!ConditionAccept(parser, ")")) {
+      return ConditionError(parser, "Expected ')'");
+    }
+    return true;
+  }
+
+  const char c = text[parser->position];
+  if (isdigit(c)) {
+    // Decimal or 0x hexadecimal, no octal
+    const bool is_hex =
+        text.compare(parser->position, 2, "0x") == 0 ||
+        text.compare(parser->position, 2, "0X") == 0;
+    const char *start = text.c_str() + parser->position;
+    char *end = NULL;
+    const DWORD64 value = strtoull(start, &end, is_hex ? 16 : 10);
+    if (isalnum(*end) || *end == '_') {
+      return ConditionError(parser, "Invalid number");
+    }
+
+    parser->position += end - start;
+    return ConditionEmitConstant(parser, value);
+  }
+
+  if (isalpha(c) || c == '_' || c == '$') {
+    size_t end = parser->position + 1;
+    while (end < text.size() && (isalnum(text[end]) || text[end] == '_')) {
+      ++end;
+    }
+
+    const std::string name =
+        text.substr(parser->position, end - parser->position);
+    parser->position = end;
+    return ConditionParseName(parser, name);
+  }
+
+  return ConditionError(parser, "Unexpected character");
+}
+
+static bool ConditionParseUnary(ConditionParser *parser) {
+  ConditionSkipSpaces(parser);
+
+  ConditionOp op;
+  if (ConditionAccept(parser, "-")) {
+    op = ConditionOp::NEGATE;
+  } else if (ConditionAccept(parser, "~")) {
+    op = ConditionOp::NOT;
+  } else if (ConditionAccept(parser, "!")) {
+    op = ConditionOp::LOGICAL_NOT;
+  } else {
+    return ConditionParsePrimary(parser);
+  }
+
+  return ConditionParseUnary(parser) && ConditionEmit(parser, op, 0);
+}
+
+// Precedence climbing, operators of the same precedence are left associative
+static bool ConditionParseExpression(ConditionParser *parser,
+                                     int min_precedence) {
+  if (!ConditionParseUnary(parser)) {
+    return false;
+  }
+
+  while (true) {
+    ConditionSkipSpaces(parser);
+
+    const ConditionBinary *binary = NULL;
+    for (const auto &it : Global_ConditionBinaries) {
+      if (parser->text->compare(parser->position, strlen(it.text), it.text) ==
+          0) {
+        binary = &it;
+        break;
+      }
+    }
+
+    if (!binary || binary->precedence < min_precedence) {
+      return true;
+    }
+    parser->position += strlen(binary->text);
+
+    if (binary->op != ConditionOp::JUMP_IF_ZERO &&
+        binary->op != ConditionOp::JUMP_IF_NOT_ZERO) {
+      if (!ConditionParseExpression(parser, binary->precedence + 1) ||
+          !ConditionEmit(parser, binary->op, -1)) {
+        return false;
+      }
+      continue;
+    }
+
+    // Right side is evaluated only if the left one doesn't decide
+    auto &code = *parser->code;
+    if (!ConditionEmit(parser, binary->op, -1)) {
+      return false;
+    }
+    const size_t offset_position = code.size();
+    code.resize(code.size() + sizeof(WORD));
+
+    if (!ConditionParseExpression(parser, binary->precedence + 1) ||
+        !ConditionEmit(parser, ConditionOp::BOOL, 0)) {
+      return false;
+    }
+
+    const size_t offset = code.size() - (offset_position + sizeof(WORD));
+    if (offset > 0xffff) {
+      return ConditionError(parser, "Expression is too long");
+    }
+    const WORD jump_offset = (WORD)offset;
+    memcpy(&code[offset_position], &jump_offset, sizeof(jump_offset));
+  }
+}
+
+// "resolve" finds variables that are not registers, it may be empty.
+// Returns false with a message in "error", if the text doesn't compile.
+static bool ConditionCompile(const std::string &text,
+                             const ConditionResolve &resolve,
+                             Condition *condition, std::string *error) {
+  ConditionParser parser = {};
+  parser.text = &text;
+  parser.resolve = &resolve;
+  parser.code = &condition->code;
+
+  condition->text = text;
+  condition->code.clear();
+  condition->is_frame_relative = false;
+
+  if (!ConditionParseExpression(&parser, 1)) {
+    *error = parser.error;
+    return false;
+  }
+
+  ConditionSkipSpaces(&parser);
+  if (parser.position != text.size()) {
+    ConditionError(&parser, "Unexpected character");
+    *error = parser.error;
+    return false;
+  }
+  condition->is_frame_relative = parser.is_frame_relative;
+
+  return true;
+}
+
+// False, if the condition can't be evaluated, like memory that isn't readable
+// or division by zero
+static bool ConditionEvaluate(const Condition &condition,
+                              const ConditionContext &context, bool *result) {
+  const BYTE *code = condition.code.data();
+  const size_t size = condition.code.size();
+
+  int64_t stack[CONDITION_MAX_STACK];
+  size_t top = 0; // Number of values on the stack
+
+  size_t i = 0;
+  while (i < size) {
+    const ConditionOp op = (ConditionOp)code[i++];
+
+    switch (op) {
+    case ConditionOp::PUSH_CONSTANT:
+      memcpy(&stack[top++], code + i, sizeof(int64_t));
+      i += sizeof(int64_t);
+      break;
+    case ConditionOp::PUSH_REGISTER:
+      stack[top++] =
+          (int64_t)(context.registers->*Global_ConditionRegisters[code[i++]]);
+      break;
+    case ConditionOp::PUSH_HITS:
+      stack[top++] = (int64_t)context.hit_count;
+      break;
+    case ConditionOp::PUSH_FRAME:
+      stack[top++] = (int64_t)context.frame_pointer;
+      break;
+    case ConditionOp::LOAD:
+    case ConditionOp::LOAD_SIGNED: {
+      const BYTE value_size = code[i++];
+
+      DWORD64 value = 0;
+      if (!MemoryCacheRead(context.memory_cache, (DWORD64)stack[top - 1],
+                           &value, value_size, NULL)) {
+        return false;
+      }
+
+      const int shift = 64 - value_size * 8;
+      stack[top - 1] = op == ConditionOp::LOAD_SIGNED
+                           ? (int64_t)(value << shift) >> shift
+                           : (int64_t)value;
+    } break;
+    case ConditionOp::NEGATE:
+      stack[top - 1] = (int64_t)(0 - (DWORD64)stack[top - 1]);
+      break;
+    case ConditionOp::NOT:
+      stack[top - 1] = ~stack[top - 1];
+      break;
+    case ConditionOp::LOGICAL_NOT:
+      stack[top - 1] = !stack[top - 1];
+      break;
+    case ConditionOp::BOOL:
+      stack[top - 1] = stack[top - 1] != 0;
+      break;
+    case ConditionOp::JUMP_IF_ZERO:
+    case ConditionOp::JUMP_IF_NOT_ZERO: {
+      WORD offset;
+      memcpy(&offset, code + i, sizeof(offset));
+      i += sizeof(offset);
+
+      const bool is_zero = stack[top - 1] == 0;
+      if (is_zero == (op == ConditionOp::JUMP_IF_ZERO)) {
+        stack[top - 1] = !is_zero;
+        i += offset;
+      } else {
+        --top;
+      }
+    } break;
+    default: {
+      const int64_t b = stack[--top];
+      int64_t &a = stack[top - 1];
+      const DWORD64 ua = (DWORD64)a;
+      const DWORD64 ub = (DWORD64)b;
+
+      switch (op) {
+      case ConditionOp::MULTIPLY:
+        a = (int64_t)(ua * ub);
+        break;
+      case ConditionOp::DIVIDE:
+      case ConditionOp::REMAINDER:
+        if (b == 0) {
+          return false;
+        }
+        if (b == -1) { // INT64_MIN / -1 overflows
+          a = op == ConditionOp::DIVIDE ? (int64_t)(0 - ua) : 0;
+        } else {
+          a = op == ConditionOp::DIVIDE ? a / b : a % b;
+        }
+        break;
+      case ConditionOp::ADD:
+        a = (int64_t)(ua + ub);
+        break;
+      case ConditionOp::SUBTRACT:
+        a = (int64_t)(ua - ub);
+        break;
+      case ConditionOp::SHIFT_LEFT:
+        a = (int64_t)(ua << (ub & 63));
+        break;
+      case ConditionOp::SHIFT_RIGHT:
+        a >>= (ub & 63);
+        break;
+      case ConditionOp::LESS:
+        a = a < b;
+        break;
+      case ConditionOp::LESS_EQUAL:
+        a = a <= b;
+        break;
+      case ConditionOp::GREATER:
+        a = a > b;
+        break;
+      case ConditionOp::GREATER_EQUAL:
+        a = a >= b;
+        break;
+      case ConditionOp::EQUAL:
+        a = a == b;
+        break;
+      case ConditionOp::NOT_EQUAL:
+        a = a != b;
+        break;
+      case ConditionOp::AND:
+        a &= b;
+        break;
+      case ConditionOp::XOR:
+        a ^= b;
+        break;
+      case ConditionOp::OR:
+        a |= b;
+        break;
+      default:
+        return false;
+      }
+    } break;
+    }
+  }
+
+  *result = top != 0 && stack[top - 1] != 0;
+
+  return true;
+}
\ No newline at end of file
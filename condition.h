@@ -0,0 +1,69 @@
+#define CONDITION_MAX_STACK 32 // Deeper expressions don't compile
+
+// Opcodes of the condition bytecode, immediates follow the opcode byte
+enum class ConditionOp : BYTE {
+  PUSH_CONSTANT, // 8 bytes value
+  PUSH_REGISTER, // 1 byte index into Global_ConditionRegisterNames
+  PUSH_HITS,
+  LOAD,        // 1 byte size, pops the address, zero extends
+  LOAD_SIGNED, // Same, sign extends
+  NEGATE,
+  NOT,
+  LOGICAL_NOT,
+  BOOL, // Non zero becomes 1
+  MULTIPLY,
+  DIVIDE,
+  REMAINDER,
+  ADD,
+  SUBTRACT,
+  SHIFT_LEFT,
+  SHIFT_RIGHT,
+  LESS,
+  LESS_EQUAL,
+  GREATER,
+  GREATER_EQUAL,
+  EQUAL,
+  NOT_EQUAL,
+  AND,
+  XOR,
+  OR,
+  // 2 bytes forward offset from the end of the instruction. Jumps keep the
+  // top, that is the result of && or ||, otherwise pop it.
+  JUMP_IF_ZERO,
+  JUMP_IF_NOT_ZERO,
+  PUSH_FRAME // Frame base of the innermost frame, not known in the target
+};
+
+// ConditionVariable::register_index of a variable relative to the frame base,
+// the same one the local variables window uses
+#define CONDITION_REGISTER_FRAME -2
+
+// Variable a condition refers to by name, resolved once at compile time.
+// Its value is read from "offset" plus the base register.
+struct ConditionVariable {
+  int register_index; // -1 - "offset" is an absolute address, or
+                      // CONDITION_REGISTER_FRAME
+  DWORD64 offset;
+  BYTE size; // 1, 2, 4 or 8
+  bool is_signed;
+};
+
+typedef std::function<bool(const std::string &, ConditionVariable *)>
+    ConditionResolve;
+
+// Breakpoint condition, compiled from C-like source text. Values are signed
+// 64 bit, memory is read with byte[], word[], dword[] and qword[], $hits is
+// the hit count of the breakpoint.
+struct Condition {
+  std::string text;
+  std::vector<BYTE> code;
+  bool is_frame_relative; // Has PUSH_FRAME, the stack has to be walked
+};
+
+// What a condition is evaluated against
+struct ConditionContext {
+  const Registers *registers;
+  MemoryCache *memory_cache;
+  DWORD64 hit_count;
+  DWORD64 frame_pointer; // Condition::is_frame_relative only
+};
\ No newline at end of file
@@ -1,99 +1,107 @@
-static Debugger CreateDebugger(Registers *registers,
-                               LocalVariables *local_variables, Source *source,
-                               Breakpoints *breakpoints,
-                               const std::wstring &process_name,
-                               const std::wstring &main_function_name,
-                               HANDLE continue_event) {
-  Debugger result = {};
-
-  STARTUPINFOW si = {};
-  PROCESS_INFORMATION pi = {};
-  if (!CreateProcessW(process_name.c_str(), NULL, NULL, NULL, FALSE,
-                      DEBUG_ONLY_THIS_PROCESS, NULL, NULL, &si, &pi)) {
-    LOG_IMGUI(CreateDebugger, "CreateProcesA failed, error = ", GetLastError())
-    assert(false);
-  }
-
-  if (!SymInitialize(pi.hProcess, NULL, false)) {
+// StackWalk64 has no user context for its read routine, there is only one
+// debugger anyway
+static MemoryCache *Global_StackWalkMemoryCache;
+
+inline BOOL CALLBACK DebuggerStackWalkReadMemory(HANDLE process,
+                                                 DWORD64 address, PVOID buffer,
+                                                 DWORD size,
+                                                 LPDWORD read_size) {
+  SIZE_T read_bytes = 0;
+  const bool result = MemoryCacheRead(Global_StackWalkMemoryCache, address,
+                                      buffer, size, &read_bytes);
+  *read_size = (DWORD)read_bytes;
+
+  return result;
+}
+
+// NULL, if the target can't be debugged. A launched one is killed once the
+// debugger exits then, an attached one is let go.
+static Debugger *CreateDebugger(Registers *registers,
+                                LocalVariables *local_variables,
+                                Source *source, Breakpoints *breakpoints,
+                                Snapshots *snapshots,
+                                const std::wstring &process_name,
+                                DWORD process_id,
+                                const std::wstring &main_function_name,
+                                DebuggerCommandQueue *command_queue) {
+  const auto launch_time = std::chrono::steady_clock::now();
+
+  // Running process is attached to, if it's given. The debugger thread
+  // blocks on the command queue while it runs, events wake it up.
+  auto backend = new Backend();
+  backend->OnEvent = [command_queue]() {
+    DebuggerCommandQueueWake(command_queue);
+  };
+  if (process_id ? !BackendAttach(backend, process_id)
+                 : !BackendLaunch(backend, process_name)) {
+    LOG_IMGUI(CreateDebugger, "Unable to start debugging the target")
+    return NULL;
+  }
+  if (!SymInitialize(backend->process, NULL, false)) {
     LOG_IMGUI(CreateDebugger, "SymInitialize failed, error = ", GetLastError())
-    assert(false);
+    return NULL;
   }
 
-  result.si = si;
-  result.pi = pi;
-  result.continue_event = continue_event;
-  result.registers = registers;
-  result.local_variables = local_variables;
-  result.source = source;
-  result.breakpoints = breakpoints;
-  result.main_function_name = main_function_name;
+  Debugger *result = new Debugger();
+  result->launch_time = launch_time;
+  result->backend = backend;
+  result->memory_cache = CreateMemoryCache(backend);
+  result->agent = new Agent();
+  result->stepper = CreateStepper(backend, result->memory_cache,
+                                  result->agent, breakpoints);
+  result->selected_thread_id = backend->thread_id;
+  result->command_queue = command_queue;
+  result->registers = registers;
+  result->local_variables = local_variables;
+  result->source = source;
+  result->breakpoints = breakpoints;
+  result->snapshots = snapshots;
+  result->main_function_name = main_function_name;
+  result->is_attached = process_id != 0;
+  result->is_start_reached = result->is_attached;
+  result->module_loader = CreateModuleLoader(backend->process, 0);
+  result->module_loader->OnLoaded = [command_queue]() {
+    DebuggerCommandQueueWake(command_queue);
+  };
+  result->symbolizer = CreateSymbolizer(backend->process);
+
+  source->line_table.store(new LineTable());
+  result->stepper->line_table = source->line_table.load();
+
+  Global_StackWalkMemoryCache = result->memory_cache;
 
   return result;
 }
 
-static inline void DebuggerSetState(Debugger *debugger, DebuggerState state) {
-  // There will be some logic later for sure
-  debugger->state = state;
-}
-
-struct EnumSymbolsCallbackData {
-  Debugger *debugger;
-  LocalVariables *local_variables;
-  ULONG64 frame_address;
-};
-
-inline std::string DebuggerGetValueFromSymbol(Debugger *debugger,
-                                              PSYMBOL_INFO symbol_info,
-                                              ULONG64 frame_address) {
-  const auto pi = debugger->pi;
+// Thread the UI shows, NULL if it runs or has exited
+static DebuggerThread *DebuggerGetSelectedThread(Debugger *debugger) {
+  auto it = debugger->stepper->threads.find(debugger->selected_thread_id);
+  if (it == debugger->stepper->threads.end() ||
+      !StepperIsThreadStopped(debugger->stepper, &it->second)) {
+    return NULL;
+  }
 
-  enum SymTagEnum tag = (enum SymTagEnum)0;
-  SymGetTypeInfo(pi.hProcess, symbol_info->ModBase, symbol_info->TypeIndex,
-                 TI_GET_SYMTAG, &tag);
-  switch (tag) {
-  case SymTagBaseType: {
-    BasicType type = (BasicType)0;
-    SymGetTypeInfo(pi.hProcess, symbol_info->ModBase, symbol_info->TypeIndex,
-                   TI_GET_BASETYPE, &type);
-    ULONG64 length = 0;
-    SymGetTypeInfo(pi.hProcess, symbol_info->ModBase, symbol_info->TypeIndex,
-                   TI_GET_LENGTH, &length);
-
-    // Load actual value
-    DWORD read_bytes;
-    switch (type) {
-    case btInt: {
-      int data;
-      if (ReadProcessMemory(pi.hProcess,
-                            (void *)(frame_address + symbol_info->Address),
-                            &data, length, &read_bytes)) {
-        return std::to_string(data);
-      }
-    }
+  return &it->second;
+}
 
-    break;
-    case btFloat: {
-      float data;
-      if (ReadProcessMemory(pi.hProcess,
-                            (void *)(frame_address + symbol_info->Address),
-                            &data, length, &read_bytes)) {
-        return std::to_string(data);
-      }
-    }
+// Debugger thread is the only one replacing it, so no epoch section is needed
+static inline const LineTable *DebuggerGetLineTable(Debugger *debugger) {
+  return debugger->source->line_table.load();
+}
 
-    break;
-    default:
-      return "Unsupported type";
-      break;
-    }
-  } break;
-  default:
-    return "Unsupported type";
-    break;
-  }
+// Local of the selected frame, values are read once all of them are known
+struct DebuggerLocalSymbol {
+  std::string name;
+  DWORD64 module_base;
+  ULONG type_index;
+  ULONG flags;
+  ULONG register_id; // CodeView one the SYMFLAG_REGREL ones are relative to
+  DWORD64 address;   // Offset for frame and register relative ones
+};
 
-  return "";
-}
+struct EnumSymbolsCallbackData {
+  std::vector<DebuggerLocalSymbol> symbols;
+};
 
 inline BOOL WINAPI EnumSymbolsCallback(PSYMBOL_INFO pSymInfo, ULONG SymbolSize,
                                        PVOID UserContext) {
@@ -105,597 +113,1314 @@ inline BOOL WINAPI EnumSymbolsCallback(PSYMBOL_INFO pSymInfo, ULONG SymbolSize,
 
   auto enum_symbols_callback_data =
       reinterpret_cast<EnumSymbolsCallbackData *>(UserContext);
-  auto &local_variables = enum_symbols_callback_data->local_variables->data;
-
-  std::string value =
-      DebuggerGetValueFromSymbol(enum_symbols_callback_data->debugger, pSymInfo,
-                                 enum_symbols_callback_data->frame_address);
 
-  local_variables.emplace_back(LocalVariable{pSymInfo->Name, value});
+  enum_symbols_callback_data->symbols.emplace_back(
+      DebuggerLocalSymbol{pSymInfo->Name, pSymInfo->ModBase,
+                          pSymInfo->TypeIndex, pSymInfo->Flags,
+                          pSymInfo->Register, pSymInfo->Address});
 
   return TRUE;
 }
 
-inline void DebuggerGetLocalVariables(Debugger *debugger) {
-  const auto &pi = debugger->pi;
-  auto &local_variables = debugger->local_variables;
-  auto context = debugger->original_context;
-
-  STACKFRAME64 stack = {};
-  stack.AddrPC.Offset = context.Eip;
-  stack.AddrPC.Mode = AddrModeFlat;
-  stack.AddrFrame.Offset = context.Ebp;
-  stack.AddrFrame.Mode = AddrModeFlat;
-  stack.AddrStack.Offset = context.Esp;
-  stack.AddrStack.Mode = AddrModeFlat;
-  if (!StackWalk64(IMAGE_FILE_MACHINE_I386, pi.hProcess, pi.hThread, &stack,
-                   &context, NULL, SymFunctionTableAccess64, SymGetModuleBase64,
-                   0)) {
-    return;
+// Types of the module, kept until another module is loaded at it's base
+static TypeModel *DebuggerGetTypeModel(Debugger *debugger,
+                                       DWORD64 module_base) {
+  auto &type_models = debugger->type_models;
+
+  auto it = type_models.find(module_base);
+  if (it == type_models.end()) {
+    TypeModel type_model = {};
+    type_model.module_base = module_base;
+    it = type_models.emplace(module_base, std::move(type_model)).first;
   }
 
-  // Function
-  PSYMBOL_INFO symbol_info =
-      (PSYMBOL_INFO) new char[sizeof(SYMBOL_INFO) + MAX_SYM_NAME];
-  symbol_info->MaxNameLen = MAX_SYM_NAME;
-  symbol_info->SizeOfStruct = sizeof(SYMBOL_INFO);
-  DWORD64 displacement;
-  SymFromAddr(pi.hProcess, stack.AddrPC.Offset, &displacement, symbol_info);
-  std::string name = symbol_info->Name;
+  return &it->second;
+}
 
-  IMAGEHLP_STACK_FRAME stack_frame = {};
-  stack_frame.InstructionOffset = stack.AddrPC.Offset;
+// Same instruction set as the debugger, WOW64 targets aren't supported
+#ifdef _WIN64
+#define DEBUGGER_MACHINE IMAGE_FILE_MACHINE_AMD64
+#else
+#define DEBUGGER_MACHINE IMAGE_FILE_MACHINE_I386
+#endif
+
+// First frame of a StackWalk64 walk over the thread's stack
+static void DebuggerBeginStackWalk(Debugger *debugger, DebuggerThread *thread,
+                                   CONTEXT *context, STACKFRAME64 *stack) {
+  const Registers &registers = StepperGetRegisters(debugger->stepper, thread);
+
+  *context = {};
+  RegistersWriteToContext(registers, context);
+
+  *stack = {};
+  stack->AddrPC.Offset = registers.Rip;
+  stack->AddrPC.Mode = AddrModeFlat;
+  stack->AddrFrame.Offset = registers.Rbp;
+  stack->AddrFrame.Mode = AddrModeFlat;
+  stack->AddrStack.Offset = registers.Rsp;
+  stack->AddrStack.Mode = AddrModeFlat;
+}
 
-  if (SymSetContext(pi.hProcess, &stack_frame, NULL) == FALSE &&
-      GetLastError() != ERROR_SUCCESS) {
-    return;
+// Frames of a stopped thread, walked once per stop and shared by all users.
+// The walk stops after "count" frames, a later call that needs more walks
+// again.
+static const std::vector<UnwindFrame> &
+DebuggerGetFrames(Debugger *debugger, DebuggerThread *thread, size_t count) {
+  auto backend = debugger->backend;
+  auto &frames = thread->frames;
+
+  const Registers &registers = StepperGetRegisters(debugger->stepper, thread);
+  if (frames.size() < thread->frames_max_count ||
+      (thread->frames_max_count && frames.size() >= count)) {
+    return frames;
   }
 
-  LocalVariablesReset(local_variables);
+  frames.clear();
+  thread->frames_max_count = count;
+  if (!registers.Rip) {
+    return frames;
+  }
 
-  EnumSymbolsCallbackData data{debugger, local_variables,
-                               stack.AddrFrame.Offset};
+  // Modules with CFI are unwound in-process, without a DbgHelp call per frame
+  const UnwindFde *fde;
+  if (registers.arch == RegistersArch::X86_64 &&
+      UnwindFindModule(debugger->stepper->modules, registers.Rip, &fde)) {
+    UnwindWalk(debugger->stepper->modules, debugger->memory_cache, registers,
+               count, &frames);
+    return frames;
+  }
 
-  if (SymEnumSymbols(pi.hProcess, 0, NULL, EnumSymbolsCallback, (PVOID)&data) ==
-      FALSE) {
-    return;
+  CONTEXT context;
+  STACKFRAME64 stack;
+  DebuggerBeginStackWalk(debugger, thread, &context, &stack);
+
+  std::lock_guard<std::mutex> lock(Global_DbgHelpMutex);
+  while (frames.size() < count) {
+    if (!StackWalk64(DEBUGGER_MACHINE, backend->process,
+                     BackendGetThreadHandle(backend, thread->id), &stack,
+                     &context, DebuggerStackWalkReadMemory,
+                     SymFunctionTableAccess64, SymGetModuleBase64, 0)) {
+      break;
+    }
+
+    frames.push_back(UnwindFrame{stack.AddrPC.Offset, stack.AddrStack.Offset,
+                                 0, stack.AddrFrame.Offset});
+    if (stack.AddrReturn.Offset == 0) {
+      break;
+    }
   }
+
+  return frames;
 }
 
-inline DWORD64 DebuggetGetFunctionReturnAddress(CONTEXT context,
-                                                PROCESS_INFORMATION &pi) {
-  STACKFRAME64 stack = {};
-  stack.AddrPC.Offset = context.Eip;
-  stack.AddrPC.Mode = AddrModeFlat;
-  stack.AddrFrame.Offset = context.Ebp;
-  stack.AddrFrame.Mode = AddrModeFlat;
-  stack.AddrStack.Offset = context.Esp;
-  stack.AddrStack.Mode = AddrModeFlat;
-  if (!StackWalk64(IMAGE_FILE_MACHINE_I386, pi.hProcess, pi.hThread, &stack,
-                   &context, NULL, SymFunctionTableAccess64, SymGetModuleBase64,
-                   0)) {
-    return NULL;
+// Address of the local in the frame, false if it's base register isn't
+// known there. Callers only have their stack and frame pointers unwound, the
+// innermost frame has every register.
+static bool DebuggerGetLocalAddress(Debugger *debugger,
+                                    DebuggerThread *thread,
+                                    DWORD frame_index,
+                                    const UnwindFrame &frame,
+                                    const DebuggerLocalSymbol &symbol,
+                                    DWORD64 *address) {
+  if (symbol.flags & SYMFLAG_FRAMEREL) {
+    *address = frame.frame_pointer + symbol.address;
+    return true;
+  }
+  if ((symbol.flags & SYMFLAG_REGREL) == 0) {
+    *address = symbol.address;
+    return true;
   }
 
-  return stack.AddrReturn.Offset;
-}
+  // Same registers as breakpoint conditions resolve the local to
+  const int register_index = ConditionFindCvRegister(symbol.register_id);
+  if (register_index < 0) {
+    return false;
+  }
 
-inline DWORD64 DebuggerGetTargetStartAddress(Debugger *debugger) {
-  auto pi = debugger->pi;
+  DWORD64 Registers::*const member = Global_ConditionRegisters[register_index];
+  DWORD64 base;
+  if (member == &Registers::Rsp) {
+    base = frame.sp;
+  } else if (member == &Registers::Rbp) {
+    base = frame.frame_pointer;
+  } else if (frame_index == 0) {
+    base = StepperGetRegisters(debugger->stepper, thread).*member;
+  } else {
+    return false;
+  }
 
-  DWORD64 result = 0;
+  *address = base + symbol.address;
+  return true;
+}
 
-  SYMBOL_INFOW *symbol;
-  symbol = (SYMBOL_INFOW *)new BYTE[sizeof(SYMBOL_INFOW) + MAX_SYM_NAME];
-  symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
-  symbol->MaxNameLen = MAX_SYM_NAME;
-  SymFromNameW(pi.hProcess, debugger->main_function_name.c_str(), symbol);
+inline void DebuggerGetLocalVariables(Debugger *debugger) {
+  auto backend = debugger->backend;
+  auto &local_variables = debugger->local_variables;
 
-  result = symbol->Address;
+  DebuggerThread *thread = DebuggerGetSelectedThread(debugger);
+  if (!thread) {
+    return;
+  }
 
-  delete[](BYTE *) symbol;
+  const DWORD frame_index = debugger->selected_frame_index;
+  const auto &frames = DebuggerGetFrames(debugger, thread, frame_index + 1);
+  if (frames.size() <= frame_index) {
+    return;
+  }
+  const UnwindFrame &frame = frames[frame_index];
 
-  return result;
-}
+  std::lock_guard<std::mutex> lock(Global_DbgHelpMutex);
 
-struct Function {
-  DWORD64 start_address;
-  DWORD64 end_address;
-};
+  // Callers are at a return address, the call before it is their scope
+  IMAGEHLP_STACK_FRAME stack_frame = {};
+  stack_frame.InstructionOffset = frame.pc - (frame_index ? 1 : 0);
 
-inline bool DebuggerGetFunctionInfo(Debugger *debugger, DWORD64 address,
-                                    Function *function) {
-  auto pi = debugger->pi;
-
-  PSYMBOL_INFO symbol_info =
-      (PSYMBOL_INFO) new char[sizeof(SYMBOL_INFO) + MAX_SYM_NAME];
-  symbol_info->MaxNameLen = MAX_SYM_NAME;
-  symbol_info->SizeOfStruct = sizeof(SYMBOL_INFO);
-  DWORD64 displacement;
-  if (!SymFromAddr(pi.hProcess, address, &displacement, symbol_info)) {
-    LOG_IMGUI(DebuggerGetFunctionInfo,
-              "SymFromAddr failed, error = ", GetLastError())
-    return false;
+  if (SymSetContext(backend->process, &stack_frame, NULL) == FALSE &&
+      GetLastError() != ERROR_SUCCESS) {
+    return;
   }
 
-  DWORD64 end_address_rough = symbol_info->Address + symbol_info->Size - 4;
-
-  // Locate the line, using this address
-  IMAGEHLP_LINE64 line = {};
-  line.SizeOfStruct = sizeof(line);
+  LocalVariablesReset(local_variables);
 
-  if (!SymGetLineFromAddr64(pi.hProcess, end_address_rough,
-                            (DWORD *)&displacement, &line)) {
-    LOG_IMGUI(DebuggerGetFunctionInfo,
-              "SymGetLineFromAddr64 failed, error = ", GetLastError())
-    return false;
+  EnumSymbolsCallbackData data;
+  if (SymEnumSymbols(backend->process, 0, NULL, EnumSymbolsCallback,
+                     (PVOID)&data) == FALSE) {
+    return;
+  }
+  const auto &symbols = data.symbols;
+
+  // Types and addresses first, they tell the part of the stack the locals
+  // are in. Frame and register relative ones are there, whatever register
+  // they are relative to.
+  std::vector<const TypeModel *> type_models(symbols.size());
+  std::vector<DWORD> types(symbols.size());
+  std::vector<DWORD64> addresses(symbols.size());
+  std::vector<bool> has_addresses(symbols.size());
+  DWORD64 frame_begin = ~0ull;
+  DWORD64 frame_end = 0;
+  for (size_t i = 0; i < symbols.size(); ++i) {
+    TypeModel *type_model =
+        DebuggerGetTypeModel(debugger, symbols[i].module_base);
+    type_models[i] = type_model;
+    types[i] =
+        TypeModelGet(backend->process, type_model, symbols[i].type_index);
+    has_addresses[i] = DebuggerGetLocalAddress(
+        debugger, thread, frame_index, frame, symbols[i], &addresses[i]);
+
+    const DWORD64 size = type_model->types[types[i]].size;
+    if ((symbols[i].flags & (SYMFLAG_REGREL | SYMFLAG_FRAMEREL)) &&
+        has_addresses[i] && size <= DEBUGGER_MAX_LOCALS_SIZE) {
+      frame_begin = std::min(frame_begin, addresses[i]);
+      frame_end = std::max(frame_end, addresses[i] + size);
+    }
   }
 
-  function->start_address = symbol_info->Address;
-  function->end_address = line.Address;
+  // One read for all of the frame's locals, instead of one per local
+  std::vector<BYTE> frame_data;
+  if (frame_begin < frame_end &&
+      frame_end - frame_begin <= DEBUGGER_MAX_LOCALS_SIZE) {
+    frame_data.resize((size_t)(frame_end - frame_begin));
+    if (!MemoryCacheRead(debugger->memory_cache, frame_begin,
+                         frame_data.data(), frame_data.size(), NULL)) {
+      frame_data.clear();
+    }
+  }
 
-  return true;
-}
+  std::vector<BYTE> buffer;
+  for (size_t i = 0; i < symbols.size(); ++i) {
+    const DebuggerLocalSymbol &symbol = symbols[i];
+    const DWORD64 size = type_models[i]->types[types[i]].size;
 
-inline void DebuggerPlaceFunctionInvisibleBreakpoints(Debugger *debugger,
-                                                      DWORD64 address) {
-  const auto &filename_to_lines = debugger->source->filename_to_lines;
-  const auto &address_to_line = debugger->source->address_to_line;
-  auto &breakpoints = debugger->breakpoints->data;
-  auto pi = debugger->pi;
+    if (symbol.flags & SYMFLAG_REGISTER) {
+      local_variables->data.push_back(
+          LocalVariable{symbol.name, "Kept in a register", 0, false});
+      continue;
+    }
+    if (!has_addresses[i]) {
+      local_variables->data.push_back(LocalVariable{
+          symbol.name, "Base register isn't known in this frame", 0, false});
+      continue;
+    }
 
-  Function function;
-  if (!DebuggerGetFunctionInfo(debugger, address, &function)) {
-    LOG_IMGUI(DebuggerPlaceFunctionInvisibleBreakpoints,
-              "Unable to get function info")
-    return;
-  }
-  auto begin = address_to_line.find(function.start_address);
-  auto end = address_to_line.find(function.end_address);
-  auto end_advanced = std::next(end, 1);
-  if (end != address_to_line.end()) {
-    for (auto it = begin; it != end_advanced; ++it) {
-      auto breakpoint_it = breakpoints.find(it->first);
-      if (breakpoint_it != breakpoints.end() ||
-          breakpoint_it->second.type == BreakpointType::INVISIBLE) {
-        continue;
+    // Rest of the frame, or the ones the frame read didn't cover are read
+    // on their own
+    const DWORD64 address = addresses[i];
+    const BYTE *value = NULL;
+    if (!frame_data.empty() && address >= frame_begin &&
+        address + size <= frame_end) {
+      value = frame_data.data() + (address - frame_begin);
+    } else if (size <= DEBUGGER_MAX_LOCALS_SIZE) {
+      buffer.resize(std::max<size_t>((size_t)size, 1));
+      if (!size || MemoryCacheRead(debugger->memory_cache, address,
+                                   buffer.data(), (SIZE_T)size, NULL)) {
+        value = buffer.data();
       }
-
-      breakpoints[it->first] =
-          CreateBreakpoint(pi.hProcess, it->first, BreakpointType::INVISIBLE);
     }
+
+    LocalVariablesAppend(local_variables, type_models[i], types[i],
+                         symbol.name, value, size, 0);
   }
 }
 
-inline BOOL WINAPI EnumSourceFilesCallback(PSOURCEFILE SourceFile,
-                                           PVOID UserContext) {
-  Debugger *debugger = (Debugger *)UserContext;
-  // LOG(INFO) << "ModBase: " << std::hex << SourceFile->ModBase << ", Filename:
-  // " << SourceFile->FileName << '\n';
-  debugger->source_files.push_back(SourceFile->FileName);
+inline DWORD64 DebuggetGetFunctionReturnAddress(Debugger *debugger,
+                                                DebuggerThread *thread) {
+  // Caller's pc is where the function returns to
+  const auto &frames = DebuggerGetFrames(debugger, thread, 2);
+  if (frames.size() < 2) {
+    return 0;
+  }
 
-  return TRUE;
+  return frames[1].pc;
 }
 
-struct EnumLinesCallbackData {
-  PROCESS_INFORMATION pi;
-  std::vector<Line> lines;
-};
+// Makes lines of the modules visible to the rest of the debugger. A batch
+// is published as one table, so a load of many modules merges once.
+inline void DebuggerPublishModules(Debugger *debugger,
+                                   const std::vector<Module> &modules) {
+  auto source = debugger->source;
+  const LineTable *published = DebuggerGetLineTable(debugger);
+
+  // Published tables are immutable. Lines are merged from the published one
+  // into a new one, only the file names are copied.
+  LineTable *line_table = new LineTable();
+  line_table->filenames = published->filenames;
+  line_table->filename_to_id = published->filename_to_id;
+
+  size_t line_count = 0;
+  for (const auto &module : modules) {
+    line_count += module.index.lines.size();
+  }
 
-inline BOOL WINAPI EnumLinesCallback(PSRCCODEINFO LineInfo, PVOID UserContext) {
-  auto data = reinterpret_cast<EnumLinesCallbackData *>(UserContext);
-  auto pi = data->pi;
-  auto &lines = data->lines;
-  // LOG_IMGUI_TO_FILE(INFO, "Module: ", LineInfo->FileName, " - Line: ",
-  // std::dec,
-  //                   LineInfo->LineNumber, " - Address: ", std::hex,
-  //                   LineInfo->Address)
-  // IMAGEHLP_LINE64 line = {};
-  // line.SizeOfStruct = sizeof(line);
+  std::vector<LineTableEntry> entries;
+  entries.reserve(line_count);
+  for (const auto &module : modules) {
+    const auto &module_index = module.index;
 
-  // DWORD displacement;
-  // if (SymGetLineFromAddr64(pi.hProcess, LineInfo->Address,
-  //                          &displacement, &line)) {
-  // }
+    std::vector<DWORD> file_ids(module_index.source_files.size());
+    for (size_t i = 0; i < file_ids.size(); ++i) {
+      file_ids[i] =
+          LineTableInternFile(line_table, module_index.source_files[i]);
+    }
 
-  if (LineInfo->LineNumber != 0xf00f00) { // What?
-    lines.emplace_back(Line{LineInfo->LineNumber, LineInfo->Address});
+    for (const auto &line : module_index.lines) {
+      entries.emplace_back(LineTableEntry{
+          module.base + line.rva, file_ids[line.file_index], line.line});
+    }
   }
 
-  return TRUE;
+  LineTableMerge(published, entries, line_table);
+
+  EpochPublish(&debugger->snapshots->epoch_domain, &source->line_table,
+               (const LineTable *)line_table);
+  debugger->stepper->line_table = line_table;
 }
 
-inline bool DebuggerLoadTargetModules(Debugger *debugger, HANDLE file,
-                                      HANDLE process, DWORD64 base_address) {
-  auto pi = debugger->pi;
+// Sets breakpoints on functions that weren't indexed yet, when they were
+// requested
+inline void DebuggerResolvePendingBreakpoints(Debugger *debugger,
+                                              const Module &module) {
+  auto breakpoints = debugger->breakpoints;
+  auto &pending_functions = breakpoints->pending_functions;
+
+  for (auto it = pending_functions.begin(); it != pending_functions.end();) {
+    const ModuleFunction *function =
+        ModuleFindFunction(&module.index, it->c_str());
+    if (!function) {
+      ++it;
+      continue;
+    }
 
-  TCHAR filename[MAX_PATH + 1];
-  if (!GetFileNameFromHandle(file, filename)) {
-    LOG_IMGUI(DebuggerProcessEvent,
-              "GetFileNameFromHandle failed, error = ", GetLastError())
-    return false;
+    const DWORD64 address = module.base + function->start_rva;
+    StepperRemoveAgentSitesOver(debugger->stepper, address);
+    BreakpointsQueueInsert(breakpoints, address, BreakpointType::USER);
+
+    LOG_IMGUI(DebuggerResolvePendingBreakpoints, "Breakpoint at ", *it,
+              " resolved to ", std::hex, address)
+
+    it = pending_functions.erase(it);
   }
 
-  DWORD64 base = SymLoadModuleEx(process, NULL, filename, NULL, base_address, 0,
-                                 NULL, NULL);
-  if (!base) {
-    LOG_IMGUI(DebuggerProcessEvent,
-              "SymLoadModuleEx failed, error = ", GetLastError())
-    return false;
+  if (!breakpoints->patches.empty()) {
+    ApplyBreakpoints(breakpoints, debugger->memory_cache);
   }
+}
 
-  IMAGEHLP_MODULE64 module_info;
-  module_info.SizeOfStruct = sizeof(module_info);
-  if (SymGetModuleInfo64(process, base, &module_info)) {
-    LOG_IMGUI(INFO, "Loaded DLL ", filename, ", at address", base_address,
-              module_info.SymType == SymPdb ? ", symbols loaded."
-                                            : "symbols not loaded")
-
-    if (module_info.SymType == SymPdb) {
-      SymEnumSourceFiles(pi.hProcess, base, "*.[ic][np][lp?]",
-                         EnumSourceFilesCallback, debugger);
-
-      for (int i = 0; i < debugger->source_files.size(); ++i) {
-        // Check if it can be opened
-        std::ifstream file(debugger->source_files[i]);
-        if (!file.is_open()) {
-          LOG_IMGUI(INFO, "Unable to open source file ",
-                    debugger->source_files[i]);
-          continue;
-        }
-
-        // Load lines info
-        EnumLinesCallbackData data = {debugger->pi};
-        SymEnumLines(pi.hProcess, base, NULL, debugger->source_files[i].c_str(),
-                     EnumLinesCallback, (PVOID)&data);
-
-        // Load lines text
-        std::string line;
-        std::vector<Line> lines_corrected;
-        for (size_t j = 0; std::getline(file, line); ++j) {
-          lines_corrected.emplace_back(Line{0, 0, std::move(line)});
-        }
-
-        // Correct debug lines with just lines with text
-        const auto &debug_lines = data.lines;
-        for (size_t j = 0; j < debug_lines.size(); ++j) {
-          DWORD index = debug_lines[j].index;
-          lines_corrected[index - 1].index = index;
-          lines_corrected[index - 1].address = debug_lines[j].address;
-        }
-
-        auto source = debugger->source;
-        const std::string filename =
-            GetFilenameFromPath(debugger->source_files[i]);
-
-        // Additional info
-        for (size_t j = 0; j < lines_corrected.size(); ++j) {
-          if (lines_corrected[j].address) { // TODO: Rethink
-            source->address_to_line[lines_corrected[j].address] =
-                lines_corrected[j];
-            source->line_address_to_filename[lines_corrected[j].address] =
-                filename;
-          }
-        }
-
-        source->filename_to_lines.emplace(
-            std::make_pair(std::move(filename), std::move(lines_corrected)));
-      }
-    }
-  } else {
-    LOG_IMGUI(DebuggerLoadTargetModules, "Unable to load ", filename)
-    return false;
+inline void DebuggerAddModules(Debugger *debugger,
+                               std::vector<Module> &&modules) {
+  if (modules.empty()) {
+    return;
   }
 
-  return true;
-}
+  DebuggerPublishModules(debugger, modules);
 
-static bool DebuggerRemoveBreakpoint(Debugger *debugger, DWORD64 address) {
-  auto &breakpoints = debugger->breakpoints->data;
-  auto pi = debugger->pi;
+  for (auto &module : modules) {
+    DebuggerResolvePendingBreakpoints(debugger, module);
 
-  if (breakpoints.find(address) != breakpoints.end()) {
-    Breakpoint breakpoint = breakpoints[address];
+    // Types of a module that was unloaded from the same base are stale
+    debugger->type_models.erase(module.base);
 
-    // Restore original instruction
-    DWORD read_bytes;
-    if (!WriteProcessMemory(pi.hProcess, (void *)breakpoint.address,
-                            &breakpoint.original_instruction, 1, &read_bytes)) {
-      LOG_IMGUI(DebuggerRemoveBreakpoint,
-                "WriteProcessMemory failed, error = ", GetLastError())
-      return false;
-    }
-    FlushInstructionCache(pi.hProcess, (void *)breakpoint.address, 1);
+    StepperAddModule(debugger->stepper, std::move(module));
+  }
+}
 
-    breakpoints.erase(address);
-  } else {
+// Picks up modules indexed by the module loader threads
+inline void DebuggerAddLoadedModules(Debugger *debugger) {
+  DebuggerAddModules(debugger,
+                     ModuleLoaderTakeLoaded(debugger->module_loader));
+}
+
+static bool DebuggerRemoveBreakpoint(Debugger *debugger, DWORD64 address) {
+  auto breakpoints = debugger->breakpoints;
+
+  if (breakpoints->data.find(address) == breakpoints->data.end()) {
     LOG_IMGUI(DebuggerRemoveBreakpoint, "Breakpoint for ", address,
               " doesn't exists!")
+    return true;
   }
 
-  return true;
+  // Restores original instruction
+  StepperRemoveAgentSite(debugger->stepper, address, true);
+  BreakpointsQueueRemove(breakpoints, address);
+  breakpoints->conditions.erase(address);
+
+  return ApplyBreakpoints(breakpoints, debugger->memory_cache);
+}
+
+// Innermost function or inline site around the address, MODULE_NO_SCOPE if
+// no module has one
+static DWORD DebuggerFindScope(Debugger *debugger, DWORD64 address,
+                               const Module **scope_module) {
+  const Module *module = StepperFindModule(debugger->stepper, address);
+  if (!module) {
+    return MODULE_NO_SCOPE;
+  }
+
+  const DWORD scope =
+      ModuleFindScope(&module->index, (DWORD)(address - module->base));
+  if (scope != MODULE_NO_SCOPE) {
+    *scope_module = module;
+  }
+
+  return scope;
 }
 
 // TODO: Rethink callstack
 static void DebuggerPrintCallstack(Debugger *debugger) {
-  auto pi = debugger->pi;
-  auto context = debugger->original_context;
+  auto backend = debugger->backend;
 
-  STACKFRAME64 stack = {};
-  stack.AddrPC.Offset = context.Eip;
-  stack.AddrPC.Mode = AddrModeFlat;
-  stack.AddrFrame.Offset = context.Ebp;
-  stack.AddrFrame.Mode = AddrModeFlat;
-  stack.AddrStack.Offset = context.Esp;
-  stack.AddrStack.Mode = AddrModeFlat;
+  DebuggerThread *thread = DebuggerGetSelectedThread(debugger);
+  if (!thread) {
+    return;
+  }
 
-  LOG(Callstack) << '\n';
-  do {
-    if (!StackWalk64(IMAGE_FILE_MACHINE_I386, pi.hProcess, pi.hThread, &stack,
-                     &context, NULL, SymFunctionTableAccess64,
-                     SymGetModuleBase64, 0)) {
-      break;
-    }
+  const auto &frames = DebuggerGetFrames(debugger, thread, UNWIND_MAX_FRAMES);
+
+  std::lock_guard<std::mutex> lock(Global_DbgHelpMutex);
 
+  LOG(Callstack) << '\n';
+  for (size_t i = 0; i < frames.size(); ++i) {
+    const UnwindFrame &frame = frames[i];
     std::stringstream ss;
 
     IMAGEHLP_MODULE64 module = {};
     module.SizeOfStruct = sizeof(module);
-    if (SymGetModuleInfo64(pi.hProcess, (DWORD64)stack.AddrPC.Offset,
-                           &module)) {
+    if (SymGetModuleInfo64(backend->process, frame.pc, &module)) {
       ss << "      Module: " << module.ModuleName << '\n';
     }
 
-    IMAGEHLP_SYMBOL64 *symbol;
-    DWORD displacement;
-    symbol =
-        (IMAGEHLP_SYMBOL64 *)new BYTE[sizeof(IMAGEHLP_SYMBOL64) + MAX_SYM_NAME];
-    ZeroMemory(symbol, sizeof(IMAGEHLP_SYMBOL64) + MAX_SYM_NAME);
-    symbol->SizeOfStruct = sizeof(IMAGEHLP_SYMBOL64);
-    symbol->MaxNameLength = MAX_SYM_NAME;
-
-    if (SymGetSymFromAddr64(pi.hProcess, (DWORD64)stack.AddrPC.Offset,
-                            (DWORD64 *)&displacement, symbol)) {
-      ss << "      Function: " << symbol->Name << '\n';
+    // Inlined calls are frames of their own in the source, innermost first.
+    // Callers are at a return address, the call is the byte before it.
+    const Module *scope_module;
+    for (DWORD scope = DebuggerFindScope(debugger, frame.pc - (i ? 1 : 0),
+                                         &scope_module);
+         scope != MODULE_NO_SCOPE;
+         scope = scope_module->index.scopes[scope].parent) {
+      const ModuleScope &module_scope = scope_module->index.scopes[scope];
+      ss << (module_scope.parent == MODULE_NO_SCOPE ? "      Function: "
+                                                    : "      Inlined: ")
+         << scope_module->index.names.c_str() + module_scope.name_offset
+         << '\n';
     }
 
     IMAGEHLP_LINE64 line = {};
     line.SizeOfStruct = sizeof(line);
 
-    if (SymGetLineFromAddr64(pi.hProcess, (DWORD64)stack.AddrPC.Offset,
-                             &displacement, &line)) {
+    DWORD displacement;
+    if (SymGetLineFromAddr64(backend->process, frame.pc, &displacement,
+                             &line)) {
       ss << "      Filename: " << line.FileName << '\n';
       ss << "      Line: " << line.LineNumber << '\n';
     }
     if (ss.rdbuf()->in_avail() != 0) {
-      std::cout << std::setw(10) << std::hex << stack.AddrPC.Offset << ":\n";
+      std::cout << std::setw(10) << std::hex << frame.pc << ":\n";
       std::cout << ss.rdbuf();
     }
-  } while (stack.AddrReturn.Offset != 0);
+  }
 }
 
 static bool DebuggerSetBreakpoint(Debugger *debugger, DWORD64 address) {
-  auto &breakpoints = debugger->breakpoints->data;
-  auto pi = debugger->pi;
+  auto breakpoints = debugger->breakpoints;
 
   // TODO: Rethink lines that are not in debugger info
   if (!address) {
     return false;
   }
 
-  // If we already have invisible breakpoint, change it's state
-  auto it = breakpoints.find(address);
-  if (it != breakpoints.end() && it->second.type == BreakpointType::INVISIBLE) {
-    it->second.type = BreakpointType::USER;
-  } else {
-    breakpoints[address] =
-        CreateBreakpoint(pi.hProcess, address, BreakpointType::USER);
+  // Invisible breakpoint at the address just changes it's state
+  StepperRemoveAgentSitesOver(debugger->stepper, address);
+  BreakpointsQueueInsert(breakpoints, address, BreakpointType::USER);
+
+  return ApplyBreakpoints(breakpoints, debugger->memory_cache);
+}
+
+// Copies the first symbol found
+inline BOOL WINAPI DebuggerFindSymbolCallback(PSYMBOL_INFO pSymInfo,
+                                              ULONG SymbolSize,
+                                              PVOID UserContext) {
+  auto symbol_info = reinterpret_cast<PSYMBOL_INFO>(UserContext);
+  *symbol_info = *pSymInfo;
+  symbol_info->MaxNameLen = 0;
+
+  return FALSE;
+}
+
+// Variable of a condition of the breakpoint at the address, locals of it's
+// scope first, then globals
+static bool DebuggerResolveVariable(Debugger *debugger, DWORD64 address,
+                                    const std::string &name,
+                                    ConditionVariable *variable) {
+  auto backend = debugger->backend;
+
+  std::lock_guard<std::mutex> lock(Global_DbgHelpMutex);
+
+  SYMBOL_INFO symbol_info = {};
+  symbol_info.SizeOfStruct = sizeof(SYMBOL_INFO);
+
+  IMAGEHLP_STACK_FRAME stack_frame = {};
+  stack_frame.InstructionOffset = address;
+  SymSetContext(backend->process, &stack_frame, NULL);
+  SymEnumSymbols(backend->process, 0, name.c_str(), DebuggerFindSymbolCallback,
+                 &symbol_info);
+
+  if (!symbol_info.TypeIndex &&
+      !SymFromName(backend->process, name.c_str(), &symbol_info)) {
+    return false;
+  }
+
+  // Kept in a register, there is no address to read
+  if (symbol_info.Flags & SYMFLAG_REGISTER) {
+    return false;
+  }
+
+  enum SymTagEnum tag = (enum SymTagEnum)0;
+  SymGetTypeInfo(backend->process, symbol_info.ModBase, symbol_info.TypeIndex,
+                 TI_GET_SYMTAG, &tag);
+  BasicType type = btNoType;
+  SymGetTypeInfo(backend->process, symbol_info.ModBase, symbol_info.TypeIndex,
+                 TI_GET_BASETYPE, &type);
+  ULONG64 length = 0;
+  SymGetTypeInfo(backend->process, symbol_info.ModBase, symbol_info.TypeIndex,
+                 TI_GET_LENGTH, &length);
+
+  if ((tag != SymTagBaseType && tag != SymTagPointerType) ||
+      type == btFloat ||
+      (length != 1 && length != 2 && length != 4 && length != 8)) {
+    return false;
+  }
+
+  // Register relative ones, rsp based in x64 code mostly, are read from the
+  // registers at the hit. Frame relative ones from the frame base of the
+  // local variables window.
+  variable->register_index = -1;
+  if (symbol_info.Flags & SYMFLAG_FRAMEREL) {
+    variable->register_index = CONDITION_REGISTER_FRAME;
+  } else if (symbol_info.Flags & SYMFLAG_REGREL) {
+    variable->register_index = ConditionFindCvRegister(symbol_info.Register);
+    if (variable->register_index < 0) {
+      return false;
+    }
+  }
+  variable->offset = symbol_info.Address;
+  variable->size = (BYTE)length;
+  variable->is_signed =
+      tag == SymTagBaseType &&
+      (type == btInt || type == btLong || type == btChar);
+
+  return true;
+}
+
+// Compiled once here, evaluated on every hit. Empty text removes the
+// condition.
+static bool DebuggerSetCondition(Debugger *debugger, DWORD64 address,
+                                 const std::string &text) {
+  auto breakpoints = debugger->breakpoints;
+
+  auto it = breakpoints->data.find(address);
+  if (it == breakpoints->data.end() ||
+      it->second.type != BreakpointType::USER) {
+    LOG_IMGUI(DebuggerSetCondition, "No breakpoint at ", std::hex, address)
+    return false;
+  }
+
+  if (text.empty()) {
+    StepperRemoveAgentSite(debugger->stepper, address, true);
+    breakpoints->conditions.erase(address);
+    return true;
+  }
+
+  Condition condition;
+  std::string error;
+  if (!ConditionCompile(
+          text,
+          [&](const std::string &name, ConditionVariable *variable) {
+            return DebuggerResolveVariable(debugger, address, name, variable);
+          },
+          &condition, &error)) {
+    LOG_IMGUI(DebuggerSetCondition, "Condition \"", text, "\": ", error)
+    return false;
   }
 
+  // Trampoline of the old one goes, the new one is built on continue
+  StepperRemoveAgentSite(debugger->stepper, address, true);
+
+  breakpoints->conditions[address] = std::move(condition);
+
   return true;
 }
 
+inline void DebuggerReadMemory(Debugger *debugger,
+                               const DebuggerCommand &command) {
+  std::vector<BYTE> data(command.size);
+
+  SIZE_T read_bytes = 0;
+  if (!MemoryCacheRead(debugger->memory_cache, command.address, data.data(),
+                       data.size(), &read_bytes)) {
+    LOG_IMGUI(DebuggerReadMemory, "Unable to read ", data.size(),
+              " bytes at ", std::hex, command.address)
+  }
+  data.resize(read_bytes);
+
+  if (command.OnMemoryRead) {
+    command.OnMemoryRead(data);
+  }
+}
+
+inline void DebuggerGetCallstack(Debugger *debugger,
+                                std::vector<DWORD64> *callstack) {
+  DebuggerThread *thread = DebuggerGetSelectedThread(debugger);
+  if (!thread) {
+    return;
+  }
+
+  const auto &frames = DebuggerGetFrames(debugger, thread, UNWIND_MAX_FRAMES);
+  for (const auto &frame : frames) {
+    callstack->push_back(frame.pc);
+  }
+}
+
+// Registers, locals and callstack of the selected thread, for the snapshots
+// until the next stop
+static void DebuggerShowThread(Debugger *debugger) {
+  DebuggerThread *thread = DebuggerGetSelectedThread(debugger);
+  if (!thread) {
+    return;
+  }
+
+  const Registers &registers = StepperGetRegisters(debugger->stepper, thread);
+  debugger->current_address = registers.Rip;
+  *debugger->registers = registers;
+  BackendGetExtendedRegisters(debugger->backend, thread->id,
+                              debugger->registers);
+
+  // Full walk first, the locals reuse it's innermost frame
+  debugger->selected_frame_index = 0;
+  debugger->callstack.clear();
+  if (registers.Rip) {
+    DebuggerGetCallstack(debugger, &debugger->callstack);
+  }
+  DebuggerGetLocalVariables(debugger);
+}
+
+// Hands current state over to the UI thread
+static void DebuggerPublishSnapshot(Debugger *debugger) {
+  StopSnapshot *snapshot = new StopSnapshot();
+  snapshot->registers = *debugger->registers;
+  snapshot->local_variables = debugger->local_variables->data;
+  snapshot->callstack = debugger->callstack;
+  snapshot->current_address = debugger->current_address;
+  snapshot->thread_id = debugger->selected_thread_id;
+  snapshot->frame_index = debugger->selected_frame_index;
+  snapshot->is_non_stop = debugger->stepper->is_non_stop;
+  snapshot->memory_read_count = debugger->memory_cache->read_count;
+  snapshot->memory_hit_count = debugger->memory_cache->hit_count;
+  snapshot->syscall_count = MemoryCacheGetSyscallCount(debugger->memory_cache);
+  snapshot->trap_count = debugger->trap_count;
+  snapshot->round_trip_count = debugger->round_trip_count;
+
+  for (auto &it : debugger->stepper->threads) {
+    SnapshotThread thread = {};
+    thread.id = it.first;
+    thread.is_stopped = StepperIsThreadStopped(debugger->stepper, &it.second);
+    thread.stop_reason = it.second.stop_reason;
+    if (thread.is_stopped) {
+      thread.address = StepperGetRegisters(debugger->stepper, &it.second).Rip;
+    }
+    snapshot->threads.push_back(thread);
+  }
+  std::sort(snapshot->threads.begin(), snapshot->threads.end(),
+            [](const SnapshotThread &a, const SnapshotThread &b) {
+              return a.id < b.id;
+            });
+
+  for (const auto &it : debugger->breakpoints->data) {
+    if (it.second.type == BreakpointType::USER) {
+      snapshot->user_breakpoints.push_back(it.first);
+    }
+  }
+  std::sort(snapshot->user_breakpoints.begin(),
+            snapshot->user_breakpoints.end());
+
+  // Hits of conditions evaluated in the target are counted there
+  for (const auto &it : debugger->agent->sites) {
+    auto breakpoint = debugger->breakpoints->data.find(it.first);
+    if (it.second.is_installed &&
+        breakpoint != debugger->breakpoints->data.end()) {
+      AgentReadHits(debugger->memory_cache, it.second,
+                    &breakpoint->second.hit_count);
+      ++snapshot->agent_site_count;
+    }
+  }
+  snapshot->is_agent_enabled = debugger->agent->is_enabled;
+
+  const auto &conditions = debugger->breakpoints->conditions;
+  for (DWORD64 address : snapshot->user_breakpoints) {
+    SnapshotBreakpoint details = {};
+    details.address = address;
+    details.hit_count = debugger->breakpoints->data.at(address).hit_count;
+
+    auto it = conditions.find(address);
+    if (it != conditions.end()) {
+      details.condition = it->second.text;
+    }
+
+    snapshot->user_breakpoint_details.push_back(std::move(details));
+  }
+
+  for (const auto &slot : debugger->breakpoints->hardware_slots) {
+    if (!slot.is_used) {
+      continue;
+    }
+
+    ++snapshot->hardware_slot_count;
+    if (slot.access != BreakpointAccess::EXECUTE) {
+      snapshot->watchpoints.push_back(slot);
+    }
+  }
+
+  EpochPublish(&debugger->snapshots->epoch_domain, &debugger->snapshots->stop,
+               (const StopSnapshot *)snapshot);
+}
+
+// Steps and continue go to the thread of the command, or to the selected one
+static bool DebuggerSetCommandState(Debugger *debugger,
+                                    const DebuggerCommand &command,
+                                    DebuggerState state) {
+  return StepperSetCommandState(
+      debugger->stepper,
+      command.thread_id ? command.thread_id : debugger->selected_thread_id,
+      state);
+}
+
+// Returns true, if command resumes the target
+static bool DebuggerExecuteCommand(Debugger *debugger,
+                                   const DebuggerCommand &command) {
+  switch (command.type) {
+  case DebuggerCommandType::STEP_OVER:
+    return DebuggerSetCommandState(debugger, command,
+                                   DebuggerState::STEP_OVER);
+  case DebuggerCommandType::STEP_IN:
+    return DebuggerSetCommandState(debugger, command, DebuggerState::STEP_IN);
+  case DebuggerCommandType::STEP_OUT:
+    return DebuggerSetCommandState(debugger, command,
+                                   DebuggerState::STEP_OUT);
+  case DebuggerCommandType::CONTINUE:
+    return DebuggerSetCommandState(debugger, command,
+                                   DebuggerState::CONTINUE);
+  case DebuggerCommandType::SET_BREAKPOINT:
+    DebuggerSetBreakpoint(debugger, command.address);
+    DebuggerPublishSnapshot(debugger);
+    break;
+  case DebuggerCommandType::REMOVE_BREAKPOINT:
+    DebuggerRemoveBreakpoint(debugger, command.address);
+    DebuggerPublishSnapshot(debugger);
+    break;
+  case DebuggerCommandType::SET_CONDITION:
+    DebuggerSetCondition(debugger, command.address, command.text);
+    DebuggerPublishSnapshot(debugger);
+    break;
+  case DebuggerCommandType::ENABLE_AGENT:
+    debugger->agent->is_enabled = command.is_enabled;
+    if (!command.is_enabled) {
+      StepperRemoveAgentSites(debugger->stepper);
+    }
+    DebuggerPublishSnapshot(debugger);
+    break;
+  case DebuggerCommandType::SET_WATCHPOINT:
+    BreakpointsAddWatchpoint(debugger->breakpoints, debugger->backend,
+                             command.address, (BYTE)command.size,
+                             command.access);
+    DebuggerPublishSnapshot(debugger);
+    break;
+  case DebuggerCommandType::REMOVE_WATCHPOINT:
+    BreakpointsRemoveWatchpoint(debugger->breakpoints, debugger->backend,
+                                command.address);
+    DebuggerPublishSnapshot(debugger);
+    break;
+  case DebuggerCommandType::READ_MEMORY:
+    DebuggerReadMemory(debugger, command);
+    break;
+  case DebuggerCommandType::PRINT_CALLSTACK:
+    DebuggerPrintCallstack(debugger);
+    break;
+  case DebuggerCommandType::SELECT_THREAD: {
+    auto it = debugger->stepper->threads.find(command.thread_id);
+    if (it != debugger->stepper->threads.end() &&
+        StepperIsThreadStopped(debugger->stepper, &it->second)) {
+      debugger->selected_thread_id = command.thread_id;
+      DebuggerShowThread(debugger);
+    }
+    DebuggerPublishSnapshot(debugger);
+  } break;
+  case DebuggerCommandType::SELECT_FRAME:
+    // Callstack stays, only the locals are of the other frame
+    if (DebuggerGetSelectedThread(debugger) &&
+        command.frame_index < debugger->callstack.size()) {
+      debugger->selected_frame_index = command.frame_index;
+      LocalVariablesReset(debugger->local_variables);
+      DebuggerGetLocalVariables(debugger);
+    }
+    DebuggerPublishSnapshot(debugger);
+    break;
+  case DebuggerCommandType::SET_NON_STOP:
+    StepperSetNonStop(debugger->stepper, command.is_enabled);
+    DebuggerPublishSnapshot(debugger);
+    break;
+  case DebuggerCommandType::DETACH:
+    debugger->is_detaching = true;
+    return true;
+  case DebuggerCommandType::QUIT:
+    Global_IsOpen = false;
+    return true;
+  }
+
+  return false;
+}
+
+// Handles commands while the target is running. Steps and continue only
+// reach suspended threads.
+inline void DebuggerProcessCommands(Debugger *debugger) {
+  DebuggerCommand command;
+  while (DebuggerCommandQueueTryPop(debugger->command_queue, &command)) {
+    DebuggerExecuteCommand(debugger, command);
+  }
+}
+
+// Blocks while the target is stopped, until a command resumes it
 inline void DebuggerWaitForAction(Debugger *debugger) {
+  DebuggerPublishSnapshot(debugger);
+
   while (Global_IsOpen) {
-    if (WaitForSingleObject(debugger->continue_event, 0) == WAIT_OBJECT_0) {
+    DebuggerCommand command;
+    DebuggerCommandQueuePop(debugger->command_queue, &command);
+
+    if (DebuggerExecuteCommand(debugger, command)) {
       break;
     }
   }
 }
 
-static bool DebuggerProcessEvent(Debugger *debugger, DEBUG_EVENT debug_event,
-                                 DWORD &continue_status) {
-  auto pi = debugger->pi;
-  auto &breakpoints = debugger->breakpoints->data;
-  auto &address_to_line = debugger->source->address_to_line;
-  DebuggerState &state = debugger->state;
+// Sets the target up for the command that resumed it, traps are counted from
+// here. Returns false, if the target has to stay stopped.
+static bool DebuggerResume(Debugger *debugger) {
+  debugger->trap_count = 0;
+  debugger->round_trip_count = 0;
 
-  continue_status = DBG_CONTINUE;
+  return StepperResume(debugger->stepper, [debugger](DebuggerThread *thread) {
+    return DebuggetGetFunctionReturnAddress(debugger, thread);
+  });
+}
 
-  switch (debug_event.dwDebugEventCode) {
-  case LOAD_DLL_DEBUG_EVENT: {
-    const LOAD_DLL_DEBUG_INFO load_dll_debug_info = debug_event.u.LoadDll;
+// Shows the stop to the user and blocks until a command resumes the target,
+// see StepperStop. In non-stop mode the others run on meanwhile, and the
+// thread waits for it's own command.
+static void DebuggerStop(Debugger *debugger, DebuggerStopReason reason) {
+  auto stepper = debugger->stepper;
 
-    DebuggerLoadTargetModules(debugger, load_dll_debug_info.hFile, pi.hProcess,
-                              (DWORD64)load_dll_debug_info.lpBaseOfDll);
-  } break;
-  case CREATE_PROCESS_DEBUG_EVENT: {
-    const CREATE_PROCESS_DEBUG_INFO create_process_debug_info =
-        debug_event.u.CreateProcessInfo;
+  debugger->selected_thread_id = stepper->thread_id;
+  StepperStop(stepper, reason);
+  DebuggerShowThread(debugger);
 
-    DebuggerLoadTargetModules(debugger, create_process_debug_info.hFile,
-                              pi.hProcess,
-                              (DWORD64)create_process_debug_info.lpBaseOfImage);
+  if (stepper->is_non_stop) {
+    DebuggerPublishSnapshot(debugger);
+    return;
+  }
 
-    CONTEXT context = {};
-    context.ContextFlags = CONTEXT_ALL;
-    GetThreadContext(pi.hThread, &context);
+  do {
+    StepperSetState(stepper, DebuggerState::NONE);
+    DebuggerWaitForAction(debugger);
+  } while (Global_IsOpen && !DebuggerResume(debugger));
+}
+
+// Target has run to the step breakpoint or single stepped, the step goes on
+// while it is on the line it started on
+static void DebuggerContinueStep(Debugger *debugger) {
+  if (StepperContinueStep(debugger->stepper)) {
+    DebuggerStop(debugger, DebuggerStopReason::STEP);
+  }
+}
+
+// Counts the hit of a user breakpoint. True, if it has no condition, or the
+// condition is true or can't be evaluated.
+static bool DebuggerIsConditionMet(Debugger *debugger,
+                                   Breakpoint *breakpoint) {
+  const auto &conditions = debugger->breakpoints->conditions;
 
-    // Replace first instruction with int3
-    DWORD64 start_address = DebuggerGetTargetStartAddress(debugger);
+  ++breakpoint->hit_count;
 
-    const Line &line = address_to_line[start_address];
+  auto it = conditions.find(breakpoint->address);
+  if (it == conditions.end()) {
+    return true;
+  }
 
-    if (debugger->OnLineAddressChange) {
-      debugger->OnLineAddressChange(start_address);
+  DebuggerThread *thread = StepperGetThread(debugger->stepper);
+  ConditionContext context = {};
+  context.registers = &thread->registers;
+  context.memory_cache = debugger->memory_cache;
+  context.hit_count = breakpoint->hit_count;
+  if (it->second.is_frame_relative) {
+    const auto &frames = DebuggerGetFrames(debugger, thread, 1);
+    if (frames.empty()) {
+      LOG_IMGUI(DebuggerProcessEvent, "No frame for \"", it->second.text,
+                "\" at ", std::hex, breakpoint->address)
+      return true;
     }
+    context.frame_pointer = frames[0].frame_pointer;
+  }
+
+  bool result;
+  if (!ConditionEvaluate(it->second, context, &result)) {
+    LOG_IMGUI(DebuggerProcessEvent, "Unable to evaluate \"", it->second.text,
+              "\" at ", std::hex, breakpoint->address)
+    return true;
+  }
 
-    breakpoints[line.address] =
-        CreateBreakpoint(pi.hProcess, line.address, BreakpointType::USER);
+  return result;
+}
+
+// Target is at one of our breakpoints, before executing it
+static void DebuggerOnBreakpoint(Debugger *debugger, DWORD64 address) {
+  auto breakpoints = debugger->breakpoints;
+  DebuggerThread *thread = StepperGetThread(debugger->stepper);
+  const Registers &registers = StepperGetRegisters(debugger->stepper, thread);
+  const DebuggerState state = thread->state;
+
+  auto it = breakpoints->data.find(address);
+  const bool is_user = it->second.type == BreakpointType::USER;
+  if (is_user && DebuggerIsConditionMet(debugger, &it->second)) {
+    const LineTable *line_table = DebuggerGetLineTable(debugger);
+    size_t line_index;
+    if (LineTableFind(line_table, address, &line_index)) {
+      LOG_IMGUI(DebuggerProcessEvent, "Breakpoint at (", std::dec,
+                line_table->lines[line_index], ", ", std::hex, address, ')');
+    }
+
+    if (!debugger->is_start_reached) {
+      debugger->is_start_reached = true;
+      LOG_IMGUI(DebuggerProcessEvent, "Reached ",
+                GetStringFromWString(debugger->main_function_name), ' ',
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - debugger->launch_time)
+                    .count(),
+                " ms after launch")
+    }
+
+    DebuggerStop(debugger, DebuggerStopReason::BREAKPOINT);
+    StepperStepOffCurrent(debugger->stepper, thread);
+    return;
+  }
+
+  // Single stepping steps go on from whatever they land on
+  const auto &step_breakpoints = thread->step_breakpoints;
+  const bool is_single_stepping = (state == DebuggerState::STEP_OVER ||
+                                   state == DebuggerState::STEP_IN) &&
+                                  step_breakpoints.empty();
+  const bool is_step_breakpoint =
+      state != DebuggerState::NONE && state != DebuggerState::CONTINUE &&
+      std::find(step_breakpoints.begin(), step_breakpoints.end(), address) !=
+          step_breakpoints.end();
+
+  if (!is_single_stepping && !is_step_breakpoint) {
+    if (is_user ||
+        StepperIsOtherStepBreakpoint(debugger->stepper, address, thread)) {
+      // Condition is false or another thread's step waits for it, resumes
+      // without waking the UI up
+      StepperStepOffBreakpoint(debugger->stepper, it->second);
+    } else {
+      // Nothing waits for it anymore
+      BreakpointsQueueRemove(breakpoints, address);
+      ApplyBreakpoints(breakpoints, debugger->memory_cache);
+    }
+    return;
+  }
+
+  if (registers.Rsp < thread->step_frame_address) {
+    // Deeper call of the same function got there, keep waiting
+    StepperStepOffBreakpoint(debugger->stepper, it->second);
+    return;
+  }
+
+  StepperRemoveStepBreakpoints(debugger->stepper, thread);
+  DebuggerContinueStep(debugger);
+  StepperStepOffCurrent(debugger->stepper, thread);
+}
+
+// "is_handled" - false, if the target should handle the exception itself
+static bool DebuggerProcessEvent(Debugger *debugger, const BackendEvent &event,
+                                 bool *is_handled) {
+  auto backend = debugger->backend;
+  auto &breakpoints = debugger->breakpoints->data;
+
+  debugger->stepper->thread_id = event.thread_id;
+  DebuggerThread *thread = StepperGetThread(debugger->stepper);
+  const DebuggerState state = thread->state;
+
+  *is_handled = true;
+
+  switch (event.type) {
+  case BackendEventType::CREATE_THREAD: {
+    // Added above, it runs on with the others. Stopped threads are listed
+    // while the rest runs only in non-stop mode.
+    if (debugger->stepper->is_non_stop) {
+      DebuggerPublishSnapshot(debugger);
+    }
+  } break;
+  case BackendEventType::EXIT_THREAD: {
+    StepperRemoveStepBreakpoints(debugger->stepper, thread);
+    StepperRemoveThread(debugger->stepper, event.thread_id);
+    if (debugger->stepper->is_non_stop) {
+      DebuggerPublishSnapshot(debugger);
+    }
   } break;
-  case OUTPUT_DEBUG_STRING_EVENT: {
-    const OUTPUT_DEBUG_STRING_INFO output_debug_string_info =
-        debug_event.u.DebugString;
-    WCHAR *message = new WCHAR[output_debug_string_info.nDebugStringLength];
-
-    if (!ReadProcessMemory(pi.hProcess,
-                           output_debug_string_info.lpDebugStringData, message,
-                           output_debug_string_info.nDebugStringLength, NULL)) {
-      LOG_IMGUI(DebuggerProcessEvent,
-                "ReadProcessMemory failed, error = ", GetLastError())
+  case BackendEventType::LOAD_MODULE: {
+    // Indexed in the background, the target keeps running meanwhile
+    ModuleLoaderPush(debugger->module_loader, event.file, event.path,
+                     event.base_address);
+  } break;
+  case BackendEventType::UNLOAD_MODULE: {
+    // Lines stay in the line table, nothing runs there anymore
+    StepperRemoveModule(debugger->stepper, event.base_address);
+  } break;
+  case BackendEventType::CREATE_PROCESS: {
+    // Already running, it's start address is long past. Indexed in the
+    // background like the rest, so that the target isn't paused for it.
+    if (debugger->is_attached) {
+      ModuleLoaderPush(debugger->module_loader, event.file, event.path,
+                       event.base_address);
+      debugger->selected_thread_id = event.thread_id;
+      break;
+    }
+
+    // Executable itself is loaded right away, it is needed to find the start
+    // address
+    Module module = {};
+    const bool is_loaded = ModuleLoad(backend->process, event.file, event.path,
+                                      event.base_address, &module);
+    CloseHandle(event.file);
+
+    // Start function comes straight from the index, the int3 is in place
+    // before any line table is built
+    const std::string start_name =
+        GetStringFromWString(debugger->main_function_name);
+    const ModuleFunction *start_function =
+        is_loaded ? ModuleFindFunction(&module.index, start_name.c_str())
+                  : NULL;
+    DWORD64 start_address = 0;
+    if (start_function) {
+      start_address = module.base + start_function->start_rva;
+
+      BreakpointsQueueInsert(debugger->breakpoints, start_address,
+                             BreakpointType::USER);
+      ApplyBreakpoints(debugger->breakpoints, debugger->memory_cache);
+
+      LOG_IMGUI(DebuggerProcessEvent, "Start breakpoint at ", std::hex,
+                start_address, " planted ", std::dec,
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - debugger->launch_time)
+                    .count(),
+                " us after launch")
+    } else {
+      // Start function lives in a DLL that isn't indexed yet
+      debugger->breakpoints->pending_functions.push_back(start_name);
+    }
+
+    // Lines are merged while the target runs to the start function, see
+    // DebuggerRun
+    if (is_loaded) {
+      ModuleLoaderAddLoaded(debugger->module_loader, std::move(module));
+    }
+    if (!start_address) {
+      break;
+    }
+
+    debugger->current_address = start_address;
+
+    DebuggerPublishSnapshot(debugger);
+  } break;
+  case BackendEventType::OUTPUT_STRING: {
+    std::vector<char> message(event.size + 1, '\0');
+    if (!MemoryCacheRead(debugger->memory_cache, event.address, message.data(),
+                         event.size, NULL)) {
+      LOG_IMGUI(DebuggerProcessEvent, "Unable to read debug string at ",
+                std::hex, event.address)
       return false;
     }
 
-    if (!output_debug_string_info.fUnicode) {
-      LOG_IMGUI(OUTPUT_DEBUG_STRING_EVENT, (char *)message)
+    if (!event.is_unicode) {
+      LOG_IMGUI(OUTPUT_DEBUG_STRING_EVENT, message.data())
     } else {
       // LOG(OUTPUT_DEBUG_STRING_EVENT, message); // Output to console is not
       // supported for now (cause i'm dumb) :(
     }
   } break;
-  case EXCEPTION_DEBUG_EVENT: {
-    const EXCEPTION_DEBUG_INFO &exception_debug_info = debug_event.u.Exception;
-    switch (exception_debug_info.ExceptionRecord.ExceptionCode) {
-    case EXCEPTION_BREAKPOINT: {
-      static bool ignore_breakpoint = true;
-      if (ignore_breakpoint) {
-        ignore_breakpoint = false;
-      } else {
-        DWORD64 exception_address =
-            (DWORD64)exception_debug_info.ExceptionRecord.ExceptionAddress;
-
-        if (debugger->OnLineAddressChange) {
-          debugger->OnLineAddressChange(exception_address);
-        }
-
-        CONTEXT context = {};
-        context.ContextFlags = CONTEXT_ALL;
-        GetThreadContext(pi.hThread, &context);
-
-        // Restore it to be before debug instruction, because exception already
-        // occured, that means target instruction already been executed
-        --context.Eip;
-
-        context.EFlags |= 0x100; // Trap flag
-        SetThreadContext(pi.hThread, &context);
-
-        debugger->original_context = context;
-
-        auto breakpoint_it = breakpoints.find(exception_address);
-        if (breakpoint_it != breakpoints.end()) {
-          const Line &line = address_to_line[exception_address];
-
-          BreakpointType type = breakpoint_it->second.type;
-          if (type != BreakpointType::INVISIBLE) {
-            LOG_IMGUI(DebuggerProcessEvent, "Breakpoint at (", std::dec,
-                      line.index, ", ", std::hex, line.address, ')');
-          }
-
-          BreakpointRestore(pi.hProcess, breakpoint_it->second);
-
-          RegistersUpdateFromContext(debugger->registers,
-                                     debugger->original_context);
-          DebuggerGetLocalVariables(debugger);
-
-          // I guess should be fine =)
-          if (type != BreakpointType::INVISIBLE) {
-            DebuggerPlaceFunctionInvisibleBreakpoints(
-                debugger, debugger->original_context.Eip);
-          }
-        }
-
-        // We hit breakpoint, so stop
-        if (state == DebuggerState::STEP_IN) {
-          state = DebuggerState::NONE;
-        }
-      }
-    } break;
-    // TODO: Refactor
-    case EXCEPTION_SINGLE_STEP: {
-      const EXCEPTION_DEBUG_INFO &exception_debug_info =
-          debug_event.u.Exception;
-      DWORD64 exception_address =
-          (DWORD64)exception_debug_info.ExceptionRecord.ExceptionAddress;
-
-      if (state != DebuggerState::STEP_IN) {
-        BreakpointRestore(pi.hProcess, debugger->original_context.Eip, 0xCC);
-
-        auto it = breakpoints.find(debugger->original_context.Eip);
-        if (state != DebuggerState::CONTINUE ||
-            (it != breakpoints.end() &&
-             it->second.type == BreakpointType::USER)) {
-          DebuggerWaitForAction(debugger);
-        }
-      }
+  case BackendEventType::BREAKPOINT: {
+    DWORD64 address = event.address;
+
+    ++debugger->trap_count;
+
+    Registers &registers = thread->registers;
+    StepperGetRegisters(debugger->stepper, thread);
+
+    // Condition was true in the target, registers are as they were at the
+    // breakpoint. The hit is counted once more below.
+    const AgentSite *site = AgentFindTrap(debugger->agent, address);
+    auto breakpoint =
+        site ? breakpoints.find(site->address) : breakpoints.end();
+    if (breakpoint != breakpoints.end()) {
+      address = site->address;
+      AgentReadHits(debugger->memory_cache, *site,
+                    &breakpoint->second.hit_count);
+      --breakpoint->second.hit_count;
+    }
 
-      if (state == DebuggerState::STEP_IN) {
-        // NOTE: As Vladislav Nikishin suggested, do that, until line index
-        // changed
-        if (address_to_line.find(exception_address) != address_to_line.end()) {
-          if (debugger->OnLineAddressChange) {
-            debugger->OnLineAddressChange(exception_address);
-          }
-
-          auto it = breakpoints.find(exception_address);
-          if (it == breakpoints.end() ||
-              (it != breakpoints.end() &&
-               it->second.type != BreakpointType::INVISIBLE)) {
-            DebuggerPlaceFunctionInvisibleBreakpoints(debugger,
-                                                      exception_address);
-          }
-
-          // To prevent infinite "Step-In" sequence
-          state = DebuggerState::NONE;
-        } else {
-          CONTEXT context = {};
-          context.ContextFlags = CONTEXT_ALL;
-          GetThreadContext(pi.hThread, &context);
-          context.EFlags |= 0x100; // Reinstall trap flag
-          SetThreadContext(pi.hThread, &context);
-        }
-      }
-    } break;
-    default:
-      if (exception_debug_info.dwFirstChance == 1) {
-      }
+    BYTE code = 0xCC;
+    if (breakpoints.find(address) == breakpoints.end() &&
+        (site || (MemoryCacheRead(debugger->memory_cache, address, &code,
+                                  sizeof(code), NULL) &&
+                  code == 0xCC))) {
+      // Compiled into the target, execution goes on after it
+      DebuggerStop(debugger, DebuggerStopReason::TRAP);
+      break;
+    }
 
-      continue_status = DBG_EXCEPTION_NOT_HANDLED;
+    // Restore it to be before debug instruction, because exception already
+    // occured, that means target instruction already been executed
+    registers.Rip = address;
+    StepperSetRegisters(debugger->stepper, thread);
+
+    // Removed while the thread was already trapping on it, it runs the
+    // original instruction now
+    if (breakpoints.find(address) == breakpoints.end()) {
       break;
     }
+
+    DebuggerOnBreakpoint(debugger, address);
   } break;
-  case EXIT_PROCESS_DEBUG_EVENT: {
-    LOG_IMGUI(DebuggerProcessEvent, "Process is terminated, exiting ...")
-    exit(0);
+  case BackendEventType::SINGLE_STEP: {
+    ++debugger->trap_count;
+
+    StepperGetRegisters(debugger->stepper, thread);
+    StepperFinishDisplacedStep(debugger->stepper, thread);
+    const DWORD64 address = thread->registers.Rip;
+
+    StepperRearmBreakpoint(debugger->stepper, thread);
+
+    // Stepped onto a breakpoint, it's int3 isn't executed yet
+    if (breakpoints.find(address) != breakpoints.end()) {
+      DebuggerOnBreakpoint(debugger, address);
+      break;
+    }
+
+    // Single stepped an instruction of the line
+    if ((state == DebuggerState::STEP_OVER ||
+         state == DebuggerState::STEP_IN) &&
+        thread->step_breakpoints.empty()) {
+      DebuggerContinueStep(debugger);
+    }
+  } break;
+  case BackendEventType::HARDWARE_BREAKPOINT: {
+    ++debugger->trap_count;
+
+    StepperGetRegisters(debugger->stepper, thread);
+    StepperFinishDisplacedStep(debugger->stepper, thread);
+    const DWORD64 address = thread->registers.Rip;
+
+    // Whatever single step was pending is over too
+    StepperRearmBreakpoint(debugger->stepper, thread);
+
+    // Watchpoints trigger after the access, execute slots before the
+    // instruction
+    bool is_watchpoint = false;
+    for (int i = 0; i < BACKEND_DEBUG_REGISTER_COUNT; ++i) {
+      const HardwareSlot &slot = debugger->breakpoints->hardware_slots[i];
+      if ((event.hardware_slots & (1 << i)) && slot.is_used &&
+          slot.access != BreakpointAccess::EXECUTE) {
+        LOG_IMGUI(DebuggerProcessEvent, "Watchpoint at ", std::hex,
+                  slot.address, " triggered before ", address)
+        is_watchpoint = true;
+      }
+    }
+
+    if (is_watchpoint) {
+      DebuggerStop(debugger, DebuggerStopReason::WATCHPOINT);
+    } else if (breakpoints.find(address) != breakpoints.end()) {
+      DebuggerOnBreakpoint(debugger, address);
+    }
   } break;
+  case BackendEventType::EXCEPTION:
+    *is_handled = false;
+    break;
+  case BackendEventType::EXIT_PROCESS:
+    LOG_IMGUI(DebuggerProcessEvent, "Process exited with code ", event.code)
+    debugger->is_exited = true;
+    break;
   default:
-    continue_status = DBG_EXCEPTION_NOT_HANDLED;
-    return true;
+    *is_handled = false;
+    break;
   }
 
   return true;
 }
 
-static void DebuggerRun(Debugger *debugger) {
-  DEBUG_EVENT debug_event = {};
+// Runs the suspended threads that a command was given for, see
+// StepperResumeThreads
+static void DebuggerResumeThreads(Debugger *debugger) {
+  auto get_return_address = [debugger](DebuggerThread *thread) {
+    return DebuggetGetFunctionReturnAddress(debugger, thread);
+  };
+  if (StepperResumeThreads(debugger->stepper, get_return_address)) {
+    debugger->trap_count = 0;
+    debugger->round_trip_count = 0;
+    DebuggerPublishSnapshot(debugger);
+  }
+}
+
+// Takes out everything that was put into the target and lets it run on
+// alone. Called between events.
+static void DebuggerDetach(Debugger *debugger) {
+  auto breakpoints = debugger->breakpoints;
+
+  // Threads that trap on an int3 while they are taken out are moved back by
+  // BackendDetach
+  BackendStopThreads(debugger->backend);
+  MemoryCacheInvalidate(debugger->memory_cache);
+
+  StepperRemoveAgentSites(debugger->stepper);
+  for (const auto &it : breakpoints->data) {
+    BreakpointsQueueRemove(breakpoints, it.first);
+  }
+  for (auto &slot : breakpoints->hardware_slots) {
+    slot.is_used = false;
+  }
+  breakpoints->is_hardware_changed = true;
+  ApplyBreakpoints(breakpoints, debugger->memory_cache);
+
+  // Displaced step buffers and agent trampolines stay, threads may still be
+  // running out of them
+  const DWORD process_id = debugger->backend->process_id;
+  if (BackendDetach(debugger->backend)) {
+    LOG_IMGUI(DebuggerDetach, "Detached from ", process_id)
+  }
+
+  debugger->stepper->threads.clear();
+  debugger->stepper->is_all_stopped = false;
+  DebuggerPublishSnapshot(debugger);
+}
+
+// Target has exited, the UI stays until it's closed. Commands that need the
+// target are dropped, memory reads come back empty.
+static void DebuggerWaitForQuit(Debugger *debugger) {
+  debugger->stepper->threads.clear();
+  DebuggerPublishSnapshot(debugger);
+
   while (Global_IsOpen) {
-    DWORD continue_status;
-    if (!WaitForDebugEvent(&debug_event, INFINITE) ||
-        !DebuggerProcessEvent(debugger, debug_event, continue_status)) {
+    DebuggerCommand command;
+    DebuggerCommandQueuePop(debugger->command_queue, &command);
+
+    if (command.type == DebuggerCommandType::QUIT) {
       Global_IsOpen = false;
-      return;
+    } else if (command.type == DebuggerCommandType::READ_MEMORY &&
+               command.OnMemoryRead) {
+      command.OnMemoryRead({});
     }
+  }
+}
 
-    ContinueDebugEvent(debug_event.dwProcessId, debug_event.dwThreadId,
-                       continue_status);
+static void DebuggerRun(Debugger *debugger) {
+  auto backend = debugger->backend;
+
+  while (Global_IsOpen && !debugger->is_detaching && !debugger->is_exited) {
+    // Event that is there already, the next one wakes the command queue
+    BackendEvent event;
+    if (!BackendWaitForEvent(backend, &event, 0)) {
+      Global_IsOpen = false;
+      break;
+    }
+
+    // Memory of a running target can change at any time
+    if (event.type == BackendEventType::NONE) {
+      MemoryCacheInvalidate(debugger->memory_cache);
+    }
+
+    DebuggerAddLoadedModules(debugger);
+    DebuggerProcessCommands(debugger);
+
+    // Blocks until there is an event, a command or indexed modules
+    if (event.type == BackendEventType::NONE) {
+      DebuggerResumeThreads(debugger);
+      if (Global_IsOpen && !debugger->is_detaching) {
+        DebuggerCommandQueueWait(debugger->command_queue);
+      }
+      continue;
+    }
+
+    ++debugger->round_trip_count;
+
+    bool is_handled;
+    if (!DebuggerProcessEvent(debugger, event, &is_handled)) {
+      Global_IsOpen = false;
+      break;
+    }
+
+    StepperUpdateAgent(debugger->stepper);
+    MemoryCacheInvalidate(debugger->memory_cache);
+    StepperRunOn(debugger->stepper);
+
+    BackendContinue(backend, event, is_handled);
+
+    // Published while the target runs, before it's next event is handled
+    DebuggerAddLoadedModules(debugger);
   }
+
+  // Attached target outlives the debugger
+  if (!debugger->is_exited &&
+      (debugger->is_detaching || debugger->is_attached)) {
+    DebuggerDetach(debugger);
+  }
+
+  if (debugger->is_exited) {
+    DebuggerWaitForQuit(debugger);
+  }
+
+  ModuleLoaderStop(debugger->module_loader);
+  SymbolizerStop(debugger->symbolizer);
 }
\ No newline at end of file
@@ -1,28 +1,3 @@
-enum class DebuggerState {
-  NONE,
-  STEP_OVER,
-  STEP_IN,
-  CONTINUE
-};
-
-struct Line {
-  DWORD index;
-  DWORD64 address;
-  std::string text;
-
-  Line &operator=(const Line &other) {
-    if (this != &other) {
-      index = other.index;
-      address = other.address;
-      text = other.text; // TODO: Mb replace with move later
-    } else {
-      assert(0);
-    }
-
-    return *this;
-  }
-};
-
 // From "cvconst.h"
 enum BasicType {
   btNoType = 0,
@@ -86,21 +61,52 @@ enum SymTagEnum {
   SymTagHLSLType
 };
 
+// From "cvconst.h"
+enum DataKind {
+  DataIsUnknown,
+  DataIsLocal,
+  DataIsStaticLocal,
+  DataIsParam,
+  DataIsObjectPtr,
+  DataIsFileStatic,
+  DataIsGlobal,
+  DataIsMember,
+  DataIsStaticMember,
+  DataIsConstant
+};
+
+#define DEBUGGER_MAX_LOCALS_SIZE 0x100000 // Of a frame, read in one go
+
 struct Source;
 
 struct Debugger {
-  STARTUPINFOW si;
-  PROCESS_INFORMATION pi;
-  std::vector<std::string> source_files;
-  CONTEXT original_context;
-  HANDLE continue_event;
-  std::function<void(DWORD64)> OnLineAddressChange;
-  DebuggerState state;
+  Backend *backend;
+  MemoryCache *memory_cache;
+  Agent *agent;
+  ModuleLoader *module_loader;
+  std::unordered_map<DWORD64, TypeModel> type_models; // By module base
+  DebuggerCommandQueue *command_queue;
+  DWORD64 current_address;
   std::wstring main_function_name; // TODO: Remove later
+  bool is_attached; // To a running process, detached from on exit
+  bool is_detaching; // Requested, done between events
+  bool is_exited; // Target is gone, the UI stays until it's closed
+  std::chrono::steady_clock::time_point launch_time;
+  bool is_start_reached; // Stopped at the start function, or attached
+
+  Stepper *stepper; // Threads, commands after a stop go to it's thread_id
+  DWORD selected_thread_id; // Shown in the UI, non-stop commands go to it
+  std::vector<DWORD64> callstack; // Of the selected thread, as last shown
+  DWORD selected_frame_index; // Into "callstack", locals are of it
+  Symbolizer *symbolizer; // Callstack rows of the UI
+
+  DWORD64 trap_count;    // Since the target was resumed by the user
+  DWORD64 round_trip_count; // Debug events since then, traps included
 
   // External modules
   Registers *registers;
   LocalVariables *local_variables;
   Source *source;
   Breakpoints *breakpoints;
+  Snapshots *snapshots;
 };
\ No newline at end of file
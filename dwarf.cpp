@@ -0,0 +1,69 @@
+static inline DWORD64 DwarfReadU(DwarfCursor *cursor, size_t size) {
+  if ((size_t)(cursor->end - cursor->at) < size) {
+    cursor->is_error = true;
+    cursor->at = cursor->end;
+    return 0;
+  }
+
+  DWORD64 result = 0;
+  memcpy(&result, cursor->at, size); // Little endian only
+  cursor->at += size;
+
+  return result;
+}
+
+static inline DWORD64 DwarfReadUleb(DwarfCursor *cursor) {
+  DWORD64 result = 0;
+  DWORD shift = 0;
+  while (cursor->at < cursor->end) {
+    const BYTE byte = *cursor->at++;
+    if (shift < 64) {
+      result |= (DWORD64)(byte & 0x7f) << shift;
+    }
+    shift += 7;
+
+    if (!(byte & 0x80)) {
+      return result;
+    }
+  }
+
+  cursor->is_error = true;
+  return 0;
+}
+
+static inline int64_t DwarfReadSleb(DwarfCursor *cursor) {
+  int64_t result = 0;
+  DWORD shift = 0;
+  while (cursor->at < cursor->end) {
+    const BYTE byte = *cursor->at++;
+    if (shift < 64) {
+      result |= (int64_t)(byte & 0x7f) << shift;
+    }
+    shift += 7;
+
+    if (!(byte & 0x80)) {
+      if (shift < 64 && (byte & 0x40)) {
+        result |= -((int64_t)1 << shift);
+      }
+      return result;
+    }
+  }
+
+  cursor->is_error = true;
+  return 0;
+}
+
+static inline const char *DwarfReadString(DwarfCursor *cursor) {
+  const BYTE *terminator =
+      (const BYTE *)memchr(cursor->at, '\0', cursor->end - cursor->at);
+  if (!terminator) {
+    cursor->is_error = true;
+    cursor->at = cursor->end;
+    return "";
+  }
+
+  const char *result = (const char *)cursor->at;
+  cursor->at = terminator + 1;
+
+  return result;
+}
\ No newline at end of file
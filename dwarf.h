@@ -0,0 +1,7 @@
+// Bounds checked reader over DWARF data. Reading past the end sets
+// "is_error" and returns zeros, so callers check it once per record.
+struct DwarfCursor {
+  const BYTE *at;
+  const BYTE *end;
+  bool is_error;
+};
\ No newline at end of file
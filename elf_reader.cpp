@@ -0,0 +1,1274 @@
+#define ELF_FILE_INDEX_NONE 0xffffffff
+
+// DWARF constants, from the DWARF 5 specification
+#define DW_LNS_copy 1
+#define DW_LNS_advance_pc 2
+#define DW_LNS_advance_line 3
+#define DW_LNS_set_file 4
+#define DW_LNS_negate_stmt 6
+#define DW_LNS_const_add_pc 8
+#define DW_LNS_fixed_advance_pc 9
+#define DW_LNE_end_sequence 1
+#define DW_LNE_set_address 2
+#define DW_LNE_define_file 3
+#define DW_LNCT_path 1
+#define DW_LNCT_directory_index 2
+#define DW_FORM_block 0x09
+#define DW_FORM_block1 0x0a
+#define DW_FORM_block2 0x03
+#define DW_FORM_block4 0x04
+#define DW_FORM_data1 0x0b
+#define DW_FORM_data2 0x05
+#define DW_FORM_data4 0x06
+#define DW_FORM_data8 0x07
+#define DW_FORM_data16 0x1e
+#define DW_FORM_string 0x08
+#define DW_FORM_strp 0x0e
+#define DW_FORM_udata 0x0f
+#define DW_FORM_line_strp 0x1f
+#define DW_FORM_addr 0x01
+#define DW_FORM_flag 0x0c
+#define DW_FORM_sdata 0x0d
+#define DW_FORM_ref_addr 0x10
+#define DW_FORM_ref1 0x11
+#define DW_FORM_ref2 0x12
+#define DW_FORM_ref4 0x13
+#define DW_FORM_ref8 0x14
+#define DW_FORM_ref_udata 0x15
+#define DW_FORM_indirect 0x16
+#define DW_FORM_sec_offset 0x17
+#define DW_FORM_exprloc 0x18
+#define DW_FORM_flag_present 0x19
+#define DW_FORM_strx 0x1a
+#define DW_FORM_addrx 0x1b
+#define DW_FORM_ref_sup4 0x1c
+#define DW_FORM_strp_sup 0x1d
+#define DW_FORM_ref_sig8 0x20
+#define DW_FORM_implicit_const 0x21
+#define DW_FORM_loclistx 0x22
+#define DW_FORM_rnglistx 0x23
+#define DW_FORM_ref_sup8 0x24
+#define DW_FORM_strx1 0x25
+#define DW_FORM_strx2 0x26
+#define DW_FORM_strx3 0x27
+#define DW_FORM_strx4 0x28
+#define DW_FORM_addrx1 0x29
+#define DW_FORM_addrx2 0x2a
+#define DW_FORM_addrx3 0x2b
+#define DW_FORM_addrx4 0x2c
+#define DW_FORM_GNU_addr_index 0x1f01
+#define DW_FORM_GNU_str_index 0x1f02
+#define DW_FORM_GNU_ref_alt 0x1f20
+#define DW_FORM_GNU_strp_alt 0x1f21
+#define DW_TAG_inlined_subroutine 0x1d
+#define DW_AT_name 0x03
+#define DW_AT_low_pc 0x11
+#define DW_AT_high_pc 0x12
+#define DW_AT_abstract_origin 0x31
+#define DW_AT_specification 0x47
+#define DW_AT_ranges 0x55
+#define DW_AT_str_offsets_base 0x72
+#define DW_AT_addr_base 0x73
+#define DW_AT_rnglists_base 0x74
+#define DW_UT_compile 0x01
+#define DW_UT_partial 0x03
+#define DW_RLE_end_of_list 0x00
+#define DW_RLE_base_addressx 0x01
+#define DW_RLE_startx_endx 0x02
+#define DW_RLE_startx_length 0x03
+#define DW_RLE_offset_pair 0x04
+#define DW_RLE_base_address 0x05
+#define DW_RLE_start_end 0x06
+#define DW_RLE_start_length 0x07
+
+#define DWARF_MAX_ABBREV_CODE 65536 // Codes are dense, usually from 1 on
+#define DWARF_MAX_ORIGIN_DEPTH 4    // Abstract origin of a specification...
+
+// String from a string section, "" if the offset is out of bounds
+static inline const char *ElfGetString(const ElfSection &section,
+                                       DWORD64 offset) {
+  if (offset >= section.size ||
+      !memchr(section.data + offset, '\0', section.size - offset)) {
+    return "";
+  }
+
+  return (const char *)section.data + offset;
+}
+
+static void ElfFileUnmap(ElfFile *elf_file) {
+  if (elf_file->data) {
+    munmap((void *)elf_file->data, elf_file->size);
+  }
+  if (elf_file->file >= 0) {
+    close(elf_file->file);
+  }
+}
+
+static bool ElfFileMap(ElfFile *elf_file, const std::string &path) {
+  *elf_file = {};
+  elf_file->file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (elf_file->file < 0) {
+    LOG_IMGUI(ElfFileMap, "Unable to open ", path)
+    return false;
+  }
+
+  struct stat file_stat;
+  if (fstat(elf_file->file, &file_stat) < 0 ||
+      (size_t)file_stat.st_size < sizeof(Elf64_Ehdr)) {
+    LOG_IMGUI(ElfFileMap, "Not an ELF file ", path)
+    ElfFileUnmap(elf_file);
+    return false;
+  }
+
+  elf_file->size = (size_t)file_stat.st_size;
+  void *data =
+      mmap(NULL, elf_file->size, PROT_READ, MAP_PRIVATE, elf_file->file, 0);
+  if (data == MAP_FAILED) {
+    LOG_IMGUI(ElfFileMap, "mmap failed, error = ", errno)
+    ElfFileUnmap(elf_file);
+    return false;
+  }
+  elf_file->data = (const BYTE *)data;
+
+  const Elf64_Ehdr *header = (const Elf64_Ehdr *)elf_file->data;
+  if (memcmp(header->e_ident, ELFMAG, SELFMAG) != 0 ||
+      header->e_ident[EI_CLASS] != ELFCLASS64 ||
+      header->e_ident[EI_DATA] != ELFDATA2LSB ||
+      header->e_shentsize != sizeof(Elf64_Shdr) ||
+      header->e_shoff > elf_file->size ||
+      (elf_file->size - header->e_shoff) / sizeof(Elf64_Shdr) <
+          header->e_shnum ||
+      header->e_phoff > elf_file->size ||
+      (elf_file->size - header->e_phoff) / sizeof(Elf64_Phdr) <
+          header->e_phnum ||
+      header->e_shstrndx >= header->e_shnum) {
+    LOG_IMGUI(ElfFileMap, "Unsupported ELF file ", path)
+    ElfFileUnmap(elf_file);
+    return false;
+  }
+
+  const Elf64_Phdr *program_headers =
+      (const Elf64_Phdr *)(elf_file->data + header->e_phoff);
+  elf_file->load_address = ~(DWORD64)0;
+  for (size_t i = 0; i < header->e_phnum; ++i) {
+    if (program_headers[i].p_type == PT_LOAD) {
+      elf_file->load_address =
+          std::min<DWORD64>(elf_file->load_address,
+                            program_headers[i].p_vaddr &
+                                ~(program_headers[i].p_align - 1));
+    }
+  }
+  if (elf_file->load_address == ~(DWORD64)0) {
+    elf_file->load_address = 0;
+  }
+
+  const Elf64_Shdr *sections =
+      (const Elf64_Shdr *)(elf_file->data + header->e_shoff);
+  const Elf64_Shdr &names = sections[header->e_shstrndx];
+  if (names.sh_offset > elf_file->size ||
+      names.sh_size > elf_file->size - names.sh_offset) {
+    LOG_IMGUI(ElfFileMap, "Broken section names in ", path)
+    ElfFileUnmap(elf_file);
+    return false;
+  }
+  const ElfSection section_names = {elf_file->data + names.sh_offset,
+                                    names.sh_size};
+
+  ElfSection dynsym = {};
+  ElfSection dynstr = {};
+  for (size_t i = 0; i < header->e_shnum; ++i) {
+    const Elf64_Shdr &section = sections[i];
+    if (section.sh_type == SHT_NOBITS || section.sh_offset > elf_file->size ||
+        section.sh_size > elf_file->size - section.sh_offset) {
+      continue;
+    }
+
+    const char *name = ElfGetString(section_names, section.sh_name);
+    const ElfSection data = {elf_file->data + section.sh_offset,
+                             section.sh_size};
+
+    if (section.sh_flags & SHF_COMPRESSED) {
+      if (strncmp(name, ".debug_", 7) == 0) {
+        LOG_IMGUI(ElfFileMap, "Compressed ", name, " in ", path,
+                  " is not supported")
+      }
+      continue;
+    }
+
+    if (strcmp(name, ".symtab") == 0) {
+      elf_file->symtab = data;
+      if (section.sh_link < header->e_shnum) {
+        const Elf64_Shdr &link = sections[section.sh_link];
+        if (link.sh_offset <= elf_file->size &&
+            link.sh_size <= elf_file->size - link.sh_offset) {
+          elf_file->strtab = {elf_file->data + link.sh_offset, link.sh_size};
+        }
+      }
+    } else if (strcmp(name, ".dynsym") == 0) {
+      dynsym = data;
+    } else if (strcmp(name, ".dynstr") == 0) {
+      dynstr = data;
+    } else if (strcmp(name, ".debug_line") == 0) {
+      elf_file->debug_line = data;
+    } else if (strcmp(name, ".debug_line_str") == 0) {
+      elf_file->debug_line_str = data;
+    } else if (strcmp(name, ".debug_str") == 0) {
+      elf_file->debug_str = data;
+    } else if (strcmp(name, ".debug_info") == 0) {
+      elf_file->debug_info = data;
+    } else if (strcmp(name, ".debug_abbrev") == 0) {
+      elf_file->debug_abbrev = data;
+    } else if (strcmp(name, ".debug_ranges") == 0) {
+      elf_file->debug_ranges = data;
+    } else if (strcmp(name, ".debug_rnglists") == 0) {
+      elf_file->debug_rnglists = data;
+    } else if (strcmp(name, ".debug_addr") == 0) {
+      elf_file->debug_addr = data;
+    } else if (strcmp(name, ".debug_str_offsets") == 0) {
+      elf_file->debug_str_offsets = data;
+    } else if (strcmp(name, ".eh_frame") == 0) {
+      elf_file->eh_frame = data;
+      elf_file->eh_frame_address = section.sh_addr;
+    }
+  }
+
+  // Stripped binaries still have exported functions
+  if (!elf_file->symtab.data) {
+    elf_file->symtab = dynsym;
+    elf_file->strtab = dynstr;
+  }
+
+  return true;
+}
+
+static void ElfReadFunctions(const ElfFile *elf_file,
+                             ModuleIndex *module_index) {
+  auto &functions = module_index->functions;
+  auto &names = module_index->names;
+
+  const Elf64_Sym *symbols = (const Elf64_Sym *)elf_file->symtab.data;
+  const size_t symbol_count = elf_file->symtab.size / sizeof(Elf64_Sym);
+
+  // Names are copied into one buffer, never more than the string table
+  names.reserve(names.size() + elf_file->strtab.size);
+
+  for (size_t i = 0; i < symbol_count; ++i) {
+    const Elf64_Sym &symbol = symbols[i];
+    if (ELF64_ST_TYPE(symbol.st_info) != STT_FUNC || symbol.st_size == 0 ||
+        symbol.st_shndx == SHN_UNDEF || symbol.st_value < elf_file->load_address) {
+      continue;
+    }
+
+    const char *name = ElfGetString(elf_file->strtab, symbol.st_name);
+    const DWORD start_rva = (DWORD)(symbol.st_value - elf_file->load_address);
+
+    functions.emplace_back(ModuleFunction{start_rva,
+                                          start_rva + (DWORD)symbol.st_size,
+                                          (DWORD)names.size()});
+    names.append(name);
+    names.push_back('\0');
+  }
+
+  // Aliases share an address, keep the first name
+  std::sort(functions.begin(), functions.end(),
+            [](const ModuleFunction &a, const ModuleFunction &b) {
+              return a.start_rva < b.start_rva;
+            });
+  functions.erase(std::unique(functions.begin(), functions.end(),
+                              [](const ModuleFunction &a,
+                                 const ModuleFunction &b) {
+                                return a.start_rva == b.start_rva;
+                              }),
+                  functions.end());
+}
+
+// Reads one attribute of a DWARF 5 directory or file entry. Strings are
+// returned in "string", numbers in "value".
+static bool DwarfReadEntryForm(const ElfFile *elf_file, DwarfCursor *cursor,
+                               DWORD64 form, bool is_64, const char **string,
+                               DWORD64 *value) {
+  *string = NULL;
+  *value = 0;
+
+  switch (form) {
+  case DW_FORM_string:
+    *string = DwarfReadString(cursor);
+    break;
+  case DW_FORM_line_strp:
+    *string = ElfGetString(elf_file->debug_line_str,
+                           DwarfReadU(cursor, is_64 ? 8 : 4));
+    break;
+  case DW_FORM_strp:
+    *string =
+        ElfGetString(elf_file->debug_str, DwarfReadU(cursor, is_64 ? 8 : 4));
+    break;
+  case DW_FORM_udata:
+    *value = DwarfReadUleb(cursor);
+    break;
+  case DW_FORM_data1:
+    *value = DwarfReadU(cursor, 1);
+    break;
+  case DW_FORM_data2:
+    *value = DwarfReadU(cursor, 2);
+    break;
+  case DW_FORM_data4:
+    *value = DwarfReadU(cursor, 4);
+    break;
+  case DW_FORM_data8:
+    *value = DwarfReadU(cursor, 8);
+    break;
+  case DW_FORM_data16:
+    DwarfReadU(cursor, 8);
+    DwarfReadU(cursor, 8);
+    break;
+  case DW_FORM_block:
+  case DW_FORM_block1:
+  case DW_FORM_block2:
+  case DW_FORM_block4: {
+    const DWORD64 size = form == DW_FORM_block    ? DwarfReadUleb(cursor)
+                         : form == DW_FORM_block1 ? DwarfReadU(cursor, 1)
+                         : form == DW_FORM_block2 ? DwarfReadU(cursor, 2)
+                                                  : DwarfReadU(cursor, 4);
+    if (size > (DWORD64)(cursor->end - cursor->at)) {
+      return false;
+    }
+    cursor->at += size;
+  } break;
+  default:
+    // Forms that need other sections (strx) aren't produced for line tables
+    // by GCC or Clang
+    return false;
+  }
+
+  return !cursor->is_error;
+}
+
+// DWARF 5 directory and file name tables
+static bool DwarfReadEntries(const ElfFile *elf_file, DwarfCursor *cursor,
+                             bool is_64, std::vector<const char *> *directories,
+                             std::vector<DwarfFileEntry> *files) {
+  for (int table = 0; table < 2; ++table) {
+    DWORD64 formats[16][2];
+    const DWORD format_count = (DWORD)DwarfReadU(cursor, 1);
+    if (format_count > 16) {
+      return false;
+    }
+    for (DWORD i = 0; i < format_count; ++i) {
+      formats[i][0] = DwarfReadUleb(cursor);
+      formats[i][1] = DwarfReadUleb(cursor);
+    }
+
+    const DWORD64 count = DwarfReadUleb(cursor);
+    if (cursor->is_error || count > (DWORD64)(cursor->end - cursor->at)) {
+      return false;
+    }
+
+    for (DWORD64 i = 0; i < count; ++i) {
+      const char *path = "";
+      DWORD64 directory_index = 0;
+      for (DWORD j = 0; j < format_count; ++j) {
+        const char *string;
+        DWORD64 value;
+        if (!DwarfReadEntryForm(elf_file, cursor, formats[j][1], is_64,
+                                &string, &value)) {
+          return false;
+        }
+
+        if (formats[j][0] == DW_LNCT_path && string) {
+          path = string;
+        } else if (formats[j][0] == DW_LNCT_directory_index) {
+          directory_index = value;
+        }
+      }
+
+      if (table == 0) {
+        directories->push_back(path);
+      } else {
+        files->push_back(
+            DwarfFileEntry{path, (DWORD)directory_index, ELF_FILE_INDEX_NONE});
+      }
+    }
+  }
+
+  return true;
+}
+
+// DWARF 2-4 include_directories and file_names. Index 0 is the compilation
+// directory and the primary file, which these versions leave implicit.
+static bool DwarfReadLegacyEntries(DwarfCursor *cursor,
+                                   std::vector<const char *> *directories,
+                                   std::vector<DwarfFileEntry> *files) {
+  directories->push_back("");
+  files->push_back(DwarfFileEntry{"", 0, ELF_FILE_INDEX_NONE});
+
+  while (!cursor->is_error) {
+    const char *directory = DwarfReadString(cursor);
+    if (!*directory) {
+      break;
+    }
+    directories->push_back(directory);
+  }
+
+  while (!cursor->is_error) {
+    const char *name = DwarfReadString(cursor);
+    if (!*name) {
+      break;
+    }
+
+    const DWORD directory_index = (DWORD)DwarfReadUleb(cursor);
+    DwarfReadUleb(cursor); // Modification time
+    DwarfReadUleb(cursor); // File size
+    files->push_back(
+        DwarfFileEntry{name, directory_index, ELF_FILE_INDEX_NONE});
+  }
+
+  return !cursor->is_error;
+}
+
+// Path is put together in "path", that every unit reuses. Only a file that
+// is new to the module is copied.
+static DWORD DwarfInternFile(DwarfFileEntry *file,
+                             const std::vector<const char *> &directories,
+                             std::unordered_map<std::string, DWORD> *file_ids,
+                             std::string *path, ModuleIndex *module_index) {
+  if (file->file_index != ELF_FILE_INDEX_NONE) {
+    return file->file_index;
+  }
+
+  path->clear();
+  if (file->name[0] != '/' && file->directory_index < directories.size() &&
+      *directories[file->directory_index]) {
+    path->append(directories[file->directory_index]);
+    path->push_back('/');
+  }
+  path->append(file->name);
+
+  auto it = file_ids->find(*path);
+  if (it == file_ids->end()) {
+    it = file_ids->emplace(*path, (DWORD)module_index->source_files.size())
+             .first;
+    module_index->source_files.push_back(*path);
+  }
+
+  file->file_index = it->second;
+
+  return file->file_index;
+}
+
+// Runs the line number program of every unit in .debug_line. Only statement
+// rows are kept, and the last row wins when several share an address.
+static void ElfReadLines(const ElfFile *elf_file, ModuleIndex *module_index) {
+  auto &lines = module_index->lines;
+
+  std::unordered_map<std::string, DWORD> file_ids;
+  std::string path;
+  std::vector<const char *> directories;
+  std::vector<DwarfFileEntry> files;
+
+  DwarfCursor unit_cursor = {elf_file->debug_line.data,
+                             elf_file->debug_line.data +
+                                 elf_file->debug_line.size,
+                             false};
+  while (unit_cursor.at < unit_cursor.end) {
+    // Unit header
+    DWORD64 unit_length = DwarfReadU(&unit_cursor, 4);
+    const bool is_64 = unit_length == 0xffffffff;
+    if (is_64) {
+      unit_length = DwarfReadU(&unit_cursor, 8);
+    }
+    if (unit_cursor.is_error ||
+        unit_length > (DWORD64)(unit_cursor.end - unit_cursor.at)) {
+      LOG_IMGUI(ElfReadLines, "Broken line table unit")
+      return;
+    }
+
+    const BYTE *unit_end = unit_cursor.at + unit_length;
+    DwarfCursor cursor = {unit_cursor.at, unit_end, false};
+    unit_cursor.at = unit_end;
+
+    const DWORD version = (DWORD)DwarfReadU(&cursor, 2);
+    if (version < 2 || version > 5) {
+      continue;
+    }
+
+    DWORD address_size = 8;
+    if (version >= 5) {
+      address_size = (DWORD)DwarfReadU(&cursor, 1);
+      DwarfReadU(&cursor, 1); // Segment selector size
+    }
+
+    const DWORD64 header_length = DwarfReadU(&cursor, is_64 ? 8 : 4);
+    if (cursor.is_error ||
+        header_length > (DWORD64)(cursor.end - cursor.at)) {
+      continue;
+    }
+    const BYTE *program = cursor.at + header_length;
+
+    const DWORD minimum_instruction_length = (DWORD)DwarfReadU(&cursor, 1);
+    if (version >= 4) {
+      DwarfReadU(&cursor, 1); // Maximum operations per instruction, VLIW only
+    }
+    const bool default_is_stmt = DwarfReadU(&cursor, 1) != 0;
+    const int line_base = (int8_t)DwarfReadU(&cursor, 1);
+    const DWORD line_range = (DWORD)DwarfReadU(&cursor, 1);
+    const DWORD opcode_base = (DWORD)DwarfReadU(&cursor, 1);
+    if (cursor.is_error || line_range == 0 || opcode_base == 0 ||
+        opcode_base - 1 > (DWORD)(cursor.end - cursor.at)) {
+      continue;
+    }
+    const BYTE *standard_opcode_lengths = cursor.at;
+    cursor.at += opcode_base - 1;
+
+    directories.clear();
+    files.clear();
+    const bool has_entries =
+        version >= 5
+            ? DwarfReadEntries(elf_file, &cursor, is_64, &directories, &files)
+            : DwarfReadLegacyEntries(&cursor, &directories, &files);
+    if (!has_entries) {
+      LOG_IMGUI(ElfReadLines, "Unsupported line table header")
+      continue;
+    }
+
+    // Line number program
+    cursor.at = program;
+
+    DWORD64 address = 0;
+    DWORD64 file = 1;
+    int64_t line = 1;
+    bool is_stmt = default_is_stmt;
+    bool is_sequence_valid = true;
+
+    const auto emit_row = [&]() {
+      if (!is_stmt || !is_sequence_valid || line <= 0 ||
+          file >= files.size() || address < elf_file->load_address) {
+        return;
+      }
+
+      const ModuleLine row = {
+          (DWORD)(address - elf_file->load_address),
+          DwarfInternFile(&files[file], directories, &file_ids, &path,
+                          module_index),
+          (DWORD)line};
+      if (!lines.empty() && lines.back().rva == row.rva) {
+        lines.back() = row;
+      } else {
+        lines.push_back(row);
+      }
+    };
+
+    while (cursor.at < cursor.end && !cursor.is_error) {
+      const DWORD opcode = (DWORD)DwarfReadU(&cursor, 1);
+
+      if (opcode >= opcode_base) {
+        const DWORD adjusted_opcode = opcode - opcode_base;
+        address += (adjusted_opcode / line_range) * minimum_instruction_length;
+        line += line_base + (int)(adjusted_opcode % line_range);
+        emit_row();
+        continue;
+      }
+
+      switch (opcode) {
+      case 0: {
+        const DWORD64 length = DwarfReadUleb(&cursor);
+        if (cursor.is_error || length == 0 ||
+            length > (DWORD64)(cursor.end - cursor.at)) {
+          cursor.is_error = true;
+          break;
+        }
+        const BYTE *next = cursor.at + length;
+
+        switch (DwarfReadU(&cursor, 1)) {
+        case DW_LNE_end_sequence:
+          address = 0;
+          file = 1;
+          line = 1;
+          is_stmt = default_is_stmt;
+          is_sequence_valid = true;
+          break;
+        case DW_LNE_set_address:
+          address = DwarfReadU(&cursor, std::min<DWORD>(address_size, 8));
+          // Functions dropped by the linker are left at address 0
+          is_sequence_valid = address >= elf_file->load_address && address;
+          break;
+        case DW_LNE_define_file: {
+          const char *name = DwarfReadString(&cursor);
+          const DWORD directory_index = (DWORD)DwarfReadUleb(&cursor);
+          files.push_back(
+              DwarfFileEntry{name, directory_index, ELF_FILE_INDEX_NONE});
+        } break;
+        default:
+          break;
+        }
+
+        cursor.at = next;
+      } break;
+      case DW_LNS_copy:
+        emit_row();
+        break;
+      case DW_LNS_advance_pc:
+        address += DwarfReadUleb(&cursor) * minimum_instruction_length;
+        break;
+      case DW_LNS_advance_line:
+        line += DwarfReadSleb(&cursor);
+        break;
+      case DW_LNS_set_file:
+        file = DwarfReadUleb(&cursor);
+        break;
+      case DW_LNS_const_add_pc:
+        address += ((255 - opcode_base) / line_range) *
+                   minimum_instruction_length;
+        break;
+      case DW_LNS_fixed_advance_pc:
+        address += DwarfReadU(&cursor, 2);
+        break;
+      case DW_LNS_negate_stmt:
+        is_stmt = !is_stmt;
+        break;
+      default:
+        // Everything else only has ULEB operands, including unknown opcodes
+        for (DWORD i = 0; i < standard_opcode_lengths[opcode - 1]; ++i) {
+          DwarfReadUleb(&cursor);
+        }
+        break;
+      }
+    }
+  }
+}
+
+// Abbreviation table that starts at the offset, false if it's broken. The
+// attributes of all the abbrevs are in one array, that the unit keeps for
+// the next one.
+static bool DwarfReadAbbrevs(const ElfFile *elf_file, DWORD64 offset,
+                             std::vector<DwarfAbbrev> *abbrevs,
+                             std::vector<DwarfAbbrevAttribute> *attributes) {
+  const ElfSection &section = elf_file->debug_abbrev;
+  if (offset >= section.size) {
+    return false;
+  }
+
+  abbrevs->clear();
+  attributes->clear();
+  DwarfCursor cursor = {section.data + offset, section.data + section.size,
+                        false};
+  while (!cursor.is_error) {
+    const DWORD64 code = DwarfReadUleb(&cursor);
+    if (code == 0) {
+      return !cursor.is_error;
+    }
+    if (code > DWARF_MAX_ABBREV_CODE) {
+      return false;
+    }
+    if (code > abbrevs->size()) {
+      abbrevs->resize(code);
+    }
+
+    DwarfAbbrev &abbrev = (*abbrevs)[code - 1];
+    abbrev.tag = DwarfReadUleb(&cursor);
+    abbrev.has_children = DwarfReadU(&cursor, 1) != 0;
+    abbrev.first_attribute = (DWORD)attributes->size();
+    while (!cursor.is_error) {
+      const DWORD64 name = DwarfReadUleb(&cursor);
+      const DWORD64 form = DwarfReadUleb(&cursor);
+      if (name == 0 && form == 0) {
+        break;
+      }
+
+      const int64_t implicit_const =
+          form == DW_FORM_implicit_const ? DwarfReadSleb(&cursor) : 0;
+      attributes->push_back(DwarfAbbrevAttribute{name, form, implicit_const});
+    }
+    abbrev.attribute_count =
+        (DWORD)attributes->size() - abbrev.first_attribute;
+  }
+
+  return false;
+}
+
+// Reads one attribute of a DIE. Strings are resolved right away when that
+// doesn't need the unit DIE, see DwarfGetString for the rest.
+static bool DwarfReadAttribute(const ElfFile *elf_file, const DwarfUnit *unit,
+                               DwarfCursor *cursor, DWORD64 form,
+                               int64_t implicit_const,
+                               DwarfAttribute *attribute) {
+  const DWORD offset_size = unit->is_64 ? 8 : 4;
+
+  attribute->form = form;
+  attribute->value = 0;
+  attribute->string = NULL;
+
+  switch (form) {
+  case DW_FORM_addr:
+    attribute->value = DwarfReadU(cursor, unit->address_size);
+    break;
+  case DW_FORM_data1:
+  case DW_FORM_ref1:
+  case DW_FORM_flag:
+  case DW_FORM_strx1:
+  case DW_FORM_addrx1:
+    attribute->value = DwarfReadU(cursor, 1);
+    break;
+  case DW_FORM_data2:
+  case DW_FORM_ref2:
+  case DW_FORM_strx2:
+  case DW_FORM_addrx2:
+    attribute->value = DwarfReadU(cursor, 2);
+    break;
+  case DW_FORM_strx3:
+  case DW_FORM_addrx3:
+    attribute->value = DwarfReadU(cursor, 3);
+    break;
+  case DW_FORM_data4:
+  case DW_FORM_ref4:
+  case DW_FORM_ref_sup4:
+  case DW_FORM_strx4:
+  case DW_FORM_addrx4:
+    attribute->value = DwarfReadU(cursor, 4);
+    break;
+  case DW_FORM_data8:
+  case DW_FORM_ref8:
+  case DW_FORM_ref_sig8:
+  case DW_FORM_ref_sup8:
+    attribute->value = DwarfReadU(cursor, 8);
+    break;
+  case DW_FORM_data16:
+    DwarfReadU(cursor, 8);
+    DwarfReadU(cursor, 8);
+    break;
+  case DW_FORM_sdata:
+    attribute->value = (DWORD64)DwarfReadSleb(cursor);
+    break;
+  case DW_FORM_udata:
+  case DW_FORM_ref_udata:
+  case DW_FORM_strx:
+  case DW_FORM_addrx:
+  case DW_FORM_loclistx:
+  case DW_FORM_rnglistx:
+  case DW_FORM_GNU_addr_index:
+  case DW_FORM_GNU_str_index:
+    attribute->value = DwarfReadUleb(cursor);
+    break;
+  case DW_FORM_strp:
+  case DW_FORM_line_strp:
+  case DW_FORM_sec_offset:
+  case DW_FORM_strp_sup:
+  case DW_FORM_GNU_ref_alt:
+  case DW_FORM_GNU_strp_alt:
+    attribute->value = DwarfReadU(cursor, offset_size);
+    break;
+  case DW_FORM_ref_addr:
+    attribute->value = DwarfReadU(
+        cursor, unit->version <= 2 ? unit->address_size : offset_size);
+    break;
+  case DW_FORM_string:
+    attribute->string = DwarfReadString(cursor);
+    break;
+  case DW_FORM_flag_present:
+    attribute->value = 1;
+    break;
+  case DW_FORM_implicit_const:
+    attribute->value = (DWORD64)implicit_const;
+    break;
+  case DW_FORM_block:
+  case DW_FORM_block1:
+  case DW_FORM_block2:
+  case DW_FORM_block4:
+  case DW_FORM_exprloc: {
+    const DWORD64 size = form == DW_FORM_block1   ? DwarfReadU(cursor, 1)
+                         : form == DW_FORM_block2 ? DwarfReadU(cursor, 2)
+                         : form == DW_FORM_block4 ? DwarfReadU(cursor, 4)
+                                                  : DwarfReadUleb(cursor);
+    if (size > (DWORD64)(cursor->end - cursor->at)) {
+      return false;
+    }
+    cursor->at += size;
+  } break;
+  case DW_FORM_indirect: {
+    const DWORD64 actual_form = DwarfReadUleb(cursor);
+    if (actual_form == DW_FORM_indirect) {
+      return false;
+    }
+    return DwarfReadAttribute(elf_file, unit, cursor, actual_form,
+                              implicit_const, attribute);
+  }
+  default:
+    return false;
+  }
+
+  if (form == DW_FORM_strp) {
+    attribute->string = ElfGetString(elf_file->debug_str, attribute->value);
+  } else if (form == DW_FORM_line_strp) {
+    attribute->string =
+        ElfGetString(elf_file->debug_line_str, attribute->value);
+  }
+
+  return !cursor->is_error;
+}
+
+// Entry "index" of the unit's .debug_addr table
+static bool DwarfReadIndexedAddress(const ElfFile *elf_file,
+                                    const DwarfUnit *unit, DWORD64 index,
+                                    DWORD64 *address) {
+  const ElfSection &section = elf_file->debug_addr;
+  if (index > section.size) {
+    return false;
+  }
+
+  const DWORD64 offset = unit->addr_base + index * unit->address_size;
+  if (offset > section.size || section.size - offset < unit->address_size) {
+    return false;
+  }
+
+  *address = 0;
+  memcpy(address, section.data + offset, unit->address_size);
+
+  return true;
+}
+
+// Value of an address class attribute, false for other forms
+static bool DwarfGetAddress(const ElfFile *elf_file, const DwarfUnit *unit,
+                            const DwarfAttribute &attribute,
+                            DWORD64 *address) {
+  switch (attribute.form) {
+  case DW_FORM_addr:
+    *address = attribute.value;
+    return true;
+  case DW_FORM_addrx:
+  case DW_FORM_addrx1:
+  case DW_FORM_addrx2:
+  case DW_FORM_addrx3:
+  case DW_FORM_addrx4:
+  case DW_FORM_GNU_addr_index:
+    return DwarfReadIndexedAddress(elf_file, unit, attribute.value, address);
+  default:
+    return false;
+  }
+}
+
+// Value of a string class attribute, NULL for other forms
+static const char *DwarfGetString(const ElfFile *elf_file,
+                                  const DwarfUnit *unit,
+                                  const DwarfAttribute &attribute) {
+  if (attribute.string) {
+    return attribute.string;
+  }
+
+  switch (attribute.form) {
+  case DW_FORM_strx:
+  case DW_FORM_strx1:
+  case DW_FORM_strx2:
+  case DW_FORM_strx3:
+  case DW_FORM_strx4:
+  case DW_FORM_GNU_str_index: {
+    const ElfSection &section = elf_file->debug_str_offsets;
+    const DWORD offset_size = unit->is_64 ? 8 : 4;
+    if (attribute.value > section.size) {
+      return NULL;
+    }
+
+    const DWORD64 at = unit->str_offsets_base + attribute.value * offset_size;
+    if (at > section.size || section.size - at < offset_size) {
+      return NULL;
+    }
+
+    DWORD64 offset = 0;
+    memcpy(&offset, section.data + at, offset_size);
+    return ElfGetString(elf_file->debug_str, offset);
+  }
+  default:
+    return NULL;
+  }
+}
+
+// Next DIE, only the attributes that DwarfDie has are kept
+static bool DwarfReadDie(const ElfFile *elf_file, const DwarfUnit *unit,
+                         DwarfCursor *cursor, DwarfDie *die) {
+  *die = {};
+
+  const DWORD64 code = DwarfReadUleb(cursor);
+  if (cursor->is_error) {
+    return false;
+  }
+  if (code == 0) {
+    return true;
+  }
+  if (code > unit->abbrevs.size() || !unit->abbrevs[code - 1].tag) {
+    return false;
+  }
+
+  const DwarfAbbrev &abbrev = unit->abbrevs[code - 1];
+  die->tag = abbrev.tag;
+  die->has_children = abbrev.has_children;
+
+  const DwarfAbbrevAttribute *attributes =
+      unit->abbrev_attributes.data() + abbrev.first_attribute;
+  for (DWORD i = 0; i < abbrev.attribute_count; ++i) {
+    const DwarfAbbrevAttribute &attribute = attributes[i];
+    DwarfAttribute value;
+    if (!DwarfReadAttribute(elf_file, unit, cursor, attribute.form,
+                            attribute.implicit_const, &value)) {
+      return false;
+    }
+
+    switch (attribute.name) {
+    case DW_AT_name:
+      die->name = value;
+      break;
+    case DW_AT_low_pc:
+      die->low_pc = value;
+      break;
+    case DW_AT_high_pc:
+      die->high_pc = value;
+      break;
+    case DW_AT_ranges:
+      die->ranges = value;
+      break;
+    case DW_AT_abstract_origin:
+    case DW_AT_specification:
+      die->origin = value;
+      break;
+    case DW_AT_str_offsets_base:
+      die->str_offsets_base = value;
+      break;
+    case DW_AT_addr_base:
+      die->addr_base = value;
+      break;
+    case DW_AT_rnglists_base:
+      die->rnglists_base = value;
+      break;
+    }
+  }
+
+  return true;
+}
+
+// Name of the DIE, or of the one it's an inlined copy or a definition of.
+// NULL if there is none. References out of the unit aren't followed.
+static const char *DwarfGetDieName(const ElfFile *elf_file,
+                                   const DwarfUnit *unit,
+                                   const DwarfDie &die) {
+  DwarfDie current = die;
+  for (DWORD depth = 0; depth <= DWARF_MAX_ORIGIN_DEPTH; ++depth) {
+    if (current.name.form) {
+      return DwarfGetString(elf_file, unit, current.name);
+    }
+
+    const DwarfAttribute &origin = current.origin;
+    const BYTE *at;
+    switch (origin.form) {
+    case DW_FORM_ref1:
+    case DW_FORM_ref2:
+    case DW_FORM_ref4:
+    case DW_FORM_ref8:
+    case DW_FORM_ref_udata:
+      if (origin.value >= (DWORD64)(unit->end - unit->begin)) {
+        return NULL;
+      }
+      at = unit->begin + origin.value;
+      break;
+    case DW_FORM_ref_addr:
+      if (origin.value < (DWORD64)(unit->begin - elf_file->debug_info.data) ||
+          origin.value >= (DWORD64)(unit->end - elf_file->debug_info.data)) {
+        return NULL;
+      }
+      at = elf_file->debug_info.data + origin.value;
+      break;
+    default:
+      return NULL;
+    }
+
+    DwarfCursor cursor = {at, unit->end, false};
+    if (!DwarfReadDie(elf_file, unit, &cursor, &current) || !current.tag) {
+      return NULL;
+    }
+  }
+
+  return NULL;
+}
+
+// DWARF 2-4 range list, pairs of addresses relative to the base
+static bool DwarfReadLegacyRanges(
+    const ElfFile *elf_file, const DwarfUnit *unit, DWORD64 offset,
+    std::vector<std::pair<DWORD64, DWORD64>> *ranges) {
+  const ElfSection &section = elf_file->debug_ranges;
+  if (offset >= section.size) {
+    return false;
+  }
+
+  const DWORD64 base_selection =
+      unit->address_size == 8 ? ~(DWORD64)0 : 0xffffffff;
+  DWORD64 base = unit->low_pc;
+
+  DwarfCursor cursor = {section.data + offset, section.data + section.size,
+                        false};
+  while (true) {
+    const DWORD64 begin = DwarfReadU(&cursor, unit->address_size);
+    const DWORD64 end = DwarfReadU(&cursor, unit->address_size);
+    if (cursor.is_error) {
+      return false;
+    }
+
+    if (begin == 0 && end == 0) {
+      return true;
+    }
+    if (begin == base_selection) {
+      base = end;
+      continue;
+    }
+    ranges->emplace_back(base + begin, base + end);
+  }
+}
+
+// DWARF 5 range list, of .debug_rnglists
+static bool DwarfReadRangeList(
+    const ElfFile *elf_file, const DwarfUnit *unit,
+    const DwarfAttribute &attribute,
+    std::vector<std::pair<DWORD64, DWORD64>> *ranges) {
+  const ElfSection &section = elf_file->debug_rnglists;
+
+  // Index into the offsets after the unit's list header
+  DWORD64 offset = attribute.value;
+  if (attribute.form == DW_FORM_rnglistx) {
+    const DWORD offset_size = unit->is_64 ? 8 : 4;
+    if (attribute.value > section.size) {
+      return false;
+    }
+
+    const DWORD64 at = unit->rnglists_base + attribute.value * offset_size;
+    if (at > section.size || section.size - at < offset_size) {
+      return false;
+    }
+
+    offset = 0;
+    memcpy(&offset, section.data + at, offset_size);
+    offset += unit->rnglists_base;
+  }
+  if (offset >= section.size) {
+    return false;
+  }
+
+  DWORD64 base = unit->low_pc;
+
+  DwarfCursor cursor = {section.data + offset, section.data + section.size,
+                        false};
+  while (!cursor.is_error) {
+    DWORD64 begin;
+    DWORD64 end;
+    switch (DwarfReadU(&cursor, 1)) {
+    case DW_RLE_end_of_list:
+      return !cursor.is_error;
+    case DW_RLE_base_addressx:
+      if (!DwarfReadIndexedAddress(elf_file, unit, DwarfReadUleb(&cursor),
+                                   &base)) {
+        return false;
+      }
+      continue;
+    case DW_RLE_startx_endx: {
+      const DWORD64 begin_index = DwarfReadUleb(&cursor);
+      const DWORD64 end_index = DwarfReadUleb(&cursor);
+      if (!DwarfReadIndexedAddress(elf_file, unit, begin_index, &begin) ||
+          !DwarfReadIndexedAddress(elf_file, unit, end_index, &end)) {
+        return false;
+      }
+    } break;
+    case DW_RLE_startx_length:
+      if (!DwarfReadIndexedAddress(elf_file, unit, DwarfReadUleb(&cursor),
+                                   &begin)) {
+        return false;
+      }
+      end = begin + DwarfReadUleb(&cursor);
+      break;
+    case DW_RLE_offset_pair:
+      begin = base + DwarfReadUleb(&cursor);
+      end = base + DwarfReadUleb(&cursor);
+      break;
+    case DW_RLE_base_address:
+      base = DwarfReadU(&cursor, unit->address_size);
+      continue;
+    case DW_RLE_start_end:
+      begin = DwarfReadU(&cursor, unit->address_size);
+      end = DwarfReadU(&cursor, unit->address_size);
+      break;
+    case DW_RLE_start_length:
+      begin = DwarfReadU(&cursor, unit->address_size);
+      end = begin + DwarfReadUleb(&cursor);
+      break;
+    default:
+      return false;
+    }
+
+    ranges->emplace_back(begin, end);
+  }
+
+  return false;
+}
+
+// Link time address ranges of the DIE, either a low and high pc or a list
+static bool DwarfGetRanges(const ElfFile *elf_file, const DwarfUnit *unit,
+                           const DwarfDie &die,
+                           std::vector<std::pair<DWORD64, DWORD64>> *ranges) {
+  DWORD64 low_pc;
+  if (die.high_pc.form &&
+      DwarfGetAddress(elf_file, unit, die.low_pc, &low_pc)) {
+    // High pc is an offset from the low one, unless it's an address too
+    DWORD64 high_pc;
+    if (!DwarfGetAddress(elf_file, unit, die.high_pc, &high_pc)) {
+      high_pc = low_pc + die.high_pc.value;
+    }
+    ranges->emplace_back(low_pc, high_pc);
+    return true;
+  }
+
+  if (!die.ranges.form) {
+    return false;
+  }
+
+  return unit->version >= 5
+             ? DwarfReadRangeList(elf_file, unit, die.ranges, ranges)
+             : DwarfReadLegacyRanges(elf_file, unit, die.ranges.value,
+                                     ranges);
+}
+
+// Inline sites of .debug_info, one per range. The functions they are in come
+// from the symbol table.
+static void ElfReadInlineSites(const ElfFile *elf_file,
+                               ModuleIndex *module_index) {
+  auto &inline_sites = module_index->inline_sites;
+  auto &names = module_index->names;
+
+  // Inlined copies of a function share it's name
+  std::unordered_map<const char *, DWORD> name_offsets;
+  std::vector<std::pair<DWORD64, DWORD64>> ranges;
+  DwarfUnit unit = {};
+  unit.abbrev_offset = ~0ull;
+  DwarfDie die;
+
+  const ElfSection &section = elf_file->debug_info;
+  DwarfCursor unit_cursor = {section.data, section.data + section.size,
+                             false};
+  while (unit_cursor.at < unit_cursor.end) {
+    // Unit header
+    unit.begin = unit_cursor.at;
+    DWORD64 unit_length = DwarfReadU(&unit_cursor, 4);
+    unit.is_64 = unit_length == 0xffffffff;
+    if (unit.is_64) {
+      unit_length = DwarfReadU(&unit_cursor, 8);
+    }
+    if (unit_cursor.is_error ||
+        unit_length > (DWORD64)(unit_cursor.end - unit_cursor.at)) {
+      LOG_IMGUI(ElfReadInlineSites, "Broken debug info unit")
+      return;
+    }
+
+    unit.end = unit_cursor.at + unit_length;
+    DwarfCursor cursor = {unit_cursor.at, unit.end, false};
+    unit_cursor.at = unit.end;
+
+    unit.version = (DWORD)DwarfReadU(&cursor, 2);
+    if (unit.version < 2 || unit.version > 5) {
+      continue;
+    }
+
+    DWORD64 abbrev_offset;
+    if (unit.version >= 5) {
+      const DWORD unit_type = (DWORD)DwarfReadU(&cursor, 1);
+      unit.address_size = (DWORD)DwarfReadU(&cursor, 1);
+      abbrev_offset = DwarfReadU(&cursor, unit.is_64 ? 8 : 4);
+
+      // Type units and split DWARF skeletons have no code of their own
+      if (unit_type != DW_UT_compile && unit_type != DW_UT_partial) {
+        continue;
+      }
+    } else {
+      abbrev_offset = DwarfReadU(&cursor, unit.is_64 ? 8 : 4);
+      unit.address_size = (DWORD)DwarfReadU(&cursor, 1);
+    }
+    if (cursor.is_error ||
+        (unit.address_size != 4 && unit.address_size != 8)) {
+      LOG_IMGUI(ElfReadInlineSites, "Unsupported debug info unit")
+      continue;
+    }
+    if (abbrev_offset != unit.abbrev_offset) {
+      unit.abbrev_offset = abbrev_offset;
+      if (!DwarfReadAbbrevs(elf_file, abbrev_offset, &unit.abbrevs,
+                            &unit.abbrev_attributes)) {
+        unit.abbrev_offset = ~0ull;
+        LOG_IMGUI(ElfReadInlineSites, "Broken abbreviation table")
+        continue;
+      }
+    }
+
+    // Unit DIE has the bases the rest is read with
+    if (!DwarfReadDie(elf_file, &unit, &cursor, &die) || !die.tag) {
+      continue;
+    }
+    unit.str_offsets_base = die.str_offsets_base.value;
+    unit.addr_base = die.addr_base.value;
+    unit.rnglists_base = die.rnglists_base.value;
+    unit.low_pc = 0;
+    DwarfGetAddress(elf_file, &unit, die.low_pc, &unit.low_pc);
+
+    while (cursor.at < cursor.end) {
+      if (!DwarfReadDie(elf_file, &unit, &cursor, &die)) {
+        LOG_IMGUI(ElfReadInlineSites, "Unsupported DIE, rest of the unit ",
+                  "is skipped")
+        break;
+      }
+      if (die.tag != DW_TAG_inlined_subroutine) {
+        continue;
+      }
+
+      ranges.clear();
+      if (!DwarfGetRanges(elf_file, &unit, die, &ranges)) {
+        continue;
+      }
+      const char *name = DwarfGetDieName(elf_file, &unit, die);
+      if (!name || !*name) {
+        continue;
+      }
+
+      auto it = name_offsets.find(name);
+      if (it == name_offsets.end()) {
+        it = name_offsets.emplace(name, (DWORD)names.size()).first;
+        names.append(name);
+        names.push_back('\0');
+      }
+
+      for (const auto &range : ranges) {
+        // Code dropped by the linker is left at address 0
+        if (!range.first || range.first < elf_file->load_address ||
+            range.first >= range.second) {
+          continue;
+        }
+
+        inline_sites.push_back(ModuleInlineSite{
+            (DWORD)(range.first - elf_file->load_address),
+            (DWORD)(range.second - elf_file->load_address), it->second});
+      }
+    }
+  }
+}
+
+// Fills the module index straight from the ELF file, no DbgHelp involved.
+// Unwind table gets the CFI, so that the file isn't mapped twice.
+static bool ElfLoadModuleIndex(const std::string &path,
+                               ModuleIndex *module_index,
+                               UnwindTable *unwind_table) {
+  ElfFile elf_file;
+  if (!ElfFileMap(&elf_file, path)) {
+    return false;
+  }
+
+  ElfReadFunctions(&elf_file, module_index);
+  ElfReadLines(&elf_file, module_index);
+  ElfReadInlineSites(&elf_file, module_index);
+  if (elf_file.eh_frame.data) {
+    UnwindTableBuild(unwind_table, elf_file.eh_frame.data,
+                     elf_file.eh_frame.size, elf_file.eh_frame_address,
+                     elf_file.load_address);
+  }
+
+  ElfFileUnmap(&elf_file);
+
+  return true;
+}
\ No newline at end of file
@@ -0,0 +1,89 @@
+// Section contents, point straight into the mapped file
+struct ElfSection {
+  const BYTE *data;
+  DWORD64 size;
+};
+
+// Memory mapped ELF64 file
+struct ElfFile {
+  int file;
+  const BYTE *data;
+  size_t size;
+
+  // Lowest PT_LOAD address, that is where the module base gets mapped to
+  DWORD64 load_address;
+
+  ElfSection symtab;
+  ElfSection strtab;
+  ElfSection debug_line;
+  ElfSection debug_line_str;
+  ElfSection debug_str;
+  ElfSection debug_info;
+  ElfSection debug_abbrev;
+  ElfSection debug_ranges;   // DWARF 2-4
+  ElfSection debug_rnglists; // DWARF 5
+  ElfSection debug_addr;
+  ElfSection debug_str_offsets;
+  ElfSection eh_frame;
+  DWORD64 eh_frame_address;
+};
+
+// File entry of a line program header, names point into the mapped file
+struct DwarfFileEntry {
+  const char *name;
+  DWORD directory_index;
+  DWORD file_index; // Into ModuleIndex::source_files, interned on first use
+};
+
+struct DwarfAbbrevAttribute {
+  DWORD64 name; // DW_AT_*
+  DWORD64 form; // DW_FORM_*
+  int64_t implicit_const;
+};
+
+// Abbreviation of .debug_abbrev, the shape of the DIEs that use it's code
+struct DwarfAbbrev {
+  DWORD64 tag; // DW_TAG_*, 0 - the code isn't declared
+  bool has_children;
+  DWORD first_attribute; // Into DwarfUnit::abbrev_attributes
+  DWORD attribute_count;
+};
+
+// Unit of .debug_info with what it's DIEs need to be read
+struct DwarfUnit {
+  const BYTE *begin; // Of the header, unit relative references start there
+  const BYTE *end;
+  DWORD version;
+  DWORD address_size;
+  bool is_64;
+  std::vector<DwarfAbbrev> abbrevs; // By code - 1
+  std::vector<DwarfAbbrevAttribute> abbrev_attributes; // Of all the abbrevs
+  DWORD64 abbrev_offset; // Of the tables above, units often share them
+
+  // From the unit DIE
+  DWORD64 low_pc; // Base of the ranges
+  DWORD64 str_offsets_base;
+  DWORD64 addr_base;
+  DWORD64 rnglists_base;
+};
+
+// Attribute value as it's stored, what it means depends on the form
+struct DwarfAttribute {
+  DWORD64 form; // 0 - the DIE doesn't have the attribute
+  DWORD64 value;
+  const char *string; // Forms that have the string in place or in .debug_str
+};
+
+// Attributes of a DIE that tell the name and the address ranges
+struct DwarfDie {
+  DWORD64 tag; // 0 - null entry, the end of the siblings
+  bool has_children;
+  DwarfAttribute name;
+  DwarfAttribute low_pc;
+  DwarfAttribute high_pc;
+  DwarfAttribute ranges;
+  DwarfAttribute origin; // DW_AT_abstract_origin or DW_AT_specification
+  DwarfAttribute str_offsets_base;
+  DwarfAttribute addr_base;
+  DwarfAttribute rnglists_base;
+};
\ No newline at end of file
@@ -0,0 +1,54 @@
+static void EpochInitialize(EpochDomain *epoch_domain) {
+  epoch_domain->epoch.store(1);
+  for (auto &reader_epoch : epoch_domain->reader_epochs) {
+    reader_epoch.store(0);
+  }
+}
+
+// Everything loaded from published pointers stays valid until EpochExit
+static inline void EpochEnter(EpochDomain *epoch_domain, size_t reader) {
+  epoch_domain->reader_epochs[reader].store(epoch_domain->epoch.load());
+}
+
+static inline void EpochExit(EpochDomain *epoch_domain, size_t reader) {
+  epoch_domain->reader_epochs[reader].store(0);
+}
+
+static void EpochCollect(EpochDomain *epoch_domain) {
+  auto &retired = epoch_domain->retired;
+
+  DWORD64 min_reader_epoch = ~0ull;
+  for (const auto &reader_epoch : epoch_domain->reader_epochs) {
+    const DWORD64 value = reader_epoch.load();
+    if (value && value < min_reader_epoch) {
+      min_reader_epoch = value;
+    }
+  }
+
+  size_t kept = 0;
+  for (size_t i = 0; i < retired.size(); ++i) {
+    if (retired[i].epoch < min_reader_epoch) {
+      retired[i].Delete(retired[i].pointer);
+    } else {
+      retired[kept++] = retired[i];
+    }
+  }
+  retired.resize(kept);
+}
+
+// Swaps published pointer and deletes the old object, when it is safe
+template <typename T>
+static void EpochPublish(EpochDomain *epoch_domain,
+                         std::atomic<const T *> *published, const T *value) {
+  const T *old_value = published->exchange(value);
+
+  // Readers that enter after this increment can't see the old value
+  const DWORD64 epoch = epoch_domain->epoch.fetch_add(1);
+  if (old_value) {
+    epoch_domain->retired.emplace_back(EpochRetired{
+        old_value, [](const void *pointer) { delete (const T *)pointer; },
+        epoch});
+  }
+
+  EpochCollect(epoch_domain);
+}
\ No newline at end of file
@@ -0,0 +1,18 @@
+#define EPOCH_MAX_READERS 4
+#define EPOCH_READER_UI 0
+
+struct EpochRetired {
+  const void *pointer;
+  void (*Delete)(const void *pointer);
+  DWORD64 epoch;
+};
+
+// Epoch based reclamation for objects published through atomic pointers.
+// Readers announce the epoch they entered at, an object replaced at epoch "e"
+// is deleted once no reader is inside a section entered at or before "e".
+// There is a single writer, the debugger thread.
+struct EpochDomain {
+  std::atomic<DWORD64> epoch;
+  std::atomic<DWORD64> reader_epochs[EPOCH_MAX_READERS]; // 0 - not reading
+  std::vector<EpochRetired> retired;                      // Writer only
+};
\ No newline at end of file
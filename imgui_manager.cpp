@@ -1,7 +1,5 @@
-static ImGuiManager CreateImGuiManager(Registers *registers,
-                                       LocalVariables *local_variables,
-                                       Source *source,
-                                       Breakpoints *breakpoints) {
+static ImGuiManager CreateImGuiManager(Snapshots *snapshots, Source *source,
+                                       Symbolizer *symbolizer) {
   ImGuiManager result;
 
   IMGUI_CHECKVERSION();
@@ -14,135 +12,572 @@ static ImGuiManager CreateImGuiManager(Registers *registers,
   ImGui::StyleColorsDark();
   ImGui::StyleColorsClassic();
 
-  result.registers = registers;
-  result.local_variables = local_variables;
+  result.snapshots = snapshots;
+  result.snapshot = nullptr;
+  result.line_table = nullptr;
   result.source = source;
-  result.breakpoints = breakpoints;
+  result.symbolizer = symbolizer;
+  result.memory_view = new ImGuiMemoryView();
   result.previous_line_address = 0;
 
   return result;
 }
 
+// 128 bit vector register as hex, most significant byte first. "high" is
+// the upper half of a 256 bit one, or NULL.
+static void ImGuiFormatVector(char *text, size_t size, const BYTE *low,
+                              const BYTE *high) {
+  size_t length = 0;
+  for (int half = high ? 1 : 0; half >= 0; --half) {
+    const BYTE *bytes = half ? high : low;
+    for (int i = 15; i >= 0 && length + 3 <= size; --i) {
+      length += snprintf(text + length, size - length, "%02x", bytes[i]);
+    }
+  }
+}
+
 inline void ImGuiDrawRegisters(ImGuiManager *imgui_manager) {
-  const auto registers = imgui_manager->registers;
+  // 32 bit names of the ones x86 has
+  static const struct {
+    const char *name;
+    const char *name_32;
+    DWORD64 Registers::*field;
+  } fields[] = {
+      {"Rax", "Eax", &Registers::Rax}, {"Rbx", "Ebx", &Registers::Rbx},
+      {"Rcx", "Ecx", &Registers::Rcx}, {"Rdx", "Edx", &Registers::Rdx},
+      {"Rsi", "Esi", &Registers::Rsi}, {"Rdi", "Edi", &Registers::Rdi},
+      {"Rbp", "Ebp", &Registers::Rbp}, {"Rsp", "Esp", &Registers::Rsp},
+      {"R8", NULL, &Registers::R8},    {"R9", NULL, &Registers::R9},
+      {"R10", NULL, &Registers::R10},  {"R11", NULL, &Registers::R11},
+      {"R12", NULL, &Registers::R12},  {"R13", NULL, &Registers::R13},
+      {"R14", NULL, &Registers::R14},  {"R15", NULL, &Registers::R15},
+      {"Rip", "Eip", &Registers::Rip}};
+  static const struct {
+    const char *name;
+    DWORD64 Registers::*field;
+  } segments[] = {{"Cs", &Registers::SegCs}, {"Ss", &Registers::SegSs},
+                  {"Ds", &Registers::SegDs}, {"Es", &Registers::SegEs},
+                  {"Fs", &Registers::SegFs}, {"Gs", &Registers::SegGs}};
+  const auto registers = &imgui_manager->snapshot->registers;
+  const bool is_64bit = registers->arch == RegistersArch::X86_64;
+  const int digits = is_64bit ? 16 : 8;
+  const int vector_count = is_64bit ? REGISTERS_VECTOR_COUNT : 8;
 
   ImGui::Begin("Registers");
-  ImGui::Text("Edi: %lu", registers->Edi);
-  ImGui::Text("Esi: %lu", registers->Esi);
-  ImGui::Text("Ebx: %lu", registers->Ebx);
-  ImGui::Text("Edx: %lu", registers->Edx);
-  ImGui::Text("Ecx: %lu", registers->Ecx);
-  ImGui::Text("Eax: %lu", registers->Eax);
-  ImGui::Text("Ebp: %lu", registers->Ebp);
-  ImGui::Text("Eip: %lu", registers->Eip);
-  ImGui::Text("SegCs: %lu", registers->SegCs);
-  ImGui::Text("EFlags: %lu", registers->EFlags);
-  ImGui::Text("Esp: %lu", registers->Esp);
-  ImGui::Text("SegSs: %lu", registers->SegSs);
+
+  for (const auto &field : fields) {
+    if (is_64bit || field.name_32) {
+      ImGui::Text("%-3s %0*llx", is_64bit ? field.name : field.name_32,
+                  digits, (unsigned long long)(registers->*field.field));
+    }
+  }
+  ImGui::Text("EFlags %08llx", (unsigned long long)registers->EFlags);
+  for (const auto &segment : segments) {
+    ImGui::Text("%s %04llx", segment.name,
+                (unsigned long long)(registers->*segment.field));
+  }
+
+  char text[80];
+  if ((registers->extended_state & REGISTERS_X87) &&
+      ImGui::TreeNode("x87")) {
+    ImGui::Text("Control %04x Status %04x Tag %02x", registers->fpu_control,
+                registers->fpu_status, registers->fpu_tag);
+
+    // In stack order, st(0) is the top
+    for (int i = 0; i < 8; ++i) {
+      ImGui::Text("St%d %g", i, RegistersGetX87Value(registers->st[i]));
+    }
+    ImGui::TreePop();
+  }
+  if ((registers->extended_state & REGISTERS_SSE) &&
+      ImGui::TreeNode("SSE")) {
+    ImGui::Text("Mxcsr %08x", registers->mxcsr);
+    for (int i = 0; i < vector_count; ++i) {
+      ImGuiFormatVector(text, sizeof(text), registers->xmm[i], NULL);
+      ImGui::Text("Xmm%-2d %s", i, text);
+    }
+    ImGui::TreePop();
+  }
+  if ((registers->extended_state & REGISTERS_AVX) &&
+      ImGui::TreeNode("AVX")) {
+    for (int i = 0; i < vector_count; ++i) {
+      ImGuiFormatVector(text, sizeof(text), registers->xmm[i],
+                        registers->ymm_high[i]);
+      ImGui::Text("Ymm%-2d %s", i, text);
+    }
+    ImGui::TreePop();
+  }
 
   ImGui::End();
 }
 
+// Draws the variable at "index" with it's members, if it's expanded.
+// Returns the index after them.
+static size_t ImGuiDrawLocalVariable(const std::vector<LocalVariable> &data,
+                                     size_t index) {
+  const LocalVariable &variable = data[index];
+
+  size_t end = index + 1;
+  while (end < data.size() && data[end].depth > variable.depth) {
+    ++end;
+  }
+
+  // Named by the variable, so it stays expanded across stops
+  const ImGuiTreeNodeFlags flags =
+      variable.has_children
+          ? 0
+          : ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_NoTreePushOnOpen;
+  if (ImGui::TreeNodeEx(variable.name.c_str(), flags, "%s = %s",
+                        variable.name.c_str(), variable.value.c_str()) &&
+      variable.has_children) {
+    for (size_t i = index + 1; i < end;) {
+      i = ImGuiDrawLocalVariable(data, i);
+    }
+    ImGui::TreePop();
+  }
+
+  return end;
+}
+
 inline void ImGuiDrawLocalVariables(ImGuiManager *imgui_manager) {
-  const auto local_variables = imgui_manager->local_variables;
-  const auto &data = local_variables->data;
+  const auto &data = imgui_manager->snapshot->local_variables;
 
   ImGui::Begin("Local variables");
-  for (size_t i = 0; i < data.size(); ++i) {
-    ImGui::Text("Name: %s, Value = %s", data[i].name.c_str(),
-                data[i].value.c_str());
+  for (size_t i = 0; i < data.size();) {
+    i = ImGuiDrawLocalVariable(data, i);
   }
   ImGui::End();
 }
 
-inline void ImGuiDrawCode(ImGuiManager *imgui_manager) {
-  auto &breakpoints = imgui_manager->breakpoints->data;
-  DWORD64 current_line_address = imgui_manager->current_line_address;
-  const auto &filename_to_lines = imgui_manager->source->filename_to_lines;
-  const auto &line_address_to_filename =
-      imgui_manager->source->line_address_to_filename;
-  auto &previous_line_address = imgui_manager->previous_line_address;
+inline void ImGuiDrawCallstack(ImGuiManager *imgui_manager) {
+  const auto snapshot = imgui_manager->snapshot;
+  const auto &callstack = snapshot->callstack;
+
+  ImGui::Begin("Callstack");
+
+  // Rows are symbolized once they are visible, until then only the address
+  // is shown
+  ImGuiListClipper clipper;
+  clipper.Begin((int)callstack.size());
+  while (clipper.Step()) {
+    for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i) {
+      // Callers are at a return address, the call is the byte before it
+      const DWORD64 address = callstack[i] - (i ? 1 : 0);
+      const SymbolizerSymbol *symbol =
+          SymbolizerFind(imgui_manager->symbolizer, address);
+
+      const unsigned long long pc = callstack[i];
+      char label[512];
+      if (!symbol) {
+        snprintf(label, sizeof(label), "%-4d %016llx", i, pc);
+      } else {
+        const char *function =
+            symbol->function.empty() ? "?" : symbol->function.c_str();
+        if (symbol->filename.empty()) {
+          snprintf(label, sizeof(label), "%-4d %016llx %s", i, pc, function);
+        } else {
+          snprintf(label, sizeof(label), "%-4d %016llx %s  %s:%lu", i, pc,
+                   function, GetFilenameFromPath(symbol->filename).c_str(),
+                   (unsigned long)symbol->line);
+        }
+      }
 
-  ImGui::Begin("Code");
-  ImGui::BeginTabBar("Files");
+      ImGui::PushID(i);
+      if (ImGui::Selectable(label, (DWORD)i == snapshot->frame_index) &&
+          imgui_manager->OnSelectFrame) {
+        imgui_manager->OnSelectFrame((DWORD)i);
+      }
+      ImGui::PopID();
+    }
+  }
+
+  ImGui::End();
+}
+
+inline void ImGuiDrawStatistics(ImGuiManager *imgui_manager) {
+  const auto snapshot = imgui_manager->snapshot;
+
+  ImGui::Begin("Statistics");
+  ImGui::Text("Syscalls this stop: %llu",
+              (unsigned long long)snapshot->syscall_count);
+  ImGui::Text("Memory reads: %llu, cached: %llu",
+              (unsigned long long)snapshot->memory_read_count,
+              (unsigned long long)snapshot->memory_hit_count);
+  ImGui::Text("Debug registers in use: %lu of %d",
+              (unsigned long)snapshot->hardware_slot_count,
+              BACKEND_DEBUG_REGISTER_COUNT);
+  ImGui::Text("Traps of the last step: %llu, kernel round trips: %llu",
+              (unsigned long long)snapshot->trap_count,
+              (unsigned long long)snapshot->round_trip_count);
+  ImGui::End();
+}
+
+inline void ImGuiDrawBreakpoints(ImGuiManager *imgui_manager) {
+  const auto line_table = imgui_manager->line_table;
+  static DWORD64 selected_address = 0;
+  static char condition_text[256] = {};
+
+  ImGui::Begin("Breakpoints");
+
+  const auto &breakpoints = imgui_manager->snapshot->user_breakpoint_details;
+  for (const auto &breakpoint : breakpoints) {
+    std::string location;
+    size_t line_index;
+    if (LineTableFind(line_table, breakpoint.address, &line_index)) {
+      const std::string &filename =
+          line_table->filenames[line_table->file_ids[line_index]];
+      location = filename.substr(filename.find_last_of("\\/") + 1) + ':' +
+                 std::to_string(line_table->lines[line_index]);
+    }
+
+    char label[512];
+    snprintf(label, sizeof(label), "%llx %s, hits: %llu %s",
+             (unsigned long long)breakpoint.address, location.c_str(),
+             (unsigned long long)breakpoint.hit_count,
+             breakpoint.condition.c_str());
+    if (ImGui::Selectable(label, breakpoint.address == selected_address)) {
+      selected_address = breakpoint.address;
+      snprintf(condition_text, sizeof(condition_text), "%s",
+               breakpoint.condition.c_str());
+    }
+  }
+
+  ImGui::Separator();
+
+  ImGui::InputText("Condition", condition_text, sizeof(condition_text));
+  if (ImGui::Button("Set") && selected_address &&
+      imgui_manager->OnSetCondition) {
+    imgui_manager->OnSetCondition(selected_address, condition_text);
+  }
+  ImGui::TextDisabled("eax == 5 && dword[esp + 4] != 0, count > 10, "
+                      "$hits %% 100 == 0");
+
+  bool is_agent_enabled = imgui_manager->snapshot->is_agent_enabled;
+  if (ImGui::Checkbox("Evaluate in the target (x86-64)", &is_agent_enabled) &&
+      imgui_manager->OnEnableAgent) {
+    imgui_manager->OnEnableAgent(is_agent_enabled);
+  }
+#ifdef _WIN32
+  if (ImGui::IsItemHovered()) {
+    ImGui::SetTooltip("Conditions that read memory or locals are evaluated "
+                      "by the debugger");
+  }
+#endif
+  ImGui::SameLine();
+  ImGui::TextDisabled("%lu in place",
+                      (unsigned long)imgui_manager->snapshot->agent_site_count);
+
+  ImGui::End();
+}
+
+inline void ImGuiDrawMemory(ImGuiManager *imgui_manager) {
+  auto memory_view = imgui_manager->memory_view;
+  static char address_text[32] = {};
+  static int size = 256;
+
+  ImGui::Begin("Memory");
+
+  ImGui::InputText("Address", address_text, sizeof(address_text),
+                   ImGuiInputTextFlags_CharsHexadecimal);
+  ImGui::InputInt("Size", &size);
+  size = std::max(1, std::min(size, IMGUI_MEMORY_MAX_SIZE));
+  if (ImGui::Button("Read") && imgui_manager->OnReadMemory) {
+    {
+      std::lock_guard<std::mutex> lock(memory_view->mutex);
+      memory_view->is_read = false;
+    }
+    imgui_manager->OnReadMemory(strtoull(address_text, NULL, 16),
+                                (size_t)size);
+  }
+
+  ImGui::Separator();
+
+  // Debugger thread fills it in, a copy is drawn
+  DWORD64 address;
+  size_t read_size;
+  std::vector<BYTE> data;
+  bool is_read;
+  {
+    std::lock_guard<std::mutex> lock(memory_view->mutex);
+    address = memory_view->address;
+    read_size = memory_view->size;
+    data = memory_view->data;
+    is_read = memory_view->is_read;
+  }
 
-  int tab_button_index = 0;
-  for (auto it = filename_to_lines.begin(); it != filename_to_lines.end();
-       ++it, ++tab_button_index) {
-    static int current_tab_button_index = 0;
+  if (!is_read) {
+    ImGui::TextDisabled("Not read yet");
+    ImGui::End();
+    return;
+  }
+  if (data.size() < read_size) {
+    ImGui::TextDisabled("%llu of %llu bytes are readable",
+                        (unsigned long long)data.size(),
+                        (unsigned long long)read_size);
+  }
+
+  // 16 bytes a row, as hex and as text
+  ImGuiListClipper clipper;
+  clipper.Begin((int)((data.size() + 15) / 16));
+  while (clipper.Step()) {
+    for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+      const size_t begin = (size_t)row * 16;
+      const size_t end = std::min(begin + 16, data.size());
+
+      char text[128];
+      int length = snprintf(text, sizeof(text), "%016llx ",
+                            (unsigned long long)(address + begin));
+      for (size_t i = begin; i < begin + 16; ++i) {
+        length += i < end ? snprintf(text + length, sizeof(text) - length,
+                                     " %02x", data[i])
+                          : snprintf(text + length, sizeof(text) - length,
+                                     "   ");
+      }
+      length += snprintf(text + length, sizeof(text) - length, "  ");
+      for (size_t i = begin; i < end; ++i) {
+        text[length++] = data[i] >= ' ' && data[i] < 0x7f ? data[i] : '.';
+      }
+      text[length] = '\0';
 
-    if (previous_line_address != current_line_address) {
-      if (line_address_to_filename.find(current_line_address) !=
-              line_address_to_filename.end() &&
-          line_address_to_filename.at(current_line_address) == it->first) {
-        current_tab_button_index = tab_button_index;
+      ImGui::TextUnformatted(text);
+    }
+  }
 
-        previous_line_address = current_line_address;
+  ImGui::End();
+}
+
+inline void ImGuiDrawWatchpoints(ImGuiManager *imgui_manager) {
+  static const char *access_names[] = {"Write", "Read/Write"};
+  static const BreakpointAccess accesses[] = {BreakpointAccess::WRITE,
+                                              BreakpointAccess::READ_WRITE};
+  static const char *size_names[] = {"1", "2", "4", "8"};
+  static char address_text[32] = {};
+  static int access_index = 0;
+  static int size_index = 2;
+
+  ImGui::Begin("Watchpoints");
+
+  ImGui::InputText("Address", address_text, sizeof(address_text),
+                   ImGuiInputTextFlags_CharsHexadecimal);
+  ImGui::Combo("Size", &size_index, size_names, IM_ARRAYSIZE(size_names));
+  ImGui::Combo("Access", &access_index, access_names,
+               IM_ARRAYSIZE(access_names));
+  if (ImGui::Button("Add") && imgui_manager->OnSetWatchpoint) {
+    const DWORD64 address = strtoull(address_text, NULL, 16);
+    imgui_manager->OnSetWatchpoint(address, (size_t)1 << size_index,
+                                   accesses[access_index]);
+  }
+
+  ImGui::Separator();
+
+  for (const auto &watchpoint : imgui_manager->snapshot->watchpoints) {
+    ImGui::PushID((void *)(uintptr_t)watchpoint.address);
+    ImGui::Text("%llx, %d bytes, %s",
+                (unsigned long long)watchpoint.address, (int)watchpoint.size,
+                watchpoint.access == BreakpointAccess::WRITE ? "write"
+                                                             : "read/write");
+    ImGui::SameLine();
+    if (ImGui::SmallButton("Remove") && imgui_manager->OnRemoveWatchpoint) {
+      imgui_manager->OnRemoveWatchpoint(watchpoint.address);
+    }
+    ImGui::PopID();
+  }
+
+  ImGui::End();
+}
+
+inline void ImGuiDrawThreads(ImGuiManager *imgui_manager) {
+  static const struct {
+    const char *label;
+    DebuggerCommandType type;
+  } commands[] = {{"Continue", DebuggerCommandType::CONTINUE},
+                  {"Over", DebuggerCommandType::STEP_OVER},
+                  {"In", DebuggerCommandType::STEP_IN},
+                  {"Out", DebuggerCommandType::STEP_OUT}};
+  const auto snapshot = imgui_manager->snapshot;
+
+  ImGui::Begin("Threads");
+
+  bool is_non_stop = snapshot->is_non_stop;
+  if (ImGui::Checkbox("Non-stop, only the thread that stops is stopped",
+                      &is_non_stop) &&
+      imgui_manager->OnSetNonStop) {
+    imgui_manager->OnSetNonStop(is_non_stop);
+  }
+
+  // Breakpoints are taken out, the target runs on alone
+  if (ImGui::Button("Detach") && imgui_manager->OnDetach) {
+    imgui_manager->OnDetach();
+  }
+
+  ImGui::Separator();
+
+  for (const auto &thread : snapshot->threads) {
+    const char *state = "running";
+    if (thread.is_stopped) {
+      switch (thread.stop_reason) {
+      case DebuggerStopReason::BREAKPOINT:
+        state = "breakpoint";
+        break;
+      case DebuggerStopReason::STEP:
+        state = "step";
+        break;
+      case DebuggerStopReason::WATCHPOINT:
+        state = "watchpoint";
+        break;
+      case DebuggerStopReason::TRAP:
+        state = "trap";
+        break;
+      default:
+        state = "stopped";
+        break;
       }
     }
 
-    if (ImGui::TabItemButton(it->first.c_str()) ||
-        current_tab_button_index == tab_button_index) {
-      for (size_t i = 0; i < it->second.size(); ++i) {
-        static const float circle_offset_x = 17.0f;
-        static const float line_number_offset_y = 2.5f;
-        static const float scroll_y = ImGui::GetScrollY();
+    char label[128];
+    snprintf(label, sizeof(label), "%lu %llx %s", (unsigned long)thread.id,
+             (unsigned long long)thread.address, state);
+
+    // Running threads have nothing to show. Buttons go after the label.
+    ImGui::PushID((int)thread.id);
+    if (ImGui::Selectable(label, thread.id == snapshot->thread_id, 0,
+                          ImVec2(ImGui::GetFontSize() * 16, 0)) &&
+        thread.is_stopped && imgui_manager->OnSelectThread) {
+      imgui_manager->OnSelectThread(thread.id);
+    }
 
-        ImGui::SetCursorPosY(ImGui::GetCursorPosY() + line_number_offset_y);
-        ImGui::Text("%d", i + 1);
+    if (snapshot->is_non_stop && thread.is_stopped) {
+      for (const auto &command : commands) {
         ImGui::SameLine();
+        if (ImGui::SmallButton(command.label) &&
+            imgui_manager->OnResumeThread) {
+          imgui_manager->OnResumeThread(command.type, thread.id);
+        }
+      }
+    }
+    ImGui::PopID();
+  }
 
-        // Breakpoints
-        auto breakpoint_it = breakpoints.find(it->second[i].address);
-        if (breakpoint_it != breakpoints.end() &&
-            breakpoint_it->second.type == BreakpointType::USER) {
-          // Draw red circle
-          ImDrawList *draw_list = ImGui::GetWindowDrawList();
+  ImGui::End();
+}
 
-          const ImVec2 scroll =
-              ImVec2(ImGui::GetScrollX(), ImGui::GetScrollY());
+inline void ImGuiDrawCode(ImGuiManager *imgui_manager) {
+  const auto &breakpoints = imgui_manager->snapshot->user_breakpoints;
+  DWORD64 current_line_address = imgui_manager->snapshot->current_address;
+  auto source = imgui_manager->source;
+  const auto line_table = imgui_manager->line_table;
+  auto &previous_line_address = imgui_manager->previous_line_address;
 
-          draw_list->AddCircleFilled(
-              ImGui::GetWindowPos() + ImGui::GetCursorPos() - ImVec2(-5, -6) -
-                  scroll,
-              10, ImGui::GetColorU32(ImVec4(1, 0, 0, 1)), 10);
-        }
+  ImGui::Begin("Code");
+  ImGui::BeginTabBar("Files");
 
-        // Draw cursor
-        float h = 0.571428f; // 4 / 7
-        if (current_line_address == it->second[i].address) {
-          h = 1.142857f; // 8 / 7
-        }
+  static int current_tab_button_index = 0;
 
-        ImGui::PushStyleColor(ImGuiCol_Button,
-                              (ImVec4)ImColor::HSV(h, 0.6f, 0.6f));
-        ImGui::PushStyleColor(ImGuiCol_ButtonHovered,
-                              (ImVec4)ImColor::HSV(h, 0.7f, 0.7f));
-        ImGui::PushStyleColor(ImGuiCol_ButtonActive,
-                              (ImVec4)ImColor::HSV(h, 0.8f, 0.8f));
-        ImGui::SameLine();
-        ImGui::SetCursorPos({ImGui::GetCursorPosX() + circle_offset_x,
-                             ImGui::GetCursorPosY() - line_number_offset_y});
-        ImGui::PushID(i);
-        if (ImGui::Button(it->second[i].text.c_str())) {
-          if (breakpoint_it != breakpoints.end() &&
-              breakpoint_it->second.type == BreakpointType::USER) {
-            if (imgui_manager->OnRemoveBreakpoint) {
-              imgui_manager->OnRemoveBreakpoint(it->second[i].address);
-            }
-          } else {
-            if (imgui_manager->OnSetBreakpoint) {
-              imgui_manager->OnSetBreakpoint(it->second[i].address);
+  // Steps can stop in the middle of a line, e.g. after a return
+  size_t current_line_index;
+  const bool is_current_line_known = LineTableFindContaining(
+      line_table, current_line_address, &current_line_index);
+
+  if (previous_line_address != current_line_address &&
+      is_current_line_known) {
+    current_tab_button_index = line_table->file_ids[current_line_index];
+
+    previous_line_address = current_line_address;
+  }
+
+  for (DWORD file_id = 0; file_id < line_table->filenames.size(); ++file_id) {
+    if (source->unavailable_files.count(file_id)) {
+      continue;
+    }
+
+    const std::string filename =
+        GetFilenameFromPath(line_table->filenames[file_id]);
+
+    ImGui::PushID(file_id);
+    if (ImGui::TabItemButton(filename.c_str()) ||
+        current_tab_button_index == file_id) {
+      // Text is mapped the first time the file is shown
+      const SourceFile *source_file = SourceGetFile(source, line_table, file_id);
+
+      size_t order_begin, order_end;
+      LineTableGetFileRange(line_table, file_id, &order_begin, &order_end);
+
+      std::string text;
+      ImGuiListClipper clipper;
+      clipper.Begin(source_file ? (int)source_file->line_offsets.size() : 0);
+      while (clipper.Step()) {
+        for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i) {
+          static const float circle_offset_x = 17.0f;
+          static const float line_number_offset_y = 2.5f;
+
+          const DWORD64 address = LineTableFindLineAddress(
+              line_table, order_begin, order_end, i + 1);
+
+          const char *text_begin;
+          const char *text_end;
+          SourceFileGetLine(source_file, i, &text_begin, &text_end);
+          text.assign(text_begin, text_end);
+
+          ImGui::SetCursorPosY(ImGui::GetCursorPosY() + line_number_offset_y);
+          ImGui::Text("%d", i + 1);
+          ImGui::SameLine();
+
+          // Breakpoints
+          const bool has_breakpoint =
+              address && std::binary_search(breakpoints.begin(),
+                                            breakpoints.end(), address);
+          if (has_breakpoint) {
+            // Draw red circle
+            ImDrawList *draw_list = ImGui::GetWindowDrawList();
+
+            const ImVec2 scroll =
+                ImVec2(ImGui::GetScrollX(), ImGui::GetScrollY());
+
+            draw_list->AddCircleFilled(
+                ImGui::GetWindowPos() + ImGui::GetCursorPos() -
+                    ImVec2(-5, -6) - scroll,
+                10, ImGui::GetColorU32(ImVec4(1, 0, 0, 1)), 10);
+          }
+
+          // Draw cursor
+          float h = 0.571428f; // 4 / 7
+          if (is_current_line_known &&
+              line_table->file_ids[current_line_index] == file_id &&
+              line_table->lines[current_line_index] == (DWORD)i + 1) {
+            h = 1.142857f; // 8 / 7
+          }
+
+          ImGui::PushStyleColor(ImGuiCol_Button,
+                                (ImVec4)ImColor::HSV(h, 0.6f, 0.6f));
+          ImGui::PushStyleColor(ImGuiCol_ButtonHovered,
+                                (ImVec4)ImColor::HSV(h, 0.7f, 0.7f));
+          ImGui::PushStyleColor(ImGuiCol_ButtonActive,
+                                (ImVec4)ImColor::HSV(h, 0.8f, 0.8f));
+          ImGui::SameLine();
+          ImGui::SetCursorPos({ImGui::GetCursorPosX() + circle_offset_x,
+                               ImGui::GetCursorPosY() - line_number_offset_y});
+          ImGui::PushID(i);
+          if (ImGui::Button(text.c_str())) {
+            if (has_breakpoint) {
+              if (imgui_manager->OnRemoveBreakpoint) {
+                imgui_manager->OnRemoveBreakpoint(address);
+              }
+            } else {
+              if (imgui_manager->OnSetBreakpoint) {
+                imgui_manager->OnSetBreakpoint(address);
+              }
             }
           }
+          ImGui::PopID();
+          ImGui::PopStyleColor(3);
         }
-        ImGui::PopID();
-        ImGui::PopStyleColor(3);
       }
+      clipper.End();
     }
+    ImGui::PopID();
 
     if (ImGui::IsItemActive()) {
-      current_tab_button_index = tab_button_index;
+      current_tab_button_index = file_id;
     }
   }
 
@@ -153,6 +588,8 @@ inline void ImGuiDrawCode(ImGuiManager *imgui_manager) {
 static inline void ImGuiLogDraw(ImGuiLog *imgui_log) {
   const auto &records = imgui_log->records;
 
+  std::lock_guard<std::mutex> lock(imgui_log->mutex);
+
   ImGui::Begin("Log");
   for (size_t i = 0; i < records.size(); ++i) {
     ImGui::Text(records[i].level.c_str());
@@ -171,6 +608,8 @@ static inline void ImGuiLogAdd(ImGuiLog *imgui_log, const std::string &type,
                                const std::string &text) {
   auto &records = imgui_log->records;
 
+  std::lock_guard<std::mutex> lock(imgui_log->mutex);
+
   records.emplace_back(ImGuiLogRecord{type + ":", text});
 
   if (records.size() > IMGUI_LOG_MAX_SIZE) {
@@ -200,7 +639,11 @@ static void ImGuiManagerUpdate(ImGuiManager *imgui_manager) {
   }
 
   if ((GetAsyncKeyState(VK_F11) & 0x8000) && !is_f11_pressed) {
-    imgui_manager->OnStepIn();
+    if (GetAsyncKeyState(VK_SHIFT) & 0x8000) {
+      imgui_manager->OnStepOut();
+    } else {
+      imgui_manager->OnStepIn();
+    }
 
     is_f11_pressed = true;
   } else if (!(GetAsyncKeyState(VK_F11) & 0x8000)) {
@@ -213,6 +656,18 @@ static void ImGuiManagerUpdate(ImGuiManager *imgui_manager) {
 }
 
 static void ImGuiManagerDraw(ImGuiManager *imgui_manager) {
+  static const StopSnapshot empty_snapshot = {};
+  static const LineTable empty_line_table = {};
+
+  // Everything published by the debugger stays alive until EpochExit
+  auto snapshots = imgui_manager->snapshots;
+  EpochEnter(&snapshots->epoch_domain, EPOCH_READER_UI);
+
+  const StopSnapshot *snapshot = snapshots->stop.load();
+  imgui_manager->snapshot = snapshot ? snapshot : &empty_snapshot;
+  const LineTable *line_table = imgui_manager->source->line_table.load();
+  imgui_manager->line_table = line_table ? line_table : &empty_line_table;
+
   // static bool draw_demo = true;
   // ImGui::ShowDemoWindow(&draw_demo);
 
@@ -319,8 +774,18 @@ static void ImGuiManagerDraw(ImGuiManager *imgui_manager) {
   ImGuiLogDraw(&Global_ImGuiLog);
   ImGuiDrawRegisters(imgui_manager);
   ImGuiDrawLocalVariables(imgui_manager);
+  ImGuiDrawCallstack(imgui_manager);
+  ImGuiDrawStatistics(imgui_manager);
+  ImGuiDrawBreakpoints(imgui_manager);
+  ImGuiDrawWatchpoints(imgui_manager);
+  ImGuiDrawMemory(imgui_manager);
+  ImGuiDrawThreads(imgui_manager);
 
   ImGui::End();
+
+  imgui_manager->snapshot = nullptr;
+  imgui_manager->line_table = nullptr;
+  EpochExit(&snapshots->epoch_domain, EPOCH_READER_UI);
 }
 
 static void ImGuiManagerBeginDirectx11() {
@@ -338,6 +803,8 @@ inline void ImGuiLogWriteToFile(ImGuiLog *imgui_log, const std::string &type,
                                 const std::string &text) {
   auto &file = imgui_log->file;
 
+  std::lock_guard<std::mutex> lock(imgui_log->mutex);
+
   if (file.is_open()) {
     file << type << ": " << text;
   }
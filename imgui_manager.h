@@ -6,24 +6,51 @@ struct ImGuiLogRecord {
 struct ImGuiLog {
   std::vector<ImGuiLogRecord> records;
   std::ofstream file;
+  std::mutex mutex; // Module loader threads log too
+};
+
+#define IMGUI_MEMORY_MAX_SIZE 4096 // Bytes of one read of the memory window
+
+// Last read of the memory window, filled in on the debugger thread
+struct ImGuiMemoryView {
+  std::mutex mutex;
+  DWORD64 address;
+  size_t size; // Asked for, "data" has less if the rest is unreadable
+  std::vector<BYTE> data;
+  bool is_read; // Since the last request
 };
 
 struct ImGuiManager {
   std::function<void()> OnStepOver;
   std::function<void()> OnStepIn;
+  std::function<void()> OnStepOut;
   std::function<void()> OnPrintCallstack;
-  std::function<bool(DWORD64)> OnSetBreakpoint;
-  std::function<bool(DWORD64)> OnRemoveBreakpoint;
+  std::function<void(DWORD64)> OnSetBreakpoint;
+  std::function<void(DWORD64)> OnRemoveBreakpoint;
+  std::function<void(DWORD64, const std::string &)> OnSetCondition;
+  std::function<void(bool)> OnEnableAgent;
+  std::function<void(DWORD64, size_t, BreakpointAccess)> OnSetWatchpoint;
+  std::function<void(DWORD64)> OnRemoveWatchpoint;
+  std::function<void(DWORD64, size_t)> OnReadMemory;
   std::function<void()> OnContinue;
+  std::function<void(DWORD)> OnSelectThread;
+  std::function<void(DWORD)> OnSelectFrame; // Locals are of it
+  std::function<void(bool)> OnSetNonStop;
+  // Steps and CONTINUE of one suspended thread, non-stop mode only
+  std::function<void(DebuggerCommandType, DWORD)> OnResumeThread;
+  std::function<void()> OnDetach;
 
-  DWORD64 current_line_address;
   DWORD64 previous_line_address;
 
+  // Valid only inside ImGuiManagerDraw
+  const StopSnapshot *snapshot;
+  const LineTable *line_table;
+
   // Modules
-  Registers *registers;
-  LocalVariables *local_variables;
+  Snapshots *snapshots;
   Source *source;
-  Breakpoints *breakpoints;
+  Symbolizer *symbolizer;
+  ImGuiMemoryView *memory_view;
 };
 
 template <typename... T>
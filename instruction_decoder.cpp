@@ -0,0 +1,591 @@
+#define DECODER_MODRM 0x0001
+#define DECODER_IMM8 0x0002
+#define DECODER_IMM16 0x0004
+#define DECODER_IMMZ 0x0008  // 16 or 32 bits, by operand size
+#define DECODER_IMMV 0x0010  // 16, 32 or 64 bits, by operand size
+#define DECODER_MOFFS 0x0020 // Address sized offset
+#define DECODER_GROUP3 0x0040    // Immediate for TEST only
+#define DECODER_REGISTER 0x0080  // ModRM, always a register (mov cr, dr)
+#define DECODER_PREFIX 0x0100
+#define DECODER_INVALID 0x0200
+#define DECODER_INVALID64 0x0400 // Not encodable in 64-bit mode
+#define DECODER_RELATIVE 0x0800  // Immediate is a branch displacement
+#define DECODER_CALL 0x1000
+#define DECODER_JUMP 0x2000
+#define DECODER_CONDITIONAL_JUMP 0x4000
+#define DECODER_RETURN 0x8000
+
+// Short names for the tables only
+#define D_N 0
+#define D_M DECODER_MODRM
+#define D_MI8 (DECODER_MODRM | DECODER_IMM8)
+#define D_MIZ (DECODER_MODRM | DECODER_IMMZ)
+#define D_I8 DECODER_IMM8
+#define D_IZ DECODER_IMMZ
+#define D_IV DECODER_IMMV
+#define D_MO DECODER_MOFFS
+#define D_P DECODER_PREFIX
+#define D_X DECODER_INVALID
+#define D_X64 DECODER_INVALID64
+#define D_JCC8                                                                 \
+  (DECODER_IMM8 | DECODER_RELATIVE | DECODER_CONDITIONAL_JUMP)
+#define D_JCCZ                                                                 \
+  (DECODER_IMMZ | DECODER_RELATIVE | DECODER_CONDITIONAL_JUMP)
+#define D_RET DECODER_RETURN
+
+// Operands of one byte opcodes
+static const WORD Global_InstructionOneByteFlags[256] = {
+    // 0x00
+    D_M, D_M, D_M, D_M, D_I8, D_IZ, D_X64, D_X64,
+    D_M, D_M, D_M, D_M, D_I8, D_IZ, D_X64, D_N,
+    // 0x10
+    D_M, D_M, D_M, D_M, D_I8, D_IZ, D_X64, D_X64,
+    D_M, D_M, D_M, D_M, D_I8, D_IZ, D_X64, D_X64,
+    // 0x20
+    D_M, D_M, D_M, D_M, D_I8, D_IZ, D_P, D_X64,
+    D_M, D_M, D_M, D_M, D_I8, D_IZ, D_P, D_X64,
+    // 0x30
+    D_M, D_M, D_M, D_M, D_I8, D_IZ, D_P, D_X64,
+    D_M, D_M, D_M, D_M, D_I8, D_IZ, D_P, D_X64,
+    // 0x40, REX in 64-bit mode
+    D_N, D_N, D_N, D_N, D_N, D_N, D_N, D_N,
+    D_N, D_N, D_N, D_N, D_N, D_N, D_N, D_N,
+    // 0x50
+    D_N, D_N, D_N, D_N, D_N, D_N, D_N, D_N,
+    D_N, D_N, D_N, D_N, D_N, D_N, D_N, D_N,
+    // 0x60
+    D_X64, D_X64, D_M | D_X64, D_M, D_P, D_P, D_P, D_P,
+    D_IZ, D_MIZ, D_I8, D_MI8, D_N, D_N, D_N, D_N,
+    // 0x70
+    D_JCC8, D_JCC8, D_JCC8, D_JCC8, D_JCC8, D_JCC8, D_JCC8, D_JCC8,
+    D_JCC8, D_JCC8, D_JCC8, D_JCC8, D_JCC8, D_JCC8, D_JCC8, D_JCC8,
+    // 0x80
+    D_MI8, D_MIZ, D_MI8 | D_X64, D_MI8, D_M, D_M, D_M, D_M,
+    D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+    // 0x90
+    D_N, D_N, D_N, D_N, D_N, D_N, D_N, D_N,
+    D_N, D_N, D_IZ | DECODER_IMM16 | D_X64 | DECODER_CALL, D_N,
+    D_N, D_N, D_N, D_N,
+    // 0xa0
+    D_MO, D_MO, D_MO, D_MO, D_N, D_N, D_N, D_N,
+    D_I8, D_IZ, D_N, D_N, D_N, D_N, D_N, D_N,
+    // 0xb0
+    D_I8, D_I8, D_I8, D_I8, D_I8, D_I8, D_I8, D_I8,
+    D_IV, D_IV, D_IV, D_IV, D_IV, D_IV, D_IV, D_IV,
+    // 0xc0, c4 and c5 are also VEX
+    D_MI8, D_MI8, DECODER_IMM16 | D_RET, D_RET, D_M | D_X64, D_M | D_X64,
+    D_MI8, D_MIZ,
+    DECODER_IMM16 | D_I8, D_N, DECODER_IMM16 | D_RET, D_RET, D_N, D_I8, D_X64,
+    D_RET,
+    // 0xd0
+    D_M, D_M, D_M, D_M, D_I8 | D_X64, D_I8 | D_X64, D_X64, D_N,
+    D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+    // 0xe0
+    D_JCC8, D_JCC8, D_JCC8, D_JCC8, D_I8, D_I8, D_I8, D_I8,
+    D_IZ | DECODER_RELATIVE | DECODER_CALL,
+    D_IZ | DECODER_RELATIVE | DECODER_JUMP,
+    D_IZ | DECODER_IMM16 | D_X64 | DECODER_JUMP,
+    D_I8 | DECODER_RELATIVE | DECODER_JUMP, D_N, D_N, D_N, D_N,
+    // 0xf0, ff is group 5, calls and jumps by ModRM reg
+    D_P, D_N, D_P, D_P, D_N, D_N, D_M | DECODER_GROUP3, D_M | DECODER_GROUP3,
+    D_N, D_N, D_N, D_N, D_N, D_N, D_M, D_M,
+};
+
+// Operands of 0x0f xx opcodes, also VEX and EVEX map 1
+static const WORD Global_InstructionTwoByteFlags[256] = {
+    // 0x00
+    D_M, D_M, D_M, D_M, D_X, D_N, D_N, D_N,
+    D_N, D_N, D_X, D_N, D_X, D_M, D_N, D_MI8,
+    // 0x10
+    D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+    D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+    // 0x20
+    DECODER_REGISTER, DECODER_REGISTER, DECODER_REGISTER, DECODER_REGISTER,
+    D_X, D_X, D_X, D_X,
+    D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+    // 0x30, 38 and 3a are three byte escapes
+    D_N, D_N, D_N, D_N, D_N, D_N, D_X, D_N,
+    D_N, D_X, D_N, D_X, D_X, D_X, D_X, D_X,
+    // 0x40
+    D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+    D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+    // 0x50
+    D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+    D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+    // 0x60
+    D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+    D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+    // 0x70
+    D_MI8, D_MI8, D_MI8, D_MI8, D_M, D_M, D_M, D_N,
+    D_M, D_M, D_X, D_X, D_M, D_M, D_M, D_M,
+    // 0x80
+    D_JCCZ, D_JCCZ, D_JCCZ, D_JCCZ, D_JCCZ, D_JCCZ, D_JCCZ, D_JCCZ,
+    D_JCCZ, D_JCCZ, D_JCCZ, D_JCCZ, D_JCCZ, D_JCCZ, D_JCCZ, D_JCCZ,
+    // 0x90
+    D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+    D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+    // 0xa0
+    D_N, D_N, D_N, D_M, D_MI8, D_M, D_X, D_X,
+    D_N, D_N, D_N, D_M, D_MI8, D_M, D_M, D_M,
+    // 0xb0
+    D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+    D_M, D_M, D_MI8, D_M, D_M, D_M, D_M, D_M,
+    // 0xc0
+    D_M, D_M, D_MI8, D_M, D_MI8, D_MI8, D_MI8, D_M,
+    D_N, D_N, D_N, D_N, D_N, D_N, D_N, D_N,
+    // 0xd0
+    D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+    D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+    // 0xe0
+    D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+    D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+    // 0xf0
+    D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+    D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+};
+
+#undef D_N
+#undef D_M
+#undef D_MI8
+#undef D_MIZ
+#undef D_I8
+#undef D_IZ
+#undef D_IV
+#undef D_MO
+#undef D_P
+#undef D_X
+#undef D_X64
+#undef D_JCC8
+#undef D_JCCZ
+#undef D_RET
+
+static inline bool InstructionReadByte(const BYTE *code, size_t size,
+                                       size_t *at, BYTE *value) {
+  if (*at >= size || *at >= INSTRUCTION_MAX_LENGTH) {
+    return false;
+  }
+
+  *value = code[(*at)++];
+
+  return true;
+}
+
+// Little endian, sign extended
+static inline bool InstructionReadSigned(const BYTE *code, size_t size,
+                                         size_t *at, DWORD byte_count,
+                                         DWORD64 *value) {
+  if (*at + byte_count > size || *at + byte_count > INSTRUCTION_MAX_LENGTH) {
+    return false;
+  }
+
+  DWORD64 result = 0;
+  for (DWORD i = 0; i < byte_count; ++i) {
+    result |= (DWORD64)code[*at + i] << (i * 8);
+  }
+  if (byte_count < 8 && (result >> (byte_count * 8 - 1)) & 1) {
+    result |= ~(DWORD64)0 << (byte_count * 8);
+  }
+
+  *at += byte_count;
+  *value = result;
+
+  return true;
+}
+
+static inline bool InstructionSkip(size_t size, size_t *at,
+                                   DWORD byte_count) {
+  if (*at + byte_count > size || *at + byte_count > INSTRUCTION_MAX_LENGTH) {
+    return false;
+  }
+
+  *at += byte_count;
+
+  return true;
+}
+
+// Skips ModRM with SIB and displacement, "modrm" gets the ModRM byte
+static bool InstructionSkipModrm(const BYTE *code, size_t size, size_t *at,
+                                 DWORD address_size, bool is_register_only,
+                                 BYTE *modrm) {
+  if (!InstructionReadByte(code, size, at, modrm)) {
+    return false;
+  }
+
+  const BYTE mod = *modrm >> 6;
+  const BYTE rm = *modrm & 7;
+  if (mod == 3 || is_register_only) {
+    return true;
+  }
+
+  DWORD displacement_size = 0;
+  if (address_size == 2) {
+    if (mod == 0 && rm == 6) {
+      displacement_size = 2;
+    } else {
+      displacement_size = mod == 1 ? 1 : (mod == 2 ? 2 : 0);
+    }
+
+    return InstructionSkip(size, at, displacement_size);
+  }
+
+  if (rm == 4) {
+    BYTE sib;
+    if (!InstructionReadByte(code, size, at, &sib)) {
+      return false;
+    }
+    if (mod == 0 && (sib & 7) == 5) {
+      displacement_size = 4;
+    }
+  }
+  if (mod == 0 && rm == 5) {
+    displacement_size = 4; // RIP relative in 64-bit mode
+  } else if (mod == 1) {
+    displacement_size = 1;
+  } else if (mod == 2) {
+    displacement_size = 4;
+  }
+
+  return InstructionSkip(size, at, displacement_size);
+}
+
+// Decodes the instruction at the start of "code", which was read from
+// "address". Returns false for invalid or truncated instructions.
+static bool InstructionDecode(const BYTE *code, size_t size, DWORD64 address,
+                              bool is_64bit, Instruction *instruction) {
+  *instruction = {};
+
+  size_t at = 0;
+  bool is_operand_size_override = false;
+  bool is_address_size_override = false;
+  BYTE rex = 0;
+
+  BYTE opcode;
+  WORD flags;
+  for (;;) {
+    if (!InstructionReadByte(code, size, &at, &opcode)) {
+      return false;
+    }
+
+    if (is_64bit && (opcode & 0xf0) == 0x40) {
+      rex = opcode;
+      continue;
+    }
+
+    flags = Global_InstructionOneByteFlags[opcode];
+    if (!(flags & DECODER_PREFIX)) {
+      break;
+    }
+
+    // REX only counts right before the opcode
+    rex = 0;
+    if (opcode == 0x66) {
+      is_operand_size_override = true;
+    } else if (opcode == 0x67) {
+      is_address_size_override = true;
+    }
+  }
+
+  const bool is_rex_w = (rex & 0x08) != 0;
+  const DWORD operand_size = is_rex_w ? 8 : (is_operand_size_override ? 2 : 4);
+  const DWORD address_size =
+      is_64bit ? (is_address_size_override ? 4 : 8)
+               : (is_address_size_override ? 2 : 4);
+
+  // VEX and EVEX reuse les, lds and bound, which are register forms in 32-bit
+  // mode only when they are a prefix. AMD XOP reuses pop with reg != 0.
+  bool is_vex = false;
+  BYTE map = 0;
+  if (opcode == 0xc4 || opcode == 0xc5 || opcode == 0x62) {
+    is_vex = is_64bit || (at < size && code[at] >= 0xc0);
+  } else if (opcode == 0x8f) {
+    is_vex = at < size && (code[at] & 0x1f) >= 8;
+  }
+
+  if (is_vex) {
+    BYTE payload;
+    if (!InstructionReadByte(code, size, &at, &payload)) {
+      return false;
+    }
+
+    if (opcode == 0xc5) {
+      map = 1;
+    } else if (opcode == 0xc4 || opcode == 0x8f) {
+      map = payload & 0x1f;
+      if (!InstructionReadByte(code, size, &at, &payload)) {
+        return false;
+      }
+    } else {
+      map = payload & 0x07;
+      if (!InstructionSkip(size, &at, 2)) {
+        return false;
+      }
+    }
+
+    if (!InstructionReadByte(code, size, &at, &opcode)) {
+      return false;
+    }
+
+    if (map == 1) {
+      flags = Global_InstructionTwoByteFlags[opcode];
+    } else if (map == 2 || map == 5 || map == 6 || map == 9) {
+      flags = DECODER_MODRM;
+    } else if (map == 3 || map == 8) {
+      flags = DECODER_MODRM | DECODER_IMM8;
+    } else if (map == 10) {
+      flags = DECODER_MODRM | DECODER_IMMZ;
+    } else {
+      return false;
+    }
+  } else if (opcode == 0x0f) {
+    if (!InstructionReadByte(code, size, &at, &opcode)) {
+      return false;
+    }
+
+    map = 1;
+    flags = Global_InstructionTwoByteFlags[opcode];
+    if (opcode == 0x38 || opcode == 0x3a) {
+      map = opcode == 0x38 ? 2 : 3;
+      flags = map == 2 ? DECODER_MODRM : DECODER_MODRM | DECODER_IMM8;
+      if (!InstructionReadByte(code, size, &at, &opcode)) {
+        return false;
+      }
+    }
+  }
+
+  if ((flags & DECODER_INVALID) ||
+      (is_64bit && (flags & DECODER_INVALID64) && !is_vex)) {
+    return false;
+  }
+
+  BYTE modrm = 0;
+  if (flags & (DECODER_MODRM | DECODER_REGISTER)) {
+    if (!InstructionSkipModrm(code, size, &at, address_size,
+                              (flags & DECODER_REGISTER) != 0, &modrm)) {
+      return false;
+    }
+
+    instruction->is_rip_relative = is_64bit && !(flags & DECODER_REGISTER) &&
+                                   (modrm & 0xc7) == 0x05;
+    if (instruction->is_rip_relative) {
+      instruction->displacement_offset = (DWORD)at - 4;
+    }
+  }
+  const BYTE reg = (modrm >> 3) & 7;
+
+  DWORD immediate_size = 0;
+  if (flags & DECODER_IMM8) {
+    immediate_size += 1;
+  }
+  if (flags & DECODER_IMM16) {
+    immediate_size += 2;
+  }
+  if (flags & DECODER_IMMZ) {
+    // Near branches ignore the operand size in 64-bit mode
+    const bool is_near_branch = is_64bit && (flags & DECODER_RELATIVE);
+    immediate_size += (operand_size == 2 && !is_near_branch) ? 2 : 4;
+  }
+  if (flags & DECODER_IMMV) {
+    immediate_size += operand_size;
+  }
+  if (flags & DECODER_MOFFS) {
+    immediate_size += address_size;
+  }
+  if ((flags & DECODER_GROUP3) && reg < 2) {
+    immediate_size += opcode == 0xf6 ? 1 : (operand_size == 2 ? 2 : 4);
+  }
+
+  if (flags & DECODER_RELATIVE) {
+    DWORD64 displacement;
+    if (!InstructionReadSigned(code, size, &at, immediate_size,
+                               &displacement)) {
+      return false;
+    }
+
+    instruction->is_relative = true;
+    instruction->target = address + at + displacement;
+    if (!is_64bit) {
+      instruction->target &= operand_size == 2 ? 0xffff : 0xffffffff;
+    }
+  } else if (!InstructionSkip(size, &at, immediate_size)) {
+    return false;
+  }
+
+  instruction->length = (DWORD)at;
+
+  // Only the legacy maps have control flow
+  if (is_vex) {
+    return true;
+  }
+
+  if (flags & DECODER_CALL) {
+    instruction->type = InstructionType::CALL;
+  } else if (flags & DECODER_JUMP) {
+    instruction->type = InstructionType::JUMP;
+  } else if (flags & DECODER_CONDITIONAL_JUMP) {
+    instruction->type = InstructionType::CONDITIONAL_JUMP;
+    instruction->condition =
+        map == 0 && (opcode & 0xf0) == 0xe0 ? INSTRUCTION_CONDITION_COUNTER
+                                            : opcode & 0x0f;
+  } else if (flags & DECODER_RETURN) {
+    instruction->type = InstructionType::RETURN;
+  } else if (map == 0 && opcode == 0xff) {
+    if (reg == 2 || reg == 3) {
+      instruction->type = InstructionType::CALL;
+    } else if (reg == 4 || reg == 5) {
+      instruction->type = InstructionType::JUMP;
+    }
+  }
+
+  return true;
+}
+
+// Whether a conditional jump is taken with "flags" (EFLAGS), false if it
+// depends on more than flags
+static bool InstructionIsJumpTaken(const Instruction &instruction,
+                                   DWORD64 flags, bool *is_taken) {
+  if (instruction.type != InstructionType::CONDITIONAL_JUMP ||
+      instruction.condition > 0x0f) {
+    return false;
+  }
+
+  const bool cf = (flags >> 0) & 1;
+  const bool pf = (flags >> 2) & 1;
+  const bool zf = (flags >> 6) & 1;
+  const bool sf = (flags >> 7) & 1;
+  const bool of = (flags >> 11) & 1;
+
+  bool result = false;
+  switch (instruction.condition >> 1) {
+  case 0:
+    result = of;
+    break;
+  case 1:
+    result = cf;
+    break;
+  case 2:
+    result = zf;
+    break;
+  case 3:
+    result = cf || zf;
+    break;
+  case 4:
+    result = sf;
+    break;
+  case 5:
+    result = pf;
+    break;
+  case 6:
+    result = sf != of;
+    break;
+  case 7:
+    result = zf || sf != of;
+    break;
+  }
+
+  // Odd conditions are the negated ones
+  *is_taken = result != ((instruction.condition & 1) != 0);
+
+  return true;
+}
+
+// Where the code from "start" up to "end", decoded into "instructions" at
+// "addresses", is left: targets of jumps out of it, the end when it's fallen
+// through, and calls, returns and indirect jumps themselves. Breakpoints
+// there let the range run freely, loops inside it included, and nothing but
+// the current frame reaches them meanwhile.
+static void InstructionGetRangeExits(
+    const std::vector<DWORD64> &addresses,
+    const std::vector<Instruction> &instructions, DWORD64 start, DWORD64 end,
+    std::vector<DWORD64> *exits) {
+  for (size_t i = 0; i < instructions.size(); ++i) {
+    const Instruction &it = instructions[i];
+
+    if (it.type == InstructionType::OTHER) {
+      continue;
+    }
+
+    if (it.type == InstructionType::CALL || !it.is_relative) {
+      exits->push_back(addresses[i]);
+    } else if (it.target < start || it.target >= end) {
+      exits->push_back(it.target);
+    }
+  }
+
+  // Falls through the end, unless the last instruction never does
+  if (instructions.empty() ||
+      (instructions.back().type != InstructionType::JUMP &&
+       instructions.back().type != InstructionType::RETURN)) {
+    exits->push_back(end);
+  }
+
+  std::sort(exits->begin(), exits->end());
+  exits->erase(std::unique(exits->begin(), exits->end()), exits->end());
+}
+
+// Copy of the instruction that does the same at "to" as at "from", relative
+// branches become rel32 ones. False, if it can't run elsewhere: loop, jcxz,
+// 16-bit branches or a target out of rel32 reach.
+static bool InstructionRelocate(const BYTE *code,
+                                const Instruction &instruction, DWORD64 from,
+                                DWORD64 to, bool is_64bit, BYTE *result,
+                                DWORD *result_length) {
+  if (!instruction.is_relative) {
+    memcpy(result, code, instruction.length);
+    *result_length = instruction.length;
+    if (!instruction.is_rip_relative) {
+      return true;
+    }
+
+    int32_t displacement;
+    memcpy(&displacement, code + instruction.displacement_offset,
+           sizeof(displacement));
+    const int64_t relocated = displacement + (int64_t)(from - to);
+    if (relocated != (int32_t)relocated) {
+      return false;
+    }
+
+    displacement = (int32_t)relocated;
+    memcpy(result + instruction.displacement_offset, &displacement,
+           sizeof(displacement));
+    return true;
+  }
+
+  // Opcode after the prefixes that don't change the displacement size
+  DWORD at = 0;
+  while (at < instruction.length &&
+         (code[at] == 0xf2 || code[at] == 0xf3 || code[at] == 0x2e ||
+          code[at] == 0x3e || (is_64bit && (code[at] & 0xf0) == 0x40))) {
+    ++at;
+  }
+  if (at + 1 >= instruction.length) {
+    return false;
+  }
+
+  DWORD length;
+  const BYTE opcode = code[at];
+  if (opcode == 0xeb || opcode == 0xe9 || opcode == 0xe8) {
+    result[0] = opcode == 0xe8 ? 0xe8 : 0xe9;
+    length = 5;
+  } else if ((opcode & 0xf0) == 0x70) {
+    result[0] = 0x0f;
+    result[1] = 0x80 | (opcode & 0x0f);
+    length = 6;
+  } else if (opcode == 0x0f && (code[at + 1] & 0xf0) == 0x80) {
+    result[0] = 0x0f;
+    result[1] = code[at + 1];
+    length = 6;
+  } else {
+    return false;
+  }
+
+  const DWORD64 displacement = instruction.target - (to + length);
+  if (is_64bit && (int64_t)displacement != (int32_t)displacement) {
+    return false;
+  }
+
+  const DWORD displacement32 = (DWORD)displacement;
+  memcpy(result + length - 4, &displacement32, sizeof(displacement32));
+  *result_length = length;
+
+  return true;
+}
\ No newline at end of file
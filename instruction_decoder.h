@@ -0,0 +1,24 @@
+#define INSTRUCTION_MAX_LENGTH 15
+
+// Condition of loop/loope/loopne/jcxz, depends on a counter register
+#define INSTRUCTION_CONDITION_COUNTER 0x10
+
+enum class InstructionType {
+  OTHER,
+  CALL,
+  JUMP,
+  CONDITIONAL_JUMP,
+  RETURN
+};
+
+// Length and control flow of one x86 or x86-64 instruction, the rest of it is
+// of no interest for stepping
+struct Instruction {
+  DWORD length;
+  InstructionType type;
+  bool is_relative; // Direct call or jump, "target" is known
+  bool is_rip_relative; // Memory operand is relative to the next instruction
+  DWORD displacement_offset; // is_rip_relative - where it's disp32 is
+  DWORD64 target;
+  BYTE condition; // CONDITIONAL_JUMP, "cc" of jcc or INSTRUCTION_CONDITION_*
+};
\ No newline at end of file
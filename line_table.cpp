@@ -0,0 +1,187 @@
+static DWORD LineTableInternFile(LineTable *line_table,
+                                 const std::string &filename) {
+  auto &filename_to_id = line_table->filename_to_id;
+
+  auto it = filename_to_id.find(filename);
+  if (it != filename_to_id.end()) {
+    return it->second;
+  }
+
+  DWORD file_id = (DWORD)line_table->filenames.size();
+  line_table->filenames.push_back(filename);
+  filename_to_id.emplace(filename, file_id);
+
+  return file_id;
+}
+
+// Index of the first entry with address >= "address", branch free
+static size_t LineTableLowerBound(const LineTable *line_table,
+                                  DWORD64 address) {
+  const auto &addresses = line_table->addresses;
+
+  size_t count = addresses.size();
+  if (count == 0) {
+    return 0;
+  }
+
+  const DWORD64 *base = addresses.data();
+  while (count > 1) {
+    const size_t half = count / 2;
+    base = (base[half] < address) ? base + half : base;
+    count -= half;
+  }
+
+  return (base - addresses.data()) + (*base < address);
+}
+
+static bool LineTableFind(const LineTable *line_table, DWORD64 address,
+                          size_t *index) {
+  const size_t result = LineTableLowerBound(line_table, address);
+  if (result == line_table->addresses.size() ||
+      line_table->addresses[result] != address) {
+    return false;
+  }
+
+  *index = result;
+
+  return true;
+}
+
+// Entry of the line that contains the address, the last one at or before it
+static bool LineTableFindContaining(const LineTable *line_table,
+                                    DWORD64 address, size_t *index) {
+  const size_t result = LineTableLowerBound(line_table, address);
+  if (result < line_table->addresses.size() &&
+      line_table->addresses[result] == address) {
+    *index = result;
+    return true;
+  }
+  if (result == 0) {
+    return false;
+  }
+
+  *index = result - 1;
+
+  return true;
+}
+
+// Merges a batch of entries (the modules of one load) with the lines of
+// "line_table" into "result", that may be the same table. An address that is
+// already present keeps its existing line. Only the batch is sorted, the
+// table's entries and their file line order are merged in linear time.
+// File names of "result" are left as they are.
+static void LineTableMerge(const LineTable *line_table,
+                           std::vector<LineTableEntry> &entries,
+                           LineTable *result) {
+  std::sort(entries.begin(), entries.end(),
+            [](const LineTableEntry &a, const LineTableEntry &b) {
+              return a.address < b.address;
+            });
+
+  const size_t count = line_table->addresses.size();
+  const size_t max_count = count + entries.size();
+
+  std::vector<DWORD64> addresses;
+  std::vector<DWORD> file_ids;
+  std::vector<DWORD> lines;
+  addresses.reserve(max_count);
+  file_ids.reserve(max_count);
+  lines.reserve(max_count);
+
+  // New indices of the table's entries, and of the batch's that are kept
+  std::vector<DWORD> moved(count);
+  std::vector<DWORD> added;
+  added.reserve(entries.size());
+
+  size_t i = 0;
+  size_t j = 0;
+  while (i < count || j < entries.size()) {
+    // Table's entry goes first on the same address, so it's never dropped
+    if (j == entries.size() ||
+        (i < count && line_table->addresses[i] <= entries[j].address)) {
+      moved[i] = (DWORD)addresses.size();
+      addresses.push_back(line_table->addresses[i]);
+      file_ids.push_back(line_table->file_ids[i]);
+      lines.push_back(line_table->lines[i]);
+      ++i;
+      continue;
+    }
+
+    const LineTableEntry &entry = entries[j++];
+    if (!addresses.empty() && addresses.back() == entry.address) {
+      continue;
+    }
+
+    added.push_back((DWORD)addresses.size());
+    addresses.push_back(entry.address);
+    file_ids.push_back(entry.file_id);
+    lines.push_back(entry.line);
+  }
+
+  // Indices follow the addresses, so the lowest address of a line is first
+  auto is_before = [&](DWORD a, DWORD b) {
+    if (file_ids[a] != file_ids[b]) {
+      return file_ids[a] < file_ids[b];
+    }
+    if (lines[a] != lines[b]) {
+      return lines[a] < lines[b];
+    }
+    return a < b;
+  };
+  std::sort(added.begin(), added.end(), is_before);
+
+  std::vector<DWORD> kept;
+  kept.reserve(count);
+  for (DWORD index : line_table->file_line_order) {
+    kept.push_back(moved[index]);
+  }
+
+  std::vector<DWORD> order;
+  order.reserve(addresses.size());
+  std::merge(kept.begin(), kept.end(), added.begin(), added.end(),
+             std::back_inserter(order), is_before);
+
+  result->addresses = std::move(addresses);
+  result->file_ids = std::move(file_ids);
+  result->lines = std::move(lines);
+  result->file_line_order = std::move(order);
+}
+
+// Merges a batch of entries into the table itself
+static void LineTableInsert(LineTable *line_table,
+                            std::vector<LineTableEntry> &entries) {
+  LineTableMerge(line_table, entries, line_table);
+}
+
+// Range of "file_line_order" that belongs to the file, ordered by line
+static void LineTableGetFileRange(const LineTable *line_table, DWORD file_id,
+                                  size_t *begin, size_t *end) {
+  const auto &order = line_table->file_line_order;
+  const auto &file_ids = line_table->file_ids;
+
+  auto first = std::lower_bound(
+      order.begin(), order.end(), file_id,
+      [&](DWORD index, DWORD value) { return file_ids[index] < value; });
+  auto last = std::upper_bound(
+      first, order.end(), file_id,
+      [&](DWORD value, DWORD index) { return value < file_ids[index]; });
+
+  *begin = first - order.begin();
+  *end = last - order.begin();
+}
+
+// Lowest address of the line inside a range from LineTableGetFileRange, or 0
+static DWORD64 LineTableFindLineAddress(const LineTable *line_table,
+                                        size_t begin, size_t end, DWORD line) {
+  const auto &order = line_table->file_line_order;
+  const auto &lines = line_table->lines;
+
+  auto it = std::lower_bound(
+      order.begin() + begin, order.begin() + end, line,
+      [&](DWORD index, DWORD value) { return lines[index] < value; });
+  if (it == order.begin() + end || lines[*it] != line) {
+    return 0;
+  }
+
+  return line_table->addresses[*it];
+}
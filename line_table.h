@@ -0,0 +1,20 @@
+struct LineTableEntry {
+  DWORD64 address;
+  DWORD file_id;
+  DWORD line;
+};
+
+// Address-sorted line table, kept as parallel arrays so that address lookups
+// only touch the address column
+struct LineTable {
+  std::vector<DWORD64> addresses;
+  std::vector<DWORD> file_ids;
+  std::vector<DWORD> lines;
+
+  // Indices into the arrays above, ordered by (file id, line, address)
+  std::vector<DWORD> file_line_order;
+
+  // Interned source file paths, file id is the index
+  std::vector<std::string> filenames;
+  std::unordered_map<std::string, DWORD> filename_to_id;
+};
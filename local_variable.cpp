@@ -1,3 +1,64 @@
 static void LocalVariablesReset(LocalVariables *local_variables) {
   local_variables->data.clear();
+}
+
+// Appends the variable, then it's members or elements. "data" has "size"
+// bytes of it, NULL - it couldn't be read.
+static void LocalVariablesAppend(LocalVariables *local_variables,
+                                 const TypeModel *type_model,
+                                 DWORD type_index, const std::string &name,
+                                 const BYTE *data, DWORD64 size,
+                                 DWORD depth) {
+  auto &variables = local_variables->data;
+  const Type &type = type_model->types[type_index];
+
+  if (!data || size < type.size) {
+    variables.push_back(LocalVariable{name, "Unreadable memory", depth, false});
+    return;
+  }
+
+  // Strings are shown whole, their characters aren't listed
+  const bool is_array = type.kind == TypeKind::ARRAY && type.count &&
+                        !TypeModelIsString(type_model, type);
+  const bool is_udt = type.kind == TypeKind::UDT && !type.fields.empty();
+  variables.push_back(
+      LocalVariable{name, TypeModelFormatValue(type_model, type_index, data),
+                    depth, is_array || is_udt});
+
+  if (is_udt) {
+    for (const auto &field : type.fields) {
+      const DWORD64 field_size = type_model->types[field.type].size;
+      if (field.offset > size || size - field.offset < field_size) {
+        variables.push_back(
+            LocalVariable{field.name, "Unreadable memory", depth + 1, false});
+      } else if (field.bit_count) {
+        variables.push_back(
+            LocalVariable{field.name,
+                          TypeModelFormatBits(type_model, field, data),
+                          depth + 1, false});
+      } else {
+        LocalVariablesAppend(local_variables, type_model, field.type,
+                             field.name, data + field.offset,
+                             size - field.offset, depth + 1);
+      }
+    }
+  }
+
+  if (is_array) {
+    const DWORD64 element_size = type_model->types[type.element].size;
+    const DWORD count =
+        std::min<DWORD>(type.count, LOCAL_VARIABLE_MAX_ELEMENTS);
+    for (DWORD i = 0; i < count; ++i) {
+      const DWORD64 offset = i * element_size;
+      LocalVariablesAppend(local_variables, type_model, type.element,
+                           '[' + std::to_string(i) + ']',
+                           offset <= size ? data + offset : NULL,
+                           offset <= size ? size - offset : 0, depth + 1);
+    }
+    if (type.count > count) {
+      variables.push_back(
+          LocalVariable{"...", std::to_string(type.count - count) + " more",
+                        depth + 1, false});
+    }
+  }
 }
\ No newline at end of file
@@ -1,6 +1,12 @@
+#define LOCAL_VARIABLE_MAX_ELEMENTS 64 // Of an array, the rest isn't listed
+
+// Members and elements follow the variable they are in, one level deeper,
+// so the UI expands them without asking the debugger
 struct LocalVariable {
   std::string name;
   std::string value;
+  DWORD depth;
+  bool has_children;
 };
 
 struct LocalVariables {
@@ -9,9 +9,32 @@
 
 #include "utils.cpp"
 #include "registers.cpp"
+#ifdef _WIN32
+#include "backend_win32.cpp"
+#else
+#include "backend_ptrace.cpp"
+#endif
+#include "memory_cache.cpp"
+#include "dwarf.cpp"
+#include "unwinder.cpp"
+#include "instruction_decoder.cpp"
+#include "condition.cpp"
+#include "agent.cpp"
+#include "type_model.cpp"
 #include "local_variable.cpp"
 #include "breakpoint.cpp"
 #include "directx11.cpp"
+#include "epoch.cpp"
+#include "line_table.cpp"
+#include "symbol_cache_codec.cpp"
+#include "symbol_cache.cpp"
+#ifndef _WIN32
+#include "elf_reader.cpp"
+#endif
+#include "module_loader.cpp"
+#include "symbolizer.cpp"
+#include "command_queue.cpp"
+#include "stepper.cpp"
 #include "debugger.cpp"
 #include "source.cpp"
 #include "imgui_manager.cpp"
@@ -30,52 +53,128 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine,
 
   if (argc < 3) {
     LOG(INFO)
-        << "Usage: <executable filename with pdb>, <main function name>\n";
+        << "Usage: <executable filename with pdb>, <main function name>\n"
+        << "       -p <process id>\n";
     return 1;
   }
 
+  // Attach to a running process, it's start is long past
+  DWORD process_id = 0;
+  if (wcscmp(argv[1], L"-p") == 0) {
+    process_id = (DWORD)wcstoul(argv[2], NULL, 10);
+  }
+
   // Test();
   if (!ImGuiLogInitialize(&Global_ImGuiLog)) {
     LOG(main) << "Unable to initialize imgui log\n";
     return 1;
   }
 
-  HANDLE continue_event = CreateEvent(NULL, FALSE, FALSE, NULL);
-  if (!continue_event) {
-    return 1;
-  }
-
   Registers registers = {};
   LocalVariables local_variables;
   Source source;
-  Breakpoints breakpoints;
-
-  Debugger debugger =
-      CreateDebugger(&registers, &local_variables, &source, &breakpoints,
-                     argv[1], argv[2], continue_event);
+  Breakpoints breakpoints = {};
+  DebuggerCommandQueue command_queue = {};
+
+  // Debugger thread publishes, UI thread only reads
+  Snapshots snapshots;
+  EpochInitialize(&snapshots.epoch_domain);
+  snapshots.stop.store(nullptr);
+
+  Debugger *debugger = CreateDebugger(&registers, &local_variables, &source,
+                                      &breakpoints, &snapshots, argv[1],
+                                      process_id, process_id ? L"" : argv[2],
+                                      &command_queue);
+  if (!debugger) {
+    LOG(main) << "Unable to start debugging the target\n";
+    return 1;
+  }
   ImGuiManager imgui_manager =
-      CreateImGuiManager(&registers, &local_variables, &source, &breakpoints);
-  debugger.OnLineAddressChange = [&](DWORD64 address) {
-    imgui_manager.current_line_address = address;
-  };
+      CreateImGuiManager(&snapshots, &source, debugger->symbolizer);
+  // Everything that touches the target runs on the debugger thread
   imgui_manager.OnStepOver = [&]() {
-    DebuggerSetState(&debugger, DebuggerState::STEP_OVER);
-    SetEvent(continue_event);
+    DebuggerCommandQueuePush(&command_queue,
+                             {DebuggerCommandType::STEP_OVER});
+  };
+  imgui_manager.OnPrintCallstack = [&]() {
+    DebuggerCommandQueuePush(&command_queue,
+                             {DebuggerCommandType::PRINT_CALLSTACK});
+  };
+  imgui_manager.OnSetBreakpoint = [&](DWORD64 address) {
+    DebuggerCommandQueuePush(&command_queue,
+                             {DebuggerCommandType::SET_BREAKPOINT, address});
   };
-  imgui_manager.OnPrintCallstack = [&]() { DebuggerPrintCallstack(&debugger); };
-  imgui_manager.OnSetBreakpoint = [&](DWORD64 address) -> bool {
-    return DebuggerSetBreakpoint(&debugger, address);
+  imgui_manager.OnRemoveBreakpoint = [&](DWORD64 address) {
+    DebuggerCommandQueuePush(&command_queue,
+                             {DebuggerCommandType::REMOVE_BREAKPOINT, address});
   };
-  imgui_manager.OnRemoveBreakpoint = [&](DWORD64 address) -> bool {
-    return DebuggerRemoveBreakpoint(&debugger, address);
+  imgui_manager.OnSetCondition = [&](DWORD64 address, const std::string &text) {
+    DebuggerCommand command = {DebuggerCommandType::SET_CONDITION, address};
+    command.text = text;
+    DebuggerCommandQueuePush(&command_queue, command);
+  };
+  imgui_manager.OnEnableAgent = [&](bool is_enabled) {
+    DebuggerCommand command = {DebuggerCommandType::ENABLE_AGENT};
+    command.is_enabled = is_enabled;
+    DebuggerCommandQueuePush(&command_queue, command);
+  };
+  imgui_manager.OnSetWatchpoint = [&](DWORD64 address, size_t size,
+                                      BreakpointAccess access) {
+    DebuggerCommand command = {DebuggerCommandType::SET_WATCHPOINT, address,
+                               size};
+    command.access = access;
+    DebuggerCommandQueuePush(&command_queue, command);
+  };
+  imgui_manager.OnRemoveWatchpoint = [&](DWORD64 address) {
+    DebuggerCommandQueuePush(&command_queue,
+                             {DebuggerCommandType::REMOVE_WATCHPOINT, address});
+  };
+  imgui_manager.OnReadMemory = [&](DWORD64 address, size_t size) {
+    DebuggerCommand command = {DebuggerCommandType::READ_MEMORY, address,
+                               size};
+    ImGuiMemoryView *memory_view = imgui_manager.memory_view;
+    command.OnMemoryRead = [memory_view, address,
+                            size](const std::vector<BYTE> &data) {
+      std::lock_guard<std::mutex> lock(memory_view->mutex);
+      memory_view->address = address;
+      memory_view->size = size;
+      memory_view->data = data;
+      memory_view->is_read = true;
+    };
+    DebuggerCommandQueuePush(&command_queue, command);
   };
   imgui_manager.OnContinue = [&]() {
-    DebuggerSetState(&debugger, DebuggerState::CONTINUE);
-    SetEvent(continue_event);
+    DebuggerCommandQueuePush(&command_queue, {DebuggerCommandType::CONTINUE});
   };
   imgui_manager.OnStepIn = [&]() {
-    DebuggerSetState(&debugger, DebuggerState::STEP_IN);
-    SetEvent(continue_event);
+    DebuggerCommandQueuePush(&command_queue, {DebuggerCommandType::STEP_IN});
+  };
+  imgui_manager.OnStepOut = [&]() {
+    DebuggerCommandQueuePush(&command_queue, {DebuggerCommandType::STEP_OUT});
+  };
+  imgui_manager.OnSelectThread = [&](DWORD thread_id) {
+    DebuggerCommand command = {DebuggerCommandType::SELECT_THREAD};
+    command.thread_id = thread_id;
+    DebuggerCommandQueuePush(&command_queue, command);
+  };
+  imgui_manager.OnSelectFrame = [&](DWORD frame_index) {
+    DebuggerCommand command = {DebuggerCommandType::SELECT_FRAME};
+    command.frame_index = frame_index;
+    DebuggerCommandQueuePush(&command_queue, command);
+  };
+  imgui_manager.OnSetNonStop = [&](bool is_enabled) {
+    DebuggerCommand command = {DebuggerCommandType::SET_NON_STOP};
+    command.is_enabled = is_enabled;
+    DebuggerCommandQueuePush(&command_queue, command);
+  };
+  imgui_manager.OnResumeThread = [&](DebuggerCommandType type,
+                                     DWORD thread_id) {
+    DebuggerCommand command = {type};
+    command.thread_id = thread_id;
+    DebuggerCommandQueuePush(&command_queue, command);
+  };
+  imgui_manager.OnDetach = [&]() {
+    DebuggerCommandQueuePush(&command_queue, {DebuggerCommandType::DETACH});
   };
 
   std::thread thread([&]() {
@@ -103,9 +202,12 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine,
           Global_IsOpen = false;
       }
     }
+
+    // Wake up debugger thread, if it waits for an action
+    DebuggerCommandQueuePush(&command_queue, {DebuggerCommandType::QUIT});
   });
 
-  DebuggerRun(&debugger);
+  DebuggerRun(debugger);
   thread.join();
 
   return 0;
@@ -1,8 +1,35 @@
+#ifdef _WIN32
 #include <Windows.h>
 #include <dbghelp.h>
 #include <psapi.h>
 #include <strsafe.h>
 #include <tchar.h>
+#else
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/signalfd.h>
+#include <dirent.h>
+#include <elf.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <limits.h>
+#include <stdint.h>
+
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef uint64_t DWORD64;
+typedef unsigned long ULONG;
+typedef size_t SIZE_T;
+typedef void *HANDLE;
+#endif
 #include <iostream>
 #include <string>
 #include <unordered_map>
@@ -17,6 +44,14 @@
 #include <set>
 #include <sstream>
 #include <initializer_list>
+#include <algorithm>
+#include <list>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <chrono>
+#include <atomic>
+#include <cmath>
 
 #define BUFSIZE 512
 #define IMGUI_LOG_MAX_SIZE 300
@@ -30,6 +65,7 @@
 #pragma comment(lib, "Shell32.lib")
 
 static bool Global_IsOpen = true;
+static std::mutex Global_DbgHelpMutex; // DbgHelp is single threaded
 
 #include "imgui/imgui.h"
 #include "imgui/imgui_impl_win32.h"
@@ -38,9 +74,27 @@ static bool Global_IsOpen = true;
 
 #include "directx11.h"
 #include "registers.h"
+#include "backend.h"
+#include "memory_cache.h"
+#include "instruction_decoder.h"
+#include "condition.h"
+#include "agent.h"
+#include "type_model.h"
 #include "local_variable.h"
 #include "breakpoint.h"
+#include "epoch.h"
+#include "snapshot.h"
+#include "dwarf.h"
+#include "unwinder.h"
+#include "module_index.h"
+#include "elf_reader.h"
+#include "symbol_cache.h"
+#include "module_loader.h"
+#include "symbolizer.h"
+#include "command_queue.h"
+#include "stepper.h"
 #include "debugger.h"
+#include "line_table.h"
 #include "source.h"
 #include "imgui_manager.h"
 
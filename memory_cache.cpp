@@ -0,0 +1,184 @@
+static MemoryCache *CreateMemoryCache(Backend *backend) {
+  MemoryCache *result = new MemoryCache();
+  result->backend = backend;
+  result->pages.reserve(MEMORY_CACHE_MAX_PAGES);
+  result->data = new BYTE[MEMORY_CACHE_MAX_PAGES * MEMORY_CACHE_PAGE_SIZE];
+  result->read_count = 0;
+  result->hit_count = 0;
+  result->syscall_base = backend->syscall_count;
+
+  return result;
+}
+
+static void MemoryCacheInvalidate(MemoryCache *memory_cache) {
+  memory_cache->page_to_index.clear();
+  memory_cache->pages.clear();
+  memory_cache->read_count = 0;
+  memory_cache->hit_count = 0;
+  memory_cache->syscall_base = memory_cache->backend->syscall_count;
+}
+
+// Backend calls made during the current stop
+static inline DWORD64 MemoryCacheGetSyscallCount(MemoryCache *memory_cache) {
+  return memory_cache->backend->syscall_count - memory_cache->syscall_base;
+}
+
+// Reads all missing pages of the range with one backend call, runs of
+// adjacent missing pages become a single range
+static void MemoryCacheFill(MemoryCache *memory_cache, DWORD64 first_page,
+                            DWORD64 last_page) {
+  auto &pages = memory_cache->pages;
+  auto &page_to_index = memory_cache->page_to_index;
+
+  const size_t page_count =
+      (size_t)((last_page - first_page) / MEMORY_CACHE_PAGE_SIZE + 1);
+  if (pages.size() + page_count > MEMORY_CACHE_MAX_PAGES) {
+    page_to_index.clear();
+    pages.clear();
+  }
+
+  std::vector<BackendMemoryRange> ranges;
+  std::vector<size_t> range_first_pages;
+  for (DWORD64 page = first_page; page <= last_page;
+       page += MEMORY_CACHE_PAGE_SIZE) {
+    if (page_to_index.count(page)) {
+      continue;
+    }
+
+    const DWORD index = (DWORD)pages.size();
+    pages.emplace_back(MemoryCachePage{page, 0});
+    page_to_index[page] = index;
+
+    // Slots are handed out in order, so adjacent pages have adjacent buffers
+    BackendMemoryRange *last = ranges.empty() ? NULL : &ranges.back();
+    if (last && last->address + last->size == page) {
+      last->size += MEMORY_CACHE_PAGE_SIZE;
+    } else {
+      ranges.emplace_back(BackendMemoryRange{
+          page, memory_cache->data + (size_t)index * MEMORY_CACHE_PAGE_SIZE,
+          MEMORY_CACHE_PAGE_SIZE, 0});
+      range_first_pages.push_back(index);
+    }
+  }
+
+  if (ranges.empty()) {
+    return;
+  }
+
+  BackendReadMemoryRanges(memory_cache->backend, ranges.data(),
+                          ranges.size());
+
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    SIZE_T remaining_size = ranges[i].transferred_size;
+    const size_t range_page_count = ranges[i].size / MEMORY_CACHE_PAGE_SIZE;
+    for (size_t j = 0; j < range_page_count; ++j) {
+      const SIZE_T size =
+          std::min<SIZE_T>(remaining_size, MEMORY_CACHE_PAGE_SIZE);
+      pages[range_first_pages[i] + j].readable_size = (DWORD)size;
+      remaining_size -= size;
+    }
+  }
+}
+
+// Same contract as BackendReadMemory, "read_size" gets the bytes read up to
+// the first unreadable one
+static bool MemoryCacheRead(MemoryCache *memory_cache, DWORD64 address,
+                            void *buffer, SIZE_T size, SIZE_T *read_size) {
+  const auto &pages = memory_cache->pages;
+  const auto &page_to_index = memory_cache->page_to_index;
+
+  if (read_size) {
+    *read_size = 0;
+  }
+  if (size == 0) {
+    return true;
+  }
+
+  const DWORD64 first_page = address & ~(DWORD64)(MEMORY_CACHE_PAGE_SIZE - 1);
+  const DWORD64 last_page =
+      (address + size - 1) & ~(DWORD64)(MEMORY_CACHE_PAGE_SIZE - 1);
+  const DWORD64 page_count =
+      (last_page - first_page) / MEMORY_CACHE_PAGE_SIZE + 1;
+  if (page_count > MEMORY_CACHE_MAX_PAGES) {
+    return BackendReadMemory(memory_cache->backend, address, buffer, size,
+                             read_size);
+  }
+
+  ++memory_cache->read_count;
+
+  bool is_cached = true;
+  for (DWORD64 page = first_page; page <= last_page && is_cached;
+       page += MEMORY_CACHE_PAGE_SIZE) {
+    is_cached = page_to_index.count(page) != 0;
+  }
+
+  if (is_cached) {
+    ++memory_cache->hit_count;
+  } else {
+    MemoryCacheFill(memory_cache, first_page, last_page);
+  }
+
+  BYTE *destination = (BYTE *)buffer;
+  SIZE_T copied_size = 0;
+  while (copied_size < size) {
+    const DWORD64 at = address + copied_size;
+    const DWORD64 page = at & ~(DWORD64)(MEMORY_CACHE_PAGE_SIZE - 1);
+    const DWORD offset = (DWORD)(at - page);
+
+    const MemoryCachePage &cached_page = pages[page_to_index.at(page)];
+    if (offset >= cached_page.readable_size) {
+      break;
+    }
+
+    const SIZE_T chunk_size = std::min<SIZE_T>(
+        size - copied_size, cached_page.readable_size - offset);
+    memcpy(destination + copied_size,
+           memory_cache->data +
+               (size_t)page_to_index.at(page) * MEMORY_CACHE_PAGE_SIZE +
+               offset,
+           chunk_size);
+    copied_size += chunk_size;
+  }
+
+  if (read_size) {
+    *read_size = copied_size;
+  }
+
+  return copied_size == size;
+}
+
+// Writes through to the target and keeps cached pages up to date
+static bool MemoryCacheWrite(MemoryCache *memory_cache, DWORD64 address,
+                             const void *buffer, SIZE_T size) {
+  auto &pages = memory_cache->pages;
+  auto &page_to_index = memory_cache->page_to_index;
+
+  const bool result =
+      BackendWriteMemory(memory_cache->backend, address, buffer, size);
+
+  const BYTE *source = (const BYTE *)buffer;
+  for (DWORD64 at = address; at < address + size;) {
+    const DWORD64 page = at & ~(DWORD64)(MEMORY_CACHE_PAGE_SIZE - 1);
+    const DWORD offset = (DWORD)(at - page);
+    const SIZE_T chunk_size = std::min<SIZE_T>(address + size - at,
+                                               MEMORY_CACHE_PAGE_SIZE - offset);
+
+    auto it = page_to_index.find(page);
+    if (it != page_to_index.end()) {
+      if (!result) {
+        // Unknown how much got written
+        page_to_index.erase(it);
+      } else if (offset < pages[it->second].readable_size) {
+        memcpy(memory_cache->data +
+                   (size_t)it->second * MEMORY_CACHE_PAGE_SIZE + offset,
+               source + (at - address),
+               std::min<SIZE_T>(chunk_size,
+                                pages[it->second].readable_size - offset));
+      }
+    }
+
+    at += chunk_size;
+  }
+
+  return result;
+}
\ No newline at end of file
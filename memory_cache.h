@@ -0,0 +1,22 @@
+#define MEMORY_CACHE_PAGE_SIZE 4096
+#define MEMORY_CACHE_MAX_PAGES 256 // Bigger reads bypass the cache
+
+struct MemoryCachePage {
+  DWORD64 address;
+  DWORD readable_size; // Bytes from the page start, 0 - unreadable
+};
+
+// Target memory, read a page at a time and kept while the target is stopped.
+// Has to be invalidated before the target runs again.
+struct MemoryCache {
+  Backend *backend;
+
+  std::unordered_map<DWORD64, DWORD> page_to_index; // Into "pages"
+  std::vector<MemoryCachePage> pages;
+  BYTE *data; // Page "i" is at data + i * MEMORY_CACHE_PAGE_SIZE
+
+  // Statistics since the last invalidate, that is for the current stop
+  DWORD64 read_count;
+  DWORD64 hit_count;
+  DWORD64 syscall_base; // Backend::syscall_count at invalidate
+};
\ No newline at end of file
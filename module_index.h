@@ -0,0 +1,61 @@
+// Line and function info of one module. Addresses are relative to the module
+// base, so the same index is valid wherever the module gets loaded.
+struct ModuleLine {
+  DWORD rva;
+  DWORD file_index; // Into ModuleIndex::source_files
+  DWORD line;
+};
+
+struct ModuleFunction {
+  DWORD start_rva;
+  DWORD end_rva;     // Exclusive
+  DWORD name_offset; // Into ModuleIndex::names
+};
+
+// Range of a function that was inlined into another one, or into an inlined
+// one. Inlined code that got split has an entry per range.
+struct ModuleInlineSite {
+  DWORD start_rva;
+  DWORD end_rva;     // Exclusive
+  DWORD name_offset; // Into ModuleIndex::names, of the inlined function
+};
+
+#define MODULE_NO_SCOPE 0xffffffff
+
+// Function or inline site, the innermost one an address is in tells the
+// inline frames above the function
+struct ModuleScope {
+  DWORD start_rva;
+  DWORD end_rva; // Exclusive, cut to the end of the parent
+  DWORD name_offset;
+  DWORD parent; // Index into ModuleIndex::scopes, MODULE_NO_SCOPE - outermost
+  DWORD function; // Index into ModuleIndex::functions of the outermost one,
+                  // MODULE_NO_SCOPE - it's not in a function
+};
+
+struct ModuleIndex {
+  std::vector<std::string> source_files;
+  std::vector<ModuleLine> lines;
+  std::vector<ModuleFunction> functions; // Sorted by start
+  std::vector<ModuleInlineSite> inline_sites; // In any order
+  std::string names; // Null terminated function names
+
+  // Indices + 1 into "functions" by hash of the name, open addressing with
+  // linear probing, 0 - empty. Built after the rest, it's not cached.
+  std::vector<DWORD> name_table;
+
+  // Functions, then inline sites, nested into each other. Range "i" of the
+  // module, from "scope_starts[i]" up to the next start, has the innermost
+  // scope "scope_indices[i]" or MODULE_NO_SCOPE. Built after the rest, it's
+  // not cached either.
+  std::vector<ModuleScope> scopes;
+  std::vector<DWORD> scope_starts;
+  std::vector<DWORD> scope_indices;
+};
+
+struct Module {
+  DWORD64 base;
+  std::string path;
+  ModuleIndex index;
+  UnwindTable unwind_table; // Empty without .eh_frame, PE modules have none
+};
\ No newline at end of file
@@ -0,0 +1,490 @@
+// FNV-1a of a null terminated name
+static inline DWORD64 ModuleHashName(const char *name) {
+  DWORD64 hash = 0xcbf29ce484222325ull;
+  for (; *name; ++name) {
+    hash ^= (BYTE)*name;
+    hash *= 0x100000001b3ull;
+  }
+
+  return hash;
+}
+
+// Of functions with the same name, the one with the lowest address is found
+static void ModuleBuildNameTable(ModuleIndex *module_index) {
+  const auto &functions = module_index->functions;
+  const char *names = module_index->names.c_str();
+  auto &name_table = module_index->name_table;
+
+  // At most half full, so probes stay short
+  size_t size = 16;
+  while (size < functions.size() * 2) {
+    size *= 2;
+  }
+  name_table.assign(size, 0);
+
+  for (DWORD i = 0; i < (DWORD)functions.size(); ++i) {
+    const char *name = names + functions[i].name_offset;
+
+    size_t slot = ModuleHashName(name) & (size - 1);
+    while (name_table[slot] &&
+           strcmp(names + functions[name_table[slot] - 1].name_offset,
+                  name) != 0) {
+      slot = (slot + 1) & (size - 1);
+    }
+    if (!name_table[slot]) {
+      name_table[slot] = i + 1;
+    }
+  }
+}
+
+// Function with exactly this name, NULL if there is none
+static const ModuleFunction *ModuleFindFunction(const ModuleIndex *module_index,
+                                                const char *name) {
+  const auto &name_table = module_index->name_table;
+  if (name_table.empty()) {
+    return NULL;
+  }
+
+  const size_t mask = name_table.size() - 1;
+  for (size_t slot = ModuleHashName(name) & mask; name_table[slot];
+       slot = (slot + 1) & mask) {
+    const ModuleFunction &function =
+        module_index->functions[name_table[slot] - 1];
+    if (strcmp(module_index->names.c_str() + function.name_offset, name) ==
+        0) {
+      return &function;
+    }
+  }
+
+  return NULL;
+}
+
+// Range of the innermost scope from "start_rva" on. One that starts at the
+// same rva is replaced, one with the same scope as the range before is
+// merged into it.
+static inline void ModuleAddScopeRange(ModuleIndex *module_index,
+                                       DWORD start_rva, DWORD scope) {
+  auto &starts = module_index->scope_starts;
+  auto &indices = module_index->scope_indices;
+
+  if (!starts.empty() && starts.back() == start_rva) {
+    starts.pop_back();
+    indices.pop_back();
+  }
+  if (!indices.empty() && indices.back() == scope) {
+    return;
+  }
+
+  starts.push_back(start_rva);
+  indices.push_back(scope);
+}
+
+// Nests inline sites into functions and each other by their ranges, then
+// cuts the module into ranges of one innermost scope each
+static void ModuleBuildScopes(ModuleIndex *module_index) {
+  const auto &functions = module_index->functions;
+  const auto &inline_sites = module_index->inline_sites;
+  auto &scopes = module_index->scopes;
+
+  scopes.clear();
+  scopes.reserve(functions.size() + inline_sites.size());
+  for (DWORD i = 0; i < (DWORD)functions.size(); ++i) {
+    scopes.push_back(ModuleScope{functions[i].start_rva, functions[i].end_rva,
+                                 functions[i].name_offset, MODULE_NO_SCOPE,
+                                 i});
+  }
+  for (const auto &inline_site : inline_sites) {
+    scopes.push_back(ModuleScope{inline_site.start_rva, inline_site.end_rva,
+                                 inline_site.name_offset, MODULE_NO_SCOPE,
+                                 MODULE_NO_SCOPE});
+  }
+
+  // Outer ones first, a function goes before an inline site of the same
+  // range
+  std::vector<DWORD> order(scopes.size());
+  for (DWORD i = 0; i < (DWORD)order.size(); ++i) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&](DWORD a, DWORD b) {
+    if (scopes[a].start_rva != scopes[b].start_rva) {
+      return scopes[a].start_rva < scopes[b].start_rva;
+    }
+    if (scopes[a].end_rva != scopes[b].end_rva) {
+      return scopes[a].end_rva > scopes[b].end_rva;
+    }
+    return a < b;
+  });
+
+  module_index->scope_starts.clear();
+  module_index->scope_indices.clear();
+
+  // Scopes around the current one, the innermost last
+  std::vector<DWORD> stack;
+  const auto close = [&](DWORD start_rva) {
+    while (!stack.empty() && scopes[stack.back()].end_rva <= start_rva) {
+      const DWORD end_rva = scopes[stack.back()].end_rva;
+      stack.pop_back();
+      ModuleAddScopeRange(module_index, end_rva,
+                          stack.empty() ? MODULE_NO_SCOPE : stack.back());
+    }
+  };
+
+  for (DWORD index : order) {
+    ModuleScope &scope = scopes[index];
+    close(scope.start_rva);
+
+    if (!stack.empty()) {
+      scope.parent = stack.back();
+      scope.end_rva = std::min(scope.end_rva, scopes[scope.parent].end_rva);
+      scope.function = scopes[scope.parent].function;
+    }
+    if (scope.start_rva >= scope.end_rva) {
+      continue;
+    }
+
+    ModuleAddScopeRange(module_index, scope.start_rva, index);
+    stack.push_back(index);
+  }
+  close(0xffffffff);
+}
+
+// Innermost function or inline site that has the rva, MODULE_NO_SCOPE if
+// there is none. Branch free, like LineTableLowerBound.
+static DWORD ModuleFindScope(const ModuleIndex *module_index, DWORD rva) {
+  const auto &starts = module_index->scope_starts;
+
+  size_t count = starts.size();
+  if (count == 0 || rva < starts[0]) {
+    return MODULE_NO_SCOPE;
+  }
+
+  // Last range that starts at or before the rva
+  const DWORD *base = starts.data();
+  while (count > 1) {
+    const size_t half = count / 2;
+    base = (base[half] <= rva) ? base + half : base;
+    count -= half;
+  }
+
+  return module_index->scope_indices[base - starts.data()];
+}
+
+// Function that has the rva, inline sites in it are looked through. NULL if
+// there is none.
+static const ModuleFunction *
+ModuleFindFunctionAt(const ModuleIndex *module_index, DWORD rva) {
+  const DWORD scope = ModuleFindScope(module_index, rva);
+  if (scope == MODULE_NO_SCOPE ||
+      module_index->scopes[scope].function == MODULE_NO_SCOPE) {
+    return NULL;
+  }
+
+  return &module_index->functions[module_index->scopes[scope].function];
+}
+
+#ifdef _WIN32
+inline BOOL WINAPI EnumSourceFilesCallback(PSOURCEFILE SourceFile,
+                                           PVOID UserContext) {
+  ModuleIndex *module_index = (ModuleIndex *)UserContext;
+  // LOG(INFO) << "ModBase: " << std::hex << SourceFile->ModBase << ", Filename:
+  // " << SourceFile->FileName << '\n';
+  module_index->source_files.push_back(SourceFile->FileName);
+
+  return TRUE;
+}
+
+struct EnumLinesCallbackData {
+  DWORD64 base;
+  DWORD file_index;
+  ModuleIndex *module_index;
+};
+
+inline BOOL WINAPI EnumLinesCallback(PSRCCODEINFO LineInfo, PVOID UserContext) {
+  auto data = reinterpret_cast<EnumLinesCallbackData *>(UserContext);
+  auto &lines = data->module_index->lines;
+  // LOG_IMGUI_TO_FILE(INFO, "Module: ", LineInfo->FileName, " - Line: ",
+  // std::dec,
+  //                   LineInfo->LineNumber, " - Address: ", std::hex,
+  //                   LineInfo->Address)
+
+  if (LineInfo->LineNumber != 0xf00f00) { // What?
+    lines.emplace_back(ModuleLine{(DWORD)(LineInfo->Address - data->base),
+                                  data->file_index, LineInfo->LineNumber});
+  }
+
+  return TRUE;
+}
+
+struct EnumFunctionsCallbackData {
+  DWORD64 base;
+  ModuleIndex *module_index;
+};
+
+inline BOOL WINAPI EnumFunctionsCallback(PSYMBOL_INFO pSymInfo,
+                                         ULONG SymbolSize, PVOID UserContext) {
+  auto data = reinterpret_cast<EnumFunctionsCallbackData *>(UserContext);
+  auto module_index = data->module_index;
+
+  if ((pSymInfo->Tag == SymTagFunction || pSymInfo->Tag == SymTagInlineSite) &&
+      pSymInfo->Size) {
+    const DWORD start_rva = (DWORD)(pSymInfo->Address - data->base);
+    const DWORD end_rva = start_rva + pSymInfo->Size;
+    const DWORD name_offset = (DWORD)module_index->names.size();
+
+    if (pSymInfo->Tag == SymTagFunction) {
+      module_index->functions.emplace_back(
+          ModuleFunction{start_rva, end_rva, name_offset});
+    } else {
+      module_index->inline_sites.emplace_back(
+          ModuleInlineSite{start_rva, end_rva, name_offset});
+    }
+    module_index->names.append(pSymInfo->Name, pSymInfo->NameLen);
+    module_index->names.push_back('\0');
+  }
+
+  return TRUE;
+}
+
+// Slow path, asks DbgHelp for everything. Caller holds Global_DbgHelpMutex.
+inline void ModuleEnumerate(HANDLE process, DWORD64 base,
+                            ModuleIndex *module_index) {
+  SymEnumSourceFiles(process, base, "*.[ic][np][lp?]",
+                     EnumSourceFilesCallback, module_index);
+
+  for (DWORD i = 0; i < module_index->source_files.size(); ++i) {
+    EnumLinesCallbackData data = {base, i, module_index};
+    SymEnumLines(process, base, NULL, module_index->source_files[i].c_str(),
+                 EnumLinesCallback, (PVOID)&data);
+  }
+
+  // Inline sites come along with the functions they are in
+  EnumFunctionsCallbackData data = {base, module_index};
+  SymEnumSymbolsEx(process, base, "*", EnumFunctionsCallback, (PVOID)&data,
+                   SYMENUM_OPTIONS_DEFAULT | SYMENUM_OPTIONS_INLINE);
+
+  // Looked up by address later
+  std::sort(module_index->functions.begin(), module_index->functions.end(),
+            [](const ModuleFunction &a, const ModuleFunction &b) {
+              return a.start_rva < b.start_rva;
+            });
+}
+
+inline bool ModuleGetSymbolCacheKey(HANDLE file, const std::string &filename,
+                                    const IMAGEHLP_MODULE64 &module_info,
+                                    SymbolCacheKey *key) {
+  BY_HANDLE_FILE_INFORMATION file_information;
+  if (!GetFileInformationByHandle(file, &file_information)) {
+    LOG_IMGUI(ModuleGetSymbolCacheKey,
+              "GetFileInformationByHandle failed, error = ", GetLastError())
+    return false;
+  }
+
+  key->path = filename;
+  key->size = ((DWORD64)file_information.nFileSizeHigh << 32) |
+              file_information.nFileSizeLow;
+  key->timestamp =
+      ((DWORD64)file_information.ftLastWriteTime.dwHighDateTime << 32) |
+      file_information.ftLastWriteTime.dwLowDateTime;
+  memcpy(key->build_id, &module_info.PdbSig70, sizeof(key->build_id));
+  key->build_age = module_info.PdbAge;
+
+  return true;
+}
+
+// Loads module symbols and fills its index, either from the symbol cache or
+// from DbgHelp. Safe to call from any thread.
+static bool ModuleLoad(HANDLE process, HANDLE file, const std::string &path,
+                       DWORD64 base_address, Module *module) {
+  TCHAR filename[MAX_PATH + 1];
+  if (!GetFileNameFromHandle(file, filename)) {
+    LOG_IMGUI(ModuleLoad, "GetFileNameFromHandle failed, error = ",
+              GetLastError())
+    return false;
+  }
+
+  IMAGEHLP_MODULE64 module_info;
+  module_info.SizeOfStruct = sizeof(module_info);
+  {
+    std::lock_guard<std::mutex> lock(Global_DbgHelpMutex);
+
+    DWORD64 base = SymLoadModuleEx(process, NULL, filename, NULL, base_address,
+                                   0, NULL, NULL);
+    if (!base) {
+      LOG_IMGUI(ModuleLoad, "SymLoadModuleEx failed, error = ", GetLastError())
+      return false;
+    }
+
+    if (!SymGetModuleInfo64(process, base, &module_info)) {
+      LOG_IMGUI(ModuleLoad, "Unable to load ", filename)
+      return false;
+    }
+
+    module->base = base;
+    module->path = filename;
+  }
+
+  LOG_IMGUI(INFO, "Loaded DLL ", filename, ", at address", base_address,
+            module_info.SymType == SymPdb ? ", symbols loaded."
+                                          : "symbols not loaded")
+
+  if (module_info.SymType != SymPdb) {
+    return true;
+  }
+
+  // Source text itself is mapped on demand, see SourceGetFile
+  SymbolCacheKey key;
+  const bool has_key =
+      ModuleGetSymbolCacheKey(file, module->path, module_info, &key);
+  if (!has_key || !SymbolCacheRead(&key, &module->index)) {
+    {
+      std::lock_guard<std::mutex> lock(Global_DbgHelpMutex);
+      ModuleEnumerate(process, module->base, &module->index);
+    }
+
+    if (has_key) {
+      SymbolCacheWrite(&key, &module->index);
+    }
+  }
+  ModuleBuildNameTable(&module->index);
+  ModuleBuildScopes(&module->index);
+
+  return true;
+}
+#else
+// Reads the ELF file directly, the index is built in a few milliseconds even
+// for big binaries, so there is no cache here
+static bool ModuleLoad(HANDLE process, HANDLE file, const std::string &path,
+                       DWORD64 base_address, Module *module) {
+  (void)process;
+  (void)file;
+
+  module->base = base_address;
+  module->path = path;
+
+  if (!ElfLoadModuleIndex(path, &module->index, &module->unwind_table)) {
+    return false;
+  }
+  ModuleBuildNameTable(&module->index);
+  ModuleBuildScopes(&module->index);
+
+  LOG_IMGUI(INFO, "Loaded ", path, ", at address ", std::hex, base_address,
+            std::dec, ", ", module->index.lines.size(), " lines")
+
+  return true;
+}
+#endif
+
+static void ModuleLoaderWorker(ModuleLoader *module_loader) {
+  while (true) {
+    ModuleLoadJob job;
+    {
+      std::unique_lock<std::mutex> lock(module_loader->mutex);
+      module_loader->condition.wait(lock, [&]() {
+        return module_loader->is_stopping || !module_loader->jobs.empty();
+      });
+
+      if (module_loader->is_stopping) {
+        return;
+      }
+
+      job = module_loader->jobs.front();
+      module_loader->jobs.pop_front();
+    }
+
+    Module module = {};
+    const bool is_loaded = ModuleLoad(module_loader->process, job.file,
+                                      job.path, job.base_address, &module);
+#ifdef _WIN32
+    CloseHandle(job.file);
+#endif
+
+    {
+      std::lock_guard<std::mutex> lock(module_loader->mutex);
+      if (is_loaded) {
+        module_loader->loaded_modules.emplace_back(std::move(module));
+      }
+      --module_loader->pending_count;
+
+      if (module_loader->pending_count == 0) {
+        const auto elapsed =
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() -
+                module_loader->burst_start)
+                .count();
+        LOG_IMGUI(ModuleLoader, "Indexed ", module_loader->burst_count,
+                  " modules in ", elapsed, " ms")
+      }
+    }
+
+    if (is_loaded && module_loader->OnLoaded) {
+      module_loader->OnLoaded();
+    }
+  }
+}
+
+// Thread count 0 - one per core, up to MODULE_LOADER_MAX_THREADS
+static ModuleLoader *CreateModuleLoader(HANDLE process, size_t thread_count) {
+  ModuleLoader *result = new ModuleLoader();
+  result->process = process;
+  result->pending_count = 0;
+  result->is_stopping = false;
+
+  if (!thread_count) {
+    thread_count = std::thread::hardware_concurrency();
+  }
+  thread_count = std::max<size_t>(
+      1, std::min<size_t>(thread_count, MODULE_LOADER_MAX_THREADS));
+
+  for (size_t i = 0; i < thread_count; ++i) {
+    result->threads.emplace_back(ModuleLoaderWorker, result);
+  }
+
+  return result;
+}
+
+// Takes ownership of the file handle
+static void ModuleLoaderPush(ModuleLoader *module_loader, HANDLE file,
+                             const std::string &path, DWORD64 base_address) {
+  {
+    std::lock_guard<std::mutex> lock(module_loader->mutex);
+    if (module_loader->pending_count == 0) {
+      module_loader->burst_start = std::chrono::steady_clock::now();
+      module_loader->burst_count = 0;
+    }
+
+    module_loader->jobs.emplace_back(ModuleLoadJob{file, path, base_address});
+    ++module_loader->pending_count;
+    ++module_loader->burst_count;
+  }
+
+  module_loader->condition.notify_one();
+}
+
+// Module indexed elsewhere, picked up with the loader's own
+static void ModuleLoaderAddLoaded(ModuleLoader *module_loader,
+                                  Module &&module) {
+  std::lock_guard<std::mutex> lock(module_loader->mutex);
+  module_loader->loaded_modules.emplace_back(std::move(module));
+}
+
+static std::vector<Module> ModuleLoaderTakeLoaded(ModuleLoader *module_loader) {
+  std::vector<Module> result;
+
+  std::lock_guard<std::mutex> lock(module_loader->mutex);
+  result.swap(module_loader->loaded_modules);
+
+  return result;
+}
+
+static void ModuleLoaderStop(ModuleLoader *module_loader) {
+  {
+    std::lock_guard<std::mutex> lock(module_loader->mutex);
+    module_loader->is_stopping = true;
+  }
+  module_loader->condition.notify_all();
+
+  for (auto &thread : module_loader->threads) {
+    thread.join();
+  }
+  module_loader->threads.clear();
+}
\ No newline at end of file
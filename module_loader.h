@@ -0,0 +1,26 @@
+#define MODULE_LOADER_MAX_THREADS 8
+
+struct ModuleLoadJob {
+  HANDLE file;
+  std::string path; // When known, otherwise taken from the file
+  DWORD64 base_address;
+};
+
+// Indexes modules on worker threads, so the debuggee can keep running while
+// its DLLs are being loaded. Results are picked up by the debugger thread.
+struct ModuleLoader {
+  HANDLE process;
+  std::vector<std::thread> threads;
+
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::deque<ModuleLoadJob> jobs;
+  std::vector<Module> loaded_modules;
+  size_t pending_count; // Queued or in progress
+  bool is_stopping;
+  std::function<void()> OnLoaded; // On a worker, after a module is indexed
+
+  // Stats for the current burst of loads
+  std::chrono::steady_clock::time_point burst_start;
+  size_t burst_count;
+};
\ No newline at end of file
@@ -1,15 +1,184 @@
-// TODO: Make for x64
-static void RegistersUpdateFromContext(Registers *registers, CONTEXT context) {
-  ASSIGN_P_V(registers, context, Edi);
-  ASSIGN_P_V(registers, context, Esi);
-  ASSIGN_P_V(registers, context, Ebx);
-  ASSIGN_P_V(registers, context, Edx);
-  ASSIGN_P_V(registers, context, Ecx);
-  ASSIGN_P_V(registers, context, Eax);
-  ASSIGN_P_V(registers, context, Ebp);
-  ASSIGN_P_V(registers, context, Eip);
-  ASSIGN_P_V(registers, context, SegCs);
+// DWARF register numbers of x86-64, the return address column is rip
+static DWORD64 Registers::*const Global_RegistersDwarf[] = {
+    &Registers::Rax, &Registers::Rdx, &Registers::Rcx, &Registers::Rbx,
+    &Registers::Rsi, &Registers::Rdi, &Registers::Rbp, &Registers::Rsp,
+    &Registers::R8,  &Registers::R9,  &Registers::R10, &Registers::R11,
+    &Registers::R12, &Registers::R13, &Registers::R14, &Registers::R15,
+    &Registers::Rip};
+
+#define REGISTERS_DWARF_RSP 7
+#define REGISTERS_DWARF_RIP 16
+
+// x87 and SSE out of a FXSAVE area, the layout is the same everywhere
+static void RegistersReadFxsave(Registers *registers, const BYTE *area,
+                                size_t vector_count) {
+  memcpy(&registers->fpu_control, area, 2);
+  memcpy(&registers->fpu_status, area + 2, 2);
+  registers->fpu_tag = area[4];
+  memcpy(&registers->mxcsr, area + 24, 4);
+  for (size_t i = 0; i < 8; ++i) {
+    memcpy(registers->st[i], area + 32 + i * 16, 10);
+  }
+  for (size_t i = 0; i < vector_count; ++i) {
+    memcpy(registers->xmm[i], area + 160 + i * 16, 16);
+  }
+
+  registers->extended_state |= REGISTERS_X87 | REGISTERS_SSE;
+}
+
+// 80 bit extended precision, as close as a double gets
+static double RegistersGetX87Value(const BYTE *value) {
+  DWORD64 mantissa;
+  WORD exponent;
+  memcpy(&mantissa, value, 8);
+  memcpy(&exponent, value + 8, 2);
+
+  const bool is_negative = (exponent & 0x8000) != 0;
+  exponent &= 0x7fff;
+
+  double result;
+  if (exponent == 0x7fff) {
+    result = (mantissa << 1) ? NAN : INFINITY;
+  } else {
+    result = ldexp((double)mantissa, (int)exponent - 16383 - 63);
+  }
+
+  return is_negative ? -result : result;
+}
+
+#ifdef _WIN32
+static void RegistersUpdateFromContext(Registers *registers,
+                                       const CONTEXT &context) {
+#ifdef _WIN64
+  registers->arch = RegistersArch::X86_64;
+  ASSIGN_P_V(registers, context, Rax);
+  ASSIGN_P_V(registers, context, Rcx);
+  ASSIGN_P_V(registers, context, Rdx);
+  ASSIGN_P_V(registers, context, Rbx);
+  ASSIGN_P_V(registers, context, Rsp);
+  ASSIGN_P_V(registers, context, Rbp);
+  ASSIGN_P_V(registers, context, Rsi);
+  ASSIGN_P_V(registers, context, Rdi);
+  ASSIGN_P_V(registers, context, R8);
+  ASSIGN_P_V(registers, context, R9);
+  ASSIGN_P_V(registers, context, R10);
+  ASSIGN_P_V(registers, context, R11);
+  ASSIGN_P_V(registers, context, R12);
+  ASSIGN_P_V(registers, context, R13);
+  ASSIGN_P_V(registers, context, R14);
+  ASSIGN_P_V(registers, context, R15);
+  ASSIGN_P_V(registers, context, Rip);
+#else
+  registers->arch = RegistersArch::X86;
+  registers->Rax = context.Eax;
+  registers->Rcx = context.Ecx;
+  registers->Rdx = context.Edx;
+  registers->Rbx = context.Ebx;
+  registers->Rsp = context.Esp;
+  registers->Rbp = context.Ebp;
+  registers->Rsi = context.Esi;
+  registers->Rdi = context.Edi;
+  registers->Rip = context.Eip;
+#endif
   ASSIGN_P_V(registers, context, EFlags);
-  ASSIGN_P_V(registers, context, Esp);
+  ASSIGN_P_V(registers, context, SegCs);
   ASSIGN_P_V(registers, context, SegSs);
-}
\ No newline at end of file
+  ASSIGN_P_V(registers, context, SegDs);
+  ASSIGN_P_V(registers, context, SegEs);
+  ASSIGN_P_V(registers, context, SegFs);
+  ASSIGN_P_V(registers, context, SegGs);
+}
+
+static void RegistersWriteToContext(const Registers &registers,
+                                    CONTEXT *context) {
+#ifdef _WIN64
+  ASSIGN_P_V(context, registers, Rax);
+  ASSIGN_P_V(context, registers, Rcx);
+  ASSIGN_P_V(context, registers, Rdx);
+  ASSIGN_P_V(context, registers, Rbx);
+  ASSIGN_P_V(context, registers, Rsp);
+  ASSIGN_P_V(context, registers, Rbp);
+  ASSIGN_P_V(context, registers, Rsi);
+  ASSIGN_P_V(context, registers, Rdi);
+  ASSIGN_P_V(context, registers, R8);
+  ASSIGN_P_V(context, registers, R9);
+  ASSIGN_P_V(context, registers, R10);
+  ASSIGN_P_V(context, registers, R11);
+  ASSIGN_P_V(context, registers, R12);
+  ASSIGN_P_V(context, registers, R13);
+  ASSIGN_P_V(context, registers, R14);
+  ASSIGN_P_V(context, registers, R15);
+  ASSIGN_P_V(context, registers, Rip);
+  context->EFlags = (DWORD)registers.EFlags;
+  context->SegCs = (WORD)registers.SegCs;
+  context->SegSs = (WORD)registers.SegSs;
+#else
+  context->Eax = (DWORD)registers.Rax;
+  context->Ecx = (DWORD)registers.Rcx;
+  context->Edx = (DWORD)registers.Rdx;
+  context->Ebx = (DWORD)registers.Rbx;
+  context->Esp = (DWORD)registers.Rsp;
+  context->Ebp = (DWORD)registers.Rbp;
+  context->Esi = (DWORD)registers.Rsi;
+  context->Edi = (DWORD)registers.Rdi;
+  context->Eip = (DWORD)registers.Rip;
+  context->EFlags = (DWORD)registers.EFlags;
+  context->SegCs = (DWORD)registers.SegCs;
+  context->SegSs = (DWORD)registers.SegSs;
+#endif
+}
+#else
+static void RegistersUpdateFromUserRegs(Registers *registers,
+                                        const user_regs_struct &regs) {
+  registers->arch = RegistersArch::X86_64;
+  registers->Rax = regs.rax;
+  registers->Rcx = regs.rcx;
+  registers->Rdx = regs.rdx;
+  registers->Rbx = regs.rbx;
+  registers->Rsp = regs.rsp;
+  registers->Rbp = regs.rbp;
+  registers->Rsi = regs.rsi;
+  registers->Rdi = regs.rdi;
+  registers->R8 = regs.r8;
+  registers->R9 = regs.r9;
+  registers->R10 = regs.r10;
+  registers->R11 = regs.r11;
+  registers->R12 = regs.r12;
+  registers->R13 = regs.r13;
+  registers->R14 = regs.r14;
+  registers->R15 = regs.r15;
+  registers->Rip = regs.rip;
+  registers->EFlags = regs.eflags;
+  registers->SegCs = regs.cs;
+  registers->SegSs = regs.ss;
+  registers->SegDs = regs.ds;
+  registers->SegEs = regs.es;
+  registers->SegFs = regs.fs;
+  registers->SegGs = regs.gs;
+}
+
+// Segments other than cs and ss are left as they are
+static void RegistersWriteToUserRegs(const Registers &registers,
+                                     user_regs_struct *regs) {
+  regs->rax = registers.Rax;
+  regs->rcx = registers.Rcx;
+  regs->rdx = registers.Rdx;
+  regs->rbx = registers.Rbx;
+  regs->rsp = registers.Rsp;
+  regs->rbp = registers.Rbp;
+  regs->rsi = registers.Rsi;
+  regs->rdi = registers.Rdi;
+  regs->r8 = registers.R8;
+  regs->r9 = registers.R9;
+  regs->r10 = registers.R10;
+  regs->r11 = registers.R11;
+  regs->r12 = registers.R12;
+  regs->r13 = registers.R13;
+  regs->r14 = registers.R14;
+  regs->r15 = registers.R15;
+  regs->rip = registers.Rip;
+  regs->eflags = registers.EFlags;
+  regs->cs = registers.SegCs;
+  regs->ss = registers.SegSs;
+}
+#endif
\ No newline at end of file
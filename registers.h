@@ -1,17 +1,57 @@
-// TODO: Make for x64
+// Instruction set the registers were read from. x86 keeps it's 32 bit
+// registers in the low halves of the 64 bit fields.
+enum class RegistersArch : BYTE { X86, X86_64 };
+
+// Parts of the state beyond the general purpose registers, read on request
+#define REGISTERS_X87 0x1
+#define REGISTERS_SSE 0x2
+#define REGISTERS_AVX 0x4
+
+#define REGISTERS_VECTOR_COUNT 16 // xmm/ymm, x86 has the first 8 only
+#define REGISTERS_DWARF_COUNT 17  // rax - r15 and the return address
+
+// Field names follow the x64 CONTEXT
 struct Registers {
-  ULONG Edi;
-  ULONG Esi;
-  ULONG Ebx;
-  ULONG Edx;
-  ULONG Ecx;
-  ULONG Eax;
-  ULONG Ebp;
-  ULONG Eip;
-  ULONG SegCs;
-  ULONG EFlags;
-  ULONG Esp;
-  ULONG SegSs;
+  RegistersArch arch;
+
+  DWORD64 Rax;
+  DWORD64 Rcx;
+  DWORD64 Rdx;
+  DWORD64 Rbx;
+  DWORD64 Rsp;
+  DWORD64 Rbp;
+  DWORD64 Rsi;
+  DWORD64 Rdi;
+  DWORD64 R8;
+  DWORD64 R9;
+  DWORD64 R10;
+  DWORD64 R11;
+  DWORD64 R12;
+  DWORD64 R13;
+  DWORD64 R14;
+  DWORD64 R15;
+  DWORD64 Rip;
+  DWORD64 EFlags;
+  DWORD64 SegCs;
+  DWORD64 SegSs;
+  DWORD64 SegDs;
+  DWORD64 SegEs;
+  DWORD64 SegFs;
+  DWORD64 SegGs;
+
+  // Below is valid for the REGISTERS_* bits set here only
+  DWORD extended_state;
+
+  // x87, in FXSAVE form
+  WORD fpu_control;
+  WORD fpu_status;
+  BYTE fpu_tag; // Abridged, bit per register, 1 - valid
+  BYTE st[8][10]; // 80 bit values, st(0) first
+
+  // SSE and AVX, upper halves of ymm are apart like in XSAVE
+  DWORD mxcsr;
+  BYTE xmm[REGISTERS_VECTOR_COUNT][16];
+  BYTE ymm_high[REGISTERS_VECTOR_COUNT][16];
 };
 
 #define ASSIGN_P_V(a, b, c) a->c = b.c // Assign 1 - pointer, 2 - by value
\ No newline at end of file
@@ -0,0 +1,45 @@
+enum class DebuggerStopReason;
+
+struct SnapshotThread {
+  DWORD id;
+  bool is_stopped;
+  DWORD64 address; // Stopped ones only
+  DebuggerStopReason stop_reason;
+};
+
+struct SnapshotBreakpoint {
+  DWORD64 address;
+  DWORD64 hit_count;
+  std::string condition; // Empty - none
+};
+
+// Immutable state of the stopped target, built by the debugger thread and
+// rendered by the UI thread
+struct StopSnapshot {
+  Registers registers;
+  std::vector<LocalVariable> local_variables;
+  std::vector<DWORD64> callstack;
+  DWORD64 current_address;
+  std::vector<SnapshotThread> threads; // By id
+  DWORD thread_id; // Registers, locals and callstack are of it
+  DWORD frame_index; // Into "callstack", locals are of it
+  bool is_non_stop;
+  std::vector<DWORD64> user_breakpoints; // Sorted
+  std::vector<SnapshotBreakpoint> user_breakpoint_details; // Same order
+  std::vector<HardwareSlot> watchpoints;
+  DWORD hardware_slot_count; // In use, watchpoints included
+  bool is_agent_enabled;
+  DWORD agent_site_count; // Conditions evaluated in the target
+
+  // Cost of the stop so far
+  DWORD64 memory_read_count;
+  DWORD64 memory_hit_count;
+  DWORD64 syscall_count;
+  DWORD64 trap_count; // Of the step or continue that ended in the stop
+  DWORD64 round_trip_count;
+};
+
+struct Snapshots {
+  EpochDomain epoch_domain;
+  std::atomic<const StopSnapshot *> stop;
+};
\ No newline at end of file
@@ -0,0 +1,121 @@
+static void SourceFileUnmap(SourceFile *source_file) {
+  if (source_file->data) {
+    UnmapViewOfFile(source_file->data);
+  }
+  if (source_file->mapping) {
+    CloseHandle(source_file->mapping);
+  }
+  if (source_file->file != INVALID_HANDLE_VALUE) {
+    CloseHandle(source_file->file);
+  }
+}
+
+static bool SourceFileMap(SourceFile *source_file, const std::string &path) {
+  source_file->file =
+      CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                  NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (source_file->file == INVALID_HANDLE_VALUE) {
+    LOG_IMGUI(SourceFileMap, "Unable to open source file ", path)
+    return false;
+  }
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(source_file->file, &size)) {
+    LOG_IMGUI(SourceFileMap, "GetFileSizeEx failed, error = ", GetLastError())
+    SourceFileUnmap(source_file);
+    return false;
+  }
+
+  source_file->size = (size_t)size.QuadPart;
+
+  // Empty files can't be mapped
+  if (source_file->size == 0) {
+    return true;
+  }
+
+  source_file->mapping =
+      CreateFileMapping(source_file->file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (!source_file->mapping) {
+    LOG_IMGUI(SourceFileMap,
+              "CreateFileMapping failed, error = ", GetLastError())
+    SourceFileUnmap(source_file);
+    return false;
+  }
+
+  source_file->data = (const char *)MapViewOfFile(source_file->mapping,
+                                                  FILE_MAP_READ, 0, 0, 0);
+  if (!source_file->data) {
+    LOG_IMGUI(SourceFileMap, "MapViewOfFile failed, error = ", GetLastError())
+    SourceFileUnmap(source_file);
+    return false;
+  }
+
+  // Line offset index
+  const char *begin = source_file->data;
+  const char *end = begin + source_file->size;
+  for (const char *it = begin; it < end;) {
+    source_file->line_offsets.push_back((DWORD)(it - begin));
+
+    it = (const char *)memchr(it, '\n', end - it);
+    if (!it) {
+      break;
+    }
+    ++it;
+  }
+
+  return true;
+}
+
+// Returns mapped file or nullptr, if it can't be opened. Pointer stays valid
+// until the next call.
+static const SourceFile *SourceGetFile(Source *source,
+                                       const LineTable *line_table,
+                                       DWORD file_id) {
+  auto &files = source->files;
+  auto &file_id_to_file = source->file_id_to_file;
+
+  auto it = file_id_to_file.find(file_id);
+  if (it != file_id_to_file.end()) {
+    files.splice(files.begin(), files, it->second);
+    return &files.front();
+  }
+
+  if (source->unavailable_files.count(file_id) ||
+      file_id >= line_table->filenames.size()) {
+    return nullptr;
+  }
+
+  SourceFile source_file = {};
+  source_file.file_id = file_id;
+  source_file.file = INVALID_HANDLE_VALUE;
+  if (!SourceFileMap(&source_file, line_table->filenames[file_id])) {
+    source->unavailable_files.insert(file_id);
+    return nullptr;
+  }
+
+  files.push_front(std::move(source_file));
+  file_id_to_file[file_id] = files.begin();
+
+  while (files.size() > SOURCE_MAX_MAPPED_FILES) {
+    file_id_to_file.erase(files.back().file_id);
+    SourceFileUnmap(&files.back());
+    files.pop_back();
+  }
+
+  return &files.front();
+}
+
+static void SourceFileGetLine(const SourceFile *source_file, size_t index,
+                              const char **begin, const char **end) {
+  const auto &line_offsets = source_file->line_offsets;
+
+  *begin = source_file->data + line_offsets[index];
+  *end = index + 1 < line_offsets.size()
+             ? source_file->data + line_offsets[index + 1]
+             : source_file->data + source_file->size;
+
+  // Trim line ending
+  while (*end > *begin && ((*end)[-1] == '\n' || (*end)[-1] == '\r')) {
+    --*end;
+  }
+}
\ No newline at end of file
@@ -1,5 +1,22 @@
+#define SOURCE_MAX_MAPPED_FILES 32
+
+// Source file text, mapped on first use
+struct SourceFile {
+  DWORD file_id;
+  HANDLE file;
+  HANDLE mapping;
+  const char *data;
+  size_t size;
+  std::vector<DWORD> line_offsets; // Start of every line
+};
+
 struct Source {
-  std::unordered_map<std::string, std::vector<Line>> filename_to_lines;
-  std::unordered_map<DWORD64, std::string> line_address_to_filename;
-  std::map<DWORD64, Line> address_to_line; // Need to be ordered
+  // Replaced as a whole by the debugger thread, readers go through an epoch
+  // section, see EpochPublish
+  std::atomic<const LineTable *> line_table;
+
+  // Mapped files, most recently used first. UI thread only.
+  std::list<SourceFile> files;
+  std::unordered_map<DWORD, std::list<SourceFile>::iterator> file_id_to_file;
+  std::set<DWORD> unavailable_files;
 };
\ No newline at end of file
@@ -0,0 +1,936 @@
+static Stepper *CreateStepper(Backend *backend, MemoryCache *memory_cache,
+                              Agent *agent, Breakpoints *breakpoints) {
+  Stepper *result = new Stepper();
+  result->backend = backend;
+  result->memory_cache = memory_cache;
+  result->agent = agent;
+  result->breakpoints = breakpoints;
+  result->thread_id = backend->thread_id;
+
+  return result;
+}
+
+// Threads are added on their first event as well, it may come before the
+// create event
+static DebuggerThread *StepperFindThread(Stepper *stepper, DWORD thread_id) {
+  auto it = stepper->threads.find(thread_id);
+  if (it == stepper->threads.end()) {
+    it = stepper->threads.emplace(thread_id, DebuggerThread()).first;
+    it->second.id = thread_id;
+    it->second.state = DebuggerState::CONTINUE;
+  }
+
+  return &it->second;
+}
+
+static inline DebuggerThread *StepperGetThread(Stepper *stepper) {
+  return StepperFindThread(stepper, stepper->thread_id);
+}
+
+// Registers of a stopped thread, read once per stop
+static const Registers &StepperGetRegisters(Stepper *stepper,
+                                            DebuggerThread *thread) {
+  if (!thread->is_registers_read) {
+    thread->is_registers_read = BackendGetRegisters(
+        stepper->backend, thread->id, &thread->registers);
+    thread->frames_max_count = 0;
+  }
+
+  return thread->registers;
+}
+
+// Writes the cached registers of the thread through, the frames walked from
+// the old ones are dropped
+static inline bool StepperSetRegisters(Stepper *stepper,
+                                       DebuggerThread *thread) {
+  thread->frames_max_count = 0;
+
+  return BackendSetRegisters(stepper->backend, thread->id, thread->registers);
+}
+
+// Registers can be read, and it won't run before a command resumes it
+static inline bool StepperIsThreadStopped(const Stepper *stepper,
+                                          const DebuggerThread *thread) {
+  return stepper->is_all_stopped || thread->is_suspended;
+}
+
+// Current thread takes the state, the others run on meanwhile. NONE stops
+// all of them. Suspended ones keep theirs, see StepperResumeThreads.
+static void StepperSetState(Stepper *stepper, DebuggerState state) {
+  StepperGetThread(stepper);
+
+  for (auto &it : stepper->threads) {
+    const bool is_current = it.first == stepper->thread_id;
+    if (it.second.is_suspended) {
+      continue;
+    }
+
+    it.second.state = (is_current || state == DebuggerState::NONE)
+                          ? state
+                          : DebuggerState::CONTINUE;
+  }
+}
+
+// Forgets an exited thread. Nothing runs from it's buffers anymore, other
+// threads may use them.
+static void StepperRemoveThread(Stepper *stepper, DWORD thread_id) {
+  auto it = stepper->threads.find(thread_id);
+  if (it == stepper->threads.end()) {
+    return;
+  }
+
+  auto &free_buffers = stepper->free_displaced_buffers;
+  const auto &buffers = it->second.displaced_buffers;
+  free_buffers.insert(free_buffers.end(), buffers.begin(), buffers.end());
+
+  stepper->threads.erase(it);
+}
+
+static bool StepperIsBaseBefore(DWORD64 address, const Module &module) {
+  return address < module.base;
+}
+
+// Keeps the modules sorted by base. One still there at the same base was
+// unloaded without an event, it's replaced.
+static void StepperAddModule(Stepper *stepper, Module &&module) {
+  auto &modules = stepper->modules;
+  auto it = std::upper_bound(modules.begin(), modules.end(), module.base,
+                             StepperIsBaseBefore);
+  if (it != modules.begin() && (it - 1)->base == module.base) {
+    *(it - 1) = std::move(module);
+  } else {
+    modules.insert(it, std::move(module));
+  }
+}
+
+// Forgets an unloaded module, the CFI rows decoded for it go with it.
+// Another one may be loaded at the same base later. Erasing keeps the rest
+// sorted.
+static void StepperRemoveModule(Stepper *stepper, DWORD64 base) {
+  auto &modules = stepper->modules;
+  modules.erase(std::remove_if(modules.begin(), modules.end(),
+                               [base](const Module &module) {
+                                 return module.base == base;
+                               }),
+                modules.end());
+}
+
+// Module the address can be in, the one with the highest base at or below
+// it. NULL if the address is below every module or too far past the base.
+static const Module *StepperFindModule(Stepper *stepper, DWORD64 address) {
+  const auto &modules = stepper->modules;
+  auto it = std::upper_bound(modules.begin(), modules.end(), address,
+                             StepperIsBaseBefore);
+  if (it == modules.begin() || address - (it - 1)->base > 0xffffffff) {
+    return NULL;
+  }
+
+  return &*(it - 1);
+}
+
+// Code at the address as the compiler emitted it, without our int3s.
+// "code" - INSTRUCTION_MAX_LENGTH bytes.
+static SIZE_T StepperReadCode(Stepper *stepper, DWORD64 address, BYTE *code) {
+  const auto &breakpoints = stepper->breakpoints->data;
+
+  SIZE_T size = 0;
+  MemoryCacheRead(stepper->memory_cache, address, code,
+                  INSTRUCTION_MAX_LENGTH, &size);
+
+  for (SIZE_T i = 0; i < size; ++i) {
+    auto it = breakpoints.find(address + i);
+    if (it != breakpoints.end()) {
+      code[i] = it->second.original_instruction;
+    }
+  }
+
+  return size;
+}
+
+// Scratch memory of the thread in rel32 reach of the address, allocated once
+// per region. Buffers of exited threads are reused.
+static bool StepperGetDisplacedBuffer(Stepper *stepper,
+                                      DebuggerThread *thread, DWORD64 address,
+                                      DWORD64 *buffer) {
+  auto &free_buffers = stepper->free_displaced_buffers;
+
+  for (DWORD64 it : thread->displaced_buffers) {
+    if (AgentIsReachable(stepper->backend, it, address)) {
+      *buffer = it;
+      return true;
+    }
+  }
+
+  auto it = std::find_if(free_buffers.begin(), free_buffers.end(),
+                         [&](DWORD64 free_buffer) {
+                           return AgentIsReachable(stepper->backend,
+                                                   free_buffer, address);
+                         });
+  if (it != free_buffers.end()) {
+    *buffer = *it;
+    free_buffers.erase(it);
+  } else if (!AgentAllocate(stepper->agent, stepper->backend, address,
+                            STEPPER_DISPLACED_SIZE, buffer)) {
+    return false;
+  }
+  thread->displaced_buffers.push_back(*buffer);
+
+  return true;
+}
+
+// Runs the instruction under the int3 from a copy in the target, so that
+// other threads can't run past the breakpoint meanwhile. The copy jumps back
+// on it's own too, for when an exception comes before the single step. False,
+// if it has to run in place. Cached registers stay as they are at the
+// breakpoint.
+static bool StepperStartDisplacedStep(Stepper *stepper,
+                                      const Breakpoint &breakpoint) {
+  auto backend = stepper->backend;
+  DebuggerThread *thread = StepperGetThread(stepper);
+  const DWORD64 address = breakpoint.address;
+
+  BYTE code[INSTRUCTION_MAX_LENGTH];
+  const SIZE_T size = StepperReadCode(stepper, address, code);
+  Instruction instruction;
+  Registers registers = StepperGetRegisters(stepper, thread);
+  if (stepper->is_displaced_step_failed || !thread->is_registers_read ||
+      registers.Rip != address ||
+      !InstructionDecode(code, size, address, backend->is_64bit,
+                         &instruction)) {
+    return false;
+  }
+
+  DWORD64 buffer;
+  if (!StepperGetDisplacedBuffer(stepper, thread, address, &buffer)) {
+    LOG_IMGUI(StepperStartDisplacedStep,
+              "No memory for displaced steps, breakpoints are lifted instead")
+    stepper->is_displaced_step_failed = true;
+    return false;
+  }
+
+  BYTE copy[STEPPER_DISPLACED_SIZE];
+  DWORD length;
+  if (!InstructionRelocate(code, instruction, address, buffer,
+                           backend->is_64bit, copy, &length)) {
+    return false;
+  }
+
+  const DWORD64 next = address + instruction.length;
+  const DWORD64 displacement = next - (buffer + length + AGENT_JUMP_LENGTH);
+  if (backend->is_64bit &&
+      (int64_t)displacement != (int32_t)displacement) {
+    return false;
+  }
+
+  const DWORD displacement32 = (DWORD)displacement;
+  copy[length] = 0xe9; // jmp rel32
+  memcpy(copy + length + 1, &displacement32, sizeof(displacement32));
+  if (!MemoryCacheWrite(stepper->memory_cache, buffer, copy,
+                        length + AGENT_JUMP_LENGTH)) {
+    return false;
+  }
+  BackendFlushInstructionCache(backend, buffer, length + AGENT_JUMP_LENGTH);
+
+  registers.Rip = buffer;
+  if (!BackendSetRegisters(backend, thread->id, registers)) {
+    return false;
+  }
+
+  thread->displaced_next = next;
+  thread->displaced_end = buffer + length;
+  thread->is_displaced_call = instruction.type == InstructionType::CALL;
+  BackendSetSingleStep(backend);
+
+  return true;
+}
+
+// Maps the thread back from the copy, as if the instruction ran in place
+static void StepperFinishDisplacedStep(Stepper *stepper,
+                                       DebuggerThread *thread) {
+  Registers &registers = thread->registers;
+  const DWORD64 next = thread->displaced_next;
+  const DWORD64 end = thread->displaced_end;
+
+  if (!next) {
+    return;
+  }
+  thread->displaced_next = 0;
+
+  if (thread->is_displaced_call) {
+    const SIZE_T size = stepper->backend->is_64bit ? 8 : 4;
+    DWORD64 return_address = 0;
+    if (MemoryCacheRead(stepper->memory_cache, registers.Rsp,
+                        &return_address, size, NULL) &&
+        return_address == end) {
+      MemoryCacheWrite(stepper->memory_cache, registers.Rsp, &next, size);
+    }
+  }
+
+  if (registers.Rip == end) {
+    registers.Rip = next;
+    StepperSetRegisters(stepper, thread);
+  }
+}
+
+// Runs the instruction under the int3 from a copy, or with it's original
+// byte if it can't, then int3 is put back on the single step that follows.
+// Other threads are stopped before it's lifted, so that none of them runs
+// past it.
+static void StepperStepOffMemoryBreakpoint(Stepper *stepper,
+                                           const Breakpoint &breakpoint) {
+  if (StepperStartDisplacedStep(stepper, breakpoint)) {
+    return;
+  }
+
+  if (stepper->threads.size() > 1) {
+    BackendHoldThreads(stepper->backend);
+  }
+  BreakpointRestore(stepper->memory_cache, breakpoint);
+  StepperGetThread(stepper)->rearm_address = breakpoint.address;
+  BackendSetSingleStep(stepper->backend);
+}
+
+// Debug register slots are just skipped once. Breakpoints with a trampoline
+// are left through it, unless the target is stepped, see
+// StepperUpdateAgent.
+static void StepperStepOffBreakpoint(Stepper *stepper,
+                                     const Breakpoint &breakpoint) {
+  if (breakpoint.hardware_slot >= 0) {
+    BackendSetResumeFlag(stepper->backend);
+    return;
+  }
+
+  const AgentSite *site = AgentFindSite(stepper->agent, breakpoint.address);
+  if (site && !site->is_failed) {
+    stepper->agent_step_off_address = breakpoint.address;
+    return;
+  }
+
+  StepperStepOffMemoryBreakpoint(stepper, breakpoint);
+}
+
+// Puts back the int3 the thread stepped off with it's last single step
+static void StepperRearmBreakpoint(Stepper *stepper, DebuggerThread *thread) {
+  const auto &breakpoints = stepper->breakpoints->data;
+
+  if (!thread->rearm_address) {
+    return;
+  }
+
+  // Unless it was removed meanwhile
+  if (breakpoints.find(thread->rearm_address) != breakpoints.end()) {
+    BreakpointRestore(stepper->memory_cache, thread->rearm_address, 0xCC);
+  }
+  thread->rearm_address = 0;
+}
+
+// Puts the int3 back in place of the jump to the agent's trampoline, hits
+// counted in the target are taken over
+static void StepperRemoveAgentSite(Stepper *stepper, DWORD64 address,
+                                   bool is_erased) {
+  auto &breakpoints = stepper->breakpoints->data;
+
+  AgentSite *site = AgentFindSite(stepper->agent, address);
+  if (!site) {
+    return;
+  }
+
+  auto it = breakpoints.find(address);
+  DWORD64 hit_count = it != breakpoints.end() ? it->second.hit_count : 0;
+  AgentRemoveSite(stepper->memory_cache, site, &hit_count);
+  if (it != breakpoints.end()) {
+    it->second.hit_count = hit_count;
+  }
+
+  if (is_erased) {
+    stepper->agent->sites.erase(address);
+  }
+}
+
+static void StepperRemoveAgentSites(Stepper *stepper) {
+  for (const auto &it : stepper->agent->sites) {
+    StepperRemoveAgentSite(stepper, it.first, false);
+  }
+}
+
+// Lifts the jumps that cover the address, an int3 there has to go into the
+// original code. They are put back on continue, if nothing is in their way.
+static void StepperRemoveAgentSitesOver(Stepper *stepper, DWORD64 address) {
+  for (const auto &it : stepper->agent->sites) {
+    const AgentSite &site = it.second;
+    if (site.is_installed && address > site.address &&
+        address < site.address + site.length) {
+      StepperRemoveAgentSite(stepper, it.first, false);
+    }
+  }
+}
+
+static bool StepperDecodeInstruction(Stepper *stepper, DWORD64 address,
+                                     Instruction *instruction) {
+  BYTE code[INSTRUCTION_MAX_LENGTH];
+  const SIZE_T size = StepperReadCode(stepper, address, code);
+
+  return InstructionDecode(code, size, address, stepper->backend->is_64bit,
+                           instruction);
+}
+
+// Function that contains the address, NULL if no module has a symbol for it
+static const ModuleFunction *StepperFindFunction(Stepper *stepper,
+                                                 DWORD64 address,
+                                                 DWORD64 *module_base) {
+  const Module *module = StepperFindModule(stepper, address);
+  if (!module) {
+    return NULL;
+  }
+
+  const ModuleFunction *function =
+      ModuleFindFunctionAt(&module->index, (DWORD)(address - module->base));
+  if (function) {
+    *module_base = module->base;
+  }
+
+  return function;
+}
+
+// Line table row of the address, false if there is no line info for it.
+// "function_start" and "function_end" - addresses of the function around it.
+static bool StepperFindLine(Stepper *stepper, DWORD64 address,
+                            size_t *line_index, DWORD64 *function_start,
+                            DWORD64 *function_end) {
+  const LineTable *line_table = stepper->line_table;
+
+  // Line table has no ends, so the line has to start inside the function
+  DWORD64 module_base;
+  const ModuleFunction *function =
+      StepperFindFunction(stepper, address, &module_base);
+  if (!function ||
+      !LineTableFindContaining(line_table, address, line_index) ||
+      line_table->addresses[*line_index] < module_base + function->start_rva) {
+    return false;
+  }
+
+  *function_start = module_base + function->start_rva;
+  *function_end = module_base + function->end_rva;
+
+  return true;
+}
+
+// Source line of the address, false if there is no line info for it
+static bool StepperGetLine(Stepper *stepper, DWORD64 address, DWORD *file_id,
+                           DWORD *line) {
+  const LineTable *line_table = stepper->line_table;
+
+  size_t line_index;
+  DWORD64 function_start;
+  DWORD64 function_end;
+  if (!StepperFindLine(stepper, address, &line_index, &function_start,
+                       &function_end)) {
+    return false;
+  }
+
+  *file_id = line_table->file_ids[line_index];
+  *line = line_table->lines[line_index];
+
+  return true;
+}
+
+// Addresses of the line around the address, neighbour rows of the same line
+// are merged. False if there is no line info for it.
+static bool StepperGetLineRange(Stepper *stepper, DWORD64 address,
+                                DWORD64 *start, DWORD64 *end) {
+  const LineTable *line_table = stepper->line_table;
+  const auto &addresses = line_table->addresses;
+  const auto &file_ids = line_table->file_ids;
+  const auto &lines = line_table->lines;
+
+  size_t index;
+  DWORD64 function_start;
+  DWORD64 function_end;
+  if (!StepperFindLine(stepper, address, &index, &function_start,
+                       &function_end)) {
+    return false;
+  }
+
+  size_t first = index;
+  while (first > 0 && addresses[first - 1] >= function_start &&
+         file_ids[first - 1] == file_ids[index] &&
+         lines[first - 1] == lines[index]) {
+    --first;
+  }
+
+  size_t last = index + 1;
+  while (last < addresses.size() && addresses[last] < function_end &&
+         file_ids[last] == file_ids[index] && lines[last] == lines[index]) {
+    ++last;
+  }
+
+  *start = addresses[first];
+  *end = function_end;
+  if (last < addresses.size() && addresses[last] < function_end) {
+    *end = addresses[last];
+  }
+
+  return true;
+}
+
+// True, if the address belongs to another line than the step started on
+static bool StepperIsStepLineLeft(Stepper *stepper, DWORD64 address) {
+  DWORD file_id;
+  DWORD line;
+  if (!StepperGetLine(stepper, address, &file_id, &line)) {
+    return true;
+  }
+
+  const DebuggerThread *thread = StepperGetThread(stepper);
+  return file_id != thread->step_file_id || line != thread->step_line;
+}
+
+// Instructions from "start" up to "end", or up to the first one that can't be
+// decoded. Returns where the decoded code ends.
+static DWORD64 StepperDecodeRange(Stepper *stepper, DWORD64 start, DWORD64 end,
+                                  std::vector<DWORD64> *addresses,
+                                  std::vector<Instruction> *instructions) {
+  addresses->clear();
+  instructions->clear();
+
+  DWORD64 address = start;
+  while (address < end && addresses->size() < STEPPER_MAX_STEP_INSTRUCTIONS) {
+    Instruction instruction;
+    if (!StepperDecodeInstruction(stepper, address, &instruction)) {
+      break;
+    }
+
+    addresses->push_back(address);
+    instructions->push_back(instruction);
+    address += instruction.length;
+  }
+
+  return address;
+}
+
+// Where to put the temporary breakpoints of a step, none if the current
+// instruction has to be single stepped. The line runs freely in between,
+// loops inside it included. Step in enters calls with line info, the rest are
+// stepped over.
+static void StepperGetStepTargets(Stepper *stepper, bool is_step_in,
+                                  std::vector<DWORD64> *targets) {
+  DebuggerThread *thread = StepperGetThread(stepper);
+  const Registers &registers = StepperGetRegisters(stepper, thread);
+  const DWORD64 current_address = registers.Rip;
+
+  thread->step_frame_address = 0;
+  thread->step_return_address = 0;
+  targets->clear();
+
+  Instruction instruction;
+  if (!StepperDecodeInstruction(stepper, current_address, &instruction)) {
+    return;
+  }
+
+  if (instruction.type == InstructionType::CALL) {
+    DWORD file_id;
+    DWORD line;
+    if (is_step_in &&
+        (!instruction.is_relative ||
+         StepperGetLine(stepper, instruction.target, &file_id, &line))) {
+      // Into it, indirect calls are checked once they land
+      thread->step_return_address = current_address + instruction.length;
+      return;
+    }
+
+    // Over the call to it's return address. Recursive calls get there with
+    // a lower stack pointer.
+    thread->step_frame_address = registers.Rsp;
+    targets->push_back(current_address + instruction.length);
+    return;
+  }
+
+  if (instruction.type != InstructionType::OTHER && !instruction.is_relative) {
+    // Return or indirect jump, only a single step knows where it goes
+    return;
+  }
+
+  // Without line info every instruction is a line of it's own
+  DWORD64 start = current_address;
+  DWORD64 end = current_address + instruction.length;
+  StepperGetLineRange(stepper, current_address, &start, &end);
+
+  std::vector<DWORD64> addresses;
+  std::vector<Instruction> instructions;
+  end = StepperDecodeRange(stepper, start, end, &addresses, &instructions);
+
+  if (!std::binary_search(addresses.begin(), addresses.end(),
+                          current_address)) {
+    // Sweep from the line start went out of sync with the current instruction
+    start = current_address;
+    end = StepperDecodeRange(stepper, start, end, &addresses, &instructions);
+  }
+
+  InstructionGetRangeExits(addresses, instructions, start, end, targets);
+}
+
+// True, if a thread other than "thread" steps to the address
+static bool StepperIsOtherStepBreakpoint(Stepper *stepper, DWORD64 address,
+                                         const DebuggerThread *thread) {
+  for (const auto &it : stepper->threads) {
+    const auto &step_breakpoints = it.second.step_breakpoints;
+    if (&it.second != thread &&
+        std::find(step_breakpoints.begin(), step_breakpoints.end(),
+                  address) != step_breakpoints.end()) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// User breakpoints at the same addresses stay, and the ones other threads
+// step to
+static void StepperRemoveStepBreakpoints(Stepper *stepper,
+                                         DebuggerThread *thread) {
+  auto breakpoints = stepper->breakpoints;
+
+  for (DWORD64 address : thread->step_breakpoints) {
+    auto it = breakpoints->data.find(address);
+    if (it != breakpoints->data.end() &&
+        it->second.type == BreakpointType::TEMPORARY &&
+        !StepperIsOtherStepBreakpoint(stepper, address, thread)) {
+      BreakpointsQueueRemove(breakpoints, address);
+    }
+  }
+  ApplyBreakpoints(breakpoints, stepper->memory_cache);
+
+  thread->step_breakpoints.clear();
+}
+
+// Puts the temporary breakpoints of the step. Single steps instead, if there
+// are none, or one of them can't be put.
+static void StepperStepTo(Stepper *stepper,
+                          const std::vector<DWORD64> &addresses) {
+  auto breakpoints = stepper->breakpoints;
+  DebuggerThread *thread = StepperGetThread(stepper);
+  auto &step_breakpoints = thread->step_breakpoints;
+
+  for (DWORD64 address : addresses) {
+    BreakpointsQueueInsert(breakpoints, address, BreakpointType::TEMPORARY);
+  }
+  ApplyBreakpoints(breakpoints, stepper->memory_cache);
+
+  step_breakpoints = addresses;
+
+  for (DWORD64 address : addresses) {
+    if (breakpoints->data.find(address) == breakpoints->data.end()) {
+      StepperRemoveStepBreakpoints(stepper, thread);
+      break;
+    }
+  }
+
+  if (step_breakpoints.empty()) {
+    BackendSetSingleStep(stepper->backend);
+  }
+}
+
+// Step over or step in from the current instruction
+static void StepperPlanStep(Stepper *stepper) {
+  std::vector<DWORD64> targets;
+  StepperGetStepTargets(
+      stepper, StepperGetThread(stepper)->state == DebuggerState::STEP_IN,
+      &targets);
+  StepperStepTo(stepper, targets);
+}
+
+// Goes on with the step of the current thread once it traps at a step
+// breakpoint or single steps. Returns true, if the step is over and the
+// thread has to stop.
+static bool StepperContinueStep(Stepper *stepper) {
+  DebuggerThread *thread = StepperGetThread(stepper);
+  const Registers &registers = StepperGetRegisters(stepper, thread);
+  const DebuggerState state = thread->state;
+  const DWORD64 return_address = thread->step_return_address;
+  thread->step_return_address = 0;
+
+  DWORD file_id;
+  DWORD line;
+  if (state == DebuggerState::STEP_IN && return_address &&
+      !StepperGetLine(stepper, registers.Rip, &file_id, &line)) {
+    // Called into code without line info, run until it returns
+    StepperStepTo(stepper, {return_address});
+    thread->step_frame_address = registers.Rsp + 1;
+    return false;
+  }
+
+  if ((state != DebuggerState::STEP_OVER && state != DebuggerState::STEP_IN) ||
+      StepperIsStepLineLeft(stepper, registers.Rip)) {
+    return true;
+  }
+
+  StepperPlanStep(stepper);
+  return false;
+}
+
+// Moves conditional breakpoints into the target before it runs on. Steps
+// need the original code, so they run without them, see StepperResume.
+static void StepperUpdateAgent(Stepper *stepper) {
+  auto agent = stepper->agent;
+  auto backend = stepper->backend;
+  auto breakpoints = stepper->breakpoints;
+  bool is_stepping = false;
+  for (const auto &it : stepper->threads) {
+    const DebuggerState state = it.second.state;
+    is_stepping = is_stepping || state == DebuggerState::STEP_OVER ||
+                  state == DebuggerState::STEP_IN ||
+                  state == DebuggerState::STEP_OUT;
+  }
+
+  const DWORD64 step_off_address = stepper->agent_step_off_address;
+  stepper->agent_step_off_address = 0;
+
+  // Thread of the event is gone, if it has exited
+  auto current = stepper->threads.find(stepper->thread_id);
+  if (current == stepper->threads.end() || !backend->is_64bit ||
+      (!step_off_address && (!agent->is_enabled || is_stepping))) {
+    return;
+  }
+
+  DebuggerThread *thread = &current->second;
+  Registers registers = StepperGetRegisters(stepper, thread);
+  const bool is_stopped = thread->is_registers_read;
+
+  // Moved instructions of the trampoline run in place of the original ones
+  if (step_off_address) {
+    const AgentSite *site = AgentFindSite(agent, step_off_address);
+    auto it = breakpoints->data.find(step_off_address);
+    if (is_stopped && site && !site->is_failed && agent->is_enabled &&
+        !is_stepping) {
+      registers.Rip = site->resume_address;
+      BackendSetRegisters(backend, thread->id, registers);
+    } else if (it != breakpoints->data.end()) {
+      StepperStepOffMemoryBreakpoint(stepper, it->second);
+    }
+  }
+
+  // Patching code under a running thread is not safe
+  if (!is_stopped || !agent->is_enabled || is_stepping ||
+      (stepper->threads.size() > 1 && !stepper->is_all_stopped)) {
+    return;
+  }
+
+  const LineTable *line_table = stepper->line_table;
+  for (const auto &it : breakpoints->conditions) {
+    const DWORD64 address = it.first;
+    auto breakpoint = breakpoints->data.find(address);
+    AgentSite *site = AgentFindSite(agent, address);
+    if (breakpoint == breakpoints->data.end() ||
+        (site && (site->is_installed || site->is_failed))) {
+      continue;
+    }
+
+    if (!site) {
+      // Code after the line may be a jump target, so only the line moves
+      size_t line_index;
+      DWORD64 function_start;
+      DWORD64 end = address;
+      if (StepperFindLine(stepper, address, &line_index, &function_start,
+                          &end) &&
+          line_index + 1 < line_table->addresses.size()) {
+        end = std::min(end, line_table->addresses[line_index + 1]);
+      }
+
+      if (!AgentAddSite(agent, stepper->memory_cache, it.second, address,
+                        breakpoint->second.original_instruction,
+                        std::max(end, address),
+                        breakpoint->second.hit_count)) {
+        continue;
+      }
+      site = AgentFindSite(agent, address);
+    }
+
+    // Nothing may be in the middle of the moved instructions, tried again
+    // on the next continue otherwise
+    const DWORD64 end = address + site->length;
+    bool is_busy = false;
+    for (auto &other : stepper->threads) {
+      const DWORD64 eip = StepperGetRegisters(stepper, &other.second).Rip;
+      const DWORD64 rearm_address = other.second.rearm_address;
+      const DWORD64 displaced_next = other.second.displaced_next;
+      is_busy = is_busy || (eip >= address && eip < end) ||
+                (rearm_address >= address && rearm_address < end) ||
+                (displaced_next > address && displaced_next < end);
+    }
+    for (DWORD64 i = address + 1; i < end; ++i) {
+      is_busy = is_busy || breakpoints->data.count(i) != 0;
+    }
+
+    if (!is_busy && BreakpointsMoveToMemory(breakpoints, stepper->memory_cache,
+                                            &breakpoint->second)) {
+      AgentInstallSite(stepper->memory_cache, site,
+                       breakpoint->second.hit_count);
+    }
+  }
+}
+
+// Steps and continue, for the thread. All stopped, the thread of the stop
+// takes the state and the target resumes. Otherwise only a suspended thread
+// can take it, it's resumed by StepperResumeThreads. Returns true, if the
+// target resumes.
+static bool StepperSetCommandState(Stepper *stepper, DWORD thread_id,
+                                   DebuggerState state) {
+  if (stepper->is_all_stopped) {
+    StepperSetState(stepper, state);
+    return true;
+  }
+
+  auto it = stepper->threads.find(thread_id);
+  if (it != stepper->threads.end() && it->second.is_suspended) {
+    it->second.state = state;
+  }
+
+  return false;
+}
+
+// Suspended threads run on with the others, once non-stop mode is off
+static void StepperSetNonStop(Stepper *stepper, bool is_enabled) {
+  stepper->is_non_stop = is_enabled;
+  if (is_enabled) {
+    return;
+  }
+
+  for (auto &it : stepper->threads) {
+    if (it.second.is_suspended) {
+      it.second.state = DebuggerState::CONTINUE;
+    }
+  }
+}
+
+// Stops the target at the current thread. Every thread is stopped, steps of
+// the others are cancelled. In non-stop mode only the thread is suspended,
+// and the others run on.
+static void StepperStop(Stepper *stepper, DebuggerStopReason reason) {
+  DebuggerThread *thread = StepperGetThread(stepper);
+
+  if (stepper->is_non_stop) {
+    StepperRemoveStepBreakpoints(stepper, thread);
+    thread->state = DebuggerState::NONE;
+    thread->stop_reason = reason;
+    thread->is_suspended = true;
+    BackendSuspendThread(stepper->backend);
+    return;
+  }
+
+  if (!stepper->is_all_stopped) {
+    BackendStopThreads(stepper->backend);
+    stepper->is_all_stopped = true;
+  }
+
+  for (auto &it : stepper->threads) {
+    StepperRemoveStepBreakpoints(stepper, &it.second);
+    if (!it.second.is_suspended) {
+      it.second.stop_reason = DebuggerStopReason::NONE;
+    }
+  }
+  thread->stop_reason = reason;
+}
+
+// Sets the current thread up for the command that resumed it. Returns false,
+// if it has to stay stopped.
+static bool StepperResume(Stepper *stepper,
+                          const StepperGetReturnAddress &get_return_address) {
+  DebuggerThread *thread = StepperGetThread(stepper);
+  const Registers &registers = StepperGetRegisters(stepper, thread);
+
+  // Steps decode and patch the original code
+  if (thread->state != DebuggerState::CONTINUE) {
+    StepperRemoveAgentSites(stepper);
+  }
+
+  switch (thread->state) {
+  case DebuggerState::STEP_OVER:
+  case DebuggerState::STEP_IN: {
+    // Without line info every instruction is a line of it's own
+    if (!StepperGetLine(stepper, registers.Rip, &thread->step_file_id,
+                        &thread->step_line)) {
+      thread->step_file_id = (DWORD)-1;
+      thread->step_line = 0;
+    }
+
+    StepperPlanStep(stepper);
+  } break;
+  case DebuggerState::STEP_OUT: {
+    const DWORD64 return_address = get_return_address(thread);
+    if (!return_address) {
+      LOG_IMGUI(StepperResume, "Unable to find the return address")
+      return false;
+    }
+
+    StepperStepTo(stepper, {return_address});
+
+    // Return pops at least the return address
+    thread->step_frame_address = registers.Rsp + 1;
+  } break;
+  default:
+    break;
+  }
+
+  return true;
+}
+
+// Breakpoint the thread is on, if any, is stepped off once it runs on. A
+// thread that stays suspended does it when it's resumed.
+static void StepperStepOffCurrent(Stepper *stepper, DebuggerThread *thread) {
+  const auto &breakpoints = stepper->breakpoints->data;
+
+  if (thread->is_suspended || thread->state == DebuggerState::NONE) {
+    return;
+  }
+
+  // Stop may have changed breakpoints
+  auto it = breakpoints.find(StepperGetRegisters(stepper, thread).Rip);
+  if (it != breakpoints.end()) {
+    StepperStepOffBreakpoint(stepper, it->second);
+  }
+}
+
+// Runs the suspended threads that a command was given for, see
+// StepperSetCommandState. Called between events only, so that threads held
+// for a step off aren't let go by the continue of another event. Returns
+// true, if any of them was resumed or had it's command dropped.
+static bool StepperResumeThreads(
+    Stepper *stepper, const StepperGetReturnAddress &get_return_address) {
+  bool result = false;
+  for (auto &it : stepper->threads) {
+    DebuggerThread *thread = &it.second;
+    if (!thread->is_suspended || thread->state == DebuggerState::NONE) {
+      continue;
+    }
+    result = true;
+
+    stepper->thread_id = thread->id;
+    if (!StepperResume(stepper, get_return_address)) {
+      thread->state = DebuggerState::NONE;
+      continue;
+    }
+
+    thread->is_suspended = false;
+    thread->stop_reason = DebuggerStopReason::NONE;
+    StepperStepOffCurrent(stepper, thread);
+    StepperUpdateAgent(stepper);
+    MemoryCacheInvalidate(stepper->memory_cache);
+
+    thread->is_registers_read = false;
+    BackendResumeThread(stepper->backend, thread->id);
+  }
+
+  return result;
+}
+
+// Every thread but the suspended ones runs on after the event. Their
+// registers are read again on their next stop.
+static void StepperRunOn(Stepper *stepper) {
+  for (auto &it : stepper->threads) {
+    if (!it.second.is_suspended) {
+      it.second.is_registers_read = false;
+      it.second.stop_reason = DebuggerStopReason::NONE;
+    }
+  }
+  stepper->is_all_stopped = false;
+}
\ No newline at end of file
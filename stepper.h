@@ -0,0 +1,76 @@
+#define STEPPER_MAX_STEP_INSTRUCTIONS 256 // Decoded per line range
+#define STEPPER_DISPLACED_SIZE 32 // Relocated instruction and a jump back
+
+struct LineTable;
+
+enum class DebuggerState {
+  NONE,
+  STEP_OVER,
+  STEP_IN,
+  STEP_OUT,
+  CONTINUE
+};
+
+enum class DebuggerStopReason {
+  NONE, // Stopped along with the thread that stopped, or running
+  BREAKPOINT,
+  STEP,
+  WATCHPOINT,
+  TRAP // int3 compiled into the target
+};
+
+// Everything that is per thread. Steps and step offs of different threads
+// don't mix.
+struct DebuggerThread {
+  DWORD id;
+  DebuggerState state;
+  DebuggerStopReason stop_reason; // Of the last stop
+  bool is_suspended; // Stopped alone in non-stop mode, until resumed
+  Registers registers; // At the last event, int3 of a breakpoint undone
+  bool is_registers_read; // Since the last stop, read once for all users
+  std::vector<UnwindFrame> frames; // Of the same stop, the innermost first
+  size_t frames_max_count; // Of the walk they came from, 0 - not walked
+
+  // Steps, temporary breakpoints around the line, or one to return to
+  DWORD step_file_id; // Line the step started on
+  DWORD step_line;
+  std::vector<DWORD64> step_breakpoints; // Empty - single stepping instead
+  DWORD64 step_frame_address; // Hits below it come from recursive calls
+  DWORD64 step_return_address; // Of the call being stepped into, 0 - none
+  DWORD64 rearm_address; // Breakpoint to put back after the next single step
+
+  // Displaced step, the instruction under an int3 runs from a copy, so that
+  // the int3 stays in place
+  DWORD64 displaced_next; // After the original instruction, 0 - none
+  DWORD64 displaced_end;  // After the copy, maps to "displaced_next"
+  bool is_displaced_call; // Return address it pushes needs the same mapping
+  std::vector<DWORD64> displaced_buffers; // One per rel32 reachable region
+};
+
+// Where the function the thread is in returns to, 0 - unknown. Stack walks
+// may need DbgHelp, so the debugger does them.
+typedef std::function<DWORD64(DebuggerThread *)> StepperGetReturnAddress;
+
+// Threads of the target, how they step and how they get off breakpoints.
+// Doesn't need DbgHelp or the UI, so the tests drive it the way the debugger
+// does.
+struct Stepper {
+  Backend *backend;
+  MemoryCache *memory_cache;
+  Agent *agent;
+  Breakpoints *breakpoints;
+  // Indexed ones sorted by base, steps plan with their functions. See
+  // StepperAddModule.
+  std::vector<Module> modules;
+  const LineTable *line_table; // Last published one, steps plan with it
+
+  std::unordered_map<DWORD, DebuggerThread> threads;
+  DWORD thread_id; // Of the last event, steps and step offs are of it
+  bool is_all_stopped; // Not just the event thread, until the next continue
+  bool is_non_stop; // Only the thread that stops is stopped, see StepperStop
+
+  bool is_displaced_step_failed; // No buffer for it, int3s are lifted
+  std::vector<DWORD64> free_displaced_buffers; // Of exited threads
+
+  DWORD64 agent_step_off_address; // Left through it's trampoline on continue
+};
\ No newline at end of file
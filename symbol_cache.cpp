@@ -0,0 +1,86 @@
+static std::string SymbolCacheGetFilename(const SymbolCacheKey *key) {
+  const auto &path = key->path;
+
+  std::stringstream ss;
+  ss << SYMBOL_CACHE_DIRECTORY << '\\' << GetFilenameFromPath(path) << '.'
+     << std::hex << SymbolCacheChecksum((const BYTE *)path.data(), path.size())
+     << ".cache";
+
+  return ss.str();
+}
+
+static bool SymbolCacheRead(const SymbolCacheKey *key,
+                            ModuleIndex *module_index) {
+  const std::string filename = SymbolCacheGetFilename(key);
+
+  HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+
+  bool result = false;
+
+  LARGE_INTEGER size;
+  if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+    HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping) {
+      const BYTE *data =
+          (const BYTE *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+      if (data) {
+        result = SymbolCacheDeserialize(key, data, (size_t)size.QuadPart,
+                                        module_index);
+        UnmapViewOfFile(data);
+      }
+      CloseHandle(mapping);
+    }
+  }
+  CloseHandle(file);
+
+  if (!result) {
+    LOG_IMGUI(SymbolCacheRead, "Discarding stale or corrupted cache ",
+              filename)
+  }
+
+  return result;
+}
+
+static bool SymbolCacheWrite(const SymbolCacheKey *key,
+                             const ModuleIndex *module_index) {
+  const std::string filename = SymbolCacheGetFilename(key);
+  const std::string temp_filename = filename + ".tmp";
+
+  std::vector<BYTE> data;
+  SymbolCacheSerialize(key, module_index, &data);
+
+  CreateDirectoryA(SYMBOL_CACHE_DIRECTORY, NULL);
+
+  // Write to temporary file first, so a reader never sees a partial cache
+  HANDLE file =
+      CreateFileA(temp_filename.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                  FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    LOG_IMGUI(SymbolCacheWrite, "CreateFileA failed, error = ", GetLastError())
+    return false;
+  }
+
+  DWORD written_bytes;
+  const BOOL written = WriteFile(file, data.data(), (DWORD)data.size(),
+                                 &written_bytes, NULL);
+  CloseHandle(file);
+
+  if (!written || written_bytes != data.size()) {
+    LOG_IMGUI(SymbolCacheWrite, "WriteFile failed, error = ", GetLastError())
+    DeleteFileA(temp_filename.c_str());
+    return false;
+  }
+
+  if (!MoveFileExA(temp_filename.c_str(), filename.c_str(),
+                   MOVEFILE_REPLACE_EXISTING)) {
+    LOG_IMGUI(SymbolCacheWrite, "MoveFileExA failed, error = ", GetLastError())
+    DeleteFileA(temp_filename.c_str());
+    return false;
+  }
+
+  return true;
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+#define SYMBOL_CACHE_DIRECTORY "symbol_cache"
+#define SYMBOL_CACHE_MAGIC 0x43534244 // "DBSC"
+#define SYMBOL_CACHE_VERSION 3 // 2 - functions are sorted, 3 - inline sites
+
+// Identity of a module binary and its debug info, cache is only reused if all
+// of it matches
+struct SymbolCacheKey {
+  std::string path;
+  DWORD64 size;
+  DWORD64 timestamp;
+  BYTE build_id[16];
+  DWORD build_age;
+};
+
+// On-disk layout: header, then path, source file names (null terminated),
+// lines, functions, inline sites and function names, all tightly packed
+struct SymbolCacheHeader {
+  DWORD magic;
+  DWORD version;
+  DWORD64 size;
+  DWORD64 timestamp;
+  BYTE build_id[16];
+  DWORD build_age;
+  DWORD path_size;
+  DWORD source_file_count;
+  DWORD source_files_size;
+  DWORD line_count;
+  DWORD function_count;
+  DWORD names_size;
+  DWORD inline_site_count;
+  DWORD64 checksum; // FNV-1a of the whole file, with this field zeroed
+};
\ No newline at end of file
@@ -0,0 +1,179 @@
+// Cache file contents, apart from the file I/O in symbol_cache.cpp. Only
+// byte buffers here, so it builds and is tested on Linux too.
+
+static DWORD64 SymbolCacheChecksum(const BYTE *data, size_t size,
+                                   DWORD64 hash = 0xcbf29ce484222325ull) {
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= data[i];
+    hash *= 0x100000001b3ull;
+  }
+
+  return hash;
+}
+
+static void SymbolCacheSerialize(const SymbolCacheKey *key,
+                                 const ModuleIndex *module_index,
+                                 std::vector<BYTE> *data) {
+  auto &result = *data;
+
+  const auto append = [&](const void *bytes, size_t size) {
+    result.insert(result.end(), (const BYTE *)bytes,
+                  (const BYTE *)bytes + size);
+  };
+
+  SymbolCacheHeader header = {};
+  header.magic = SYMBOL_CACHE_MAGIC;
+  header.version = SYMBOL_CACHE_VERSION;
+  header.size = key->size;
+  header.timestamp = key->timestamp;
+  memcpy(header.build_id, key->build_id, sizeof(header.build_id));
+  header.build_age = key->build_age;
+  header.path_size = (DWORD)key->path.size();
+  header.source_file_count = (DWORD)module_index->source_files.size();
+  header.line_count = (DWORD)module_index->lines.size();
+  header.function_count = (DWORD)module_index->functions.size();
+  header.inline_site_count = (DWORD)module_index->inline_sites.size();
+  header.names_size = (DWORD)module_index->names.size();
+
+  result.clear();
+  result.resize(sizeof(header));
+
+  append(key->path.data(), key->path.size());
+
+  for (const auto &source_file : module_index->source_files) {
+    append(source_file.c_str(), source_file.size() + 1);
+    header.source_files_size += (DWORD)source_file.size() + 1;
+  }
+
+  append(module_index->lines.data(),
+         module_index->lines.size() * sizeof(ModuleLine));
+  append(module_index->functions.data(),
+         module_index->functions.size() * sizeof(ModuleFunction));
+  append(module_index->inline_sites.data(),
+         module_index->inline_sites.size() * sizeof(ModuleInlineSite));
+  append(module_index->names.data(), module_index->names.size());
+
+  // Checksum covers the header too, with checksum field itself zeroed
+  header.checksum = SymbolCacheChecksum(
+      result.data() + sizeof(header), result.size() - sizeof(header),
+      SymbolCacheChecksum((const BYTE *)&header, sizeof(header)));
+  memcpy(result.data(), &header, sizeof(header));
+}
+
+// Copied, the file has no alignment. Empty arrays have no data to copy to.
+template <typename T>
+static void SymbolCacheReadArray(const BYTE *it, DWORD count,
+                                 std::vector<T> *result) {
+  result->resize(count);
+  if (count) {
+    memcpy(result->data(), it, count * sizeof(T));
+  }
+}
+
+// Validates everything before trusting it, cache file may be truncated,
+// stale or just garbage
+static bool SymbolCacheDeserialize(const SymbolCacheKey *key, const BYTE *data,
+                                   size_t size, ModuleIndex *module_index) {
+  SymbolCacheHeader header;
+  if (size < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, data, sizeof(header));
+
+  if (header.magic != SYMBOL_CACHE_MAGIC ||
+      header.version != SYMBOL_CACHE_VERSION) {
+    return false;
+  }
+
+  if (header.size != key->size || header.timestamp != key->timestamp ||
+      header.build_age != key->build_age ||
+      memcmp(header.build_id, key->build_id, sizeof(header.build_id)) != 0) {
+    return false;
+  }
+
+  const DWORD64 expected_size =
+      sizeof(header) + (DWORD64)header.path_size + header.source_files_size +
+      (DWORD64)header.line_count * sizeof(ModuleLine) +
+      (DWORD64)header.function_count * sizeof(ModuleFunction) +
+      (DWORD64)header.inline_site_count * sizeof(ModuleInlineSite) +
+      header.names_size;
+  if (expected_size != size) {
+    return false;
+  }
+
+  const DWORD64 checksum = header.checksum;
+  header.checksum = 0;
+
+  const BYTE *it = data + sizeof(header);
+  if (SymbolCacheChecksum(
+          it, size - sizeof(header),
+          SymbolCacheChecksum((const BYTE *)&header, sizeof(header))) !=
+      checksum) {
+    return false;
+  }
+
+  if (header.path_size != key->path.size() ||
+      memcmp(it, key->path.data(), header.path_size) != 0) {
+    return false;
+  }
+  it += header.path_size;
+
+  ModuleIndex result;
+
+  // Source files
+  const char *source_files = (const char *)it;
+  const char *source_files_end = source_files + header.source_files_size;
+  if (header.source_files_size && source_files_end[-1] != '\0') {
+    return false;
+  }
+
+  result.source_files.reserve(header.source_file_count);
+  for (const char *source_file = source_files;
+       source_file < source_files_end;
+       source_file += strlen(source_file) + 1) {
+    result.source_files.emplace_back(source_file);
+  }
+  if (result.source_files.size() != header.source_file_count) {
+    return false;
+  }
+  it += header.source_files_size;
+
+  // Lines
+  SymbolCacheReadArray(it, header.line_count, &result.lines);
+  for (const auto &line : result.lines) {
+    if (line.file_index >= header.source_file_count) {
+      return false;
+    }
+  }
+  it += header.line_count * sizeof(ModuleLine);
+
+  // Functions
+  SymbolCacheReadArray(it, header.function_count, &result.functions);
+  for (const auto &function : result.functions) {
+    if (function.name_offset >= header.names_size ||
+        function.start_rva > function.end_rva) {
+      return false;
+    }
+  }
+  it += header.function_count * sizeof(ModuleFunction);
+
+  // Inline sites
+  SymbolCacheReadArray(it, header.inline_site_count, &result.inline_sites);
+  for (const auto &inline_site : result.inline_sites) {
+    if (inline_site.name_offset >= header.names_size ||
+        inline_site.start_rva > inline_site.end_rva) {
+      return false;
+    }
+  }
+  it += header.inline_site_count * sizeof(ModuleInlineSite);
+
+  // Names
+  if (header.names_size && it[header.names_size - 1] != '\0') {
+    return false;
+  }
+  result.names.assign((const char *)it, header.names_size);
+
+  *module_index = std::move(result);
+
+  return true;
+}
\ No newline at end of file
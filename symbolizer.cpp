@@ -0,0 +1,92 @@
+// DbgHelp is held for one address at a time, the debugger thread doesn't wait
+// long for it
+static void SymbolizerResolve(HANDLE process, DWORD64 address,
+                              SYMBOL_INFO *symbol_info,
+                              SymbolizerSymbol *symbol) {
+  std::lock_guard<std::mutex> lock(Global_DbgHelpMutex);
+
+  symbol_info->SizeOfStruct = sizeof(SYMBOL_INFO);
+  symbol_info->MaxNameLen = MAX_SYM_NAME;
+  DWORD64 displacement;
+  if (SymFromAddr(process, address, &displacement, symbol_info)) {
+    symbol->function = symbol_info->Name;
+  }
+
+  IMAGEHLP_LINE64 line = {};
+  line.SizeOfStruct = sizeof(line);
+  DWORD line_displacement;
+  if (SymGetLineFromAddr64(process, address, &line_displacement, &line)) {
+    symbol->filename = line.FileName;
+    symbol->line = line.LineNumber;
+  }
+}
+
+static void SymbolizerWorker(Symbolizer *symbolizer) {
+  std::vector<BYTE> symbol_buffer(sizeof(SYMBOL_INFO) + MAX_SYM_NAME);
+  SYMBOL_INFO *symbol_info = (SYMBOL_INFO *)symbol_buffer.data();
+
+  while (true) {
+    DWORD64 address;
+    {
+      std::unique_lock<std::mutex> lock(symbolizer->mutex);
+      symbolizer->condition.wait(lock, [&]() {
+        return symbolizer->is_stopping || !symbolizer->requests.empty();
+      });
+
+      if (symbolizer->is_stopping) {
+        return;
+      }
+
+      // Rows shown last are the ones still on screen
+      address = symbolizer->requests.back();
+      symbolizer->requests.pop_back();
+    }
+
+    SymbolizerSymbol symbol = {};
+    SymbolizerResolve(symbolizer->process, address, symbol_info, &symbol);
+    symbol.is_resolved = true;
+
+    std::lock_guard<std::mutex> lock(symbolizer->mutex);
+    symbolizer->symbols[address] = std::move(symbol);
+  }
+}
+
+static Symbolizer *CreateSymbolizer(HANDLE process) {
+  Symbolizer *result = new Symbolizer();
+  result->process = process;
+  result->is_stopping = false;
+  result->thread = std::thread(SymbolizerWorker, result);
+
+  return result;
+}
+
+// Symbol of the address if it's resolved, otherwise NULL and the address is
+// queued once
+static const SymbolizerSymbol *SymbolizerFind(Symbolizer *symbolizer,
+                                              DWORD64 address) {
+  {
+    std::lock_guard<std::mutex> lock(symbolizer->mutex);
+    auto it = symbolizer->symbols.find(address);
+    if (it != symbolizer->symbols.end()) {
+      return it->second.is_resolved ? &it->second : NULL;
+    }
+
+    symbolizer->symbols.emplace(address, SymbolizerSymbol());
+    symbolizer->requests.push_back(address);
+  }
+
+  symbolizer->condition.notify_one();
+
+  return NULL;
+}
+
+// Queued addresses are dropped, the UI may still ask but nothing resolves
+static void SymbolizerStop(Symbolizer *symbolizer) {
+  {
+    std::lock_guard<std::mutex> lock(symbolizer->mutex);
+    symbolizer->is_stopping = true;
+  }
+  symbolizer->condition.notify_all();
+
+  symbolizer->thread.join();
+}
\ No newline at end of file
@@ -0,0 +1,26 @@
+// Function and line of one address
+struct SymbolizerSymbol {
+  bool is_resolved; // False while it's queued, the rest is empty until then
+  std::string function; // Empty - unknown
+  std::string filename; // Empty - no line info
+  DWORD line;
+};
+
+// Resolves addresses the UI asks for on a worker thread, so a deep callstack
+// costs DbgHelp calls only for the rows that get shown. Results are kept for
+// the whole session, stops share them.
+struct Symbolizer {
+  HANDLE process;
+  std::thread thread;
+
+  std::mutex mutex;
+  std::condition_variable condition;
+  // SymbolizerFind hands out pointers to resolved entries that the UI reads
+  // without the lock and keeps across frames. That relies on two things:
+  // unordered_map nodes stay put when it rehashes, and a resolved entry is
+  // never assigned again or erased. Open addressing moves entries when it
+  // grows, switching to it means SymbolizerFind has to return copies.
+  std::unordered_map<DWORD64, SymbolizerSymbol> symbols; // By address
+  std::vector<DWORD64> requests; // Newest last, resolved first
+  bool is_stopping;
+};
\ No newline at end of file
@@ -0,0 +1,202 @@
+#define TEST_WITH_TARGET
+#include "test.h"
+
+#define BENCH_THREAD_COUNT 200 // Besides the main one
+#define BENCH_RUN_COUNT 3
+
+struct BenchRun {
+  double stop_ms;   // All threads stopped, BackendAttach returned
+  double resume_ms; // All of them run again, the attach events handled
+  size_t thread_count;
+  size_t module_count;
+  int stopped_after_attach; // Threads still stopped a while after
+  double detach_ms; // With the threads trapped on a removed int3
+  int stopped_after_detach;
+  DWORD64 ticks_after_detach; // CPU time the target used since, 0 - hung
+};
+
+static int BenchCountThreads(pid_t process_id, int *stopped_count) {
+  const std::string task_path =
+      "/proc/" + std::to_string(process_id) + "/task";
+  DIR *task = opendir(task_path.c_str());
+  if (!task) {
+    return 0;
+  }
+
+  int count = 0;
+  *stopped_count = 0;
+  while (dirent *entry = readdir(task)) {
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+
+    std::ifstream file(task_path + "/" + entry->d_name + "/stat");
+    std::string stat;
+    std::getline(file, stat);
+    const size_t name_end = stat.rfind(')');
+    if (name_end == std::string::npos || name_end + 2 >= stat.size()) {
+      continue;
+    }
+
+    ++count;
+    if (stat[name_end + 2] == 't' || stat[name_end + 2] == 'T') {
+      ++*stopped_count;
+    }
+  }
+  closedir(task);
+
+  return count;
+}
+
+// utime and stime of the process, in clock ticks
+static DWORD64 BenchGetTicks(pid_t process_id) {
+  std::ifstream file("/proc/" + std::to_string(process_id) + "/stat");
+  std::string stat;
+  std::getline(file, stat);
+  const size_t name_end = stat.rfind(')');
+  if (name_end == std::string::npos) {
+    return 0;
+  }
+
+  // Fields after the name start with the third one, the state
+  std::istringstream fields(stat.substr(name_end + 2));
+  std::string field;
+  DWORD64 ticks = 0;
+  for (int i = 3; i <= 15 && fields >> field; ++i) {
+    if (i >= 14) {
+      ticks += strtoull(field.c_str(), NULL, 10);
+    }
+  }
+
+  return ticks;
+}
+
+static double BenchGetMs(double start) {
+  return (TestGetSeconds() - start) * 1e3;
+}
+
+// Attaches to a running target, lets it run, then detaches with every
+// thread trapped on an int3 in Spin that's removed right before
+static bool BenchAttachAndDetach(pid_t process_id, BenchRun *run) {
+  Backend backend = {};
+  std::vector<BackendEvent> events;
+  double stop_seconds;
+  const double start = TestGetSeconds();
+  if (!TestAttach(&backend, process_id, &events, &stop_seconds)) {
+    return false;
+  }
+  run->resume_ms = BenchGetMs(start);
+  run->stop_ms = stop_seconds * 1e3;
+
+  DWORD64 base = 0;
+  std::string path;
+  run->thread_count = 1;
+  run->module_count = 0;
+  for (const BackendEvent &event : events) {
+    if (event.type == BackendEventType::CREATE_PROCESS) {
+      base = event.base_address;
+      path = event.path;
+    } else if (event.type == BackendEventType::CREATE_THREAD) {
+      ++run->thread_count;
+    } else if (event.type == BackendEventType::LOAD_MODULE) {
+      ++run->module_count;
+    }
+  }
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  BenchCountThreads(process_id, &run->stopped_after_attach);
+
+  Module module;
+  const ModuleFunction *function = NULL;
+  if (ModuleLoad(NULL, NULL, path, base, &module)) {
+    function = ModuleFindFunction(&module.index, "Spin");
+  }
+  if (!function) {
+    return false;
+  }
+
+  // First hit is put back on the int3, the others trap meanwhile
+  const DWORD64 address = module.base + function->start_rva;
+  const BYTE trap = 0xcc;
+  BYTE original;
+  BackendStopThreads(&backend);
+  if (!BackendReadMemory(&backend, address, &original, 1, NULL) ||
+      !BackendWriteMemory(&backend, address, &trap, 1)) {
+    return false;
+  }
+  BackendResumeThreads(&backend);
+
+  BackendEvent event;
+  if (!TestWaitFor(&backend, BackendEventType::BREAKPOINT, &event)) {
+    return false;
+  }
+
+  Registers registers = {};
+  BackendGetRegisters(&backend, event.thread_id, &registers);
+  registers.Rip = event.address;
+  BackendSetRegisters(&backend, event.thread_id, registers);
+  BackendContinue(&backend, event, true);
+  std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  const double detach_start = TestGetSeconds();
+  BackendStopThreads(&backend);
+  BackendWriteMemory(&backend, address, &original, 1);
+  const bool is_detached = BackendDetach(&backend);
+  run->detach_ms = BenchGetMs(detach_start);
+
+  const DWORD64 ticks = BenchGetTicks(process_id);
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  BenchCountThreads(process_id, &run->stopped_after_detach);
+  run->ticks_after_detach = BenchGetTicks(process_id) - ticks;
+
+  return is_detached;
+}
+
+// Attaches to targets/spin with it's threads busy, a few times, argument
+// is the thread count
+int main(int argc, char **argv) {
+  const std::string path = TestGetTargetPath(argv[0], "spin");
+  const std::string thread_count =
+      std::to_string(argc > 1 ? atoi(argv[1]) : BENCH_THREAD_COUNT);
+
+  Global_TestIsLogMuted = true;
+
+  printf("attach_bench: %s busy threads\n", thread_count.c_str());
+  for (int i = 0; i < BENCH_RUN_COUNT; ++i) {
+    const pid_t process_id = fork();
+    if (process_id == 0) {
+      execl(path.c_str(), path.c_str(), thread_count.c_str(), (char *)NULL);
+      _exit(127);
+    }
+
+    // Until every thread is started
+    const int expected_count = atoi(thread_count.c_str()) + 1;
+    int stopped_count;
+    for (int wait_ms = 0; wait_ms < 5000; ++wait_ms) {
+      if (BenchCountThreads(process_id, &stopped_count) >= expected_count) {
+        break;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    BenchRun run = {};
+    const bool is_done = BenchAttachAndDetach(process_id, &run);
+    kill(process_id, SIGKILL);
+    waitpid(process_id, NULL, 0);
+    if (!is_done) {
+      printf("attach_bench: can't debug %s\n", path.c_str());
+      return 1;
+    }
+
+    printf("  stopped %.1f ms, running %.1f ms after the attach, %zu "
+           "threads, %zu modules, %d stopped after\n",
+           run.stop_ms, run.resume_ms, run.thread_count, run.module_count,
+           run.stopped_after_attach);
+    printf("  detached in %.1f ms, %d stopped after, %llu ticks run in "
+           "200 ms\n",
+           run.detach_ms, run.stopped_after_detach,
+           (unsigned long long)run.ticks_after_detach);
+  }
+
+  return 0;
+}
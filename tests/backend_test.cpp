@@ -0,0 +1,97 @@
+#define TEST_WITH_TARGET
+#include "test.h"
+
+static bool TestEndsWith(const std::string &path, const char *name) {
+  const size_t length = strlen(name);
+  return path.size() >= length &&
+         path.compare(path.size() - length, length, name) == 0;
+}
+
+// Launched process reports the dynamic linker at the start, the libraries it
+// maps and the plugin that targets/load loads and unloads, through the
+// _dl_debug_state hook. The hook itself isn't reported.
+static void TestLaunchedModules(const std::string &path) {
+  Backend backend;
+  BackendEvent event;
+  TEST_CHECK(TestLaunch(&backend, path, &event, NULL))
+  BackendContinue(&backend, event, true);
+
+  const std::string exe_path = BackendGetExePath((pid_t)backend.process_id);
+  std::map<DWORD64, std::string> loaded;
+  DWORD64 plugin_base = 0;
+  bool is_plugin_unloaded = false;
+  bool is_linker_first = false;
+  size_t breakpoint_count = 0;
+  while (BackendWaitForEvent(&backend, &event, 5000) &&
+         event.type != BackendEventType::NONE &&
+         event.type != BackendEventType::EXIT_PROCESS) {
+    if (event.type == BackendEventType::LOAD_MODULE) {
+      TEST_CHECK(event.path != exe_path && BackendIsElfFile(event.path))
+      is_linker_first |= loaded.empty() && event.path.find("/ld-") !=
+                                               std::string::npos;
+      loaded[event.base_address] = event.path;
+      if (TestEndsWith(event.path, "/plugin.so")) {
+        plugin_base = event.base_address;
+      }
+    } else if (event.type == BackendEventType::UNLOAD_MODULE) {
+      TEST_CHECK(loaded.count(event.base_address) == 1)
+      is_plugin_unloaded |= event.base_address == plugin_base;
+      loaded.erase(event.base_address);
+    } else if (event.type == BackendEventType::BREAKPOINT) {
+      ++breakpoint_count;
+    }
+    BackendContinue(&backend, event, true);
+  }
+
+  TEST_CHECK(event.type == BackendEventType::EXIT_PROCESS && event.code == 0)
+  TEST_CHECK(is_linker_first)
+  TEST_CHECK(std::any_of(loaded.begin(), loaded.end(), [](const auto &it) {
+    return it.second.find("/libc.") != std::string::npos;
+  }))
+  TEST_CHECK(plugin_base != 0)
+  TEST_CHECK(is_plugin_unloaded)
+  TEST_CHECK(breakpoint_count == 0)
+
+  TestKill(&backend);
+  BackendDetach(&backend);
+}
+
+// Hook is taken out on detach, the process runs on untraced
+static void TestDetachUnhooks(const std::string &path) {
+  Backend backend;
+  BackendEvent event;
+  TEST_CHECK(TestLaunch(&backend, path, &event, NULL))
+  BackendContinue(&backend, event, true);
+  TEST_CHECK(TestWaitFor(&backend, BackendEventType::CREATE_THREAD, &event))
+
+  const DWORD64 address = backend.load_hook_address;
+  BYTE code = 0;
+  TEST_CHECK(address != 0)
+  TEST_CHECK(BackendReadMemory(&backend, address, &code, 1, NULL))
+  TEST_CHECK(code == 0xCC)
+
+  const pid_t process_id = (pid_t)backend.process_id;
+  TEST_CHECK(BackendDetach(&backend))
+  TEST_CHECK(backend.load_hook_address == 0)
+
+  const int memory_file =
+      open(("/proc/" + std::to_string(process_id) + "/mem").c_str(),
+           O_RDONLY);
+  TEST_CHECK(pread(memory_file, &code, 1, (off_t)address) == 1)
+  TEST_CHECK(code != 0xCC)
+  close(memory_file);
+
+  kill(process_id, SIGKILL);
+  waitpid(process_id, NULL, 0);
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+
+  Global_TestIsLogMuted = true;
+
+  TestLaunchedModules(TestGetTargetPath(argv[0], "load"));
+  TestDetachUnhooks(TestGetTargetPath(argv[0], "spin"));
+
+  return TestFinish("backend_test");
+}
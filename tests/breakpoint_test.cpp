@@ -0,0 +1,322 @@
+#define TEST_WITH_TARGET
+#include "test.h"
+
+#include "../condition.h"
+#include "../agent.h"
+#include "../breakpoint.h"
+#include "../stepper.h"
+#include "../condition.cpp"
+#include "../agent.cpp"
+#include "../breakpoint.cpp"
+#include "../stepper.cpp"
+
+// Same as in targets/threads
+#define TEST_THREAD_COUNT 4
+#define TEST_COUNT 50
+#define TEST_WATCHED_INDEX 2 // Of global_odd_counts, one thread writes it
+
+// Address of a variable in the executable's .symtab, 0 if it isn't there
+static DWORD64 TestFindVariable(const std::string &path, DWORD64 base,
+                                const char *name) {
+  ElfFile elf_file;
+  if (!ElfFileMap(&elf_file, path)) {
+    return 0;
+  }
+
+  DWORD64 result = 0;
+  const Elf64_Sym *symbols = (const Elf64_Sym *)elf_file.symtab.data;
+  const size_t symbol_count = elf_file.symtab.size / sizeof(Elf64_Sym);
+  for (size_t i = 0; i < symbol_count && !result; ++i) {
+    const Elf64_Sym &symbol = symbols[i];
+    if (ELF64_ST_TYPE(symbol.st_info) == STT_OBJECT &&
+        strcmp(ElfGetString(elf_file.strtab, symbol.st_name), name) == 0) {
+      result = base + symbol.st_value - elf_file.load_address;
+    }
+  }
+  ElfFileUnmap(&elf_file);
+
+  return result;
+}
+
+// Byte in the target as it is, past the memory cache
+static BYTE TestReadByte(Backend *backend, DWORD64 address) {
+  BYTE result = 0;
+  BackendReadMemory(backend, address, &result, 1, NULL);
+  return result;
+}
+
+// Start of every instruction of the function
+static std::vector<DWORD64> TestGetInstructions(MemoryCache *memory_cache,
+                                                const Module &module,
+                                                const char *name) {
+  std::vector<DWORD64> result;
+  const ModuleFunction *function = ModuleFindFunction(&module.index, name);
+  if (!function) {
+    return result;
+  }
+
+  const DWORD64 end = module.base + function->end_rva;
+  for (DWORD64 address = module.base + function->start_rva; address < end;) {
+    BYTE code[INSTRUCTION_MAX_LENGTH];
+    SIZE_T size = 0;
+    MemoryCacheRead(memory_cache, address, code, sizeof(code), &size);
+    Instruction instruction;
+    if (!InstructionDecode(code, size, address, true, &instruction)) {
+      break;
+    }
+
+    result.push_back(address);
+    address += instruction.length;
+  }
+
+  return result;
+}
+
+// int3s on every function of targets/big, over a hundred pages of them, are
+// written with one read, one write and one flush per page. Removing them puts
+// the original code back byte for byte.
+static void TestApplyPages(const std::string &path) {
+  Backend backend;
+  BackendEvent event;
+  Module module;
+  TEST_CHECK(TestLaunch(&backend, path, &event, &module))
+  MemoryCache *memory_cache = CreateMemoryCache(&backend);
+  Breakpoints breakpoints = {};
+
+  std::vector<DWORD64> addresses;
+  for (const ModuleFunction &function : module.index.functions) {
+    addresses.push_back(module.base + function.start_rva);
+  }
+  std::set<DWORD64> pages;
+  std::vector<BYTE> original_instructions;
+  for (DWORD64 address : addresses) {
+    pages.insert(address & ~(DWORD64)(MEMORY_CACHE_PAGE_SIZE - 1));
+    original_instructions.push_back(TestReadByte(&backend, address));
+  }
+  TEST_CHECK(pages.size() > 100)
+
+  // Code pages are read-only, every write falls back to /proc/<pid>/mem
+  for (int is_insert = 1; is_insert >= 0; --is_insert) {
+    for (DWORD64 address : addresses) {
+      if (is_insert) {
+        BreakpointsQueueInsert(&breakpoints, address,
+                               BreakpointType::TEMPORARY);
+      } else {
+        BreakpointsQueueRemove(&breakpoints, address);
+      }
+    }
+
+    MemoryCacheInvalidate(memory_cache);
+    const DWORD64 syscall_count = backend.syscall_count;
+    const DWORD64 flush_count = backend.flush_count;
+    TEST_CHECK(ApplyBreakpoints(&breakpoints, memory_cache))
+    TEST_CHECK(memory_cache->read_count == pages.size())
+    TEST_CHECK(backend.syscall_count - syscall_count == 3 * pages.size())
+    TEST_CHECK(backend.flush_count - flush_count == pages.size())
+
+    TEST_CHECK(breakpoints.data.size() == (is_insert ? addresses.size() : 0))
+    for (size_t i = 0; i < addresses.size(); ++i) {
+      TEST_CHECK(TestReadByte(&backend, addresses[i]) ==
+                 (is_insert ? 0xcc : original_instructions[i]))
+    }
+  }
+
+  TestKill(&backend);
+}
+
+// A breakpoint set inside the jump of a conditional one goes into the
+// original code, the jump is lifted for it. Removing both restores the code.
+static void TestAgentOverlap(const std::string &path) {
+  Backend backend;
+  BackendEvent event;
+  Module module;
+  TEST_CHECK(TestLaunch(&backend, path, &event, &module))
+  MemoryCache *memory_cache = CreateMemoryCache(&backend);
+  Agent agent = {};
+  agent.is_enabled = true;
+  Breakpoints breakpoints = {};
+  Stepper *stepper =
+      CreateStepper(&backend, memory_cache, &agent, &breakpoints);
+
+  const auto &instructions =
+      TestGetInstructions(memory_cache, module, "Count");
+  TEST_CHECK(instructions.size() > 2)
+  if (instructions.size() <= 2) {
+    TestKill(&backend);
+    return;
+  }
+  const DWORD64 address = instructions[0];
+  BYTE code[AGENT_MAX_LENGTH];
+  TEST_CHECK(BackendReadMemory(&backend, address, code, sizeof(code), NULL))
+
+  // Conditional breakpoint, as the debugger moves it into the target
+  Condition condition;
+  std::string error;
+  TEST_CHECK(ConditionCompile("edi == 2", ConditionResolve(), &condition,
+                              &error))
+  BreakpointsQueueInsert(&breakpoints, address, BreakpointType::USER);
+  TEST_CHECK(ApplyBreakpoints(&breakpoints, memory_cache))
+  Breakpoint &breakpoint = breakpoints.data[address];
+  TEST_CHECK(BreakpointsMoveToMemory(&breakpoints, memory_cache, &breakpoint))
+  TEST_CHECK(AgentAddSite(&agent, memory_cache, condition, address,
+                          breakpoint.original_instruction,
+                          instructions.back(), 0))
+  AgentSite *site = AgentFindSite(&agent, address);
+  TEST_CHECK(site && AgentInstallSite(memory_cache, site, 0))
+  TEST_CHECK(TestReadByte(&backend, address) == 0xe9)
+
+  // Next instruction is under the jump
+  const DWORD64 inner_address = instructions[1];
+  TEST_CHECK(site && inner_address < address + site->length)
+  StepperRemoveAgentSitesOver(stepper, inner_address);
+  BreakpointsQueueInsert(&breakpoints, inner_address,
+                         BreakpointType::TEMPORARY);
+  TEST_CHECK(ApplyBreakpoints(&breakpoints, memory_cache))
+  TEST_CHECK(site && !site->is_installed)
+  TEST_CHECK(TestReadByte(&backend, address) == 0xcc)
+  TEST_CHECK(TestReadByte(&backend, inner_address) == 0xcc)
+  TEST_CHECK(breakpoints.data[inner_address].original_instruction ==
+             code[inner_address - address])
+
+  StepperRemoveAgentSite(stepper, address, true);
+  BreakpointsQueueRemove(&breakpoints, address);
+  BreakpointsQueueRemove(&breakpoints, inner_address);
+  TEST_CHECK(ApplyBreakpoints(&breakpoints, memory_cache))
+  BYTE restored_code[AGENT_MAX_LENGTH];
+  TEST_CHECK(BackendReadMemory(&backend, address, restored_code,
+                               sizeof(restored_code), NULL))
+  TEST_CHECK(memcmp(code, restored_code, sizeof(code)) == 0)
+
+  TestKill(&backend);
+}
+
+// User breakpoints take the debug registers until they run out, then int3s
+// are used. Removing one frees it's slot for a watchpoint. A write watchpoint
+// on a variable of one thread triggers on that thread only.
+static void TestHardwareSlots(const std::string &path) {
+  Backend backend;
+  BackendEvent event;
+  Module module;
+  TEST_CHECK(TestLaunch(&backend, path, &event, &module))
+  MemoryCache *memory_cache = CreateMemoryCache(&backend);
+  Breakpoints breakpoints = {};
+
+  // One more than there are slots, on the first instructions of Count
+  const ModuleFunction *function = ModuleFindFunction(&module.index, "Count");
+  TEST_CHECK(function)
+  DWORD64 addresses[BACKEND_DEBUG_REGISTER_COUNT + 1] = {};
+  BYTE original_instructions[BACKEND_DEBUG_REGISTER_COUNT + 1] = {};
+  DWORD64 address = function ? module.base + function->start_rva : 0;
+  for (int i = 0; i < BACKEND_DEBUG_REGISTER_COUNT + 1 && address; ++i) {
+    BYTE code[INSTRUCTION_MAX_LENGTH];
+    SIZE_T size = 0;
+    MemoryCacheRead(memory_cache, address, code, sizeof(code), &size);
+    Instruction instruction;
+    TEST_CHECK(InstructionDecode(code, size, address, true, &instruction))
+
+    addresses[i] = address;
+    original_instructions[i] = code[0];
+    BreakpointsQueueInsert(&breakpoints, address, BreakpointType::USER);
+    address += instruction.length;
+  }
+  TEST_CHECK(ApplyBreakpoints(&breakpoints, memory_cache))
+
+  for (int i = 0; i < BACKEND_DEBUG_REGISTER_COUNT; ++i) {
+    const Breakpoint &breakpoint = breakpoints.data[addresses[i]];
+    TEST_CHECK(breakpoint.hardware_slot == i)
+    TEST_CHECK(breakpoints.hardware_slots[i].is_used)
+    TEST_CHECK(breakpoints.hardware_slots[i].address == addresses[i])
+    TEST_CHECK(backend.debug_control & BACKEND_DEBUG_ENABLE(i))
+    TEST_CHECK(TestReadByte(&backend, addresses[i]) ==
+               original_instructions[i])
+  }
+
+  // Fifth falls back to an int3
+  const DWORD64 int3_address = addresses[BACKEND_DEBUG_REGISTER_COUNT];
+  TEST_CHECK(breakpoints.data[int3_address].hardware_slot == -1)
+  TEST_CHECK(TestReadByte(&backend, int3_address) == 0xcc)
+
+  const DWORD64 watched_address =
+      TestFindVariable(path, module.base, "global_odd_counts") +
+      TEST_WATCHED_INDEX * sizeof(long);
+  TEST_CHECK(watched_address > TEST_WATCHED_INDEX * sizeof(long))
+  TEST_CHECK(!BreakpointsAddWatchpoint(&breakpoints, &backend,
+                                       watched_address, sizeof(long),
+                                       BreakpointAccess::WRITE))
+
+  // Slots are freed as their breakpoints go
+  BreakpointsQueueRemove(&breakpoints, addresses[1]);
+  TEST_CHECK(ApplyBreakpoints(&breakpoints, memory_cache))
+  TEST_CHECK(!breakpoints.data.count(addresses[1]))
+  TEST_CHECK(!breakpoints.hardware_slots[1].is_used)
+  TEST_CHECK(!(backend.debug_control & BACKEND_DEBUG_ENABLE(1)))
+  TEST_CHECK(backend.debug_control & BACKEND_DEBUG_ENABLE(0))
+
+  for (int i = 0; i < BACKEND_DEBUG_REGISTER_COUNT + 1; ++i) {
+    BreakpointsQueueRemove(&breakpoints, addresses[i]);
+  }
+  TEST_CHECK(ApplyBreakpoints(&breakpoints, memory_cache))
+  TEST_CHECK(breakpoints.data.empty())
+  TEST_CHECK(backend.debug_control == 0)
+  TEST_CHECK(TestReadByte(&backend, int3_address) ==
+             original_instructions[BACKEND_DEBUG_REGISTER_COUNT])
+  for (const HardwareSlot &slot : breakpoints.hardware_slots) {
+    TEST_CHECK(!slot.is_used)
+  }
+
+  // Watchpoints free theirs the same way
+  TEST_CHECK(BreakpointsAddWatchpoint(&breakpoints, &backend, watched_address,
+                                      sizeof(long), BreakpointAccess::WRITE))
+  TEST_CHECK(BreakpointsRemoveWatchpoint(&breakpoints, &backend,
+                                         watched_address))
+  TEST_CHECK(backend.debug_control == 0)
+  TEST_CHECK(BreakpointsAddWatchpoint(&breakpoints, &backend, watched_address,
+                                      sizeof(long), BreakpointAccess::WRITE))
+  TEST_CHECK(breakpoints.hardware_slots[0].is_used)
+
+  // Threads started after it get the debug registers too
+  std::set<DWORD> hit_thread_ids;
+  DWORD64 hit_count = 0;
+  DWORD exit_code = (DWORD)-1;
+  BackendContinue(&backend, event, true);
+  while (BackendWaitForEvent(&backend, &event, 5000) &&
+         event.type != BackendEventType::NONE) {
+    if (event.type == BackendEventType::EXIT_PROCESS) {
+      exit_code = event.code;
+      break;
+    }
+
+    bool is_handled = true;
+    if (event.type == BackendEventType::HARDWARE_BREAKPOINT) {
+      TEST_CHECK(event.hardware_slots == 1)
+      hit_thread_ids.insert(event.thread_id);
+      ++hit_count;
+    } else if (event.type == BackendEventType::EXCEPTION) {
+      is_handled = false;
+    }
+    BackendContinue(&backend, event, is_handled);
+  }
+
+  TEST_CHECK(exit_code == 0)
+  TEST_CHECK(hit_count == TEST_COUNT)
+  TEST_CHECK(hit_thread_ids.size() == 1)
+  TEST_CHECK(!hit_thread_ids.count((DWORD)backend.process_id))
+
+  if (exit_code != 0) {
+    TestKill(&backend);
+  }
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+
+  const std::string path = TestGetTargetPath(argv[0], "threads");
+
+  Global_TestIsLogMuted = true;
+
+  TestApplyPages(TestGetTargetPath(argv[0], "big"));
+  TestAgentOverlap(path);
+  TestHardwareSlots(path);
+
+  return TestFinish("breakpoint_test");
+}
@@ -0,0 +1,110 @@
+#define TEST_WITH_TARGET
+#include "test.h"
+
+#include "../condition.h"
+#include "../agent.h"
+#include "../breakpoint.h"
+#include "../command_queue.h"
+#include "../condition.cpp"
+#include "../agent.cpp"
+#include "../breakpoint.cpp"
+#include "../command_queue.cpp"
+
+#define TEST_IDLE_MS 300
+
+// CPU time of the calling thread
+static double TestGetThreadSeconds() {
+  timespec time;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+  return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// Same loop as DebuggerRun: events that are there are handled, then the
+// thread blocks on the queue until the backend or a command wakes it. Stops
+// on a command or once "type" comes, it's in "event", NONE for a command.
+// Returns the number of times the thread was woken.
+static size_t TestRunUntil(Backend *backend,
+                           DebuggerCommandQueue *command_queue,
+                           BackendEventType type, BackendEvent *event) {
+  size_t wake_count = 0;
+  while (true) {
+    TEST_CHECK(BackendWaitForEvent(backend, event, 0))
+    if (event->type == type) {
+      return wake_count;
+    }
+
+    if (event->type != BackendEventType::NONE) {
+      BackendContinue(backend, *event, true);
+      continue;
+    }
+
+    DebuggerCommand command;
+    if (DebuggerCommandQueueTryPop(command_queue, &command)) {
+      *event = {};
+      return wake_count;
+    }
+
+    DebuggerCommandQueueWait(command_queue);
+    ++wake_count;
+  }
+}
+
+// targets/spin runs without events after it's thread is created. Nothing
+// wakes the debugger thread then, until a command comes. Exit of the target
+// wakes it too.
+static void TestBlockingWait(const std::string &path) {
+  DebuggerCommandQueue command_queue = {};
+
+  Backend backend;
+  backend.OnEvent = [&]() { DebuggerCommandQueueWake(&command_queue); };
+
+  BackendEvent event;
+  TEST_CHECK(TestLaunch(&backend, path, &event, NULL))
+  BackendContinue(&backend, event, true);
+
+  // Creation of the spinning thread comes through the wake
+  TestRunUntil(&backend, &command_queue, BackendEventType::CREATE_THREAD,
+               &event);
+  TEST_CHECK(event.type == BackendEventType::CREATE_THREAD)
+  BackendContinue(&backend, event, true);
+
+  std::thread ui([&]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(TEST_IDLE_MS));
+    DebuggerCommand command = {};
+    command.type = DebuggerCommandType::CONTINUE;
+    DebuggerCommandQueuePush(&command_queue, command);
+  });
+
+  const auto start = std::chrono::steady_clock::now();
+  const double cpu_start = TestGetThreadSeconds();
+  const size_t wake_count = TestRunUntil(
+      &backend, &command_queue, BackendEventType::EXIT_PROCESS, &event);
+  const double cpu_seconds = TestGetThreadSeconds() - cpu_start;
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  ui.join();
+
+  // Woken by the command alone, 10 ms of polling would wake it 30 times
+  TEST_CHECK(event.type == BackendEventType::NONE)
+  TEST_CHECK(elapsed >= std::chrono::milliseconds(TEST_IDLE_MS))
+  TEST_CHECK(wake_count <= 2)
+  TEST_CHECK(cpu_seconds < 0.01)
+
+  kill(backend.process_id, SIGKILL);
+  TestRunUntil(&backend, &command_queue, BackendEventType::EXIT_PROCESS,
+               &event);
+  TEST_CHECK(event.type == BackendEventType::EXIT_PROCESS)
+  BackendContinue(&backend, event, true);
+
+  BackendStopEventThread(&backend);
+  close(backend.signal_file);
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+
+  Global_TestIsLogMuted = true;
+
+  TestBlockingWait(TestGetTargetPath(argv[0], "spin"));
+
+  return TestFinish("command_queue_test");
+}
@@ -0,0 +1,151 @@
+#include "test.h"
+
+#include "../registers.h"
+#include "../backend.h"
+#include "../memory_cache.h"
+#include "../condition.h"
+#include "../registers.cpp"
+#include "../backend_ptrace.cpp"
+#include "../memory_cache.cpp"
+#include "../condition.cpp"
+
+#define CV_REG_EBP 22
+#define CV_AMD64_RSP 335
+#define CV_AMD64_R13 341
+
+// Stand-in of a stack frame, read back through process_vm_readv of the test
+// process itself
+static int64_t Global_ConditionTestFrame[16];
+
+static bool ConditionTestRun(const std::string &text,
+                             const ConditionVariable &variable,
+                             const ConditionContext &context, bool *result,
+                             Condition *condition) {
+  std::string error;
+  if (!ConditionCompile(
+          text,
+          [&](const std::string &name, ConditionVariable *resolved) {
+            if (name != "count") {
+              return false;
+            }
+            *resolved = variable;
+            return true;
+          },
+          condition, &error)) {
+    return false;
+  }
+
+  return ConditionEvaluate(*condition, context, result);
+}
+
+static void TestCvRegisters() {
+  TEST_CHECK(ConditionFindCvRegister(CV_REG_EBP) ==
+             ConditionFindRegister("ebp"))
+  TEST_CHECK(ConditionFindCvRegister(CV_AMD64_RSP) ==
+             ConditionFindRegister("esp"))
+  TEST_CHECK(ConditionFindCvRegister(CV_AMD64_R13) ==
+             ConditionFindRegister("r13"))
+  TEST_CHECK(ConditionFindCvRegister(0) == -1)
+  TEST_CHECK(ConditionFindCvRegister(30006) == -1) // CV_ALLREG_VFRAME
+}
+
+// x64 MSVC locals are rsp relative, read from rsp at the hit, not from rbp
+static void TestRegisterRelative(MemoryCache *memory_cache) {
+  Registers registers = {};
+  registers.Rsp = (DWORD64)Global_ConditionTestFrame;
+  registers.Rbp = registers.Rsp + 0x40;
+  Global_ConditionTestFrame[4] = -5;
+
+  ConditionVariable variable = {};
+  variable.register_index = ConditionFindCvRegister(CV_AMD64_RSP);
+  variable.offset = 4 * sizeof(int64_t);
+  variable.size = 4;
+  variable.is_signed = true;
+
+  ConditionContext context = {};
+  context.registers = &registers;
+  context.memory_cache = memory_cache;
+
+  Condition condition;
+  bool result = false;
+  TEST_CHECK(ConditionTestRun("count == -5 && count < 0", variable, context,
+                              &result, &condition))
+  TEST_CHECK(result)
+  TEST_CHECK(!condition.is_frame_relative)
+
+  MemoryCacheInvalidate(memory_cache);
+  Global_ConditionTestFrame[4] = 7;
+  TEST_CHECK(ConditionTestRun("count == -5", variable, context, &result,
+                              &condition))
+  TEST_CHECK(!result)
+
+  // Negative offsets from a register
+  MemoryCacheInvalidate(memory_cache);
+  registers.Rsp += 8 * sizeof(int64_t);
+  variable.offset = (DWORD64)(-4 * (int64_t)sizeof(int64_t));
+  TEST_CHECK(ConditionTestRun("count == 7", variable, context, &result,
+                              &condition))
+  TEST_CHECK(result)
+}
+
+static void TestFrameRelative(MemoryCache *memory_cache) {
+  Registers registers = {};
+  Global_ConditionTestFrame[10] = 42;
+
+  ConditionVariable variable = {};
+  variable.register_index = CONDITION_REGISTER_FRAME;
+  variable.offset = 2 * sizeof(int64_t);
+  variable.size = 8;
+  variable.is_signed = true;
+
+  ConditionContext context = {};
+  context.registers = &registers;
+  context.memory_cache = memory_cache;
+  context.frame_pointer = (DWORD64)&Global_ConditionTestFrame[8];
+
+  MemoryCacheInvalidate(memory_cache);
+  Condition condition;
+  bool result = false;
+  TEST_CHECK(ConditionTestRun("count * 2 == 84", variable, context, &result,
+                              &condition))
+  TEST_CHECK(result)
+  TEST_CHECK(condition.is_frame_relative)
+}
+
+static void TestErrors(MemoryCache *memory_cache) {
+  Registers registers = {};
+  ConditionVariable variable = {};
+  variable.register_index = -1;
+  variable.offset = 16; // Never mapped
+  variable.size = 4;
+
+  ConditionContext context = {};
+  context.registers = &registers;
+  context.memory_cache = memory_cache;
+
+  Condition condition;
+  bool result = false;
+  TEST_CHECK(!ConditionTestRun("other == 1", variable, context, &result,
+                               &condition))
+  TEST_CHECK(!ConditionTestRun("count ==", variable, context, &result,
+                               &condition))
+  TEST_CHECK(!ConditionTestRun("count == 1", variable, context, &result,
+                               &condition))
+  TEST_CHECK(!ConditionTestRun("1 / (esp - esp)", variable, context, &result,
+                               &condition))
+}
+
+int main() {
+  Global_TestIsLogMuted = true;
+
+  Backend backend = {};
+  backend.process_id = (DWORD)getpid();
+  MemoryCache *memory_cache = CreateMemoryCache(&backend);
+
+  TestCvRegisters();
+  TestRegisterRelative(memory_cache);
+  TestFrameRelative(memory_cache);
+  TestErrors(memory_cache);
+
+  return TestFinish("condition_test");
+}
@@ -0,0 +1,66 @@
+#define TEST_WITH_TARGET
+#include "test.h"
+
+#define BENCH_RUN_COUNT 5
+
+static size_t Global_BenchAllocationCount;
+
+void *operator new(size_t size) {
+  ++Global_BenchAllocationCount;
+  if (void *result = malloc(size ? size : 1)) {
+    return result;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept { free(pointer); }
+void operator delete(void *pointer, size_t) noexcept { free(pointer); }
+
+// Indexes a -g binary, targets/units unless a path is given. A debug build
+// of a big project is the interesting one.
+int main(int argc, char **argv) {
+  const std::string path =
+      argc > 1 ? argv[1] : TestGetTargetPath(argv[0], "units");
+
+  ElfFile elf_file;
+  if (!ElfFileMap(&elf_file, path)) {
+    printf("elf_reader_bench: %s is not an ELF file\n", path.c_str());
+    return 1;
+  }
+  const double file_size = elf_file.size / 1e6;
+  const double debug_line_size = elf_file.debug_line.size / 1e6;
+  const double debug_info_size = elf_file.debug_info.size / 1e6;
+  ElfFileUnmap(&elf_file);
+
+  double best_seconds = 1e9;
+  size_t allocation_count = 0;
+  ModuleIndex module_index;
+  for (int run = 0; run < BENCH_RUN_COUNT; ++run) {
+    module_index = ModuleIndex();
+    UnwindTable unwind_table;
+
+    const size_t allocations_before = Global_BenchAllocationCount;
+    const double start = TestGetSeconds();
+    if (!ElfLoadModuleIndex(path, &module_index, &unwind_table)) {
+      printf("elf_reader_bench: can't read %s\n", path.c_str());
+      return 1;
+    }
+    best_seconds = std::min(best_seconds, TestGetSeconds() - start);
+    allocation_count = Global_BenchAllocationCount - allocations_before;
+  }
+
+  const size_t line_count = module_index.lines.size();
+  const size_t function_count = module_index.functions.size();
+  printf("elf_reader_bench: %s, %.1f MB, .debug_line %.1f MB, "
+         ".debug_info %.1f MB\n",
+         path.c_str(), file_size, debug_line_size, debug_info_size);
+  printf("  %zu files, %zu lines, %zu functions, %zu inline sites\n",
+         module_index.source_files.size(), line_count, function_count,
+         module_index.inline_sites.size());
+  printf("  indexed in %.2f ms, %.1f M lines/s, %.0f MB/s of .debug_line\n",
+         best_seconds * 1e3, line_count / best_seconds / 1e6,
+         debug_line_size / best_seconds);
+  printf("  %zu heap allocations\n", allocation_count);
+
+  return 0;
+}
@@ -0,0 +1,97 @@
+#include "test.h"
+#include <link.h>
+
+#include "../registers.h"
+#include "../backend.h"
+#include "../memory_cache.h"
+#include "../dwarf.h"
+#include "../unwinder.h"
+#include "../module_index.h"
+#include "../elf_reader.h"
+#include "../module_loader.h"
+#include "../registers.cpp"
+#include "../backend_ptrace.cpp"
+#include "../memory_cache.cpp"
+#include "../dwarf.cpp"
+#include "../unwinder.cpp"
+#include "../elf_reader.cpp"
+#include "../module_loader.cpp"
+
+static const DWORD Global_ElfTestMarkerLine = __LINE__ + 1;
+extern "C" __attribute__((noinline)) int ElfTestMarker(int value) {
+  return value * 3 + 1;
+}
+
+// Address the test binary got mapped at, where it's lowest PT_LOAD goes
+static DWORD64 ElfTestGetBias() {
+  DWORD64 result = 0;
+  dl_iterate_phdr(
+      [](dl_phdr_info *info, size_t, void *data) {
+        *(DWORD64 *)data = info->dlpi_addr;
+        return 1; // Main program comes first
+      },
+      &result);
+
+  return result;
+}
+
+// Reads the test binary itself and checks what the compiler put there
+static void TestSelf() {
+  Module module;
+  TEST_CHECK(ModuleLoad(NULL, NULL, "/proc/self/exe", 0, &module))
+  const ModuleIndex &index = module.index;
+  TEST_CHECK(!index.functions.empty())
+  TEST_CHECK(!index.lines.empty())
+
+  for (size_t i = 1; i < index.functions.size(); ++i) {
+    TEST_CHECK(index.functions[i - 1].start_rva < index.functions[i].start_rva)
+  }
+
+  const ModuleFunction *function = ModuleFindFunction(&index, "ElfTestMarker");
+  TEST_CHECK(function)
+  if (!function) {
+    return;
+  }
+
+  ElfFile elf_file;
+  TEST_CHECK(ElfFileMap(&elf_file, "/proc/self/exe"))
+  const DWORD64 rva =
+      (DWORD64)&ElfTestMarker - ElfTestGetBias() - elf_file.load_address;
+  ElfFileUnmap(&elf_file);
+  TEST_CHECK(function->start_rva == rva)
+
+  // Lines of the marker are in this file, around it's definition
+  size_t line_count = 0;
+  for (const ModuleLine &line : index.lines) {
+    if (line.rva < function->start_rva || line.rva >= function->end_rva) {
+      continue;
+    }
+
+    const std::string &file = index.source_files[line.file_index];
+    TEST_CHECK(file.size() >= strlen("elf_reader_test.cpp") &&
+               file.compare(file.size() - strlen("elf_reader_test.cpp"),
+                            std::string::npos, "elf_reader_test.cpp") == 0)
+    TEST_CHECK(line.line >= Global_ElfTestMarkerLine &&
+               line.line <= Global_ElfTestMarkerLine + 2)
+    ++line_count;
+  }
+  TEST_CHECK(line_count > 0)
+
+  TEST_CHECK(ModuleFindFunctionAt(&index, function->start_rva) == function)
+  TEST_CHECK(ModuleFindFunctionAt(&index, function->end_rva - 1) == function)
+}
+
+static void TestNotElf() {
+  Module module;
+  TEST_CHECK(!ModuleLoad(NULL, NULL, "/proc/self/status", 0, &module))
+  TEST_CHECK(!ModuleLoad(NULL, NULL, "/nonexistent", 0, &module))
+}
+
+int main() {
+  Global_TestIsLogMuted = true;
+
+  TestSelf();
+  TestNotElf();
+
+  return TestFinish("elf_reader_test");
+}
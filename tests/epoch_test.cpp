@@ -0,0 +1,117 @@
+#include "test.h"
+
+#include "../epoch.h"
+#include "../epoch.cpp"
+
+#define EPOCH_TEST_READERS (EPOCH_MAX_READERS - 1)
+#define EPOCH_TEST_PUBLISHES 20000
+
+static std::atomic<size_t> Global_EpochTestAliveCount;
+
+// "version" is stored twice, a reader seeing them differ has read an object
+// that was deleted under it
+struct EpochTestObject {
+  DWORD64 version;
+  std::vector<DWORD64> versions;
+
+  ~EpochTestObject() {
+    version = ~0ull;
+    versions.clear();
+    --Global_EpochTestAliveCount;
+  }
+};
+
+static const EpochTestObject *EpochTestCreate(DWORD64 version) {
+  auto result = new EpochTestObject();
+  result->version = version;
+  result->versions.assign(4, version);
+  ++Global_EpochTestAliveCount;
+  return result;
+}
+
+// Single writer publishes while the readers check every object they load
+static void TestStress() {
+  EpochDomain epoch_domain;
+  EpochInitialize(&epoch_domain);
+  std::atomic<const EpochTestObject *> published{nullptr};
+  EpochPublish(&epoch_domain, &published, EpochTestCreate(0));
+
+  std::atomic<bool> is_stopped{false};
+  std::atomic<size_t> read_count{0};
+  std::atomic<size_t> bad_read_count{0};
+
+  std::vector<std::thread> readers;
+  for (size_t reader = 1; reader <= EPOCH_TEST_READERS; ++reader) {
+    readers.emplace_back([&, reader]() {
+      DWORD64 previous_version = 0;
+      while (!is_stopped.load()) {
+        EpochEnter(&epoch_domain, reader);
+        const EpochTestObject *object = published.load();
+        const DWORD64 version = object->version;
+        bool is_good = version >= previous_version &&
+                       object->versions.size() == 4;
+        for (DWORD64 other_version : object->versions) {
+          is_good = is_good && other_version == version;
+        }
+        EpochExit(&epoch_domain, reader);
+
+        previous_version = version;
+        bad_read_count += !is_good;
+        ++read_count;
+      }
+    });
+  }
+
+  for (DWORD64 version = 1; version <= EPOCH_TEST_PUBLISHES; ++version) {
+    EpochPublish(&epoch_domain, &published, EpochTestCreate(version));
+    if (version % 64 == 0) {
+      std::this_thread::yield();
+    }
+  }
+
+  is_stopped.store(true);
+  for (auto &reader : readers) {
+    reader.join();
+  }
+
+  TEST_CHECK(bad_read_count.load() == 0)
+  TEST_CHECK(read_count.load() > 0)
+
+  // No reader is inside a section, all but the published one go
+  EpochCollect(&epoch_domain);
+  TEST_CHECK(epoch_domain.retired.empty())
+  TEST_CHECK(Global_EpochTestAliveCount.load() == 1)
+  TEST_CHECK(published.load()->version == EPOCH_TEST_PUBLISHES)
+
+  delete published.load();
+}
+
+// Object replaced while a reader is inside waits for its EpochExit
+static void TestReaderHoldsObject() {
+  EpochDomain epoch_domain;
+  EpochInitialize(&epoch_domain);
+  std::atomic<const EpochTestObject *> published{nullptr};
+  EpochPublish(&epoch_domain, &published, EpochTestCreate(0));
+
+  EpochEnter(&epoch_domain, EPOCH_READER_UI);
+  const EpochTestObject *object = published.load();
+
+  EpochPublish(&epoch_domain, &published, EpochTestCreate(1));
+  EpochPublish(&epoch_domain, &published, EpochTestCreate(2));
+  TEST_CHECK(epoch_domain.retired.size() == 2)
+  TEST_CHECK(object->version == 0)
+
+  EpochExit(&epoch_domain, EPOCH_READER_UI);
+  EpochCollect(&epoch_domain);
+  TEST_CHECK(epoch_domain.retired.empty())
+  TEST_CHECK(Global_EpochTestAliveCount.load() == 1)
+
+  delete published.load();
+}
+
+int main() {
+  TestReaderHoldsObject();
+  TestStress();
+
+  return TestFinish("epoch_test");
+}
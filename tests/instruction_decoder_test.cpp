@@ -0,0 +1,235 @@
+#include "test.h"
+
+#include "../instruction_decoder.h"
+#include "../instruction_decoder.cpp"
+
+struct DecoderTestCase {
+  const char *text; // Mnemonic, as objdump prints it
+  DWORD64 address;
+  const char *code; // Hex
+  InstructionType type;
+  bool is_relative;
+  DWORD64 target;
+};
+
+// Assembled with GNU as and listed by objdump. Covers prefixes, REX, VEX,
+// EVEX, ModRM/SIB forms, RIP relative operands and rel8/rel32 branches.
+static const DecoderTestCase Global_DecoderTestCases64[] = {
+    {"nop", 0x0, "90", InstructionType::OTHER, false, 0},
+    {"ret", 0x1, "c3", InstructionType::RETURN, false, 0},
+    {"ret", 0x2, "c20800", InstructionType::RETURN, false, 0},
+    {"lretq", 0x5, "48cb", InstructionType::RETURN, false, 0},
+    {"push", 0x7, "55", InstructionType::OTHER, false, 0},
+    {"push", 0x8, "4154", InstructionType::OTHER, false, 0},
+    {"mov", 0xa, "4889e5", InstructionType::OTHER, false, 0},
+    {"mov", 0xd, "4989c7", InstructionType::OTHER, false, 0},
+    {"add", 0x10, "83c001", InstructionType::OTHER, false, 0},
+    {"add", 0x13, "480578563412", InstructionType::OTHER, false, 0},
+    {"movabs", 0x19, "48b88877665544332211", InstructionType::OTHER, false, 0},
+    {"mov", 0x23, "41bb44332211", InstructionType::OTHER, false, 0},
+    {"movabs", 0x29, "a08877665544332211", InstructionType::OTHER, false, 0},
+    {"movabs", 0x32, "a38877665544332211", InstructionType::OTHER, false, 0},
+    {"mov", 0x3b, "488b442410", InstructionType::OTHER, false, 0},
+    {"mov", 0x40, "8b0c98", InstructionType::OTHER, false, 0},
+    {"mov", 0x43, "8b14cd78563412", InstructionType::OTHER, false, 0},
+    {"mov", 0x4a, "488b0424", InstructionType::OTHER, false, 0},
+    {"mov", 0x4e, "498b4500", InstructionType::OTHER, false, 0},
+    {"mov", 0x52, "498b0424", InstructionType::OTHER, false, 0},
+    {"mov", 0x56, "488b4508", InstructionType::OTHER, false, 0},
+    {"lea", 0x5a, "488d0500010000", InstructionType::OTHER, false, 0},
+    {"mov", 0x61, "488b0d20000000", InstructionType::OTHER, false, 0},
+    {"cmpl", 0x68, "833d1000000005", InstructionType::OTHER, false, 0},
+    {"movl", 0x6f, "c7051000000044332211", InstructionType::OTHER, false, 0},
+    {"movw", 0x79, "66c705100000002211", InstructionType::OTHER, false, 0},
+    {"test", 0x82, "a944332211", InstructionType::OTHER, false, 0},
+    {"testl", 0x87, "f70044332211", InstructionType::OTHER, false, 0},
+    {"testb", 0x8d, "f60007", InstructionType::OTHER, false, 0},
+    {"notl", 0x90, "f710", InstructionType::OTHER, false, 0},
+    {"imul", 0x92, "69c8e8030000", InstructionType::OTHER, false, 0},
+    {"imul", 0x98, "6bc80a", InstructionType::OTHER, false, 0},
+    {"add", 0x9b, "6601c3", InstructionType::OTHER, false, 0},
+    {"mov", 0x9e, "66b82211", InstructionType::OTHER, false, 0},
+    {"cmpxchg", 0xa2, "f0480fb10a", InstructionType::OTHER, false, 0},
+    {"movsb", 0xa7, "f3a4", InstructionType::OTHER, false, 0},
+    {"scas", 0xa9, "f2ae", InstructionType::OTHER, false, 0},
+    {"mov", 0xab, "678b00", InstructionType::OTHER, false, 0},
+    {"mov", 0xae, "64488b00", InstructionType::OTHER, false, 0},
+    {"movzbl", 0xb2, "0fb600", InstructionType::OTHER, false, 0},
+    {"movsbq", 0xb5, "480fbec0", InstructionType::OTHER, false, 0},
+    {"cmove", 0xb9, "480f44c8", InstructionType::OTHER, false, 0},
+    {"sete", 0xbd, "0f94c0", InstructionType::OTHER, false, 0},
+    {"bt", 0xc0, "0fbae003", InstructionType::OTHER, false, 0},
+    {"shld", 0xc4, "0fa4c104", InstructionType::OTHER, false, 0},
+    {"cpuid", 0xc8, "0fa2", InstructionType::OTHER, false, 0},
+    {"rdtsc", 0xca, "0f31", InstructionType::OTHER, false, 0},
+    {"syscall", 0xcc, "0f05", InstructionType::OTHER, false, 0},
+    {"ud2", 0xce, "0f0b", InstructionType::OTHER, false, 0},
+    {"int3", 0xd0, "cc", InstructionType::OTHER, false, 0},
+    {"int", 0xd1, "cd80", InstructionType::OTHER, false, 0},
+    {"hlt", 0xd3, "f4", InstructionType::OTHER, false, 0},
+    {"pause", 0xd4, "f390", InstructionType::OTHER, false, 0},
+    {"endbr64", 0xd6, "f30f1efa", InstructionType::OTHER, false, 0},
+    {"nopw", 0xda, "660f1f0400", InstructionType::OTHER, false, 0},
+    {"nopl", 0xdf, "0f1f00", InstructionType::OTHER, false, 0},
+    {"nopw", 0xe2, "662e0f1f840000000000", InstructionType::OTHER, false, 0},
+    {"movaps", 0xec, "0f28c8", InstructionType::OTHER, false, 0},
+    {"movdqu", 0xef, "f30f6f10", InstructionType::OTHER, false, 0},
+    {"pshufd", 0xf3, "660f70c81b", InstructionType::OTHER, false, 0},
+    {"pshufb", 0xf8, "660f3800c1", InstructionType::OTHER, false, 0},
+    {"palignr", 0xfd, "660f3a0fc104", InstructionType::OTHER, false, 0},
+    {"pinsrd", 0x103, "660f3a22c001", InstructionType::OTHER, false, 0},
+    {"crc32", 0x109, "f2480f38f1c8", InstructionType::OTHER, false, 0},
+    {"vmovaps", 0x10f, "c5fc28c8", InstructionType::OTHER, false, 0},
+    {"vaddps", 0x113, "c5f458c2", InstructionType::OTHER, false, 0},
+    {"vmovdqu", 0x117, "c57e6f445810", InstructionType::OTHER, false, 0},
+    {"vpshufd", 0x11d, "c5fd70c81b", InstructionType::OTHER, false, 0},
+    {"vpermq", 0x122, "c4e3fd00c84e", InstructionType::OTHER, false, 0},
+    {"vblendvps", 0x128, "c4e3714ac230", InstructionType::OTHER, false, 0},
+    {"vfmadd231ps", 0x12e, "c4e275b8c2", InstructionType::OTHER, false, 0},
+    {"vmovaps", 0x133, "c5f8280540000000", InstructionType::OTHER, false, 0},
+    {"vzeroupper", 0x13b, "c5f877", InstructionType::OTHER, false, 0},
+    {"andn", 0x13e, "c4e260f2c8", InstructionType::OTHER, false, 0},
+    {"vaddps", 0x143, "62f1744858c2", InstructionType::OTHER, false, 0},
+    {"vmovdqu64", 0x149, "62f1fe486f4801", InstructionType::OTHER, false, 0},
+    {"call", 0x150, "e8abfeffff", InstructionType::CALL, true, 0x0},
+    {"call", 0x155, "ffd0", InstructionType::CALL, false, 0},
+    {"call", 0x157, "ff1510000000", InstructionType::CALL, false, 0},
+    {"call", 0x15d, "ff14d8", InstructionType::CALL, false, 0},
+    {"jmp", 0x160, "e99bfeffff", InstructionType::JUMP, true, 0x0},
+    {"jmp", 0x165, "eb31", InstructionType::JUMP, true, 0x198},
+    {"jmp", 0x167, "ffe0", InstructionType::JUMP, false, 0},
+    {"jmp", 0x169, "ff2510000000", InstructionType::JUMP, false, 0},
+    {"jmp", 0x16f, "3effe0", InstructionType::JUMP, false, 0},
+    {"je", 0x172, "0f8488feffff", InstructionType::CONDITIONAL_JUMP, true, 0x0},
+    {"jne", 0x178, "751e", InstructionType::CONDITIONAL_JUMP, true, 0x198},
+    {"jg", 0x17a, "7f1c", InstructionType::CONDITIONAL_JUMP, true, 0x198},
+    {"jrcxz", 0x17c, "e31a", InstructionType::CONDITIONAL_JUMP, true, 0x198},
+    {"loop", 0x17e, "e218", InstructionType::CONDITIONAL_JUMP, true, 0x198},
+    {"loope", 0x180, "e116", InstructionType::CONDITIONAL_JUMP, true, 0x198},
+    {"loopne", 0x182, "e014", InstructionType::CONDITIONAL_JUMP, true, 0x198},
+    {"je", 0x184, "0f843b010000",
+     InstructionType::CONDITIONAL_JUMP, true, 0x2c5},
+    {"jl", 0x18a, "0f8c35010000",
+     InstructionType::CONDITIONAL_JUMP, true, 0x2c5},
+    {"jmp", 0x190, "f2e92f010000", InstructionType::JUMP, true, 0x2c5},
+    {"ret", 0x196, "f2c3", InstructionType::RETURN, false, 0},
+    {"ret", 0x2c5, "c3", InstructionType::RETURN, false, 0},
+};
+
+// 32-bit only encodings, les/lds/bound, inc/dec, far branches and 16-bit
+// address and operand sizes
+static const DecoderTestCase Global_DecoderTestCases32[] = {
+    {"push", 0x0, "55", InstructionType::OTHER, false, 0},
+    {"mov", 0x1, "89e5", InstructionType::OTHER, false, 0},
+    {"mov", 0x3, "8b4508", InstructionType::OTHER, false, 0},
+    {"mov", 0x6, "8b0c98", InstructionType::OTHER, false, 0},
+    {"mov", 0x9, "a144332211", InstructionType::OTHER, false, 0},
+    {"mov", 0xe, "a344332211", InstructionType::OTHER, false, 0},
+    {"inc", 0x13, "40", InstructionType::OTHER, false, 0},
+    {"dec", 0x14, "49", InstructionType::OTHER, false, 0},
+    {"les", 0x15, "c400", InstructionType::OTHER, false, 0},
+    {"lds", 0x17, "c500", InstructionType::OTHER, false, 0},
+    {"bound", 0x19, "6201", InstructionType::OTHER, false, 0},
+    {"vaddps", 0x1b, "c5f458c2", InstructionType::OTHER, false, 0},
+    {"vmovaps", 0x1f, "c5f828c8", InstructionType::OTHER, false, 0},
+    {"pusha", 0x23, "60", InstructionType::OTHER, false, 0},
+    {"popa", 0x24, "61", InstructionType::OTHER, false, 0},
+    {"mov", 0x25, "67668b00", InstructionType::OTHER, false, 0},
+    {"mov", 0x29, "66b82211", InstructionType::OTHER, false, 0},
+    {"ret", 0x2d, "c3", InstructionType::RETURN, false, 0},
+    {"lret", 0x2e, "ca0400", InstructionType::RETURN, false, 0},
+    {"call", 0x31, "e8caffffff", InstructionType::CALL, true, 0x0},
+    {"call", 0x36, "ffd0", InstructionType::CALL, false, 0},
+    {"call", 0x38, "ff5010", InstructionType::CALL, false, 0},
+    {"lcall", 0x3b, "9a443322111000", InstructionType::CALL, false, 0},
+    {"ljmp", 0x42, "ea443322111000", InstructionType::JUMP, false, 0},
+    {"jmp", 0x49, "ebb5", InstructionType::JUMP, true, 0x0},
+    {"jmp", 0x4b, "eb0f", InstructionType::JUMP, true, 0x5c},
+    {"je", 0x4d, "74b1", InstructionType::CONDITIONAL_JUMP, true, 0x0},
+    {"jne", 0x4f, "750b", InstructionType::CONDITIONAL_JUMP, true, 0x5c},
+    {"jecxz", 0x51, "e309", InstructionType::CONDITIONAL_JUMP, true, 0x5c},
+    {"loop", 0x53, "e207", InstructionType::CONDITIONAL_JUMP, true, 0x5c},
+    {"jcxz", 0x55, "67e304", InstructionType::CONDITIONAL_JUMP, true, 0x5c},
+    {"callw", 0x58, "66e8a4ff", InstructionType::CALL, true, 0x0},
+    {"ret", 0x5c, "c3", InstructionType::RETURN, false, 0},
+};
+
+static size_t DecoderTestParse(const char *text, BYTE *code) {
+  size_t size = 0;
+  for (; text[0] && text[1]; text += 2) {
+    const char digits[3] = {text[0], text[1], '\0'};
+    code[size++] = (BYTE)strtoul(digits, NULL, 16);
+  }
+
+  return size;
+}
+
+static void TestCases(const DecoderTestCase *cases, size_t count,
+                      bool is_64bit) {
+  for (size_t i = 0; i < count; ++i) {
+    const DecoderTestCase &test_case = cases[i];
+    BYTE code[INSTRUCTION_MAX_LENGTH + 1];
+    const size_t size = DecoderTestParse(test_case.code, code);
+
+    Instruction instruction;
+    const bool is_decoded = InstructionDecode(code, size, test_case.address,
+                                              is_64bit, &instruction);
+    const bool is_good =
+        is_decoded && instruction.length == size &&
+        instruction.type == test_case.type &&
+        instruction.is_relative == test_case.is_relative &&
+        (!test_case.is_relative || instruction.target == test_case.target);
+    if (!is_good) {
+      fprintf(stderr, "%s %s, %d-bit\n", test_case.text, test_case.code,
+              is_64bit ? 64 : 32);
+    }
+    TEST_CHECK(is_good)
+
+    // Cut short, it's never decoded as a shorter instruction
+    for (size_t cut_size = 0; cut_size < size; ++cut_size) {
+      TEST_CHECK(!InstructionDecode(code, cut_size, test_case.address,
+                                    is_64bit, &instruction))
+    }
+  }
+}
+
+// Operands the relocation of a displaced instruction has to fix up
+static void TestRipRelative() {
+  static const struct {
+    const char *code;
+    bool is_64bit;
+    bool is_rip_relative;
+    DWORD displacement_offset;
+  } cases[] = {{"488d0500010000", true, true, 3},       // lea 0x100(%rip)
+               {"833d1000000005", true, true, 2},       // cmpl $5, imm8 after
+               {"c7051000000044332211", true, true, 2}, // movl, imm32 after
+               {"c5f8280540000000", true, true, 4},     // vmovaps
+               {"ff1510000000", true, true, 2},         // call *0x10(%rip)
+               {"488b442410", true, false, 0},          // mov 0x10(%rsp)
+               {"8b0510000000", false, false, 0}};      // Absolute in 32-bit
+
+  for (const auto &test_case : cases) {
+    BYTE code[INSTRUCTION_MAX_LENGTH + 1];
+    const size_t size = DecoderTestParse(test_case.code, code);
+
+    Instruction instruction;
+    TEST_CHECK(InstructionDecode(code, size, 0x1000, test_case.is_64bit,
+                                 &instruction))
+    TEST_CHECK(instruction.is_rip_relative == test_case.is_rip_relative)
+    TEST_CHECK(!test_case.is_rip_relative ||
+               instruction.displacement_offset ==
+                   test_case.displacement_offset)
+  }
+}
+
+int main() {
+  TestCases(Global_DecoderTestCases64,
+            sizeof(Global_DecoderTestCases64) / sizeof(DecoderTestCase),
+            true);
+  TestCases(Global_DecoderTestCases32,
+            sizeof(Global_DecoderTestCases32) / sizeof(DecoderTestCase),
+            false);
+  TestRipRelative();
+
+  return TestFinish("instruction_decoder_test");
+}
@@ -0,0 +1,118 @@
+#include "test.h"
+
+#include "../line_table.h"
+#include "../line_table.cpp"
+
+#define BENCH_LINE_COUNT 2000000
+#define BENCH_FILE_COUNT 5000
+#define BENCH_LOOKUP_COUNT 10000000
+#define BENCH_MODULE_COUNT 200
+#define BENCH_MODULE_LINES 10000
+
+// What Source kept before the line table, a node per line with a copy of
+// the file name
+struct BenchLine {
+  std::string filename;
+  DWORD line;
+};
+
+// Lines of the modules of a process start, published the way the debugger
+// does: a new table per module, or one for all of them
+static void BenchPublish() {
+  std::mt19937_64 random(2);
+
+  std::vector<std::vector<LineTableEntry>> modules(BENCH_MODULE_COUNT);
+  for (size_t i = 0; i < modules.size(); ++i) {
+    DWORD64 address = 0x7ff800000000 + i * 0x1000000;
+    for (int j = 0; j < BENCH_MODULE_LINES; ++j) {
+      address += 1 + random() % 12;
+      modules[i].push_back(LineTableEntry{
+          address, (DWORD)(random() % BENCH_FILE_COUNT),
+          (DWORD)(random() % 3000 + 1)});
+    }
+  }
+
+  double start = TestGetSeconds();
+  const LineTable *published = new LineTable();
+  for (auto &entries : modules) {
+    LineTable *line_table = new LineTable();
+    LineTableMerge(published, entries, line_table);
+    delete published;
+    published = line_table;
+  }
+  const double module_seconds = TestGetSeconds() - start;
+  delete published;
+
+  start = TestGetSeconds();
+  std::vector<LineTableEntry> batch;
+  for (const auto &entries : modules) {
+    batch.insert(batch.end(), entries.begin(), entries.end());
+  }
+  LineTable empty;
+  LineTable line_table;
+  LineTableMerge(&empty, batch, &line_table);
+  const double batch_seconds = TestGetSeconds() - start;
+
+  printf("line_table_bench: %d modules of %d lines published\n",
+         BENCH_MODULE_COUNT, BENCH_MODULE_LINES);
+  printf("  one by one  %6.1f ms\n", module_seconds * 1e3);
+  printf("  one batch   %6.1f ms\n", batch_seconds * 1e3);
+}
+
+int main() {
+  std::mt19937_64 random(1);
+
+  LineTable line_table;
+  std::vector<LineTableEntry> entries;
+  std::map<DWORD64, BenchLine> address_to_line;
+
+  DWORD64 address = 0x140001000;
+  for (int i = 0; i < BENCH_LINE_COUNT; ++i) {
+    address += 1 + random() % 12;
+    const std::string filename =
+        "C:\\src\\project\\module" +
+        std::to_string(random() % BENCH_FILE_COUNT) + ".cpp";
+    const DWORD line = (DWORD)(random() % 3000 + 1);
+
+    entries.push_back(LineTableEntry{
+        address, LineTableInternFile(&line_table, filename), line});
+    address_to_line.emplace(address, BenchLine{filename, line});
+  }
+  LineTableInsert(&line_table, entries);
+
+  std::vector<DWORD64> lookups(BENCH_LOOKUP_COUNT);
+  const DWORD64 first = line_table.addresses.front();
+  const DWORD64 span = line_table.addresses.back() - first + 1;
+  for (auto &lookup : lookups) {
+    lookup = first + random() % span;
+  }
+
+  // Containing line, the query behind steps and the code view
+  double start = TestGetSeconds();
+  DWORD64 map_sum = 0;
+  for (DWORD64 lookup : lookups) {
+    auto it = address_to_line.upper_bound(lookup);
+    map_sum += (--it)->second.line;
+  }
+  const double map_seconds = TestGetSeconds() - start;
+
+  start = TestGetSeconds();
+  DWORD64 table_sum = 0;
+  for (DWORD64 lookup : lookups) {
+    size_t index = 0;
+    LineTableFindContaining(&line_table, lookup, &index);
+    table_sum += line_table.lines[index];
+  }
+  const double table_seconds = TestGetSeconds() - start;
+
+  printf("line_table_bench: %d lines, %d lookups\n", BENCH_LINE_COUNT,
+         BENCH_LOOKUP_COUNT);
+  printf("  std::map    %6.1f ns per lookup\n",
+         map_seconds * 1e9 / BENCH_LOOKUP_COUNT);
+  printf("  line table  %6.1f ns per lookup\n",
+         table_seconds * 1e9 / BENCH_LOOKUP_COUNT);
+
+  BenchPublish();
+
+  return map_sum == table_sum ? 0 : 1;
+}
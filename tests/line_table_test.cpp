@@ -0,0 +1,149 @@
+#include "test.h"
+
+#include "../line_table.h"
+#include "../line_table.cpp"
+
+// Entry of the line that has the address, by std::upper_bound
+static bool ReferenceFindContaining(const std::vector<DWORD64> &addresses,
+                                    DWORD64 address, size_t *index) {
+  auto it = std::upper_bound(addresses.begin(), addresses.end(), address);
+  if (it == addresses.begin()) {
+    return false;
+  }
+
+  *index = (it - addresses.begin()) - 1;
+  return true;
+}
+
+static void TestEmpty() {
+  LineTable line_table;
+  size_t index = 0;
+
+  TEST_CHECK(LineTableLowerBound(&line_table, 0x1000) == 0)
+  TEST_CHECK(!LineTableFind(&line_table, 0x1000, &index))
+  TEST_CHECK(!LineTableFindContaining(&line_table, 0x1000, &index))
+  TEST_CHECK(!LineTableFindContaining(&line_table, 0, &index))
+}
+
+static void TestEdges() {
+  LineTable line_table;
+  const DWORD file_id = LineTableInternFile(&line_table, "a.cpp");
+  std::vector<LineTableEntry> entries = {{0x1000, file_id, 10},
+                                         {0x1010, file_id, 11},
+                                         {0x1020, file_id, 12}};
+  LineTableInsert(&line_table, entries);
+
+  size_t index = 0;
+  TEST_CHECK(!LineTableFindContaining(&line_table, 0xfff, &index))
+  TEST_CHECK(!LineTableFind(&line_table, 0xfff, &index))
+
+  TEST_CHECK(LineTableFind(&line_table, 0x1000, &index) && index == 0)
+  TEST_CHECK(LineTableFindContaining(&line_table, 0x100f, &index) &&
+             index == 0)
+  TEST_CHECK(!LineTableFind(&line_table, 0x100f, &index))
+
+  // After the last one it's still the last line, like the reference
+  TEST_CHECK(LineTableFindContaining(&line_table, 0x1020, &index) &&
+             index == 2)
+  TEST_CHECK(LineTableFindContaining(&line_table, ~(DWORD64)0, &index) &&
+             index == 2)
+  TEST_CHECK(!LineTableFind(&line_table, 0x1021, &index))
+
+  TEST_CHECK(LineTableFindLineAddress(&line_table, 0, 3, 11) == 0x1010)
+}
+
+// Modules merged one after another, an address that is already there keeps
+// it's line
+static void TestRandom() {
+  LineTable line_table;
+  std::map<DWORD64, std::pair<DWORD, DWORD>> reference;
+  std::mt19937_64 random(1);
+
+  for (int module = 0; module < 20; ++module) {
+    const DWORD file_id = LineTableInternFile(
+        &line_table, "file" + std::to_string(module % 7) + ".cpp");
+
+    std::vector<LineTableEntry> entries;
+    std::map<DWORD64, DWORD> batch;
+    for (int i = 0; i < 1000; ++i) {
+      const DWORD64 address = 0x400000 + random() % 100000;
+      const DWORD line = (DWORD)(random() % 500 + 1);
+      if (batch.emplace(address, line).second) {
+        entries.push_back(LineTableEntry{address, file_id, line});
+      }
+    }
+    for (const auto &entry : entries) {
+      reference.emplace(entry.address,
+                        std::make_pair(entry.file_id, entry.line));
+    }
+
+    LineTableInsert(&line_table, entries);
+  }
+
+  std::vector<DWORD64> addresses;
+  for (const auto &it : reference) {
+    addresses.push_back(it.first);
+  }
+  TEST_CHECK(line_table.addresses == addresses)
+  for (size_t i = 0; i < addresses.size(); ++i) {
+    TEST_CHECK(line_table.file_ids[i] == reference[addresses[i]].first)
+    TEST_CHECK(line_table.lines[i] == reference[addresses[i]].second)
+  }
+
+  for (int i = 0; i < 200000; ++i) {
+    const DWORD64 address = 0x400000 - 100 + random() % 100200;
+
+    size_t index = 0;
+    size_t expected = 0;
+    const bool is_found = LineTableFind(&line_table, address, &index);
+    TEST_CHECK(is_found == (reference.count(address) != 0))
+    TEST_CHECK(!is_found || index == (size_t)(std::lower_bound(
+                                                  addresses.begin(),
+                                                  addresses.end(), address) -
+                                              addresses.begin()))
+
+    const bool is_contained =
+        LineTableFindContaining(&line_table, address, &index);
+    TEST_CHECK(is_contained ==
+               ReferenceFindContaining(addresses, address, &expected))
+    TEST_CHECK(!is_contained || index == expected)
+  }
+
+  // Merged file line order is the one a stable sort of the whole table gives
+  std::vector<DWORD> order(addresses.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = (DWORD)i;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](DWORD a, DWORD b) {
+    if (line_table.file_ids[a] != line_table.file_ids[b]) {
+      return line_table.file_ids[a] < line_table.file_ids[b];
+    }
+    return line_table.lines[a] < line_table.lines[b];
+  });
+  TEST_CHECK(line_table.file_line_order == order)
+
+  // Lines of a file are ordered, the lowest address of a line first
+  size_t begin = 0;
+  size_t end = 0;
+  LineTableGetFileRange(&line_table, 3, &begin, &end);
+  TEST_CHECK(begin < end)
+  for (size_t i = begin; i < end; ++i) {
+    const DWORD index = line_table.file_line_order[i];
+    TEST_CHECK(line_table.file_ids[index] == 3)
+    if (i > begin) {
+      const DWORD previous = line_table.file_line_order[i - 1];
+      TEST_CHECK(line_table.lines[previous] < line_table.lines[index] ||
+                 (line_table.lines[previous] == line_table.lines[index] &&
+                  line_table.addresses[previous] <
+                      line_table.addresses[index]))
+    }
+  }
+}
+
+int main() {
+  TestEmpty();
+  TestEdges();
+  TestRandom();
+
+  return TestFinish("line_table_test");
+}
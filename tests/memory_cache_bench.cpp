@@ -0,0 +1,114 @@
+#include "test.h"
+
+#include "../registers.h"
+#include "../backend.h"
+#include "../memory_cache.h"
+#include "../registers.cpp"
+#include "../backend_ptrace.cpp"
+#include "../memory_cache.cpp"
+
+#define BENCH_STOP_COUNT 10000
+#define BENCH_FRAME_COUNT 16 // Unwound, 16 bytes each
+#define BENCH_LOCAL_COUNT 24 // Of the selected frame, 8 bytes each
+#define BENCH_BREAKPOINT_COUNT 8 // Restored, a byte each
+
+// What the debugger reads at a stop, for a target stopped at "registers".
+// Frames and locals are below the stack pointer, the stack of a process
+// that just started has nothing much above it.
+static void BenchGetStopReads(const Registers &registers,
+                              std::vector<std::pair<DWORD64, SIZE_T>> *reads) {
+  for (DWORD64 i = 0; i < BENCH_FRAME_COUNT; ++i) {
+    reads->emplace_back(registers.Rsp - 96 * (i + 1), 16);
+  }
+  for (DWORD64 i = 0; i < BENCH_LOCAL_COUNT; ++i) {
+    reads->emplace_back(registers.Rsp - 128 + 8 * (i % 12) - 512 * (i / 12),
+                        8);
+  }
+  for (DWORD64 i = 0; i < BENCH_BREAKPOINT_COUNT; ++i) {
+    reads->emplace_back(registers.Rip + 64 * i, 1);
+  }
+}
+
+// A process stopped right after exec is the ptrace stand-in, it's stack and
+// code are read the way the debugger reads them at every stop
+int main() {
+  Backend backend;
+  if (!BackendLaunch(&backend, L"/bin/true")) {
+    printf("memory_cache_bench: can't start /bin/true\n");
+    return 1;
+  }
+
+  Registers registers = {};
+  if (!BackendGetRegisters(&backend, backend.process_id, &registers)) {
+    printf("memory_cache_bench: can't read registers\n");
+    kill(backend.process_id, SIGKILL);
+    return 1;
+  }
+
+  std::vector<std::pair<DWORD64, SIZE_T>> reads;
+  BenchGetStopReads(registers, &reads);
+
+  // Each read on it's own, as DebuggerGetValueFromSymbol and the
+  // breakpoints did
+  std::vector<BYTE> direct_data;
+  const DWORD64 direct_syscalls_before = backend.syscall_count;
+  const double direct_start = TestGetSeconds();
+  for (int stop = 0; stop < BENCH_STOP_COUNT; ++stop) {
+    direct_data.clear();
+    for (const auto &read : reads) {
+      BYTE buffer[16];
+      SIZE_T read_size = 0;
+      BackendReadMemory(&backend, read.first, buffer, read.second, &read_size);
+      direct_data.insert(direct_data.end(), buffer, buffer + read_size);
+    }
+  }
+  const double direct_seconds = TestGetSeconds() - direct_start;
+  const DWORD64 direct_syscalls = backend.syscall_count - direct_syscalls_before;
+
+  // Through the cache, invalidated at every stop as on resume
+  MemoryCache *memory_cache = CreateMemoryCache(&backend);
+  std::vector<BYTE> cached_data;
+  DWORD64 cached_syscalls = 0;
+  DWORD64 hit_count = 0;
+  const double cached_start = TestGetSeconds();
+  for (int stop = 0; stop < BENCH_STOP_COUNT; ++stop) {
+    MemoryCacheInvalidate(memory_cache);
+
+    cached_data.clear();
+    for (const auto &read : reads) {
+      BYTE buffer[16];
+      SIZE_T read_size = 0;
+      MemoryCacheRead(memory_cache, read.first, buffer, read.second,
+                      &read_size);
+      cached_data.insert(cached_data.end(), buffer, buffer + read_size);
+    }
+
+    cached_syscalls += MemoryCacheGetSyscallCount(memory_cache);
+    hit_count += memory_cache->hit_count;
+  }
+  const double cached_seconds = TestGetSeconds() - cached_start;
+
+  kill(backend.process_id, SIGKILL);
+  waitpid(backend.process_id, NULL, 0);
+
+  SIZE_T requested_size = 0;
+  for (const auto &read : reads) {
+    requested_size += read.second;
+  }
+  if (cached_data != direct_data || direct_data.size() != requested_size) {
+    printf("memory_cache_bench: reads differ\n");
+    return 1;
+  }
+
+  printf("memory_cache_bench: %zu reads a stop, %d stops\n", reads.size(),
+         BENCH_STOP_COUNT);
+  printf("  uncached %.1f syscalls a stop, %.2f us a stop\n",
+         (double)direct_syscalls / BENCH_STOP_COUNT,
+         direct_seconds * 1e6 / BENCH_STOP_COUNT);
+  printf("  cached   %.1f syscalls a stop, %.2f us a stop, %.0f%% hits\n",
+         (double)cached_syscalls / BENCH_STOP_COUNT,
+         cached_seconds * 1e6 / BENCH_STOP_COUNT,
+         100.0 * hit_count / (reads.size() * BENCH_STOP_COUNT));
+
+  return 0;
+}
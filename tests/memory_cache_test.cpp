@@ -0,0 +1,101 @@
+#include "test.h"
+
+#include "../registers.h"
+#include "../backend.h"
+#include "../memory_cache.h"
+#include "../registers.cpp"
+#include "../backend_ptrace.cpp"
+#include "../memory_cache.cpp"
+
+// Cached reads return what direct reads do, across pages and up to an
+// unreadable one
+static void TestRead(Backend *backend, MemoryCache *memory_cache,
+                     const Registers &registers) {
+  static BYTE direct[3 * MEMORY_CACHE_PAGE_SIZE];
+  static BYTE cached[3 * MEMORY_CACHE_PAGE_SIZE];
+
+  const DWORD64 address = registers.Rsp - 2 * MEMORY_CACHE_PAGE_SIZE - 100;
+  SIZE_T direct_size = 0;
+  SIZE_T cached_size = 0;
+  TEST_CHECK(BackendReadMemory(backend, address, direct, sizeof(direct),
+                               &direct_size) ||
+             direct_size > 0)
+
+  MemoryCacheInvalidate(memory_cache);
+  MemoryCacheRead(memory_cache, address, cached, sizeof(cached), &cached_size);
+  TEST_CHECK(cached_size == direct_size)
+  TEST_CHECK(memcmp(direct, cached, direct_size) == 0)
+  TEST_CHECK(MemoryCacheGetSyscallCount(memory_cache) == 1)
+
+  // Inside what is cached now, no syscall
+  BYTE value[8];
+  TEST_CHECK(MemoryCacheRead(memory_cache, address + 8, value, sizeof(value),
+                             NULL))
+  TEST_CHECK(memcmp(value, direct + 8, sizeof(value)) == 0)
+  TEST_CHECK(MemoryCacheGetSyscallCount(memory_cache) == 1)
+  TEST_CHECK(memory_cache->hit_count == 1)
+
+  SIZE_T read_size = 99;
+  TEST_CHECK(!MemoryCacheRead(memory_cache, 16, value, sizeof(value),
+                              &read_size))
+  TEST_CHECK(read_size == 0)
+}
+
+// Writes go to the target and to the cached page
+static void TestWrite(Backend *backend, MemoryCache *memory_cache,
+                      const Registers &registers) {
+  const DWORD64 address = registers.Rip;
+
+  MemoryCacheInvalidate(memory_cache);
+  BYTE original = 0;
+  TEST_CHECK(MemoryCacheRead(memory_cache, address, &original, 1, NULL))
+
+  const BYTE trap = 0xcc;
+  TEST_CHECK(MemoryCacheWrite(memory_cache, address, &trap, 1))
+
+  BYTE cached = 0;
+  BYTE direct = 0;
+  TEST_CHECK(MemoryCacheRead(memory_cache, address, &cached, 1, NULL))
+  TEST_CHECK(BackendReadMemory(backend, address, &direct, 1, NULL))
+  TEST_CHECK(cached == trap && direct == trap)
+
+  TEST_CHECK(MemoryCacheWrite(memory_cache, address, &original, 1))
+  MemoryCacheInvalidate(memory_cache);
+  TEST_CHECK(MemoryCacheRead(memory_cache, address, &cached, 1, NULL))
+  TEST_CHECK(cached == original)
+}
+
+// Bigger than the whole cache, read directly
+static void TestBypass(MemoryCache *memory_cache, const Registers &registers) {
+  std::vector<BYTE> buffer((MEMORY_CACHE_MAX_PAGES + 1) *
+                           MEMORY_CACHE_PAGE_SIZE);
+
+  MemoryCacheInvalidate(memory_cache);
+  MemoryCacheRead(memory_cache, registers.Rsp - buffer.size(), buffer.data(),
+                  buffer.size(), NULL);
+  TEST_CHECK(memory_cache->pages.empty())
+  TEST_CHECK(memory_cache->read_count == 0)
+}
+
+int main() {
+  Global_TestIsLogMuted = true;
+
+  Backend backend;
+  TEST_CHECK(BackendLaunch(&backend, L"/bin/true"))
+  if (Global_TestFailureCount) {
+    return TestFinish("memory_cache_test");
+  }
+
+  Registers registers = {};
+  TEST_CHECK(BackendGetRegisters(&backend, backend.process_id, &registers))
+
+  MemoryCache *memory_cache = CreateMemoryCache(&backend);
+  TestRead(&backend, memory_cache, registers);
+  TestWrite(&backend, memory_cache, registers);
+  TestBypass(memory_cache, registers);
+
+  kill(backend.process_id, SIGKILL);
+  waitpid(backend.process_id, NULL, 0);
+
+  return TestFinish("memory_cache_test");
+}
@@ -0,0 +1,195 @@
+#include "test.h"
+
+#include "../registers.h"
+#include "../backend.h"
+#include "../memory_cache.h"
+#include "../dwarf.h"
+#include "../unwinder.h"
+#include "../module_index.h"
+#include "../elf_reader.h"
+#include "../module_loader.h"
+#include "../line_table.h"
+#include "../registers.cpp"
+#include "../backend_ptrace.cpp"
+#include "../memory_cache.cpp"
+#include "../dwarf.cpp"
+#include "../unwinder.cpp"
+#include "../elf_reader.cpp"
+#include "../module_loader.cpp"
+#include "../line_table.cpp"
+
+#define BENCH_MODULE_COUNT 160
+#define BENCH_LIBRARY_DIRECTORY "/usr/lib/x86_64-linux-gnu"
+
+// Shared libraries stand in for the DLLs of a service starting up, unless
+// paths are given
+static std::vector<std::string> BenchGetModulePaths(int argc, char **argv) {
+  std::vector<std::string> result;
+  for (int i = 1; i < argc; ++i) {
+    result.push_back(argv[i]);
+  }
+  if (!result.empty()) {
+    return result;
+  }
+
+  DIR *directory = opendir(BENCH_LIBRARY_DIRECTORY);
+  if (!directory) {
+    return result;
+  }
+  while (dirent *entry = readdir(directory)) {
+    const std::string path =
+        std::string(BENCH_LIBRARY_DIRECTORY) + '/' + entry->d_name;
+
+    struct stat status;
+    if (strstr(entry->d_name, ".so") && stat(path.c_str(), &status) == 0 &&
+        S_ISREG(status.st_mode)) {
+      result.push_back(path);
+    }
+  }
+  closedir(directory);
+
+  std::sort(result.begin(), result.end());
+  if (result.size() > BENCH_MODULE_COUNT) {
+    result.resize(BENCH_MODULE_COUNT);
+  }
+
+  return result;
+}
+
+// Event loop only queues the modules and goes on. Indexed ones are picked
+// up between events, each pickup resolves pending breakpoints and publishes
+// the lines of it's modules as one table, like DebuggerAddLoadedModules.
+static bool BenchLoader(const std::vector<std::string> &paths,
+                        size_t thread_count,
+                        std::vector<std::string> pending_functions,
+                        size_t loaded_count) {
+  double start = TestGetSeconds();
+  ModuleLoader *module_loader = CreateModuleLoader(NULL, thread_count);
+  for (size_t i = 0; i < paths.size(); ++i) {
+    ModuleLoaderPush(module_loader, NULL, paths[i], 0x10000000 * (i + 1));
+  }
+  const double push_seconds = TestGetSeconds() - start;
+
+  std::vector<Module> modules;
+  const LineTable *published = new LineTable();
+  size_t resolved_count = 0;
+  size_t pickup_count = 0;
+  double max_take_seconds = 0;
+  while (true) {
+    const double take_start = TestGetSeconds();
+    std::vector<Module> loaded = ModuleLoaderTakeLoaded(module_loader);
+    if (!loaded.empty()) {
+      LineTable *line_table = new LineTable();
+      line_table->filenames = published->filenames;
+      line_table->filename_to_id = published->filename_to_id;
+
+      std::vector<LineTableEntry> entries;
+      for (const auto &module : loaded) {
+        std::vector<DWORD> file_ids;
+        for (const auto &source_file : module.index.source_files) {
+          file_ids.push_back(LineTableInternFile(line_table, source_file));
+        }
+        for (const auto &line : module.index.lines) {
+          entries.emplace_back(LineTableEntry{module.base + line.rva,
+                                              file_ids[line.file_index],
+                                              line.line});
+        }
+      }
+      LineTableMerge(published, entries, line_table);
+      delete published;
+      published = line_table;
+      ++pickup_count;
+    }
+
+    for (auto &module : loaded) {
+      for (auto it = pending_functions.begin();
+           it != pending_functions.end();) {
+        if (ModuleFindFunction(&module.index, it->c_str())) {
+          it = pending_functions.erase(it);
+          ++resolved_count;
+        } else {
+          ++it;
+        }
+      }
+      modules.emplace_back(std::move(module));
+    }
+    max_take_seconds =
+        std::max(max_take_seconds, TestGetSeconds() - take_start);
+
+    {
+      std::lock_guard<std::mutex> lock(module_loader->mutex);
+      if (module_loader->pending_count == 0 &&
+          module_loader->loaded_modules.empty()) {
+        break;
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  const double loader_seconds = TestGetSeconds() - start;
+  ModuleLoaderStop(module_loader);
+  delete module_loader;
+
+  printf("  module loader (%zu)   %8.1f ms, target frozen %.3f ms to queue, "
+         "%.3f ms max per pickup, %.0f modules/s\n",
+         thread_count, loader_seconds * 1e3, push_seconds * 1e3,
+         max_take_seconds * 1e3, modules.size() / loader_seconds);
+  printf("    %zu pickups, %zu lines published, pending breakpoints "
+         "resolved: %zu, left %zu\n",
+         pickup_count, published->addresses.size(), resolved_count,
+         pending_functions.size());
+  delete published;
+
+  return modules.size() == loaded_count && pending_functions.empty();
+}
+
+int main(int argc, char **argv) {
+  const std::vector<std::string> paths = BenchGetModulePaths(argc, argv);
+  if (paths.empty()) {
+    printf("module_loader_bench: no modules to load\n");
+    return 1;
+  }
+  Global_TestIsLogMuted = true;
+
+  // Untimed pass, so that both runs find the files in the page cache. It
+  // picks the breakpoints that are set by name before their module is there.
+  std::vector<std::string> pending_functions;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    Module module = {};
+    if (ModuleLoad(NULL, NULL, paths[i], 0, &module) && i % 8 == 0 &&
+        !module.index.functions.empty()) {
+      const ModuleFunction &function =
+          module.index.functions[module.index.functions.size() / 2];
+      pending_functions.push_back(module.index.names.c_str() +
+                                  function.name_offset);
+    }
+  }
+
+  // Before, every load event indexed it's module while the target waited
+  double start = TestGetSeconds();
+  size_t loaded_count = 0;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    Module module = {};
+    if (ModuleLoad(NULL, NULL, paths[i], 0x10000000 * (i + 1), &module)) {
+      ++loaded_count;
+    }
+  }
+  const double synchronous_seconds = TestGetSeconds() - start;
+
+  printf("module_loader_bench: %zu load events, %zu indexed\n", paths.size(),
+         loaded_count);
+  printf("  on the event thread  %8.1f ms, target frozen all of it, "
+         "%.0f modules/s\n",
+         synchronous_seconds * 1e3, loaded_count / synchronous_seconds);
+
+  // Throughput only grows with the workers on more than one core, the
+  // target is frozen to queue either way
+  bool is_good = true;
+  for (size_t thread_count = 1; thread_count <= MODULE_LOADER_MAX_THREADS;
+       thread_count *= 2) {
+    is_good = BenchLoader(paths, thread_count, pending_functions,
+                          loaded_count) &&
+              is_good;
+  }
+
+  return is_good ? 0 : 1;
+}
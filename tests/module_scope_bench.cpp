@@ -0,0 +1,113 @@
+#include "test.h"
+
+#include "../registers.h"
+#include "../backend.h"
+#include "../memory_cache.h"
+#include "../dwarf.h"
+#include "../unwinder.h"
+#include "../instruction_decoder.h"
+#include "../line_table.h"
+#include "../module_index.h"
+#include "../elf_reader.h"
+#include "../module_loader.h"
+#include "../registers.cpp"
+#include "../backend_ptrace.cpp"
+#include "../memory_cache.cpp"
+#include "../dwarf.cpp"
+#include "../unwinder.cpp"
+#include "../instruction_decoder.cpp"
+#include "../line_table.cpp"
+#include "../elf_reader.cpp"
+#include "../module_loader.cpp"
+
+#define BENCH_ADDRESS_COUNT 10000000
+
+// Function that has the rva as it was found before the scopes, NULL if
+// there is none
+static const ModuleFunction *BenchFindFunction(const ModuleIndex &index,
+                                               DWORD rva) {
+  const auto &functions = index.functions;
+  auto it = std::upper_bound(
+      functions.begin(), functions.end(), rva,
+      [](DWORD value, const ModuleFunction &function) {
+        return value < function.start_rva;
+      });
+  if (it == functions.begin() || rva >= (it - 1)->end_rva) {
+    return NULL;
+  }
+
+  return &*(it - 1);
+}
+
+// Symbolizes random addresses of a -O2 -g binary, the benchmark itself
+// unless a path is given: the function with a binary search over functions
+// as before, the function and the whole inline chain through the scopes
+int main(int argc, char **argv) {
+  const std::string path = argc > 1 ? argv[1] : "/proc/self/exe";
+
+  ModuleIndex index;
+  UnwindTable unwind_table;
+  const double build_start = TestGetSeconds();
+  if (!ElfLoadModuleIndex(path, &index, &unwind_table) ||
+      index.functions.empty()) {
+    printf("module_scope_bench: no functions in %s\n", path.c_str());
+    return 1;
+  }
+  ModuleBuildScopes(&index);
+  const double build_seconds = TestGetSeconds() - build_start;
+
+  // Over the code, gaps between functions included
+  const DWORD start_rva = index.functions.front().start_rva;
+  const DWORD end_rva = index.functions.back().end_rva;
+  std::mt19937 random(1);
+  std::vector<DWORD> rvas(BENCH_ADDRESS_COUNT);
+  for (DWORD &rva : rvas) {
+    rva = start_rva + random() % (end_rva - start_rva);
+  }
+
+  size_t search_sum = 0;
+  double start = TestGetSeconds();
+  for (DWORD rva : rvas) {
+    const ModuleFunction *function = BenchFindFunction(index, rva);
+    search_sum += function ? function->start_rva : 0;
+  }
+  const double search_seconds = TestGetSeconds() - start;
+
+  size_t scope_sum = 0;
+  start = TestGetSeconds();
+  for (DWORD rva : rvas) {
+    const ModuleFunction *function = ModuleFindFunctionAt(&index, rva);
+    scope_sum += function ? function->start_rva : 0;
+  }
+  const double scope_seconds = TestGetSeconds() - start;
+
+  size_t depth_sum = 0;
+  start = TestGetSeconds();
+  for (DWORD rva : rvas) {
+    for (DWORD scope = ModuleFindScope(&index, rva); scope != MODULE_NO_SCOPE;
+         scope = index.scopes[scope].parent) {
+      ++depth_sum;
+    }
+  }
+  const double chain_seconds = TestGetSeconds() - start;
+
+  // Both find the same functions, inline sites don't change it
+  if (search_sum != scope_sum) {
+    printf("module_scope_bench: functions found differ\n");
+    return 1;
+  }
+
+  printf("module_scope_bench: %zu functions, %zu inline sites, %zu ranges, "
+         "built in %.1f ms\n",
+         index.functions.size(), index.inline_sites.size(),
+         index.scope_starts.size(), build_seconds * 1e3);
+  printf("  %d random addresses: function %.1f ns by binary search, %.1f ns "
+         "through scopes\n",
+         BENCH_ADDRESS_COUNT, search_seconds / BENCH_ADDRESS_COUNT * 1e9,
+         scope_seconds / BENCH_ADDRESS_COUNT * 1e9);
+  printf("  inline chain %.1f ns, %.2f scopes deep on average\n",
+         chain_seconds / BENCH_ADDRESS_COUNT * 1e9,
+         (double)depth_sum / BENCH_ADDRESS_COUNT);
+
+  return 0;
+}
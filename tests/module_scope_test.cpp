@@ -0,0 +1,219 @@
+#include "test.h"
+
+#include "../registers.h"
+#include "../backend.h"
+#include "../memory_cache.h"
+#include "../dwarf.h"
+#include "../unwinder.h"
+#include "../instruction_decoder.h"
+#include "../line_table.h"
+#include "../module_index.h"
+#include "../elf_reader.h"
+#include "../module_loader.h"
+#include "../registers.cpp"
+#include "../backend_ptrace.cpp"
+#include "../memory_cache.cpp"
+#include "../dwarf.cpp"
+#include "../unwinder.cpp"
+#include "../instruction_decoder.cpp"
+#include "../line_table.cpp"
+#include "../elf_reader.cpp"
+#include "../module_loader.cpp"
+
+static DWORD TestAddName(ModuleIndex *module_index, const std::string &name) {
+  const DWORD name_offset = (DWORD)module_index->names.size();
+  module_index->names.append(name);
+  module_index->names.push_back('\0');
+
+  return name_offset;
+}
+
+static void TestAddFunction(ModuleIndex *module_index, const char *name,
+                            DWORD start_rva, DWORD end_rva) {
+  module_index->functions.push_back(
+      ModuleFunction{start_rva, end_rva, TestAddName(module_index, name)});
+}
+
+static void TestAddInlineSite(ModuleIndex *module_index, const char *name,
+                              DWORD start_rva, DWORD end_rva) {
+  module_index->inline_sites.push_back(
+      ModuleInlineSite{start_rva, end_rva, TestAddName(module_index, name)});
+}
+
+// Names of the scopes the rva is in, the innermost first, space separated
+static std::string TestGetChain(const ModuleIndex &module_index, DWORD rva) {
+  std::string result;
+  for (DWORD scope = ModuleFindScope(&module_index, rva);
+       scope != MODULE_NO_SCOPE; scope = module_index.scopes[scope].parent) {
+    if (!result.empty()) {
+      result += ' ';
+    }
+    result +=
+        module_index.names.c_str() + module_index.scopes[scope].name_offset;
+  }
+
+  return result;
+}
+
+static std::string TestGetFunctionName(const ModuleIndex &module_index,
+                                       DWORD rva) {
+  const ModuleFunction *function = ModuleFindFunctionAt(&module_index, rva);
+  return function ? module_index.names.c_str() + function->name_offset : "";
+}
+
+// Nesting, a split inline site, a site past the end of it's function, one
+// with the same range as it's function, one outside of any function and the
+// gaps between them
+static void TestNesting() {
+  ModuleIndex module_index;
+  TestAddFunction(&module_index, "A", 0x100, 0x200);
+  TestAddFunction(&module_index, "B", 0x200, 0x300);
+  TestAddFunction(&module_index, "C", 0x400, 0x500);
+  TestAddInlineSite(&module_index, "Z", 0x1f0, 0x220);
+  TestAddInlineSite(&module_index, "Y", 0x130, 0x140);
+  TestAddInlineSite(&module_index, "X", 0x120, 0x180);
+  TestAddInlineSite(&module_index, "X", 0x190, 0x1a0);
+  TestAddInlineSite(&module_index, "S", 0x400, 0x500);
+  TestAddInlineSite(&module_index, "T", 0x480, 0x490);
+  TestAddInlineSite(&module_index, "U", 0x600, 0x610);
+  ModuleBuildScopes(&module_index);
+
+  const std::pair<DWORD, const char *> chains[] = {
+      {0x0ff, ""},      {0x100, "A"},     {0x11f, "A"},
+      {0x120, "X A"},   {0x130, "Y X A"}, {0x13f, "Y X A"},
+      {0x140, "X A"},   {0x17f, "X A"},   {0x180, "A"},
+      {0x190, "X A"},   {0x1a0, "A"},     {0x1f0, "Z A"},
+      {0x1ff, "Z A"},   {0x200, "B"},     {0x21f, "B"},
+      {0x2ff, "B"},     {0x300, ""},      {0x3ff, ""},
+      {0x400, "S C"},   {0x480, "T S C"}, {0x490, "S C"},
+      {0x4ff, "S C"},   {0x500, ""},      {0x600, "U"},
+      {0x60f, "U"},     {0x610, ""},      {0xffffffff, ""}};
+  for (const auto &chain : chains) {
+    TEST_CHECK(TestGetChain(module_index, chain.first) == chain.second)
+  }
+
+  TEST_CHECK(TestGetFunctionName(module_index, 0x130) == "A")
+  TEST_CHECK(TestGetFunctionName(module_index, 0x1f8) == "A")
+  TEST_CHECK(TestGetFunctionName(module_index, 0x200) == "B")
+  TEST_CHECK(TestGetFunctionName(module_index, 0x485) == "C")
+  TEST_CHECK(TestGetFunctionName(module_index, 0x300) == "")
+  TEST_CHECK(TestGetFunctionName(module_index, 0x605) == "")
+
+  // Cut to the end of the function it's in
+  for (const ModuleScope &scope : module_index.scopes) {
+    if (strcmp(module_index.names.c_str() + scope.name_offset, "Z") == 0) {
+      TEST_CHECK(scope.end_rva == 0x200)
+    }
+  }
+}
+
+static void TestEmpty() {
+  ModuleIndex module_index;
+  ModuleBuildScopes(&module_index);
+
+  TEST_CHECK(ModuleFindScope(&module_index, 0) == MODULE_NO_SCOPE)
+  TEST_CHECK(ModuleFindScope(&module_index, 0x1000) == MODULE_NO_SCOPE)
+  TEST_CHECK(ModuleFindFunctionAt(&module_index, 0x1000) == NULL)
+}
+
+// Generated scope of the random tree, with the names of it's chain
+struct TestNode {
+  DWORD start_rva;
+  DWORD end_rva;
+  std::string chain;
+  std::vector<TestNode> children;
+};
+
+// Children that don't overlap each other, inside the parent's range
+static void TestGenerate(ModuleIndex *module_index, std::mt19937 *random,
+                         TestNode *parent, int depth) {
+  DWORD rva = parent->start_rva;
+  while (depth < 4 && parent->end_rva - rva > 4) {
+    const DWORD start_rva = rva + (*random)() % 8;
+    if (start_rva + 1 >= parent->end_rva) {
+      break;
+    }
+    const DWORD size = (parent->end_rva - start_rva) / 2;
+    const DWORD end_rva =
+        start_rva + 1 + (*random)() % std::max<DWORD>(1, size);
+
+    const std::string name = "I" + std::to_string(module_index->names.size());
+    TestNode node = {start_rva, end_rva, name + " " + parent->chain, {}};
+
+    // Inline code is split in two ranges now and then
+    const DWORD middle = start_rva + (end_rva - start_rva) / 2;
+    if ((*random)() % 4 == 0 && middle > start_rva) {
+      const DWORD name_offset = TestAddName(module_index, name);
+      module_index->inline_sites.push_back(
+          ModuleInlineSite{start_rva, middle, name_offset});
+      module_index->inline_sites.push_back(
+          ModuleInlineSite{middle + 1, end_rva, name_offset});
+      TestNode first = node;
+      first.end_rva = middle;
+      node.start_rva = middle + 1;
+      TestGenerate(module_index, random, &first, depth + 1);
+      parent->children.push_back(first);
+    } else {
+      TestAddInlineSite(module_index, name.c_str(), start_rva, end_rva);
+    }
+
+    if (node.start_rva < node.end_rva) {
+      TestGenerate(module_index, random, &node, depth + 1);
+      parent->children.push_back(node);
+    }
+    rva = end_rva;
+  }
+}
+
+static std::string TestFindChain(const std::vector<TestNode> &nodes,
+                                 DWORD rva) {
+  for (const TestNode &node : nodes) {
+    if (rva >= node.start_rva && rva < node.end_rva) {
+      const std::string chain = TestFindChain(node.children, rva);
+      return chain.empty() ? node.chain : chain;
+    }
+  }
+
+  return "";
+}
+
+// Every rva of random nested scopes against the tree they were made from
+static void TestRandom() {
+  std::mt19937 random(1);
+  for (int round = 0; round < 20; ++round) {
+    ModuleIndex module_index;
+    std::vector<TestNode> functions;
+
+    DWORD rva = 0x1000;
+    for (int i = 0; i < 50; ++i) {
+      rva += random() % 16; // Gaps between functions, or none
+      const DWORD end_rva = rva + 1 + random() % 256;
+      const std::string name = "F" + std::to_string(i);
+      TestNode node = {rva, end_rva, name, {}};
+      TestAddFunction(&module_index, name.c_str(), rva, end_rva);
+      TestGenerate(&module_index, &random, &node, 0);
+      functions.push_back(node);
+      rva = end_rva;
+    }
+
+    std::shuffle(module_index.inline_sites.begin(),
+                 module_index.inline_sites.end(), random);
+    ModuleBuildScopes(&module_index);
+
+    for (DWORD i = 0xff0; i < rva + 16; ++i) {
+      const std::string chain = TestFindChain(functions, i);
+      TEST_CHECK(TestGetChain(module_index, i) == chain)
+
+      const std::string function = chain.substr(chain.rfind(' ') + 1);
+      TEST_CHECK(TestGetFunctionName(module_index, i) == function)
+    }
+  }
+}
+
+int main() {
+  TestNesting();
+  TestEmpty();
+  TestRandom();
+
+  return TestFinish("module_scope_test");
+}
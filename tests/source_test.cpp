@@ -0,0 +1,196 @@
+#include "test.h"
+
+#include "../line_table.h"
+#include "../line_table.cpp"
+
+// Win32 file mapping as far as the source view uses it, on top of POSIX.
+// Handles are file descriptors, views are remembered with their sizes.
+#define INVALID_HANDLE_VALUE ((HANDLE)-1)
+#define GENERIC_READ 0x80000000
+#define FILE_SHARE_READ 1
+#define FILE_SHARE_WRITE 2
+#define OPEN_EXISTING 3
+#define FILE_ATTRIBUTE_NORMAL 0x80
+#define PAGE_READONLY 2
+#define FILE_MAP_READ 4
+
+union LARGE_INTEGER {
+  int64_t QuadPart;
+};
+
+static size_t Global_TestOpenCount;
+static size_t Global_TestHandleCount;
+static std::map<const void *, size_t> Global_TestViews;
+
+static DWORD GetLastError() { return (DWORD)errno; }
+
+static HANDLE CreateFileA(const char *path, DWORD, DWORD, void *, DWORD,
+                          DWORD, HANDLE) {
+  ++Global_TestOpenCount;
+  const int fd = open(path, O_RDONLY);
+  Global_TestHandleCount += fd >= 0;
+  return fd >= 0 ? (HANDLE)(intptr_t)fd : INVALID_HANDLE_VALUE;
+}
+
+static bool GetFileSizeEx(HANDLE file, LARGE_INTEGER *size) {
+  struct stat status;
+  if (fstat((int)(intptr_t)file, &status) != 0) {
+    return false;
+  }
+
+  size->QuadPart = status.st_size;
+  return true;
+}
+
+static HANDLE CreateFileMapping(HANDLE file, void *, DWORD, DWORD, DWORD,
+                                const char *) {
+  const int fd = dup((int)(intptr_t)file);
+  Global_TestHandleCount += fd >= 0;
+  return fd >= 0 ? (HANDLE)(intptr_t)fd : NULL;
+}
+
+static void *MapViewOfFile(HANDLE mapping, DWORD, DWORD, DWORD, SIZE_T) {
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(mapping, &size)) {
+    return NULL;
+  }
+
+  void *view = mmap(NULL, (size_t)size.QuadPart, PROT_READ, MAP_PRIVATE,
+                    (int)(intptr_t)mapping, 0);
+  if (view == MAP_FAILED) {
+    return NULL;
+  }
+
+  Global_TestViews[view] = (size_t)size.QuadPart;
+  return view;
+}
+
+static bool UnmapViewOfFile(const void *view) {
+  auto it = Global_TestViews.find(view);
+  if (it == Global_TestViews.end()) {
+    return false;
+  }
+
+  munmap((void *)view, it->second);
+  Global_TestViews.erase(it);
+  return true;
+}
+
+static bool CloseHandle(HANDLE handle) {
+  --Global_TestHandleCount;
+  return close((int)(intptr_t)handle) == 0;
+}
+
+#include "../source.h"
+#include "../source.cpp"
+
+#define TEST_FILE_COUNT (SOURCE_MAX_MAPPED_FILES + 8)
+
+// Files of the line table, the first one is empty and the last one is
+// missing. The rest have a line with the file's number.
+static std::string TestWriteFiles(LineTable *line_table) {
+  char directory[] = "/tmp/source_test.XXXXXX";
+  TEST_CHECK(mkdtemp(directory))
+
+  for (int i = 0; i < TEST_FILE_COUNT; ++i) {
+    const std::string path =
+        std::string(directory) + "/" + std::to_string(i) + ".cpp";
+    LineTableInternFile(line_table, path);
+    if (i + 1 == TEST_FILE_COUNT) {
+      continue;
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (i) {
+      file << "// " << i << "\r\n\nint main() {}";
+    }
+  }
+
+  return directory;
+}
+
+static std::string TestGetLine(const SourceFile *source_file, size_t index) {
+  const char *begin;
+  const char *end;
+  SourceFileGetLine(source_file, index, &begin, &end);
+  return std::string(begin, end);
+}
+
+// Files are mapped the first time they are shown, then kept for the most
+// recently shown SOURCE_MAX_MAPPED_FILES
+static void TestMapping(const LineTable &line_table) {
+  Source source = {};
+
+  // Nothing is opened before a file is asked for
+  TEST_CHECK(Global_TestOpenCount == 0)
+
+  const SourceFile *source_file = SourceGetFile(&source, &line_table, 1);
+  TEST_CHECK(source_file && source_file->file_id == 1)
+  TEST_CHECK(Global_TestOpenCount == 1)
+  if (source_file) {
+    TEST_CHECK(source_file->line_offsets.size() == 3)
+    TEST_CHECK(TestGetLine(source_file, 0) == "// 1")
+    TEST_CHECK(TestGetLine(source_file, 1) == "")
+    TEST_CHECK(TestGetLine(source_file, 2) == "int main() {}")
+  }
+
+  // Mapped one is used again
+  TEST_CHECK(SourceGetFile(&source, &line_table, 1) == source_file)
+  TEST_CHECK(Global_TestOpenCount == 1)
+
+  // Empty file has no view and no lines
+  source_file = SourceGetFile(&source, &line_table, 0);
+  TEST_CHECK(source_file && source_file->size == 0 && !source_file->data)
+  TEST_CHECK(source_file && source_file->line_offsets.empty())
+
+  // Missing one is tried once, as are ids the table doesn't have
+  const DWORD missing_id = TEST_FILE_COUNT - 1;
+  TEST_CHECK(!SourceGetFile(&source, &line_table, missing_id))
+  TEST_CHECK(!SourceGetFile(&source, &line_table, missing_id))
+  TEST_CHECK(!SourceGetFile(&source, &line_table, TEST_FILE_COUNT))
+  TEST_CHECK(Global_TestOpenCount == 3)
+
+  // File 1 is shown all along, file 0 isn't. It's the least recently used
+  // one once the limit is reached.
+  for (DWORD file_id = 2; file_id <= SOURCE_MAX_MAPPED_FILES; ++file_id) {
+    TEST_CHECK(SourceGetFile(&source, &line_table, file_id))
+    TEST_CHECK(SourceGetFile(&source, &line_table, 1))
+  }
+  TEST_CHECK(source.files.size() == SOURCE_MAX_MAPPED_FILES)
+  TEST_CHECK(source.file_id_to_file.count(0) == 0)
+  TEST_CHECK(source.file_id_to_file.count(1) == 1)
+  TEST_CHECK(source.files.front().file_id == 1)
+  TEST_CHECK(Global_TestViews.size() == SOURCE_MAX_MAPPED_FILES)
+
+  // Evicted file is mapped again
+  const size_t open_count = Global_TestOpenCount;
+  source_file = SourceGetFile(&source, &line_table, 0);
+  TEST_CHECK(source_file && source_file->file_id == 0)
+  TEST_CHECK(Global_TestOpenCount == open_count + 1)
+  TEST_CHECK(source.file_id_to_file.count(2) == 0)
+
+  // Every file that is kept has it's handles, no more
+  TEST_CHECK(source.files.size() == source.file_id_to_file.size())
+  TEST_CHECK(Global_TestHandleCount == SOURCE_MAX_MAPPED_FILES * 2 - 1)
+  for (SourceFile &file : source.files) {
+    SourceFileUnmap(&file);
+  }
+  TEST_CHECK(Global_TestViews.empty())
+  TEST_CHECK(Global_TestHandleCount == 0)
+}
+
+int main() {
+  LineTable line_table;
+  const std::string directory = TestWriteFiles(&line_table);
+
+  Global_TestIsLogMuted = true;
+
+  TestMapping(line_table);
+
+  for (const std::string &filename : line_table.filenames) {
+    unlink(filename.c_str());
+  }
+  rmdir(directory.c_str());
+
+  return TestFinish("source_test");
+}
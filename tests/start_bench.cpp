@@ -0,0 +1,184 @@
+#define TEST_WITH_TARGET
+#include "test.h"
+
+#define BENCH_RUN_COUNT 5
+#define BENCH_LOOKUP_REPEAT_COUNT 100
+
+// How the start breakpoint is found once the executable is indexed
+enum class BenchStrategy {
+  // As before: lines merged into the line table first, then the name looked
+  // up by a scan over every function, like SymFromNameW did
+  PUBLISH_THEN_SCAN,
+  // As the debugger does now: looked up in the name table and planted. The
+  // line table is merged while the target runs to it.
+  LOOKUP_THEN_PUBLISH
+};
+
+// Times from launch, in milliseconds
+struct BenchRun {
+  double indexed_ms;
+  double planted_ms;
+  double reached_ms;
+};
+
+static void BenchPublish(LineTable *line_table, const Module &module) {
+  std::vector<DWORD> file_ids;
+  for (const std::string &source_file : module.index.source_files) {
+    file_ids.push_back(LineTableInternFile(line_table, source_file));
+  }
+
+  std::vector<LineTableEntry> entries;
+  for (const ModuleLine &line : module.index.lines) {
+    entries.emplace_back(LineTableEntry{module.base + line.rva,
+                                        file_ids[line.file_index],
+                                        line.line});
+  }
+  LineTableInsert(line_table, entries);
+}
+
+static const ModuleFunction *BenchScanFunctions(const ModuleIndex &index,
+                                                const char *name) {
+  for (const ModuleFunction &function : index.functions) {
+    if (strcmp(index.names.c_str() + function.name_offset, name) == 0) {
+      return &function;
+    }
+  }
+
+  return NULL;
+}
+
+// Launches the target and runs it to an int3 on main
+static bool BenchRunToMain(const std::string &path, BenchStrategy strategy,
+                           BenchRun *run) {
+  const double start = TestGetSeconds();
+
+  Backend backend;
+  BackendEvent event;
+  Module module;
+  if (!TestLaunch(&backend, path, &event, &module)) {
+    return false;
+  }
+  run->indexed_ms = (TestGetSeconds() - start) * 1e3;
+
+  LineTable line_table;
+  const ModuleFunction *main_function;
+  if (strategy == BenchStrategy::PUBLISH_THEN_SCAN) {
+    BenchPublish(&line_table, module);
+    main_function = BenchScanFunctions(module.index, "main");
+  } else {
+    main_function = ModuleFindFunction(&module.index, "main");
+  }
+
+  const BYTE trap = 0xcc;
+  BYTE original;
+  const DWORD64 address =
+      main_function ? module.base + main_function->start_rva : 0;
+  if (!main_function ||
+      !BackendReadMemory(&backend, address, &original, 1, NULL) ||
+      !BackendWriteMemory(&backend, address, &trap, 1)) {
+    TestKill(&backend);
+    return false;
+  }
+  run->planted_ms = (TestGetSeconds() - start) * 1e3;
+
+  BackendContinue(&backend, event, true);
+  if (strategy == BenchStrategy::LOOKUP_THEN_PUBLISH) {
+    BenchPublish(&line_table, module);
+  }
+
+  // Stop at main is shown once it's reached and the lines are there
+  const bool is_reached =
+      TestWaitFor(&backend, BackendEventType::BREAKPOINT, &event) &&
+      event.address == address;
+  run->reached_ms = (TestGetSeconds() - start) * 1e3;
+
+  TestKill(&backend);
+
+  return is_reached;
+}
+
+// Launch to main of targets/big, or of the executable given, with both
+// strategies. Best of a few runs each, then the cost of a name lookup.
+int main(int argc, char **argv) {
+  const std::string path =
+      argc > 1 ? argv[1] : TestGetTargetPath(argv[0], "big");
+
+  Global_TestIsLogMuted = true;
+
+  const BenchStrategy strategies[2] = {BenchStrategy::PUBLISH_THEN_SCAN,
+                                       BenchStrategy::LOOKUP_THEN_PUBLISH};
+  const char *names[2] = {"publish, then scan  ", "look up, then publish"};
+  BenchRun best_runs[2] = {};
+  for (int i = 0; i < 2; ++i) {
+    for (int j = 0; j < BENCH_RUN_COUNT; ++j) {
+      BenchRun run = {};
+      if (!BenchRunToMain(path, strategies[i], &run)) {
+        printf("start_bench: can't run %s to main\n", path.c_str());
+        return 1;
+      }
+
+      if (j == 0 || run.planted_ms < best_runs[i].planted_ms) {
+        best_runs[i].indexed_ms = run.indexed_ms;
+        best_runs[i].planted_ms = run.planted_ms;
+      }
+      if (j == 0 || run.reached_ms < best_runs[i].reached_ms) {
+        best_runs[i].reached_ms = run.reached_ms;
+      }
+    }
+  }
+
+  Module module;
+  if (!ModuleLoad(NULL, NULL, path, 0, &module)) {
+    printf("start_bench: can't index %s\n", path.c_str());
+    return 1;
+  }
+  const ModuleIndex &index = module.index;
+
+  // Every function by name, each way
+  size_t found_count = 0;
+  double start = TestGetSeconds();
+  for (const ModuleFunction &function : index.functions) {
+    found_count += BenchScanFunctions(
+                       index, index.names.c_str() + function.name_offset) !=
+                   NULL;
+  }
+  const double scan_seconds = TestGetSeconds() - start;
+
+  start = TestGetSeconds();
+  for (int i = 0; i < BENCH_LOOKUP_REPEAT_COUNT; ++i) {
+    for (const ModuleFunction &function : index.functions) {
+      found_count += ModuleFindFunction(
+                         &index, index.names.c_str() + function.name_offset) !=
+                     NULL;
+    }
+  }
+  const double hash_seconds =
+      (TestGetSeconds() - start) / BENCH_LOOKUP_REPEAT_COUNT;
+
+  start = TestGetSeconds();
+  ModuleBuildNameTable(&module.index);
+  const double build_seconds = TestGetSeconds() - start;
+
+  if (found_count !=
+      index.functions.size() * (1 + BENCH_LOOKUP_REPEAT_COUNT)) {
+    printf("start_bench: names of %s not found\n", path.c_str());
+    return 1;
+  }
+
+  printf("start_bench: %zu functions, %zu lines, best of %d, from launch\n",
+         index.functions.size(), index.lines.size(), BENCH_RUN_COUNT);
+  for (int i = 0; i < 2; ++i) {
+    printf("  %s indexed %.1f ms, planted %.1f ms, main %.1f ms\n", names[i],
+           best_runs[i].indexed_ms, best_runs[i].planted_ms,
+           best_runs[i].reached_ms);
+  }
+
+  const double function_count =
+      (double)std::max<size_t>(1, index.functions.size());
+  printf("  name lookup %.0f ns hashed, %.1f us scanned, table built in "
+         "%.2f ms\n",
+         hash_seconds / function_count * 1e9,
+         scan_seconds / function_count * 1e6, build_seconds * 1e3);
+
+  return 0;
+}
@@ -0,0 +1,264 @@
+#define TEST_WITH_TARGET
+#include "test.h"
+
+#include "../condition.h"
+#include "../agent.h"
+#include "../breakpoint.h"
+#include "../stepper.h"
+#include "../condition.cpp"
+#include "../agent.cpp"
+#include "../breakpoint.cpp"
+#include "../stepper.cpp"
+
+#define BENCH_STEP_COUNT 40
+
+// How a step over finds the next line
+enum class BenchStrategy {
+  // As before the decoder: an int3 on every line of the function, kept for
+  // good, each hit is a trap and a single step to put it back
+  FUNCTION_BREAKPOINTS,
+  // As the debugger does now: temporary int3s where the line is left,
+  // removed on hit
+  LINE_EXITS
+};
+
+struct BenchTarget {
+  Backend backend;
+  BackendEvent event; // Last one, continued by BenchRun
+  LineTable line_table;
+  MemoryCache *memory_cache;
+  Agent agent;
+  Breakpoints breakpoints;
+  Stepper *stepper; // Plans the steps, as in the debugger
+  DWORD64 address; // Where it's stopped
+  DWORD64 trap_count;
+  bool is_exited;
+};
+
+// Temporary breakpoints never take a debug register, so all of them are int3s
+static void BenchInsert(BenchTarget *target, DWORD64 address) {
+  BreakpointsQueueInsert(&target->breakpoints, address,
+                         BreakpointType::TEMPORARY);
+  ApplyBreakpoints(&target->breakpoints, target->memory_cache);
+}
+
+static void BenchRemove(BenchTarget *target, DWORD64 address) {
+  BreakpointsQueueRemove(&target->breakpoints, address);
+  ApplyBreakpoints(&target->breakpoints, target->memory_cache);
+}
+
+// Lets the target run to the next trap or to it's end
+static void BenchWait(BenchTarget *target, bool is_single_step) {
+  if (is_single_step) {
+    BackendSetSingleStep(&target->backend);
+  }
+  BackendContinue(&target->backend, target->event, true);
+
+  while (BackendWaitForEvent(&target->backend, &target->event, 1000)) {
+    const BackendEvent &event = target->event;
+    if (event.type == BackendEventType::EXIT_PROCESS) {
+      target->is_exited = true;
+      return;
+    }
+
+    if (event.type != BackendEventType::BREAKPOINT &&
+        event.type != BackendEventType::SINGLE_STEP) {
+      BackendContinue(&target->backend, event, false);
+      continue;
+    }
+
+    ++target->trap_count;
+    MemoryCacheInvalidate(target->memory_cache);
+
+    target->stepper->thread_id = event.thread_id;
+    DebuggerThread *thread = StepperGetThread(target->stepper);
+    thread->is_registers_read = false;
+    StepperGetRegisters(target->stepper, thread);
+    if (event.type == BackendEventType::BREAKPOINT &&
+        target->breakpoints.data.count(event.address)) {
+      thread->registers.Rip = event.address;
+      StepperSetRegisters(target->stepper, thread);
+    }
+    target->address = thread->registers.Rip;
+
+    return;
+  }
+
+  target->is_exited = true;
+}
+
+// Steps off an int3 of ours first, the way the debugger puts it back
+static void BenchRun(BenchTarget *target, bool is_single_step) {
+  if (target->breakpoints.data.count(target->address)) {
+    const DWORD64 address = target->address;
+    BenchRemove(target, address);
+    BenchWait(target, true);
+    BenchInsert(target, address);
+    if (is_single_step || target->is_exited) {
+      return;
+    }
+  }
+
+  BenchWait(target, is_single_step);
+}
+
+static void BenchStepOver(BenchTarget *target, BenchStrategy strategy) {
+  Stepper *stepper = target->stepper;
+
+  if (strategy == BenchStrategy::FUNCTION_BREAKPOINTS) {
+    DWORD64 module_base;
+    const ModuleFunction *function =
+        StepperFindFunction(stepper, target->address, &module_base);
+    if (function) {
+      const DWORD64 start = module_base + function->start_rva;
+      const DWORD64 end = module_base + function->end_rva;
+      const auto &addresses = target->line_table.addresses;
+      for (size_t i = LineTableLowerBound(&target->line_table, start);
+           i < addresses.size() && addresses[i] < end; ++i) {
+        BreakpointsQueueInsert(&target->breakpoints, addresses[i],
+                               BreakpointType::TEMPORARY);
+      }
+      ApplyBreakpoints(&target->breakpoints, target->memory_cache);
+    }
+
+    BenchRun(target, false);
+    return;
+  }
+
+  DebuggerThread *thread = StepperGetThread(stepper);
+  if (!StepperGetLine(stepper, target->address, &thread->step_file_id,
+                      &thread->step_line)) {
+    BenchRun(target, true);
+    return;
+  }
+
+  std::vector<DWORD64> targets;
+  do {
+    StepperGetStepTargets(stepper, false, &targets);
+    StepperStepTo(stepper, targets);
+
+    BenchRun(target, thread->step_breakpoints.empty());
+
+    StepperRemoveStepBreakpoints(stepper, thread);
+  } while (!target->is_exited &&
+           !StepperIsStepLineLeft(stepper, target->address));
+}
+
+// Lines of the launched target, then runs it to main
+static bool BenchRunToMain(BenchTarget *target, Module &&module) {
+  const ModuleIndex &index = module.index;
+  std::vector<DWORD> file_ids;
+  for (const std::string &source_file : index.source_files) {
+    file_ids.push_back(LineTableInternFile(&target->line_table, source_file));
+  }
+  std::vector<LineTableEntry> entries;
+  for (const ModuleLine &line : index.lines) {
+    entries.emplace_back(LineTableEntry{module.base + line.rva,
+                                        file_ids[line.file_index],
+                                        line.line});
+  }
+  LineTableInsert(&target->line_table, entries);
+
+  target->memory_cache = CreateMemoryCache(&target->backend);
+  target->stepper = CreateStepper(&target->backend, target->memory_cache,
+                                  &target->agent, &target->breakpoints);
+  target->stepper->line_table = &target->line_table;
+  target->stepper->modules.emplace_back(std::move(module));
+  target->trap_count = 0;
+  target->is_exited = false;
+
+  // Runs to main, it's where the steps start
+  const Module &main_module = target->stepper->modules[0];
+  const ModuleFunction *main_function =
+      ModuleFindFunction(&main_module.index, "main");
+  if (!main_function) {
+    return false;
+  }
+  const DWORD64 main_address = main_module.base + main_function->start_rva;
+  BenchInsert(target, main_address);
+  BenchWait(target, false);
+  BenchRemove(target, main_address);
+
+  return !target->is_exited && target->address == main_address;
+}
+
+// Lines stopped on, traps taken by the steps and by the rest of the run.
+// Function breakpoints stop on every line table entry, a line that has a few
+// is stopped on more than once, so traps are counted per line stepped to.
+static bool BenchRunStrategy(const std::string &path, BenchStrategy strategy,
+                             std::vector<DWORD> *lines, DWORD64 *step_traps,
+                             DWORD64 *run_traps, double *seconds) {
+  BenchTarget target = {};
+  Module module;
+  if (!TestLaunch(&target.backend, path, &target.event, &module)) {
+    return false;
+  }
+  if (!BenchRunToMain(&target, std::move(module))) {
+    TestKill(&target.backend);
+    return false;
+  }
+
+  const double start = TestGetSeconds();
+
+  target.trap_count = 0;
+  for (int i = 0; i < BENCH_STEP_COUNT && !target.is_exited; ++i) {
+    BenchStepOver(&target, strategy);
+
+    DWORD file_id;
+    DWORD line;
+    lines->push_back(
+        StepperGetLine(target.stepper, target.address, &file_id, &line)
+            ? line
+            : 0);
+  }
+  *step_traps = target.trap_count;
+
+  target.trap_count = 0;
+  while (!target.is_exited) {
+    BenchRun(&target, false);
+  }
+  *run_traps = target.trap_count;
+
+  *seconds = TestGetSeconds() - start;
+
+  return true;
+}
+
+// Steps over the lines of a loop in targets/step, then lets it run to the
+// end, with both strategies
+int main(int argc, char **argv) {
+  (void)argc;
+
+  const std::string path = TestGetTargetPath(argv[0], "step");
+
+  Global_TestIsLogMuted = true;
+
+  std::vector<DWORD> lines[2];
+  DWORD64 step_traps[2];
+  DWORD64 run_traps[2];
+  double seconds[2];
+  const BenchStrategy strategies[2] = {BenchStrategy::FUNCTION_BREAKPOINTS,
+                                       BenchStrategy::LINE_EXITS};
+  for (int i = 0; i < 2; ++i) {
+    if (!BenchRunStrategy(path, strategies[i], &lines[i], &step_traps[i],
+                          &run_traps[i], &seconds[i])) {
+      printf("step_bench: can't debug %s\n", path.c_str());
+      return 1;
+    }
+  }
+
+  printf("step_bench: %d steps over, then run to the end\n",
+         BENCH_STEP_COUNT);
+  const char *names[2] = {"line breakpoints", "line exits      "};
+  for (int i = 0; i < 2; ++i) {
+    size_t line_change_count = 0;
+    for (size_t j = 1; j < lines[i].size(); ++j) {
+      line_change_count += lines[i][j] != lines[i][j - 1];
+    }
+    printf("  %s %.2f traps a line, %llu traps after, %.1f ms\n", names[i],
+           (double)step_traps[i] / std::max<size_t>(1, line_change_count),
+           (unsigned long long)run_traps[i], seconds[i] * 1e3);
+  }
+
+  return 0;
+}
@@ -0,0 +1,239 @@
+#define TEST_WITH_TARGET
+#include "test.h"
+
+#include "../condition.h"
+#include "../agent.h"
+#include "../breakpoint.h"
+#include "../stepper.h"
+#include "../condition.cpp"
+#include "../agent.cpp"
+#include "../breakpoint.cpp"
+#include "../stepper.cpp"
+
+// Lines of targets/step
+#define TEST_CALL_LINE 14 // total += Add(i, i);
+#define TEST_NEXT_LINE 15 // total ^= i;
+
+struct TestTarget {
+  Backend backend;
+  BackendEvent event; // Last one, continued by the next step
+  LineTable line_table;
+  MemoryCache *memory_cache;
+  Agent agent;
+  Breakpoints breakpoints;
+  Stepper *stepper; // Plans and goes on with the steps, as in the debugger
+  DWORD64 trap_count; // Of the last step
+};
+
+// Lines of the executable are in the line table, as the debugger publishes
+// them. Stepper is there even if the launch fails, the checks that follow
+// fail.
+static bool TestLaunchTarget(TestTarget *target, const std::string &path) {
+  Module module;
+  const bool result =
+      TestLaunch(&target->backend, path, &target->event, &module);
+
+  const ModuleIndex &index = module.index;
+  std::vector<DWORD> file_ids;
+  for (const std::string &source_file : index.source_files) {
+    file_ids.push_back(LineTableInternFile(&target->line_table, source_file));
+  }
+  std::vector<LineTableEntry> entries;
+  for (const ModuleLine &line : index.lines) {
+    entries.emplace_back(LineTableEntry{module.base + line.rva,
+                                        file_ids[line.file_index],
+                                        line.line});
+  }
+  LineTableInsert(&target->line_table, entries);
+
+  target->memory_cache = CreateMemoryCache(&target->backend);
+  target->stepper = CreateStepper(&target->backend, target->memory_cache,
+                                  &target->agent, &target->breakpoints);
+  target->stepper->line_table = &target->line_table;
+  target->stepper->modules.emplace_back(std::move(module));
+
+  return result;
+}
+
+// Start of the function, 0 if there is none
+static DWORD64 TestGetFunction(TestTarget *target, const char *name,
+                               DWORD64 *end) {
+  const Module &module = target->stepper->modules[0];
+  const ModuleFunction *function = ModuleFindFunction(&module.index, name);
+  if (!function) {
+    return 0;
+  }
+
+  *end = module.base + function->end_rva;
+  return module.base + function->start_rva;
+}
+
+// First address of the line in the function, 0 if it has none
+static DWORD64 TestGetLineAddress(TestTarget *target, const char *function,
+                                  DWORD line) {
+  const LineTable &line_table = target->line_table;
+  DWORD64 end;
+  const DWORD64 start = TestGetFunction(target, function, &end);
+  for (size_t i = LineTableLowerBound(&line_table, start);
+       start && i < line_table.addresses.size() &&
+       line_table.addresses[i] < end;
+       ++i) {
+    if (line_table.lines[i] == line) {
+      return line_table.addresses[i];
+    }
+  }
+
+  return 0;
+}
+
+// Runs the target to an int3 at the address, then lifts it
+static bool TestRunTo(TestTarget *target, DWORD64 address) {
+  BreakpointsQueueInsert(&target->breakpoints, address,
+                         BreakpointType::TEMPORARY);
+  ApplyBreakpoints(&target->breakpoints, target->memory_cache);
+  MemoryCacheInvalidate(target->memory_cache);
+  BackendContinue(&target->backend, target->event, true);
+
+  const bool result = TestWaitFor(&target->backend,
+                                  BackendEventType::BREAKPOINT,
+                                  &target->event) &&
+                      target->event.address == address;
+
+  BreakpointsQueueRemove(&target->breakpoints, address);
+  ApplyBreakpoints(&target->breakpoints, target->memory_cache);
+  if (!result) {
+    return false;
+  }
+
+  target->backend.thread_id = target->event.thread_id;
+  target->stepper->thread_id = target->event.thread_id;
+  DebuggerThread *thread = StepperGetThread(target->stepper);
+  thread->is_registers_read = false;
+  StepperGetRegisters(target->stepper, thread);
+  thread->registers.Rip = address;
+
+  return StepperSetRegisters(target->stepper, thread);
+}
+
+// Steps the way the debugger does, from the command until the step is over.
+// Returns where it stopped, 0 if the target exited or timed out.
+static DWORD64 TestStep(TestTarget *target, DebuggerState state) {
+  Backend *backend = &target->backend;
+  BackendEvent &event = target->event;
+  Stepper *stepper = target->stepper;
+  DebuggerThread *thread = StepperGetThread(stepper);
+
+  target->trap_count = 0;
+  StepperSetState(stepper, state);
+  if (!StepperResume(stepper, [](DebuggerThread *) { return (DWORD64)0; })) {
+    return 0;
+  }
+  StepperStepOffCurrent(stepper, thread);
+
+  bool is_handled = true;
+  for (;;) {
+    StepperRunOn(stepper);
+    BackendContinue(backend, event, is_handled);
+    is_handled = true;
+
+    if (!BackendWaitForEvent(backend, &event, 5000) ||
+        event.type == BackendEventType::NONE ||
+        event.type == BackendEventType::EXIT_PROCESS) {
+      return 0;
+    }
+    if (event.type != BackendEventType::BREAKPOINT &&
+        event.type != BackendEventType::SINGLE_STEP) {
+      is_handled = false;
+      continue;
+    }
+
+    ++target->trap_count;
+    MemoryCacheInvalidate(target->memory_cache);
+    StepperGetRegisters(stepper, thread);
+    if (event.type == BackendEventType::BREAKPOINT) {
+      thread->registers.Rip = event.address;
+      StepperSetRegisters(stepper, thread);
+    } else {
+      StepperFinishDisplacedStep(stepper, thread);
+      StepperRearmBreakpoint(stepper, thread);
+    }
+
+    // Only the step's own int3s are there
+    const DWORD64 address = thread->registers.Rip;
+    auto it = target->breakpoints.data.find(address);
+    if (it != target->breakpoints.data.end()) {
+      if (thread->registers.Rsp < thread->step_frame_address) {
+        StepperStepOffBreakpoint(stepper, it->second);
+        continue;
+      }
+    } else if (!thread->step_breakpoints.empty()) {
+      continue;
+    }
+
+    StepperRemoveStepBreakpoints(stepper, thread);
+    if (StepperContinueStep(stepper)) {
+      StepperSetState(stepper, DebuggerState::NONE);
+      return address;
+    }
+    StepperStepOffCurrent(stepper, thread);
+  }
+}
+
+// Steps over and into the line of main that calls Add. Both run the line's
+// instructions between int3s, and stop exactly where the next line starts.
+static void TestStepOverCall(const std::string &path) {
+  TestTarget target = {};
+  TEST_CHECK(TestLaunchTarget(&target, path))
+
+  DWORD64 add_end;
+  const DWORD64 add_address = TestGetFunction(&target, "Add", &add_end);
+  const DWORD64 call_address =
+      TestGetLineAddress(&target, "main", TEST_CALL_LINE);
+  const DWORD64 next_address =
+      TestGetLineAddress(&target, "main", TEST_NEXT_LINE);
+  TEST_CHECK(add_address && call_address && next_address)
+
+  // Line is a few instructions, the call among them
+  BYTE code[INSTRUCTION_MAX_LENGTH];
+  size_t instruction_count = 0;
+  bool is_call_found = false;
+  for (DWORD64 address = call_address; address < next_address;) {
+    Instruction instruction;
+    if (!InstructionDecode(code,
+                           StepperReadCode(target.stepper, address, code),
+                           address, true, &instruction)) {
+      break;
+    }
+    is_call_found = is_call_found || instruction.type == InstructionType::CALL;
+    ++instruction_count;
+    address += instruction.length;
+  }
+  TEST_CHECK(is_call_found)
+  TEST_CHECK(instruction_count > 2)
+
+  TEST_CHECK(TestRunTo(&target, call_address))
+  TEST_CHECK(TestStep(&target, DebuggerState::STEP_OVER) == next_address)
+  TEST_CHECK(target.trap_count < instruction_count)
+
+  // Next time around the loop
+  TEST_CHECK(TestRunTo(&target, call_address))
+  TEST_CHECK(TestStep(&target, DebuggerState::STEP_IN) == add_address)
+  TEST_CHECK(target.trap_count < instruction_count)
+
+  // Step breakpoints are all gone
+  TEST_CHECK(target.breakpoints.data.empty())
+
+  TestKill(&target.backend);
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+
+  const std::string path = TestGetTargetPath(argv[0], "step");
+
+  Global_TestIsLogMuted = true;
+
+  TestStepOverCall(path);
+
+  return TestFinish("step_test");
+}
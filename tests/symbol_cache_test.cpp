@@ -0,0 +1,176 @@
+#include "test.h"
+
+#include "../registers.h"
+#include "../dwarf.h"
+#include "../unwinder.h"
+#include "../module_index.h"
+#include "../symbol_cache.h"
+#include "../symbol_cache_codec.cpp"
+
+static SymbolCacheKey TestGetKey() {
+  SymbolCacheKey key = {};
+  key.path = "C:\\service\\bin\\service.dll";
+  key.size = 0x123456;
+  key.timestamp = 0x5f5e1000;
+  for (int i = 0; i < 16; ++i) {
+    key.build_id[i] = (BYTE)(i * 17);
+  }
+  key.build_age = 3;
+
+  return key;
+}
+
+static ModuleIndex TestGetModuleIndex() {
+  ModuleIndex module_index;
+  module_index.source_files = {"a.cpp", "b.cpp", "include\\c.h"};
+  for (DWORD i = 0; i < 1000; ++i) {
+    module_index.lines.push_back(ModuleLine{0x1000 + i * 4, i % 3, 10 + i});
+  }
+
+  const char *names[] = {"main", "Process", "Handle", "Inlined"};
+  for (const char *name : names) {
+    const DWORD name_offset = (DWORD)module_index.names.size();
+    module_index.names.append(name);
+    module_index.names.push_back('\0');
+
+    const DWORD start_rva = 0x1000 + name_offset * 0x10;
+    if (strcmp(name, "Inlined") == 0) {
+      module_index.inline_sites.push_back(
+          ModuleInlineSite{start_rva, start_rva + 8, name_offset});
+    } else {
+      module_index.functions.push_back(
+          ModuleFunction{start_rva, start_rva + 0x10, name_offset});
+    }
+  }
+
+  return module_index;
+}
+
+static bool TestIsSameLine(const ModuleLine &a, const ModuleLine &b) {
+  return a.rva == b.rva && a.file_index == b.file_index && a.line == b.line;
+}
+
+static void TestRoundTrip() {
+  const SymbolCacheKey key = TestGetKey();
+  const ModuleIndex module_index = TestGetModuleIndex();
+
+  std::vector<BYTE> data;
+  SymbolCacheSerialize(&key, &module_index, &data);
+
+  ModuleIndex result;
+  TEST_CHECK(SymbolCacheDeserialize(&key, data.data(), data.size(), &result))
+  TEST_CHECK(result.source_files == module_index.source_files)
+  TEST_CHECK(result.names == module_index.names)
+  TEST_CHECK(result.lines.size() == module_index.lines.size())
+  for (size_t i = 0; i < result.lines.size(); ++i) {
+    TEST_CHECK(TestIsSameLine(result.lines[i], module_index.lines[i]))
+  }
+  TEST_CHECK(result.functions.size() == module_index.functions.size())
+  for (size_t i = 0; i < result.functions.size(); ++i) {
+    TEST_CHECK(memcmp(&result.functions[i], &module_index.functions[i],
+                      sizeof(ModuleFunction)) == 0)
+  }
+  TEST_CHECK(result.inline_sites.size() == module_index.inline_sites.size())
+  TEST_CHECK(result.inline_sites.size() &&
+             memcmp(&result.inline_sites[0], &module_index.inline_sites[0],
+                    sizeof(ModuleInlineSite)) == 0)
+
+  // Empty module too
+  ModuleIndex empty;
+  SymbolCacheSerialize(&key, &empty, &data);
+  TEST_CHECK(SymbolCacheDeserialize(&key, data.data(), data.size(), &result))
+  TEST_CHECK(result.lines.empty() && result.functions.empty() &&
+             result.source_files.empty())
+}
+
+// Header with a new checksum, so that only the changed field can be the
+// reason the cache is rejected
+static void TestRewriteHeader(std::vector<BYTE> *data,
+                              const std::function<void(SymbolCacheHeader *)>
+                                  &change) {
+  SymbolCacheHeader header;
+  memcpy(&header, data->data(), sizeof(header));
+  change(&header);
+
+  header.checksum = 0;
+  header.checksum = SymbolCacheChecksum(
+      data->data() + sizeof(header), data->size() - sizeof(header),
+      SymbolCacheChecksum((const BYTE *)&header, sizeof(header)));
+  memcpy(data->data(), &header, sizeof(header));
+}
+
+static void TestCorruption() {
+  const SymbolCacheKey key = TestGetKey();
+  const ModuleIndex module_index = TestGetModuleIndex();
+
+  std::vector<BYTE> data;
+  SymbolCacheSerialize(&key, &module_index, &data);
+
+  ModuleIndex result;
+  result.names = "untouched";
+
+  // Truncated anywhere, down to an empty file
+  for (size_t size : {data.size() - 1, data.size() / 2,
+                      sizeof(SymbolCacheHeader), sizeof(SymbolCacheHeader) - 1,
+                      (size_t)0}) {
+    TEST_CHECK(!SymbolCacheDeserialize(&key, data.data(), size, &result))
+  }
+
+  // Flipped byte of the checksum itself, and of the contents
+  std::vector<BYTE> corrupted = data;
+  corrupted[offsetof(SymbolCacheHeader, checksum)] ^= 0x01;
+  TEST_CHECK(!SymbolCacheDeserialize(&key, corrupted.data(), corrupted.size(),
+                                     &result))
+  for (size_t offset = sizeof(SymbolCacheHeader); offset < data.size();
+       offset += 97) {
+    corrupted = data;
+    corrupted[offset] ^= 0x40;
+    TEST_CHECK(!SymbolCacheDeserialize(&key, corrupted.data(),
+                                       corrupted.size(), &result))
+  }
+
+  // Version of another build of the debugger
+  corrupted = data;
+  TestRewriteHeader(&corrupted, [](SymbolCacheHeader *header) {
+    header->version = SYMBOL_CACHE_VERSION - 1;
+  });
+  TEST_CHECK(!SymbolCacheDeserialize(&key, corrupted.data(), corrupted.size(),
+                                     &result))
+
+  corrupted = data;
+  TestRewriteHeader(&corrupted,
+                    [](SymbolCacheHeader *header) { header->magic = 0; });
+  TEST_CHECK(!SymbolCacheDeserialize(&key, corrupted.data(), corrupted.size(),
+                                     &result))
+
+  // Counts that don't add up to the size
+  corrupted = data;
+  TestRewriteHeader(&corrupted,
+                    [](SymbolCacheHeader *header) { ++header->line_count; });
+  TEST_CHECK(!SymbolCacheDeserialize(&key, corrupted.data(), corrupted.size(),
+                                     &result))
+
+  // Stale, the module changed since
+  SymbolCacheKey other_key = key;
+  other_key.timestamp++;
+  TEST_CHECK(!SymbolCacheDeserialize(&other_key, data.data(), data.size(),
+                                     &result))
+  other_key = key;
+  other_key.build_id[15] ^= 1;
+  TEST_CHECK(!SymbolCacheDeserialize(&other_key, data.data(), data.size(),
+                                     &result))
+  other_key = key;
+  other_key.path += "x";
+  TEST_CHECK(!SymbolCacheDeserialize(&other_key, data.data(), data.size(),
+                                     &result))
+
+  // Failures leave the index alone
+  TEST_CHECK(result.names == "untouched")
+}
+
+int main() {
+  TestRoundTrip();
+  TestCorruption();
+
+  return TestFinish("symbol_cache_test");
+}
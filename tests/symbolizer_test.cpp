@@ -0,0 +1,124 @@
+#include "test.h"
+
+// DbgHelp as far as the symbolizer uses it. Names and lines follow from the
+// address, so a reader can tell a torn or moved entry.
+#define MAX_SYM_NAME 2000
+
+struct SYMBOL_INFO {
+  ULONG SizeOfStruct;
+  ULONG MaxNameLen;
+  char Name[1];
+};
+
+struct IMAGEHLP_LINE64 {
+  DWORD SizeOfStruct;
+  char *FileName;
+  DWORD LineNumber;
+};
+
+static bool SymFromAddr(HANDLE, DWORD64 address, DWORD64 *displacement,
+                        SYMBOL_INFO *symbol_info) {
+  *displacement = 0;
+  snprintf(symbol_info->Name, symbol_info->MaxNameLen, "F%llx",
+           (unsigned long long)address);
+  return true;
+}
+
+static bool SymGetLineFromAddr64(HANDLE, DWORD64 address,
+                                 DWORD *displacement, IMAGEHLP_LINE64 *line) {
+  // Held by Global_DbgHelpMutex, like DbgHelp's own buffer
+  static char filename[64];
+  snprintf(filename, sizeof(filename), "file%llx.cpp",
+           (unsigned long long)address);
+  *displacement = 0;
+  line->FileName = filename;
+  line->LineNumber = (DWORD)(address & 0xffff);
+  return true;
+}
+
+#include "../symbolizer.h"
+#include "../symbolizer.cpp"
+
+#define SYMBOLIZER_TEST_READERS 4
+#define SYMBOLIZER_TEST_ADDRESSES 20000 // Rehashes the map many times
+
+static bool TestIsSymbolOf(const SymbolizerSymbol *symbol, DWORD64 address) {
+  std::stringstream function;
+  function << "F" << std::hex << address;
+  std::stringstream filename;
+  filename << "file" << std::hex << address << ".cpp";
+
+  return symbol->is_resolved && symbol->function == function.str() &&
+         symbol->filename == filename.str() &&
+         symbol->line == (address & 0xffff);
+}
+
+// Readers ask for overlapping addresses the way the UI does and read the
+// resolved entries without the lock, while the worker publishes others and
+// the map rehashes. Entries handed out before are read again on every round.
+static void TestStress() {
+  Symbolizer *symbolizer = CreateSymbolizer(NULL);
+
+  std::atomic<size_t> read_count{0};
+  std::atomic<size_t> bad_read_count{0};
+
+  std::vector<std::thread> readers;
+  for (size_t reader = 0; reader < SYMBOLIZER_TEST_READERS; ++reader) {
+    readers.emplace_back([&, reader]() {
+      std::vector<std::pair<DWORD64, const SymbolizerSymbol *>> resolved;
+      std::vector<bool> is_resolved(SYMBOLIZER_TEST_ADDRESSES);
+      const DWORD64 first = reader * SYMBOLIZER_TEST_ADDRESSES / 2;
+
+      while (resolved.size() < SYMBOLIZER_TEST_ADDRESSES) {
+        for (size_t i = 0; i < SYMBOLIZER_TEST_ADDRESSES; ++i) {
+          if (is_resolved[i]) {
+            continue;
+          }
+
+          const DWORD64 address = 0x400000 + (first + i) * 16;
+          const SymbolizerSymbol *symbol =
+              SymbolizerFind(symbolizer, address);
+          if (symbol) {
+            is_resolved[i] = true;
+            resolved.emplace_back(address, symbol);
+          }
+        }
+
+        for (const auto &it : resolved) {
+          bad_read_count += !TestIsSymbolOf(it.second, it.first);
+          ++read_count;
+        }
+        std::this_thread::yield();
+      }
+
+      // Same entry comes back once it's resolved
+      for (const auto &it : resolved) {
+        bad_read_count += SymbolizerFind(symbolizer, it.first) != it.second;
+      }
+    });
+  }
+
+  for (auto &reader : readers) {
+    reader.join();
+  }
+
+  TEST_CHECK(bad_read_count.load() == 0)
+  TEST_CHECK(read_count.load() >= SYMBOLIZER_TEST_READERS *
+                                      SYMBOLIZER_TEST_ADDRESSES)
+  {
+    std::lock_guard<std::mutex> lock(symbolizer->mutex);
+    TEST_CHECK(symbolizer->requests.empty())
+  }
+
+  SymbolizerStop(symbolizer);
+
+  // Nothing resolves after the stop
+  TEST_CHECK(!SymbolizerFind(symbolizer, 0x10))
+  delete symbolizer;
+}
+
+int main() {
+  TestStress();
+
+  return TestFinish("symbolizer_test");
+}
@@ -0,0 +1,35 @@
+// Started by start_bench, it's 30000 functions make the module index and
+// line table big. They are never called.
+
+#define TARGET_FUNCTION(NAME)                                                  \
+  int NAME(int x) { return x * 3 + 1; }
+
+// Ten functions for each digit appended to the name
+#define TARGET_DIGITS_1(NAME)                                                  \
+  TARGET_FUNCTION(NAME##0) TARGET_FUNCTION(NAME##1) TARGET_FUNCTION(NAME##2)   \
+  TARGET_FUNCTION(NAME##3) TARGET_FUNCTION(NAME##4) TARGET_FUNCTION(NAME##5)   \
+  TARGET_FUNCTION(NAME##6) TARGET_FUNCTION(NAME##7) TARGET_FUNCTION(NAME##8)   \
+  TARGET_FUNCTION(NAME##9)
+#define TARGET_DIGITS_2(NAME)                                                  \
+  TARGET_DIGITS_1(NAME##0) TARGET_DIGITS_1(NAME##1) TARGET_DIGITS_1(NAME##2)   \
+  TARGET_DIGITS_1(NAME##3) TARGET_DIGITS_1(NAME##4) TARGET_DIGITS_1(NAME##5)   \
+  TARGET_DIGITS_1(NAME##6) TARGET_DIGITS_1(NAME##7) TARGET_DIGITS_1(NAME##8)   \
+  TARGET_DIGITS_1(NAME##9)
+#define TARGET_DIGITS_3(NAME)                                                  \
+  TARGET_DIGITS_2(NAME##0) TARGET_DIGITS_2(NAME##1) TARGET_DIGITS_2(NAME##2)   \
+  TARGET_DIGITS_2(NAME##3) TARGET_DIGITS_2(NAME##4) TARGET_DIGITS_2(NAME##5)   \
+  TARGET_DIGITS_2(NAME##6) TARGET_DIGITS_2(NAME##7) TARGET_DIGITS_2(NAME##8)   \
+  TARGET_DIGITS_2(NAME##9)
+#define TARGET_DIGITS_4(NAME)                                                  \
+  TARGET_DIGITS_3(NAME##0) TARGET_DIGITS_3(NAME##1) TARGET_DIGITS_3(NAME##2)   \
+  TARGET_DIGITS_3(NAME##3) TARGET_DIGITS_3(NAME##4) TARGET_DIGITS_3(NAME##5)   \
+  TARGET_DIGITS_3(NAME##6) TARGET_DIGITS_3(NAME##7) TARGET_DIGITS_3(NAME##8)   \
+  TARGET_DIGITS_3(NAME##9)
+
+TARGET_DIGITS_4(Function1)
+TARGET_DIGITS_4(Function2)
+TARGET_DIGITS_4(Function3)
+
+int main() {
+  return 0;
+}
@@ -0,0 +1,21 @@
+// Debugged by backend_test. Loads plugin.so, found next to it, calls into it
+// and unloads it again.
+#include <dlfcn.h>
+#include <string>
+
+int main(int argc, char **argv) {
+  (void)argc;
+
+  std::string path = argv[0];
+  path.replace(path.rfind('/') + 1, std::string::npos, "plugin.so");
+  void *plugin = dlopen(path.c_str(), RTLD_NOW);
+  if (!plugin) {
+    return 1;
+  }
+
+  int (*Plugin)() = (int (*)())dlsym(plugin, "Plugin");
+  const int result = Plugin ? Plugin() : 1;
+  dlclose(plugin);
+
+  return result;
+}
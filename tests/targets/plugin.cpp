@@ -0,0 +1,2 @@
+// Shared object that targets/load loads while it's debugged
+extern "C" __attribute__((noinline)) int Plugin() { return 0; }
@@ -0,0 +1,33 @@
+// Walked by unwind_bench. Recurses 10000 deep, then traps from a qsort
+// callback so that libc frames are in the middle of the stack.
+#include <stdlib.h>
+
+#define TARGET_DEPTH 10000
+
+static int Compare(const void *a, const void *b) {
+  static bool is_trapped;
+  if (!is_trapped) {
+    is_trapped = true;
+    __asm__ volatile("int3");
+  }
+
+  return *(const int *)a - *(const int *)b;
+}
+
+extern "C" __attribute__((noinline)) int Recurse(int n, volatile int *sink) {
+  int local[4] = {n, n + 1, n + 2, n + 3};
+  if (n == 0) {
+    int values[4] = {3, 1, 2, 0};
+    qsort(values, 4, sizeof(int), Compare);
+    return values[0] + local[1];
+  }
+
+  const int result = Recurse(n - 1, sink) + local[n & 3];
+  *sink = result;
+  return result;
+}
+
+int main() {
+  volatile int sink;
+  return Recurse(TARGET_DEPTH, &sink) & 1;
+}
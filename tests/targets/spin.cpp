@@ -0,0 +1,35 @@
+// Attached to by attach_bench. Threads, given as the argument, spin in Spin
+// until the process is killed.
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+volatile unsigned long global_total;
+
+extern "C" __attribute__((noinline)) void Spin(volatile unsigned long *x) {
+  *x += 1;
+}
+
+static void *Run(void *) {
+  volatile unsigned long x = 0;
+  for (;;) {
+    Spin(&x);
+    if ((x & 1023) == 0) {
+      __atomic_fetch_add(&global_total, 1, __ATOMIC_RELAXED);
+    }
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  const int thread_count = argc > 1 ? atoi(argv[1]) : 1;
+  for (int i = 0; i < thread_count; ++i) {
+    pthread_t thread;
+    pthread_create(&thread, 0, Run, 0);
+  }
+
+  for (;;) {
+    pause();
+  }
+}
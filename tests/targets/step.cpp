@@ -0,0 +1,20 @@
+// Stepped over line by line by step_bench, then let run to the end. Stepped
+// over and into the call of Add by step_test.
+
+volatile int global_total;
+
+extern "C" int Add(int a, int b) {
+  int c = a + b;
+  return c;
+}
+
+int main() {
+  int total = 0;
+  for (int i = 0; i < 200; ++i) {
+    total += Add(i, i);
+    total ^= i;
+  }
+  global_total = total;
+
+  return 0;
+}
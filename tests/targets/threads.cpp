@@ -0,0 +1,36 @@
+// Debugged by threads_test, with int3s on every instruction of Count and
+// Work. Exits with 1 if an increment got lost. C names, to be found in
+// .symtab as they are.
+#include <pthread.h>
+
+#define TARGET_THREAD_COUNT 4
+#define TARGET_COUNT 50
+
+long global_total;
+long global_odd_counts[TARGET_THREAD_COUNT];
+
+extern "C" void Count(long index, long i) {
+  __atomic_fetch_add(&global_total, 1, __ATOMIC_SEQ_CST);
+  global_odd_counts[index] += i & 1;
+}
+
+extern "C" void *Work(void *argument) {
+  const long index = (long)argument;
+  for (long i = 0; i < TARGET_COUNT; ++i) {
+    Count(index, i);
+  }
+
+  return 0;
+}
+
+int main() {
+  pthread_t threads[TARGET_THREAD_COUNT];
+  for (long i = 0; i < TARGET_THREAD_COUNT; ++i) {
+    pthread_create(&threads[i], 0, Work, (void *)i);
+  }
+  for (long i = 0; i < TARGET_THREAD_COUNT; ++i) {
+    pthread_join(threads[i], 0);
+  }
+
+  return global_total == TARGET_THREAD_COUNT * TARGET_COUNT ? 0 : 1;
+}
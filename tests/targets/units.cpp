@@ -0,0 +1,28 @@
+// Indexed by elf_reader_bench. The Makefile builds it 40 times with -O2, one
+// unit for each TARGET_UNIT, so that many units share headers and inlines.
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define TARGET_JOIN(A, B) A##B
+#define TARGET_NAME(A, B) TARGET_JOIN(A, B)
+
+std::string TARGET_NAME(Unit, TARGET_UNIT)(int count) {
+  std::map<std::string, std::vector<int>> values;
+  for (int i = 0; i < count; ++i) {
+    values[std::to_string(i % 7)].push_back(i);
+  }
+
+  std::ostringstream text;
+  for (auto &it : values) {
+    std::sort(it.second.begin(), it.second.end());
+    text << it.first << ':' << it.second.size() << ' ';
+  }
+  return text.str();
+}
+
+#if TARGET_UNIT == 0
+int main() { return Unit0(10).empty() ? 1 : 0; }
+#endif
@@ -0,0 +1,196 @@
+// Linux tests and benchmarks include the modules they cover straight from
+// the tree, like main.cpp does. This is the part of main.h they need,
+// without Win32, DbgHelp or ImGui.
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/signalfd.h>
+#include <dirent.h>
+#include <elf.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef uint64_t DWORD64;
+typedef unsigned long ULONG;
+typedef size_t SIZE_T;
+typedef void *HANDLE;
+
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <map>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#include <functional>
+#include <assert.h>
+#include <fstream>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <list>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <chrono>
+#include <atomic>
+#include <cmath>
+#include <random>
+
+static std::mutex Global_DbgHelpMutex;
+static bool Global_TestIsLogMuted; // Benchmarks log per module or per hit
+
+template <typename... Args>
+inline void TestLog(const char *type, Args &&...args) {
+  if (Global_TestIsLogMuted) {
+    return;
+  }
+
+  std::stringstream ss;
+  ss << type << ": ";
+  (ss << ... << args);
+  fprintf(stderr, "%s\n", ss.str().c_str());
+}
+
+#define LOG_IMGUI(TYPE, ...) TestLog(#TYPE, __VA_ARGS__);
+#define LOG(TYPE) std::cout << #TYPE << ": "
+
+static int Global_TestFailureCount;
+
+#define TEST_CHECK(CONDITION)                                                  \
+  if (!(CONDITION)) {                                                          \
+    fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #CONDITION);            \
+    ++Global_TestFailureCount;                                                 \
+  }
+
+// Exit code of a test's main
+inline int TestFinish(const char *name) {
+  if (Global_TestFailureCount) {
+    printf("%s: %d checks failed\n", name, Global_TestFailureCount);
+    return 1;
+  }
+
+  printf("%s: ok\n", name);
+  return 0;
+}
+
+inline double TestGetSeconds() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Tests and benchmarks that debug a program of targets/ define it before the
+// include, they share the modules under the backend and the helpers below
+#ifdef TEST_WITH_TARGET
+#include "../registers.h"
+#include "../backend.h"
+#include "../memory_cache.h"
+#include "../dwarf.h"
+#include "../unwinder.h"
+#include "../instruction_decoder.h"
+#include "../line_table.h"
+#include "../module_index.h"
+#include "../elf_reader.h"
+#include "../module_loader.h"
+#include "../registers.cpp"
+#include "../backend_ptrace.cpp"
+#include "../memory_cache.cpp"
+#include "../dwarf.cpp"
+#include "../unwinder.cpp"
+#include "../instruction_decoder.cpp"
+#include "../line_table.cpp"
+#include "../elf_reader.cpp"
+#include "../module_loader.cpp"
+
+// targets/<name>, next to the test's own binary
+inline std::string TestGetTargetPath(const char *argv0, const char *name) {
+  const std::string path = argv0;
+  return path.substr(0, path.find_last_of('/') + 1) + "targets/" + name;
+}
+
+// Starts the target, stopped before it's first instruction with the
+// CREATE_PROCESS event in "event". "module" - the executable indexed at it's
+// base, unless NULL.
+inline bool TestLaunch(Backend *backend, const std::string &path,
+                       BackendEvent *event, Module *module) {
+  if (!BackendLaunch(backend, std::wstring(path.begin(), path.end()))) {
+    return false;
+  }
+
+  if (!BackendWaitForEvent(backend, event, 1000) ||
+      event->type != BackendEventType::CREATE_PROCESS ||
+      (module && !ModuleLoad(NULL, NULL, path, event->base_address, module))) {
+    kill(backend->process_id, SIGKILL);
+    waitpid(backend->process_id, NULL, 0);
+    return false;
+  }
+
+  return true;
+}
+
+// Stops a running process and handles the events the attach reports, the
+// process, it's threads and modules, in "events". It runs again after.
+// "stop_seconds" - time until all threads were stopped, unless NULL.
+inline bool TestAttach(Backend *backend, pid_t process_id,
+                       std::vector<BackendEvent> *events,
+                       double *stop_seconds) {
+  const double start = TestGetSeconds();
+  if (!BackendAttach(backend, process_id)) {
+    return false;
+  }
+  if (stop_seconds) {
+    *stop_seconds = TestGetSeconds() - start;
+  }
+
+  while (backend->is_attaching) {
+    BackendEvent event;
+    if (!BackendWaitForEvent(backend, &event, 1000)) {
+      return false;
+    }
+
+    if (event.type != BackendEventType::NONE) {
+      BackendContinue(backend, event, true);
+      events->push_back(std::move(event));
+    }
+  }
+
+  return true;
+}
+
+// Runs the target until an event of the type, the ones before it are
+// continued with their signals delivered. False on exit or timeout, the
+// event that came is in "event" either way.
+inline bool TestWaitFor(Backend *backend, BackendEventType type,
+                        BackendEvent *event) {
+  while (BackendWaitForEvent(backend, event, 5000) &&
+         event->type != BackendEventType::NONE &&
+         event->type != BackendEventType::EXIT_PROCESS) {
+    if (event->type == type) {
+      return true;
+    }
+    BackendContinue(backend, *event, false);
+  }
+
+  return false;
+}
+
+// Kills a target that hasn't exited, and reaps it
+inline void TestKill(Backend *backend) {
+  if (kill(backend->process_id, SIGKILL) == 0) {
+    waitpid(backend->process_id, NULL, 0);
+  }
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,384 @@
+#define TEST_WITH_TARGET
+#include "test.h"
+
+#include "../condition.h"
+#include "../agent.h"
+#include "../breakpoint.h"
+#include "../stepper.h"
+#include "../condition.cpp"
+#include "../agent.cpp"
+#include "../breakpoint.cpp"
+#include "../stepper.cpp"
+
+// Same as in targets/threads
+#define TEST_THREAD_COUNT 4
+#define TEST_COUNT 50
+
+struct TestTarget {
+  Backend backend;
+  BackendEvent event;
+  Module module;
+  MemoryCache *memory_cache;
+  Agent agent;
+  Breakpoints breakpoints;
+  Stepper *stepper; // Steps off the breakpoints, as in the debugger
+  std::unordered_map<DWORD64, DWORD64> hit_counts; // By address
+  std::unordered_map<DWORD, DWORD64> thread_hit_counts;
+  DWORD64 displaced_count;
+  DWORD64 in_place_count; // Instructions that couldn't be relocated
+  DWORD64 stray_count;    // Traps that aren't ours
+  DWORD64 signal_count;
+  size_t created_thread_count;
+  size_t exited_thread_count;
+  DWORD exit_code;
+  bool is_exited;
+
+  // Non-stop, the first thread to hit is kept there while the others run
+  DWORD suspended_thread_id; // 0 - none
+  DWORD64 suspended_address;
+
+  // All-stop, the next hit stops every thread and isn't continued
+  bool is_stopping;
+};
+
+// Stepper is there even if the launch fails, the checks that follow fail
+static bool TestLaunchTarget(TestTarget *target, const std::string &path) {
+  const bool result =
+      TestLaunch(&target->backend, path, &target->event, &target->module);
+  target->memory_cache = CreateMemoryCache(&target->backend);
+  target->stepper = CreateStepper(&target->backend, target->memory_cache,
+                                  &target->agent, &target->breakpoints);
+
+  return result;
+}
+
+// int3 on every instruction of a function. Temporary breakpoints never take
+// a debug register, so all of them are int3s.
+static bool TestInsertFunction(TestTarget *target, const char *name,
+                               DWORD64 *start) {
+  const ModuleFunction *function =
+      ModuleFindFunction(&target->module.index, name);
+  if (!function) {
+    return false;
+  }
+
+  *start = target->module.base + function->start_rva;
+  const DWORD64 end = target->module.base + function->end_rva;
+  for (DWORD64 address = *start; address < end;) {
+    BYTE code[INSTRUCTION_MAX_LENGTH];
+    const SIZE_T size = StepperReadCode(target->stepper, address, code);
+    Instruction instruction;
+    if (!InstructionDecode(code, size, address, true, &instruction)) {
+      return false;
+    }
+
+    BreakpointsQueueInsert(&target->breakpoints, address,
+                           BreakpointType::TEMPORARY);
+    address += instruction.length;
+  }
+
+  return ApplyBreakpoints(&target->breakpoints, target->memory_cache);
+}
+
+// Steps the current thread off the breakpoint it's on, through a copy or in
+// place
+static void TestStepOff(TestTarget *target, DWORD64 address) {
+  StepperStepOffBreakpoint(target->stepper,
+                           target->breakpoints.data[address]);
+  if (StepperGetThread(target->stepper)->displaced_next) {
+    ++target->displaced_count;
+  } else {
+    ++target->in_place_count;
+  }
+}
+
+// Handles one event and continues it. False on timeout.
+static bool TestHandleEvent(TestTarget *target) {
+  Backend *backend = &target->backend;
+  BackendEvent &event = target->event;
+  if (!BackendWaitForEvent(backend, &event, 5000) ||
+      event.type == BackendEventType::NONE) {
+    return false;
+  }
+  backend->thread_id = event.thread_id;
+  target->stepper->thread_id = event.thread_id;
+  DebuggerThread *thread = StepperGetThread(target->stepper);
+  MemoryCacheInvalidate(target->memory_cache);
+
+  bool is_handled = true;
+  switch (event.type) {
+  case BackendEventType::EXIT_PROCESS:
+    target->exit_code = event.code;
+    target->is_exited = true;
+    return true;
+  case BackendEventType::CREATE_THREAD:
+    ++target->created_thread_count;
+    break;
+  case BackendEventType::EXIT_THREAD:
+    ++target->exited_thread_count;
+    StepperRemoveThread(target->stepper, event.thread_id);
+    break;
+  case BackendEventType::SINGLE_STEP:
+    StepperGetRegisters(target->stepper, thread);
+    StepperFinishDisplacedStep(target->stepper, thread);
+    StepperRearmBreakpoint(target->stepper, thread);
+    break;
+  case BackendEventType::BREAKPOINT: {
+    if (!target->breakpoints.data.count(event.address)) {
+      ++target->stray_count;
+      break;
+    }
+    ++target->hit_counts[event.address];
+    ++target->thread_hit_counts[event.thread_id];
+
+    StepperGetRegisters(target->stepper, thread);
+    thread->registers.Rip = event.address;
+    StepperSetRegisters(target->stepper, thread);
+
+    if (target->is_stopping) {
+      StepperStop(target->stepper, DebuggerStopReason::BREAKPOINT);
+      return true;
+    }
+
+    // Stepping off waits for the resume, like in the debugger
+    if (target->stepper->is_non_stop && !target->suspended_address) {
+      target->suspended_thread_id = event.thread_id;
+      target->suspended_address = event.address;
+      StepperStop(target->stepper, DebuggerStopReason::BREAKPOINT);
+      break;
+    }
+
+    TestStepOff(target, event.address);
+    break;
+  }
+  case BackendEventType::EXCEPTION:
+    ++target->signal_count;
+    is_handled = false;
+    break;
+  default:
+    break;
+  }
+
+  StepperRunOn(target->stepper);
+  BackendContinue(backend, event, is_handled);
+
+  return true;
+}
+
+// Every thread traps on every instruction of Count and of the loop that
+// calls it, and steps off through a copy. None of them may run past an int3
+// unseen, or skip or repeat an instruction.
+static void TestDisplacedSteps(const std::string &path) {
+  TestTarget target = {};
+  TEST_CHECK(TestLaunchTarget(&target, path))
+
+  DWORD64 count_address = 0;
+  DWORD64 work_address = 0;
+  TEST_CHECK(TestInsertFunction(&target, "Count", &count_address))
+  TEST_CHECK(TestInsertFunction(&target, "Work", &work_address))
+  MemoryCacheInvalidate(target.memory_cache);
+  BackendContinue(&target.backend, target.event, true);
+
+  while (!target.is_exited && TestHandleEvent(&target)) {
+  }
+
+  TEST_CHECK(target.is_exited)
+  TEST_CHECK(target.exit_code == 0)
+  TEST_CHECK(target.created_thread_count == TEST_THREAD_COUNT)
+  TEST_CHECK(target.exited_thread_count == TEST_THREAD_COUNT)
+  TEST_CHECK(target.hit_counts[work_address] == TEST_THREAD_COUNT)
+  TEST_CHECK(target.hit_counts[count_address] ==
+             TEST_THREAD_COUNT * TEST_COUNT)
+  TEST_CHECK(target.in_place_count == 0)
+  TEST_CHECK(target.stray_count == 0)
+  TEST_CHECK(target.signal_count == 0)
+
+  // Each instruction of Count runs once per call
+  for (auto &it : target.hit_counts) {
+    const ModuleFunction *function = ModuleFindFunctionAt(
+        &target.module.index, (DWORD)(it.first - target.module.base));
+    if (function &&
+        target.module.base + function->start_rva == count_address) {
+      TEST_CHECK(it.second == TEST_THREAD_COUNT * TEST_COUNT)
+    }
+  }
+
+  if (!target.is_exited) {
+    TestKill(&target.backend);
+  }
+}
+
+// Every thread stops when one hits, and each keeps it's own registers, stop
+// reason and step state while the test switches between them. Registers are
+// read once per stop, and again after the target ran.
+static void TestThreadSwitches(const std::string &path) {
+  TestTarget target = {};
+  TEST_CHECK(TestLaunchTarget(&target, path))
+  Stepper *stepper = target.stepper;
+
+  DWORD64 count_address = 0;
+  TEST_CHECK(TestInsertFunction(&target, "Count", &count_address))
+  MemoryCacheInvalidate(target.memory_cache);
+  BackendContinue(&target.backend, target.event, true);
+
+  // Workers are in the middle of their loops
+  while (!target.is_exited && target.thread_hit_counts.size() < 2 &&
+         TestHandleEvent(&target)) {
+  }
+  target.is_stopping = true;
+  while (!target.is_exited && TestHandleEvent(&target) &&
+         target.event.type != BackendEventType::BREAKPOINT) {
+  }
+  target.is_stopping = false;
+  const DWORD thread_id = target.event.thread_id;
+  TEST_CHECK(stepper->is_all_stopped)
+
+  std::vector<DWORD> thread_ids;
+  for (const auto &it : target.backend.threads) {
+    thread_ids.push_back(it.first);
+  }
+  TEST_CHECK(thread_ids.size() > 2)
+
+  std::set<DWORD64> stacks;
+  for (DWORD id : thread_ids) {
+    DebuggerThread *thread = StepperFindThread(stepper, id);
+    const Registers &registers = StepperGetRegisters(stepper, thread);
+    Registers expected = {};
+    TEST_CHECK(BackendGetRegisters(&target.backend, id, &expected))
+    TEST_CHECK(registers.Rip == expected.Rip || id == thread_id)
+    TEST_CHECK(registers.Rsp == expected.Rsp)
+    TEST_CHECK(StepperIsThreadStopped(stepper, thread))
+    TEST_CHECK(thread->stop_reason == (id == thread_id
+                                           ? DebuggerStopReason::BREAKPOINT
+                                           : DebuggerStopReason::NONE))
+    stacks.insert(registers.Rsp);
+  }
+  TEST_CHECK(stacks.size() == thread_ids.size())
+
+  // Switching back and forth reads nothing again
+  const DWORD64 syscall_count = target.backend.syscall_count;
+  for (DWORD id : thread_ids) {
+    StepperGetRegisters(stepper, StepperFindThread(stepper, id));
+  }
+  TEST_CHECK(target.backend.syscall_count == syscall_count)
+
+  // Step goes to the selected thread only, the others just run
+  for (DWORD id : thread_ids) {
+    stepper->thread_id = id;
+    StepperSetState(stepper, DebuggerState::STEP_OVER);
+    for (DWORD other_id : thread_ids) {
+      TEST_CHECK(StepperFindThread(stepper, other_id)->state ==
+                 (other_id == id ? DebuggerState::STEP_OVER
+                                 : DebuggerState::CONTINUE))
+    }
+  }
+  stepper->thread_id = thread_id;
+  StepperSetState(stepper, DebuggerState::CONTINUE);
+
+  // Registers of the last stop are dropped as the target runs on
+  StepperStepOffCurrent(stepper, StepperGetThread(stepper));
+  StepperRunOn(stepper);
+  TEST_CHECK(!stepper->is_all_stopped)
+  for (DWORD id : thread_ids) {
+    TEST_CHECK(!StepperFindThread(stepper, id)->is_registers_read)
+  }
+  BackendContinue(&target.backend, target.event, true);
+
+  while (!target.is_exited && TestHandleEvent(&target)) {
+  }
+
+  TEST_CHECK(target.is_exited)
+  TEST_CHECK(target.exit_code == 0)
+  TEST_CHECK(target.hit_counts[count_address] ==
+             TEST_THREAD_COUNT * TEST_COUNT)
+  TEST_CHECK(target.stray_count == 0)
+
+  if (!target.is_exited) {
+    TestKill(&target.backend);
+  }
+}
+
+// Thread state in /proc is "t" while it's in a ptrace stop
+static bool TestIsThreadStopped(DWORD process_id, DWORD thread_id) {
+  std::ifstream file("/proc/" + std::to_string(process_id) + "/task/" +
+                     std::to_string(thread_id) + "/stat");
+  std::string stat;
+  std::getline(file, stat);
+
+  // Name in parentheses may have spaces
+  const size_t name_end = stat.rfind(')');
+  return name_end != std::string::npos && name_end + 2 < stat.size() &&
+         stat[name_end + 2] == 't';
+}
+
+// A thread suspended on a breakpoint stays there while the others run on
+// and trap, then a continue for it's id resumes it and it steps off on it's
+// own, through the stop, command and resume of the debugger
+static void TestNonStop(const std::string &path) {
+  TestTarget target = {};
+  TEST_CHECK(TestLaunchTarget(&target, path))
+  StepperSetNonStop(target.stepper, true);
+
+  DWORD64 count_address = 0;
+  TEST_CHECK(TestInsertFunction(&target, "Count", &count_address))
+  MemoryCacheInvalidate(target.memory_cache);
+  BackendContinue(&target.backend, target.event, true);
+
+  DWORD64 other_hit_count = 0;
+  while (!target.is_exited && TestHandleEvent(&target)) {
+    const DWORD thread_id = target.suspended_thread_id;
+    if (!thread_id || target.event.type != BackendEventType::BREAKPOINT ||
+        target.event.thread_id == thread_id) {
+      continue;
+    }
+
+    if (++other_hit_count == TEST_COUNT) {
+      Stepper *stepper = target.stepper;
+      const DebuggerThread &thread = stepper->threads[thread_id];
+      TEST_CHECK(TestIsThreadStopped(target.backend.process_id, thread_id))
+      TEST_CHECK(target.thread_hit_counts[thread_id] == 1)
+      TEST_CHECK(StepperIsThreadStopped(stepper, &thread))
+      TEST_CHECK(thread.stop_reason == DebuggerStopReason::BREAKPOINT)
+
+      // Target keeps running, only the thread takes the command
+      TEST_CHECK(!StepperSetCommandState(stepper, thread_id,
+                                         DebuggerState::CONTINUE))
+      TEST_CHECK(thread.is_suspended)
+
+      // Resumes are applied between events
+      TEST_CHECK(StepperResumeThreads(
+          stepper, [](DebuggerThread *) { return (DWORD64)0; }))
+      TEST_CHECK(!thread.is_suspended)
+      TEST_CHECK(thread.stop_reason == DebuggerStopReason::NONE)
+      target.suspended_thread_id = 0;
+    }
+  }
+
+  TEST_CHECK(target.suspended_address)
+  TEST_CHECK(!target.suspended_thread_id)
+  TEST_CHECK(other_hit_count >= TEST_COUNT)
+  TEST_CHECK(target.is_exited)
+  TEST_CHECK(target.exit_code == 0)
+  TEST_CHECK(target.hit_counts[count_address] ==
+             TEST_THREAD_COUNT * TEST_COUNT)
+  TEST_CHECK(target.stray_count == 0)
+  TEST_CHECK(target.signal_count == 0)
+
+  if (!target.is_exited) {
+    TestKill(&target.backend);
+  }
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+
+  const std::string path = TestGetTargetPath(argv[0], "threads");
+
+  Global_TestIsLogMuted = true;
+
+  TestDisplacedSteps(path);
+  TestNonStop(path);
+  TestThreadSwitches(path);
+
+  return TestFinish("threads_test");
+}
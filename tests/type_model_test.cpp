@@ -0,0 +1,330 @@
+#include "test.h"
+
+#include <stddef.h>
+
+// DbgHelp type info as far as the type model asks for it, answered from the
+// fixture below
+typedef wchar_t WCHAR;
+typedef uint64_t ULONG64;
+
+enum SymTagEnum {
+  SymTagNull = 0,
+  SymTagData = 7,
+  SymTagUDT = 11,
+  SymTagEnum = 12,
+  SymTagPointerType = 14,
+  SymTagArrayType = 15,
+  SymTagBaseType = 16,
+  SymTagTypedef = 17,
+  SymTagBaseClass = 18
+};
+
+enum BasicType {
+  btNoType = 0,
+  btChar = 2,
+  btWChar = 3,
+  btInt = 6,
+  btUInt = 7,
+  btFloat = 8,
+  btBool = 10,
+  btLong = 13,
+  btULong = 14,
+  btHresult = 31
+};
+
+enum DataKind { DataIsUnknown = 0, DataIsMember = 7 };
+
+enum IMAGEHLP_SYMBOL_TYPE_INFO {
+  TI_GET_SYMTAG,
+  TI_GET_SYMNAME,
+  TI_GET_LENGTH,
+  TI_GET_TYPEID,
+  TI_GET_BASETYPE,
+  TI_FINDCHILDREN,
+  TI_GET_DATAKIND,
+  TI_GET_OFFSET,
+  TI_GET_VALUE,
+  TI_GET_COUNT,
+  TI_GET_CHILDRENCOUNT,
+  TI_GET_BITPOSITION
+};
+
+struct TI_FINDCHILDREN_PARAMS {
+  ULONG Count;
+  ULONG Start;
+  ULONG ChildId[1];
+};
+
+enum { VT_I2 = 2, VT_I4 = 3, VT_I1 = 16, VT_UI1, VT_UI2, VT_UI4, VT_I8,
+       VT_UI8, VT_INT, VT_UINT };
+
+struct VARIANT {
+  WORD vt;
+  union {
+    char cVal;
+    BYTE bVal;
+    short iVal;
+    WORD uiVal;
+    int32_t lVal;
+    uint32_t ulVal;
+    int intVal;
+    unsigned int uintVal;
+    int64_t llVal;
+    uint64_t ullVal;
+  };
+};
+
+// Fixture names are literals, nothing is allocated
+static void LocalFree(void *) {}
+
+static std::string GetStringFromWString(const WCHAR *text) {
+  std::string result;
+  for (; *text; ++text) {
+    result.push_back((char)*text);
+  }
+  return result;
+}
+
+// Program the fixture describes, as a compiler lays it out
+enum TestColor { TEST_RED = 1, TEST_GREEN = 2 };
+typedef int TestCount;
+
+struct TestPoint {
+  int x;
+  int y;
+};
+
+struct TestRecord {
+  TestCount count;
+  const char *name;
+  short values[3];
+  char label[8];
+  TestPoint origin;
+  TestColor color;
+  TestRecord *next;
+  double ratio;
+};
+
+// One DbgHelp symbol, type or member
+struct TestSymbol {
+  DWORD tag;
+  const WCHAR *name;
+  DWORD64 length;
+  ULONG type_id;
+  DWORD base_type; // Also of enums
+  DWORD count;     // Of array elements
+  DWORD offset;    // Of members
+  int64_t value;   // Of enumerators
+  std::vector<ULONG> children;
+};
+
+static std::map<ULONG, TestSymbol> Global_TestSymbols = {
+    {1, {SymTagUDT, L"TestRecord", sizeof(TestRecord), 0, 0, 0, 0, 0,
+         {100, 101, 102, 103, 104, 105, 106, 107}}},
+    {2, {SymTagBaseType, NULL, sizeof(int), 0, btInt, 0, 0, 0, {}}},
+    {3, {SymTagPointerType, NULL, sizeof(char *), 4, 0, 0, 0, 0, {}}},
+    {4, {SymTagBaseType, NULL, 1, 0, btChar, 0, 0, 0, {}}},
+    {5, {SymTagArrayType, NULL, sizeof(short[3]), 6, 0, 3, 0, 0, {}}},
+    {6, {SymTagBaseType, NULL, sizeof(short), 0, btInt, 0, 0, 0, {}}},
+    {7, {SymTagArrayType, NULL, sizeof(char[8]), 4, 0, 8, 0, 0, {}}},
+    {8, {SymTagUDT, L"TestPoint", sizeof(TestPoint), 0, 0, 0, 0, 0,
+         {110, 111}}},
+    {9, {SymTagEnum, L"TestColor", sizeof(TestColor), 0, btUInt, 0, 0, 0,
+         {120, 121}}},
+    {10, {SymTagTypedef, L"TestCount", 0, 2, 0, 0, 0, 0, {}}},
+    {11, {SymTagPointerType, NULL, sizeof(TestRecord *), 1, 0, 0, 0, 0, {}}},
+    {12, {SymTagBaseType, NULL, sizeof(double), 0, btFloat, 0, 0, 0, {}}},
+    {100, {SymTagData, L"count", 0, 10, 0, 0, offsetof(TestRecord, count), 0,
+           {}}},
+    {101, {SymTagData, L"name", 0, 3, 0, 0, offsetof(TestRecord, name), 0,
+           {}}},
+    {102, {SymTagData, L"values", 0, 5, 0, 0, offsetof(TestRecord, values),
+           0, {}}},
+    {103, {SymTagData, L"label", 0, 7, 0, 0, offsetof(TestRecord, label), 0,
+           {}}},
+    {104, {SymTagData, L"origin", 0, 8, 0, 0, offsetof(TestRecord, origin),
+           0, {}}},
+    {105, {SymTagData, L"color", 0, 9, 0, 0, offsetof(TestRecord, color), 0,
+           {}}},
+    {106, {SymTagData, L"next", 0, 11, 0, 0, offsetof(TestRecord, next), 0,
+           {}}},
+    {107, {SymTagData, L"ratio", 0, 12, 0, 0, offsetof(TestRecord, ratio), 0,
+           {}}},
+    {110, {SymTagData, L"x", 0, 2, 0, 0, offsetof(TestPoint, x), 0, {}}},
+    {111, {SymTagData, L"y", 0, 2, 0, 0, offsetof(TestPoint, y), 0, {}}},
+    {120, {SymTagData, L"TEST_RED", 0, 0, 0, 0, 0, TEST_RED, {}}},
+    {121, {SymTagData, L"TEST_GREEN", 0, 0, 0, 0, 0, TEST_GREEN, {}}}};
+
+static size_t Global_TestQueryCount;
+
+static bool SymGetTypeInfo(HANDLE, DWORD64, ULONG type_index,
+                           IMAGEHLP_SYMBOL_TYPE_INFO info, void *result) {
+  ++Global_TestQueryCount;
+
+  auto it = Global_TestSymbols.find(type_index);
+  if (it == Global_TestSymbols.end()) {
+    return false;
+  }
+
+  const TestSymbol &symbol = it->second;
+  switch (info) {
+  case TI_GET_SYMTAG:
+    *(DWORD *)result = symbol.tag;
+    return true;
+  case TI_GET_SYMNAME:
+    *(const WCHAR **)result = symbol.name;
+    return symbol.name != NULL;
+  case TI_GET_LENGTH:
+    *(DWORD64 *)result = symbol.length;
+    return symbol.length != 0;
+  case TI_GET_TYPEID:
+    *(ULONG *)result = symbol.type_id;
+    return symbol.type_id != 0;
+  case TI_GET_BASETYPE:
+    *(DWORD *)result = symbol.base_type;
+    return true;
+  case TI_GET_COUNT:
+    *(DWORD *)result = symbol.count;
+    return true;
+  case TI_GET_CHILDRENCOUNT:
+    *(DWORD *)result = (DWORD)symbol.children.size();
+    return true;
+  case TI_FINDCHILDREN: {
+    auto params = (TI_FINDCHILDREN_PARAMS *)result;
+    std::copy(symbol.children.begin(), symbol.children.end(),
+              params->ChildId);
+    return true;
+  }
+  case TI_GET_DATAKIND:
+    *(DWORD *)result = symbol.type_id ? DataIsMember : DataIsUnknown;
+    return true;
+  case TI_GET_OFFSET:
+    *(DWORD *)result = symbol.offset;
+    return true;
+  case TI_GET_VALUE: {
+    auto variant = (VARIANT *)result;
+    variant->vt = VT_I4;
+    variant->lVal = (int32_t)symbol.value;
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+#include "../type_model.h"
+#include "../local_variable.h"
+#include "../type_model.cpp"
+#include "../local_variable.cpp"
+
+// Type of the fixture's record, built the way the locals window builds it
+static void TestBuild(TypeModel *type_model, DWORD *type) {
+  Global_TestQueryCount = 0;
+  *type = TypeModelGet(NULL, type_model, 1);
+  TEST_CHECK(Global_TestQueryCount > 0)
+
+  const Type &record = type_model->types[*type];
+  TEST_CHECK(record.kind == TypeKind::UDT)
+  TEST_CHECK(record.name == "TestRecord")
+  TEST_CHECK(record.size == sizeof(TestRecord))
+  TEST_CHECK(record.fields.size() == 8)
+  if (record.fields.size() != 8) {
+    return;
+  }
+
+  // Typedef is looked through, to the same entry as int
+  TEST_CHECK(record.fields[0].type == TypeModelGet(NULL, type_model, 2))
+  TEST_CHECK(type_model->types[record.fields[0].type].kind == TypeKind::BASE)
+
+  const Type &name = type_model->types[record.fields[1].type];
+  TEST_CHECK(name.kind == TypeKind::POINTER)
+  TEST_CHECK(name.size == sizeof(char *))
+
+  const Type &values = type_model->types[record.fields[2].type];
+  TEST_CHECK(values.kind == TypeKind::ARRAY)
+  TEST_CHECK(values.count == 3)
+  TEST_CHECK(values.size == sizeof(short[3]))
+  TEST_CHECK(type_model->types[values.element].size == sizeof(short))
+
+  const Type &origin = type_model->types[record.fields[4].type];
+  TEST_CHECK(origin.kind == TypeKind::UDT)
+  TEST_CHECK(origin.fields.size() == 2)
+  TEST_CHECK(record.fields[4].offset == offsetof(TestRecord, origin))
+
+  const Type &color = type_model->types[record.fields[5].type];
+  TEST_CHECK(color.kind == TypeKind::ENUM)
+  TEST_CHECK(color.enumerators.size() == 2)
+
+  // Pointer back to the record is built once, it's pointee isn't followed
+  const Type &next = type_model->types[record.fields[6].type];
+  TEST_CHECK(next.kind == TypeKind::POINTER)
+  TEST_CHECK(next.element == TYPE_MODEL_NONE)
+}
+
+// Record's bytes give the rows the locals window shows, members and
+// elements below it. None of them asks DbgHelp again.
+static void TestFormat(const TypeModel *type_model, DWORD type) {
+  TestRecord record = {};
+  record.count = 7;
+  record.name = (const char *)0x1234;
+  record.values[0] = 1;
+  record.values[1] = -2;
+  record.values[2] = 3;
+  strcpy(record.label, "abc");
+  record.origin = {-5, 6};
+  record.color = TEST_GREEN;
+  record.ratio = 0.5;
+
+  LocalVariables local_variables = {};
+  Global_TestQueryCount = 0;
+  LocalVariablesAppend(&local_variables, type_model, type, "record",
+                       (const BYTE *)&record, sizeof(record), 0);
+  TEST_CHECK(Global_TestQueryCount == 0)
+
+  const std::vector<LocalVariable> expected = {
+      {"record", "{...}", 0, true},
+      {"count", "7", 1, false},
+      {"name", "0x1234", 1, false},
+      {"values", "[3]", 1, true},
+      {"[0]", "1", 2, false},
+      {"[1]", "-2", 2, false},
+      {"[2]", "3", 2, false},
+      {"label", "\"abc\"", 1, false},
+      {"origin", "{...}", 1, true},
+      {"x", "-5", 2, false},
+      {"y", "6", 2, false},
+      {"color", "TEST_GREEN", 1, false},
+      {"next", "0x0", 1, false},
+      {"ratio", std::to_string(0.5), 1, false}};
+
+  const auto &rows = local_variables.data;
+  TEST_CHECK(rows.size() == expected.size())
+  for (size_t i = 0; i < std::min(rows.size(), expected.size()); ++i) {
+    TEST_CHECK(rows[i].name == expected[i].name)
+    TEST_CHECK(rows[i].value == expected[i].value)
+    TEST_CHECK(rows[i].depth == expected[i].depth)
+    TEST_CHECK(rows[i].has_children == expected[i].has_children)
+  }
+
+  // Read that came short of the record shows nothing of it
+  LocalVariablesReset(&local_variables);
+  LocalVariablesAppend(&local_variables, type_model, type, "record",
+                       (const BYTE *)&record, sizeof(record) - 1, 0);
+  TEST_CHECK(rows.size() == 1)
+  TEST_CHECK(rows.size() == 1 && rows[0].value == "Unreadable memory")
+}
+
+int main() {
+  TypeModel type_model = {};
+  DWORD type = TYPE_MODEL_NONE;
+  TestBuild(&type_model, &type);
+
+  // Built types are looked up, not queried again
+  Global_TestQueryCount = 0;
+  TEST_CHECK(TypeModelGet(NULL, &type_model, 1) == type)
+  TEST_CHECK(Global_TestQueryCount == 0)
+
+  TestFormat(&type_model, type);
+
+  return TestFinish("type_model_test");
+}
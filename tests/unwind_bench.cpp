@@ -0,0 +1,119 @@
+#define TEST_WITH_TARGET
+#include "test.h"
+
+#define BENCH_DEPTH 10000 // Same as in targets/recurse
+#define BENCH_SECONDS 1.0 // Walked again and again for it, each way
+
+// Every ELF object mapped into the process, indexed where it's mapped
+static void BenchLoadModules(DWORD process_id, std::vector<Module> *modules) {
+  std::ifstream maps("/proc/" + std::to_string(process_id) + "/maps");
+  std::set<std::string> paths;
+  std::string line;
+  while (std::getline(maps, line)) {
+    unsigned long start;
+    unsigned long end;
+    unsigned long offset;
+    char permissions[8];
+    char path[PATH_MAX] = "";
+    if (sscanf(line.c_str(), "%lx-%lx %7s %lx %*s %*s %4095s", &start, &end,
+               permissions, &offset, path) < 4 ||
+        offset != 0 || path[0] != '/' || !paths.insert(path).second) {
+      continue;
+    }
+
+    Module module;
+    if (ModuleLoad(NULL, NULL, path, start, &module)) {
+      modules->push_back(std::move(module));
+    }
+  }
+}
+
+static const char *BenchGetFunctionName(const std::vector<Module> &modules,
+                                        DWORD64 pc) {
+  for (const Module &module : modules) {
+    if (pc < module.base) {
+      continue;
+    }
+
+    const ModuleFunction *function =
+        ModuleFindFunctionAt(&module.index, (DWORD)(pc - module.base));
+    if (function) {
+      return module.index.names.c_str() + function->name_offset;
+    }
+  }
+
+  return "";
+}
+
+// Walks the stack of targets/recurse where it traps, with the memory cache
+// emptied before every walk as at a new stop, and kept between walks
+int main(int argc, char **argv) {
+  (void)argc;
+
+  const std::string path = TestGetTargetPath(argv[0], "recurse");
+
+  Global_TestIsLogMuted = true;
+
+  Backend backend;
+  BackendEvent event;
+  if (!TestLaunch(&backend, path, &event, NULL)) {
+    printf("unwind_bench: can't start %s\n", path.c_str());
+    return 1;
+  }
+  BackendContinue(&backend, event, true);
+  if (!TestWaitFor(&backend, BackendEventType::BREAKPOINT, &event)) {
+    printf("unwind_bench: %s didn't trap\n", path.c_str());
+    TestKill(&backend);
+    return 1;
+  }
+
+  std::vector<Module> modules;
+  BenchLoadModules(backend.process_id, &modules);
+
+  Registers registers = {};
+  BackendGetRegisters(&backend, event.thread_id, &registers);
+  MemoryCache *memory_cache = CreateMemoryCache(&backend);
+
+  std::vector<UnwindFrame> frames;
+  UnwindWalk(modules, memory_cache, registers, UNWIND_MAX_FRAMES, &frames);
+
+  size_t recurse_count = 0;
+  for (const UnwindFrame &frame : frames) {
+    recurse_count +=
+        strcmp(BenchGetFunctionName(modules, frame.pc), "Recurse") == 0;
+  }
+  const char *last_name =
+      frames.empty() ? "" : BenchGetFunctionName(modules, frames.back().pc);
+
+  printf("unwind_bench: %zu frames, %zu of Recurse, outermost %s\n",
+         frames.size(), recurse_count, last_name);
+
+  const char *names[2] = {"cold", "warm"};
+  for (int is_warm = 0; is_warm < 2; ++is_warm) {
+    size_t frame_count = 0;
+    size_t walk_count = 0;
+    const DWORD64 syscall_count = backend.syscall_count;
+    const double start = TestGetSeconds();
+    double seconds = 0;
+    while (seconds < BENCH_SECONDS) {
+      if (!is_warm) {
+        MemoryCacheInvalidate(memory_cache);
+      }
+      frames.clear();
+      UnwindWalk(modules, memory_cache, registers, UNWIND_MAX_FRAMES,
+                 &frames);
+      frame_count += frames.size();
+      ++walk_count;
+      seconds = TestGetSeconds() - start;
+    }
+
+    printf("  %s %.2fM frames/s, %.0f us a walk, %.1f syscalls a walk\n",
+           names[is_warm], frame_count / seconds / 1e6,
+           seconds / walk_count * 1e6,
+           (double)(backend.syscall_count - syscall_count) / walk_count);
+  }
+
+  TestKill(&backend);
+
+  return recurse_count > BENCH_DEPTH ? 0 : 1;
+}
@@ -0,0 +1,186 @@
+#define TEST_WITH_TARGET
+#include "test.h"
+
+#include "../condition.h"
+#include "../agent.h"
+#include "../breakpoint.h"
+#include "../stepper.h"
+#include "../condition.cpp"
+#include "../agent.cpp"
+#include "../breakpoint.cpp"
+#include "../stepper.cpp"
+
+#define TEST_DEPTH 10000 // Same as in targets/recurse
+
+// Every ELF object mapped into the process, indexed where it's mapped. Maps
+// are in address order, so the modules are sorted by base.
+static void TestLoadModules(DWORD process_id, std::vector<Module> *modules) {
+  std::ifstream maps("/proc/" + std::to_string(process_id) + "/maps");
+  std::set<std::string> paths;
+  std::string line;
+  while (std::getline(maps, line)) {
+    unsigned long start;
+    unsigned long end;
+    unsigned long offset;
+    char permissions[8];
+    char path[PATH_MAX] = "";
+    if (sscanf(line.c_str(), "%lx-%lx %7s %lx %*s %*s %4095s", &start, &end,
+               permissions, &offset, path) < 4 ||
+        offset != 0 || path[0] != '/' || !paths.insert(path).second) {
+      continue;
+    }
+
+    Module module;
+    if (ModuleLoad(NULL, NULL, path, start, &module)) {
+      modules->push_back(std::move(module));
+    }
+  }
+}
+
+// Same walk as UnwindWalk, with every FDE's rows decoded again for each
+// frame. Rows cached before are kept for the cached walks.
+static void TestWalkUncached(std::vector<Module> &modules,
+                             MemoryCache *memory_cache,
+                             const Registers &registers,
+                             std::vector<UnwindFrame> *frames) {
+  Registers current = registers;
+  bool is_return_address = false;
+
+  while (current.Rip && frames->size() < UNWIND_MAX_FRAMES) {
+    UnwindFrame frame = {current.Rip, current.Rsp, 0, current.Rbp};
+    const DWORD64 sp = current.Rsp;
+
+    const UnwindFde *fde;
+    Module *module = UnwindFindModule(
+        modules, current.Rip - (is_return_address ? 1 : 0), &fde);
+    UnwindStepResult result = UnwindStepResult::NO_INFO;
+    bool is_signal_frame = false;
+    if (module) {
+      auto &rows = module->unwind_table.rows;
+      auto cached_rows = std::move(rows);
+      rows.clear();
+      result = UnwindStep(&module->unwind_table, module->base, fde,
+                          memory_cache, is_return_address, &current,
+                          &frame.cfa, &is_signal_frame);
+      rows = std::move(cached_rows);
+    }
+    if (result == UnwindStepResult::NO_INFO) {
+      result = UnwindStepFramePointer(memory_cache, &current);
+    }
+
+    frames->push_back(frame);
+    if (result != UnwindStepResult::CALLER ||
+        (current.Rsp <= sp && !is_signal_frame)) {
+      break;
+    }
+    is_return_address = !is_signal_frame;
+  }
+}
+
+static bool TestIsSameWalk(const std::vector<UnwindFrame> &a,
+                           const std::vector<UnwindFrame> &b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (a[i].pc != b[i].pc || a[i].sp != b[i].sp || a[i].cfa != b[i].cfa ||
+        a[i].frame_pointer != b[i].frame_pointer) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Walks with the rows cached so far, then with all of them cached. Both
+// have to match the uncached walk.
+static void TestCheckCachedWalk(std::vector<Module> &modules,
+                                MemoryCache *memory_cache,
+                                const Registers &registers,
+                                const std::vector<UnwindFrame> &expected) {
+  for (int i = 0; i < 2; ++i) {
+    std::vector<UnwindFrame> frames;
+    UnwindWalk(modules, memory_cache, registers, UNWIND_MAX_FRAMES, &frames);
+    TEST_CHECK(TestIsSameWalk(frames, expected))
+  }
+}
+
+// Stack of targets/recurse where it traps, with libc's qsort in the middle.
+// Cached CFI rows give the same frames as rows decoded for every frame, also
+// once libc is unloaded and after it's loaded again.
+static void TestCachedRows(const std::string &path) {
+  Backend backend;
+  BackendEvent event;
+  TEST_CHECK(TestLaunch(&backend, path, &event, NULL))
+  BackendContinue(&backend, event, true);
+  TEST_CHECK(TestWaitFor(&backend, BackendEventType::BREAKPOINT, &event))
+
+  MemoryCache *memory_cache = CreateMemoryCache(&backend);
+  Agent agent = {};
+  Breakpoints breakpoints = {};
+  Stepper *stepper =
+      CreateStepper(&backend, memory_cache, &agent, &breakpoints);
+  std::vector<Module> &modules = stepper->modules;
+  TestLoadModules(backend.process_id, &modules);
+  TEST_CHECK(modules.size() > 2)
+
+  Registers registers = {};
+  TEST_CHECK(BackendGetRegisters(&backend, event.thread_id, &registers))
+
+  std::vector<UnwindFrame> expected;
+  TestWalkUncached(modules, memory_cache, registers, &expected);
+  TEST_CHECK(expected.size() > TEST_DEPTH)
+  for (Module &module : modules) {
+    module.unwind_table.rows.clear();
+  }
+  TestCheckCachedWalk(modules, memory_cache, registers, expected);
+
+  // qsort is unwound without it's CFI then, rows of the other modules are
+  // kept
+  auto libc = std::find_if(modules.begin(), modules.end(),
+                           [](const Module &module) {
+                             return module.path.find("/libc.") !=
+                                    std::string::npos;
+                           });
+  TEST_CHECK(libc != modules.end())
+  if (libc != modules.end()) {
+    const std::string libc_path = libc->path;
+    const DWORD64 libc_base = libc->base;
+    StepperRemoveModule(stepper, libc_base);
+    TEST_CHECK(modules.end() ==
+               std::find_if(modules.begin(), modules.end(),
+                            [&](const Module &module) {
+                              return module.base == libc_base;
+                            }))
+
+    std::vector<UnwindFrame> unloaded;
+    TestWalkUncached(modules, memory_cache, registers, &unloaded);
+    TEST_CHECK(unloaded.size() < expected.size())
+    TestCheckCachedWalk(modules, memory_cache, registers, unloaded);
+
+    // Back in it's place, modules stay sorted by base
+    Module module;
+    TEST_CHECK(ModuleLoad(NULL, NULL, libc_path, libc_base, &module))
+    StepperAddModule(stepper, std::move(module));
+    TEST_CHECK(std::is_sorted(modules.begin(), modules.end(),
+                              [](const Module &a, const Module &b) {
+                                return a.base < b.base;
+                              }))
+    TestCheckCachedWalk(modules, memory_cache, registers, expected);
+  }
+
+  TestKill(&backend);
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+
+  const std::string path = TestGetTargetPath(argv[0], "recurse");
+
+  Global_TestIsLogMuted = true;
+
+  TestCachedRows(path);
+
+  return TestFinish("unwinder_test");
+}
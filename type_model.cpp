@@ -0,0 +1,365 @@
+// Name of a type or a member, DbgHelp allocates it
+static std::string TypeModelGetName(HANDLE process, DWORD64 module_base,
+                                    ULONG type_index) {
+  WCHAR *name = NULL;
+  if (!SymGetTypeInfo(process, module_base, type_index, TI_GET_SYMNAME,
+                      &name) ||
+      !name) {
+    return "";
+  }
+
+  std::string result = GetStringFromWString(name);
+  LocalFree(name);
+
+  return result;
+}
+
+static std::vector<ULONG> TypeModelGetChildren(HANDLE process,
+                                               DWORD64 module_base,
+                                               ULONG type_index) {
+  DWORD count = 0;
+  if (!SymGetTypeInfo(process, module_base, type_index, TI_GET_CHILDRENCOUNT,
+                      &count) ||
+      count == 0) {
+    return {};
+  }
+
+  std::vector<BYTE> buffer(sizeof(TI_FINDCHILDREN_PARAMS) +
+                           count * sizeof(ULONG));
+  auto params = (TI_FINDCHILDREN_PARAMS *)buffer.data();
+  params->Count = count;
+  params->Start = 0;
+  if (!SymGetTypeInfo(process, module_base, type_index, TI_FINDCHILDREN,
+                      params)) {
+    return {};
+  }
+
+  return std::vector<ULONG>(params->ChildId, params->ChildId + count);
+}
+
+static int64_t TypeModelGetVariantValue(const VARIANT &variant) {
+  switch (variant.vt) {
+  case VT_I1:
+    return variant.cVal;
+  case VT_UI1:
+    return variant.bVal;
+  case VT_I2:
+    return variant.iVal;
+  case VT_UI2:
+    return variant.uiVal;
+  case VT_I4:
+    return variant.lVal;
+  case VT_UI4:
+    return variant.ulVal;
+  case VT_INT:
+    return variant.intVal;
+  case VT_UINT:
+    return variant.uintVal;
+  case VT_I8:
+    return variant.llVal;
+  case VT_UI8:
+    return (int64_t)variant.ullVal;
+  default:
+    return 0;
+  }
+}
+
+static DWORD TypeModelGet(HANDLE process, TypeModel *type_model,
+                          ULONG type_index);
+
+// Data members and base classes of a UDT, static members aren't in it's
+// layout
+static void TypeModelAddFields(HANDLE process, TypeModel *type_model,
+                               ULONG type_index, Type *type) {
+  const DWORD64 module_base = type_model->module_base;
+
+  std::vector<TypeField> members;
+  for (ULONG child :
+       TypeModelGetChildren(process, module_base, type_index)) {
+    DWORD tag = SymTagNull;
+    SymGetTypeInfo(process, module_base, child, TI_GET_SYMTAG, &tag);
+    if (tag == SymTagData) {
+      DWORD data_kind = DataIsUnknown;
+      SymGetTypeInfo(process, module_base, child, TI_GET_DATAKIND,
+                     &data_kind);
+      if (data_kind != DataIsMember) {
+        continue;
+      }
+    } else if (tag != SymTagBaseClass) {
+      continue;
+    }
+
+    // Virtual base classes have no fixed offset, they aren't shown
+    ULONG field_type = 0;
+    DWORD offset = 0;
+    if (!SymGetTypeInfo(process, module_base, child, TI_GET_TYPEID,
+                        &field_type) ||
+        !SymGetTypeInfo(process, module_base, child, TI_GET_OFFSET,
+                        &offset)) {
+      continue;
+    }
+
+    TypeField field = {};
+    field.type = TypeModelGet(process, type_model, field_type);
+    field.offset = offset;
+
+    // Length of a bit field is in bits
+    DWORD bit_position = 0;
+    ULONG64 bit_count = 0;
+    if (tag == SymTagData &&
+        SymGetTypeInfo(process, module_base, child, TI_GET_BITPOSITION,
+                       &bit_position) &&
+        SymGetTypeInfo(process, module_base, child, TI_GET_LENGTH,
+                       &bit_count)) {
+      field.bit_position = bit_position;
+      field.bit_count = (DWORD)bit_count;
+    }
+
+    if (tag == SymTagBaseClass) {
+      field.name = type_model->types[field.type].name;
+      type->fields.push_back(field);
+    } else {
+      field.name = TypeModelGetName(process, module_base, child);
+      members.push_back(field);
+    }
+  }
+
+  type->fields.insert(type->fields.end(), members.begin(), members.end());
+}
+
+// Index into "types" of a DbgHelp type index. The type is built the first
+// time, along with the types it's made of.
+static DWORD TypeModelGet(HANDLE process, TypeModel *type_model,
+                          ULONG type_index) {
+  const DWORD64 module_base = type_model->module_base;
+  auto &types = type_model->types;
+  auto &type_indices = type_model->type_indices;
+
+  auto it = type_indices.find(type_index);
+  if (it != type_indices.end()) {
+    return it->second;
+  }
+
+  DWORD tag = SymTagNull;
+  SymGetTypeInfo(process, module_base, type_index, TI_GET_SYMTAG, &tag);
+
+  ULONG target = 0;
+  if (tag == SymTagTypedef &&
+      SymGetTypeInfo(process, module_base, type_index, TI_GET_TYPEID,
+                     &target)) {
+    const DWORD index = TypeModelGet(process, type_model, target);
+    type_indices.emplace(type_index, index);
+    return index;
+  }
+
+  // Found before it's built, a type can lead back to itself
+  const DWORD index = (DWORD)types.size();
+  types.push_back(Type{});
+  type_indices.emplace(type_index, index);
+
+  Type type = {};
+  type.element = TYPE_MODEL_NONE;
+  SymGetTypeInfo(process, module_base, type_index, TI_GET_LENGTH,
+                 &type.size);
+
+  switch (tag) {
+  case SymTagBaseType:
+    type.kind = TypeKind::BASE;
+    SymGetTypeInfo(process, module_base, type_index, TI_GET_BASETYPE,
+                   &type.base_type);
+    break;
+  case SymTagPointerType:
+    type.kind = TypeKind::POINTER;
+    break;
+  case SymTagArrayType: {
+    ULONG element = 0;
+    if (!SymGetTypeInfo(process, module_base, type_index, TI_GET_TYPEID,
+                        &element)) {
+      break;
+    }
+
+    type.kind = TypeKind::ARRAY;
+    SymGetTypeInfo(process, module_base, type_index, TI_GET_COUNT,
+                   &type.count);
+    type.element = TypeModelGet(process, type_model, element);
+  } break;
+  case SymTagEnum:
+    type.kind = TypeKind::ENUM;
+    type.name = TypeModelGetName(process, module_base, type_index);
+    SymGetTypeInfo(process, module_base, type_index, TI_GET_BASETYPE,
+                   &type.base_type);
+
+    for (ULONG child :
+         TypeModelGetChildren(process, module_base, type_index)) {
+      VARIANT value = {};
+      SymGetTypeInfo(process, module_base, child, TI_GET_VALUE, &value);
+      type.enumerators.push_back(
+          TypeEnumerator{TypeModelGetName(process, module_base, child),
+                         TypeModelGetVariantValue(value)});
+    }
+    break;
+  case SymTagUDT:
+    type.kind = TypeKind::UDT;
+    type.name = TypeModelGetName(process, module_base, type_index);
+    TypeModelAddFields(process, type_model, type_index, &type);
+    break;
+  }
+
+  types[index] = std::move(type);
+
+  return index;
+}
+
+// Little endian integer of up to 8 bytes, sign extended if it's signed
+static DWORD64 TypeModelReadInteger(const BYTE *data, DWORD64 size,
+                                    bool is_signed) {
+  DWORD64 value = 0;
+  size = std::min<DWORD64>(size, sizeof(value));
+  if (size == 0) {
+    return 0;
+  }
+
+  memcpy(&value, data, size);
+  if (is_signed && size < sizeof(value)) {
+    const DWORD shift = (DWORD)(sizeof(value) - size) * 8;
+    value = (DWORD64)((int64_t)(value << shift) >> shift);
+  }
+
+  return value;
+}
+
+static bool TypeModelIsSigned(DWORD base_type) {
+  return base_type == btInt || base_type == btLong || base_type == btChar;
+}
+
+static bool TypeModelIsInteger(DWORD base_type) {
+  switch (base_type) {
+  case btChar:
+  case btWChar:
+  case btInt:
+  case btUInt:
+  case btBool:
+  case btLong:
+  case btULong:
+  case btHresult:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Integer of a base type or an enum, as it's shown
+static std::string TypeModelFormatInteger(const Type &type, DWORD64 value) {
+  if (type.kind == TypeKind::ENUM) {
+    for (const auto &enumerator : type.enumerators) {
+      if ((DWORD64)enumerator.value == value) {
+        return enumerator.name;
+      }
+    }
+  }
+
+  char text[64];
+  switch (type.base_type) {
+  case btBool:
+    return value ? "true" : "false";
+  case btHresult:
+    snprintf(text, sizeof(text), "0x%08llx", (unsigned long long)value);
+    return text;
+  case btChar:
+    if (value >= ' ' && value < 0x7f) {
+      snprintf(text, sizeof(text), "%lld '%c'", (long long)value,
+               (char)value);
+      return text;
+    }
+    break;
+  }
+
+  if (TypeModelIsSigned(type.base_type)) {
+    snprintf(text, sizeof(text), "%lld", (long long)value);
+  } else {
+    snprintf(text, sizeof(text), "%llu", (unsigned long long)value);
+  }
+
+  return text;
+}
+
+// Char arrays are shown as strings
+static bool TypeModelIsString(const TypeModel *type_model, const Type &type) {
+  if (type.kind != TypeKind::ARRAY) {
+    return false;
+  }
+
+  const Type &element = type_model->types[type.element];
+  return element.kind == TypeKind::BASE && element.base_type == btChar &&
+         element.size == 1;
+}
+
+// Value of the type at "data", that has all of it's bytes. Members and
+// elements aren't included.
+static std::string TypeModelFormatValue(const TypeModel *type_model,
+                                        DWORD type_index, const BYTE *data) {
+  const Type &type = type_model->types[type_index];
+
+  switch (type.kind) {
+  case TypeKind::BASE:
+    if (type.base_type == btFloat && type.size == sizeof(float)) {
+      float value;
+      memcpy(&value, data, sizeof(value));
+      return std::to_string(value);
+    }
+    if (type.base_type == btFloat && type.size == sizeof(double)) {
+      double value;
+      memcpy(&value, data, sizeof(value));
+      return std::to_string(value);
+    }
+    if (!TypeModelIsInteger(type.base_type)) {
+      break;
+    }
+    // Fall through
+  case TypeKind::ENUM:
+    return TypeModelFormatInteger(
+        type, TypeModelReadInteger(data, type.size,
+                                   TypeModelIsSigned(type.base_type)));
+  case TypeKind::POINTER: {
+    char text[32];
+    snprintf(text, sizeof(text), "0x%llx",
+             (unsigned long long)TypeModelReadInteger(data, type.size,
+                                                      false));
+    return text;
+  }
+  case TypeKind::ARRAY:
+    if (TypeModelIsString(type_model, type)) {
+      // Up to the terminator, if there is one
+      const char *text = (const char *)data;
+      return '"' + std::string(text, strnlen(text, type.count)) + '"';
+    }
+    return '[' + std::to_string(type.count) + ']';
+  case TypeKind::UDT:
+    return "{...}";
+  default:
+    break;
+  }
+
+  return "Unsupported type";
+}
+
+// Value of a bit field of the UDT at "data"
+static std::string TypeModelFormatBits(const TypeModel *type_model,
+                                       const TypeField &field,
+                                       const BYTE *data) {
+  const Type &type = type_model->types[field.type];
+
+  DWORD64 value = TypeModelReadInteger(data + field.offset, type.size, false);
+  value >>= field.bit_position;
+  if (field.bit_count < 64) {
+    value &= ((DWORD64)1 << field.bit_count) - 1;
+
+    // Top bit of the field is the sign
+    const DWORD shift = 64 - field.bit_count;
+    if (TypeModelIsSigned(type.base_type)) {
+      value = (DWORD64)((int64_t)(value << shift) >> shift);
+    }
+  }
+
+  return TypeModelFormatInteger(type, value);
+}
\ No newline at end of file
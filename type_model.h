@@ -0,0 +1,46 @@
+#define TYPE_MODEL_NONE 0xffffffff
+
+enum class TypeKind {
+  UNSUPPORTED, // Function types and the like, there is no value to show
+  BASE,
+  POINTER,
+  ARRAY,
+  UDT,
+  ENUM
+};
+
+// Member of a UDT, base classes are members too
+struct TypeField {
+  std::string name; // Of the class for base classes
+  DWORD type;       // Index into TypeModel::types
+  DWORD offset;     // From the start of the UDT
+  DWORD bit_position;
+  DWORD bit_count; // 0 - not a bit field
+};
+
+struct TypeEnumerator {
+  std::string name;
+  int64_t value;
+};
+
+// Typedefs are looked through, they have no entry of their own
+struct Type {
+  TypeKind kind;
+  std::string name; // UDTs and enums
+  DWORD64 size;
+  DWORD base_type; // BasicType, of the enum's values for enums
+  DWORD element;   // Of arrays, index into TypeModel::types
+  DWORD count;     // Of array elements
+  std::vector<TypeField> fields; // Base classes first
+  std::vector<TypeEnumerator> enumerators;
+};
+
+// Layout of the types of one module, each one is built from the debug info
+// the first time a symbol of it is shown. Members of a UDT are built with
+// it, so showing them later costs no DbgHelp calls. Pointers aren't
+// followed, the pointee isn't needed to show the address.
+struct TypeModel {
+  DWORD64 module_base;
+  std::vector<Type> types;
+  std::unordered_map<ULONG, DWORD> type_indices; // DbgHelp ones to "types"
+};
\ No newline at end of file
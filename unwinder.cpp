@@ -0,0 +1,946 @@
+// Pointer encodings of .eh_frame, from the Linux Standard Base
+#define DW_EH_PE_absptr 0x00
+#define DW_EH_PE_uleb128 0x01
+#define DW_EH_PE_udata2 0x02
+#define DW_EH_PE_udata4 0x03
+#define DW_EH_PE_udata8 0x04
+#define DW_EH_PE_sleb128 0x09
+#define DW_EH_PE_sdata2 0x0a
+#define DW_EH_PE_sdata4 0x0b
+#define DW_EH_PE_sdata8 0x0c
+#define DW_EH_PE_pcrel 0x10
+
+// Call frame instructions, from the DWARF 5 specification
+#define DW_CFA_advance_loc 0x40
+#define DW_CFA_offset 0x80
+#define DW_CFA_restore 0xc0
+#define DW_CFA_nop 0x00
+#define DW_CFA_set_loc 0x01
+#define DW_CFA_advance_loc1 0x02
+#define DW_CFA_advance_loc2 0x03
+#define DW_CFA_advance_loc4 0x04
+#define DW_CFA_offset_extended 0x05
+#define DW_CFA_restore_extended 0x06
+#define DW_CFA_undefined 0x07
+#define DW_CFA_same_value 0x08
+#define DW_CFA_register 0x09
+#define DW_CFA_remember_state 0x0a
+#define DW_CFA_restore_state 0x0b
+#define DW_CFA_def_cfa 0x0c
+#define DW_CFA_def_cfa_register 0x0d
+#define DW_CFA_def_cfa_offset 0x0e
+#define DW_CFA_def_cfa_expression 0x0f
+#define DW_CFA_expression 0x10
+#define DW_CFA_offset_extended_sf 0x11
+#define DW_CFA_def_cfa_sf 0x12
+#define DW_CFA_def_cfa_offset_sf 0x13
+#define DW_CFA_val_offset 0x14
+#define DW_CFA_val_offset_sf 0x15
+#define DW_CFA_val_expression 0x16
+#define DW_CFA_GNU_args_size 0x2e
+#define DW_CFA_GNU_negative_offset_extended 0x2f
+
+// Expression operations used in CFI
+#define DW_OP_addr 0x03
+#define DW_OP_deref 0x06
+#define DW_OP_const1u 0x08
+#define DW_OP_const1s 0x09
+#define DW_OP_const2u 0x0a
+#define DW_OP_const2s 0x0b
+#define DW_OP_const4u 0x0c
+#define DW_OP_const4s 0x0d
+#define DW_OP_const8u 0x0e
+#define DW_OP_const8s 0x0f
+#define DW_OP_constu 0x10
+#define DW_OP_consts 0x11
+#define DW_OP_dup 0x12
+#define DW_OP_drop 0x13
+#define DW_OP_over 0x14
+#define DW_OP_swap 0x16
+#define DW_OP_and 0x1a
+#define DW_OP_minus 0x1c
+#define DW_OP_mul 0x1e
+#define DW_OP_neg 0x1f
+#define DW_OP_not 0x20
+#define DW_OP_or 0x21
+#define DW_OP_plus 0x22
+#define DW_OP_plus_uconst 0x23
+#define DW_OP_shl 0x24
+#define DW_OP_shr 0x25
+#define DW_OP_shra 0x26
+#define DW_OP_xor 0x27
+#define DW_OP_bra 0x28
+#define DW_OP_eq 0x29
+#define DW_OP_ge 0x2a
+#define DW_OP_gt 0x2b
+#define DW_OP_le 0x2c
+#define DW_OP_lt 0x2d
+#define DW_OP_ne 0x2e
+#define DW_OP_skip 0x2f
+#define DW_OP_lit0 0x30
+#define DW_OP_lit31 0x4f
+#define DW_OP_breg0 0x70
+#define DW_OP_breg31 0x8f
+#define DW_OP_bregx 0x92
+#define DW_OP_deref_size 0x94
+#define DW_OP_nop 0x96
+
+#define UNWIND_MAX_EXPRESSION_STACK 64
+
+// Link time address of an encoded pointer
+static DWORD64 UnwindReadPointer(const UnwindTable *table,
+                                 DwarfCursor *cursor, BYTE encoding) {
+  const DWORD64 position =
+      table->eh_frame_address + (cursor->at - table->eh_frame.data());
+
+  DWORD64 result;
+  switch (encoding & 0x0f) {
+  case DW_EH_PE_absptr:
+  case DW_EH_PE_udata8:
+  case DW_EH_PE_sdata8:
+    result = DwarfReadU(cursor, 8);
+    break;
+  case DW_EH_PE_uleb128:
+    result = DwarfReadUleb(cursor);
+    break;
+  case DW_EH_PE_udata2:
+    result = DwarfReadU(cursor, 2);
+    break;
+  case DW_EH_PE_udata4:
+    result = DwarfReadU(cursor, 4);
+    break;
+  case DW_EH_PE_sleb128:
+    result = (DWORD64)DwarfReadSleb(cursor);
+    break;
+  case DW_EH_PE_sdata2:
+    result = (DWORD64)(int16_t)DwarfReadU(cursor, 2);
+    break;
+  case DW_EH_PE_sdata4:
+    result = (DWORD64)(int32_t)DwarfReadU(cursor, 4);
+    break;
+  default:
+    cursor->is_error = true;
+    return 0;
+  }
+
+  // Text and data relative ones aren't used on x86-64
+  switch (encoding & 0x70) {
+  case 0:
+    break;
+  case DW_EH_PE_pcrel:
+    result += position;
+    break;
+  default:
+    cursor->is_error = true;
+    return 0;
+  }
+
+  return result;
+}
+
+// Entry of .eh_frame at the offset, "entry" gets it's contents after the id.
+// false at the terminator and past the end.
+static bool UnwindReadEntry(const UnwindTable *table, DWORD64 offset,
+                            DwarfCursor *entry, DWORD64 *id_offset,
+                            DWORD *id, DWORD64 *next_offset) {
+  const auto &eh_frame = table->eh_frame;
+  if (offset >= eh_frame.size()) {
+    return false;
+  }
+
+  DwarfCursor cursor = {eh_frame.data() + offset,
+                        eh_frame.data() + eh_frame.size(), false};
+  DWORD64 length = DwarfReadU(&cursor, 4);
+  if (length == 0xffffffff) {
+    length = DwarfReadU(&cursor, 8);
+  }
+  if (length == 0 || cursor.is_error ||
+      length > (DWORD64)(cursor.end - cursor.at)) {
+    return false;
+  }
+
+  *id_offset = cursor.at - eh_frame.data();
+  *next_offset = *id_offset + length;
+  cursor.end = cursor.at + length;
+  *id = (DWORD)DwarfReadU(&cursor, 4);
+  *entry = cursor;
+
+  return !cursor.is_error;
+}
+
+static bool UnwindReadCie(const UnwindTable *table, DWORD64 offset,
+                          UnwindCie *cie) {
+  DwarfCursor cursor;
+  DWORD64 id_offset;
+  DWORD id;
+  DWORD64 next_offset;
+  if (!UnwindReadEntry(table, offset, &cursor, &id_offset, &id,
+                       &next_offset) ||
+      id != 0) {
+    return false;
+  }
+
+  const BYTE version = (BYTE)DwarfReadU(&cursor, 1);
+  const char *augmentation = DwarfReadString(&cursor);
+  if (augmentation[0] == 'e' && augmentation[1] == 'h') {
+    DwarfReadU(&cursor, 8); // Old GCC, address of the exception table
+  }
+
+  cie->code_alignment = DwarfReadUleb(&cursor);
+  cie->data_alignment = DwarfReadSleb(&cursor);
+  cie->return_register = version == 1 ? (DWORD)DwarfReadU(&cursor, 1)
+                                       : (DWORD)DwarfReadUleb(&cursor);
+  cie->pointer_encoding = DW_EH_PE_absptr;
+  cie->has_augmentation_data = augmentation[0] == 'z';
+  cie->is_signal_frame = false;
+
+  if (cie->has_augmentation_data) {
+    const DWORD64 size = DwarfReadUleb(&cursor);
+    if (cursor.is_error || size > (DWORD64)(cursor.end - cursor.at)) {
+      return false;
+    }
+    const BYTE *end = cursor.at + size;
+
+    for (const char *c = augmentation + 1; *c; ++c) {
+      if (*c == 'R') {
+        cie->pointer_encoding = (BYTE)DwarfReadU(&cursor, 1);
+      } else if (*c == 'P') {
+        // Personality routine, only exceptions need it
+        const BYTE encoding = (BYTE)DwarfReadU(&cursor, 1);
+        UnwindReadPointer(table, &cursor, encoding & 0x7f);
+      } else if (*c == 'L') {
+        DwarfReadU(&cursor, 1);
+      } else if (*c == 'S') {
+        cie->is_signal_frame = true;
+      } else {
+        break; // Rest of the data is skipped over
+      }
+    }
+
+    cursor.at = end;
+  } else if (augmentation[0] != '\0') {
+    return false; // Data of unknown augmentations can't be skipped
+  }
+
+  cie->instructions = cursor;
+
+  return !cursor.is_error;
+}
+
+// FDE with it's CIE, "start" is a link time address
+static bool UnwindReadFde(const UnwindTable *table, DWORD64 offset,
+                          UnwindCie *cie, DWORD64 *start, DWORD64 *size,
+                          DwarfCursor *instructions) {
+  DwarfCursor cursor;
+  DWORD64 id_offset;
+  DWORD id;
+  DWORD64 next_offset;
+  if (!UnwindReadEntry(table, offset, &cursor, &id_offset, &id,
+                       &next_offset) ||
+      id == 0 || id > id_offset ||
+      !UnwindReadCie(table, id_offset - id, cie)) {
+    return false;
+  }
+
+  *start = UnwindReadPointer(table, &cursor, cie->pointer_encoding);
+  *size = UnwindReadPointer(table, &cursor, cie->pointer_encoding & 0x0f);
+  if (cie->has_augmentation_data) {
+    const DWORD64 augmentation_size = DwarfReadUleb(&cursor);
+    if (augmentation_size > (DWORD64)(cursor.end - cursor.at)) {
+      return false;
+    }
+    cursor.at += augmentation_size;
+  }
+
+  *instructions = cursor;
+
+  return !cursor.is_error;
+}
+
+// Copies .eh_frame of a module and indexes it's FDEs
+static void UnwindTableBuild(UnwindTable *table, const BYTE *eh_frame,
+                             size_t size, DWORD64 eh_frame_address,
+                             DWORD64 load_address) {
+  table->eh_frame.assign(eh_frame, eh_frame + size);
+  table->eh_frame_address = eh_frame_address;
+  table->load_address = load_address;
+  table->fdes.clear();
+
+  DwarfCursor entry;
+  DWORD64 id_offset;
+  DWORD id;
+  DWORD64 next_offset;
+  for (DWORD64 offset = 0; UnwindReadEntry(table, offset, &entry, &id_offset,
+                                           &id, &next_offset);
+       offset = next_offset) {
+    UnwindCie cie;
+    DWORD64 start;
+    DWORD64 function_size;
+    DwarfCursor instructions;
+    if (id == 0 ||
+        !UnwindReadFde(table, offset, &cie, &start, &function_size,
+                       &instructions) ||
+        function_size == 0 || start < load_address) {
+      continue;
+    }
+
+    const DWORD64 start_rva = start - load_address;
+    table->fdes.push_back(UnwindFde{(DWORD)start_rva,
+                                    (DWORD)(start_rva + function_size),
+                                    (DWORD)offset});
+  }
+
+  std::sort(table->fdes.begin(), table->fdes.end(),
+            [](const UnwindFde &a, const UnwindFde &b) {
+              return a.start_rva < b.start_rva;
+            });
+}
+
+static const UnwindFde *UnwindFindFde(const UnwindTable *table,
+                                      DWORD64 rva) {
+  const auto &fdes = table->fdes;
+
+  auto it = std::upper_bound(fdes.begin(), fdes.end(), rva,
+                             [](DWORD64 value, const UnwindFde &fde) {
+                               return value < fde.start_rva;
+                             });
+  if (it == fdes.begin() || rva >= (--it)->end_rva) {
+    return NULL;
+  }
+
+  return &*it;
+}
+
+static inline void UnwindSetRule(UnwindRow *row, DWORD64 index,
+                                 UnwindRule rule, int64_t value) {
+  if (index < REGISTERS_DWARF_COUNT) {
+    row->registers[index] = UnwindRegisterRule{value, 0, rule};
+  }
+}
+
+// Row that holds from "location" on, it replaces one with the same start
+static void UnwindAddRow(const UnwindTable *table, DWORD64 location,
+                         const UnwindRow &row, UnwindFdeRows *rows) {
+  const DWORD start_rva = (DWORD)(location - table->load_address);
+  if (!rows->start_rvas.empty() && rows->start_rvas.back() == start_rva) {
+    rows->rows.back() = row;
+    return;
+  }
+
+  rows->start_rvas.push_back(start_rva);
+  rows->rows.push_back(row);
+}
+
+// Runs call frame instructions from "location" on and adds the row of every
+// location they advance past to "rows", the last one too. "initial" is the
+// row after the CIE instructions, "initial" and "rows" are NULL while those
+// run.
+static bool UnwindRunInstructions(const UnwindTable *table,
+                                  const UnwindCie &cie, DwarfCursor cursor,
+                                  DWORD64 location, const UnwindRow *initial,
+                                  UnwindRow *row, UnwindFdeRows *rows) {
+  std::vector<UnwindRow> remembered;
+
+  while (cursor.at < cursor.end && !cursor.is_error) {
+    const BYTE op = (BYTE)DwarfReadU(&cursor, 1);
+    const BYTE operand = op & 0x3f;
+
+    switch (op & 0xc0) {
+    case DW_CFA_advance_loc:
+      if (rows) {
+        UnwindAddRow(table, location, *row, rows);
+      }
+      location += operand * cie.code_alignment;
+      continue;
+    case DW_CFA_offset:
+      UnwindSetRule(row, operand, UnwindRule::OFFSET,
+                    (int64_t)DwarfReadUleb(&cursor) * cie.data_alignment);
+      continue;
+    case DW_CFA_restore:
+      if (operand < REGISTERS_DWARF_COUNT) {
+        row->registers[operand] = initial ? initial->registers[operand]
+                                          : UnwindRegisterRule{};
+      }
+      continue;
+    }
+
+    DWORD64 delta = 0;
+    switch (op) {
+    case DW_CFA_nop:
+      break;
+    case DW_CFA_set_loc:
+      if (rows) {
+        UnwindAddRow(table, location, *row, rows);
+      }
+      location = UnwindReadPointer(table, &cursor, cie.pointer_encoding);
+      break;
+    case DW_CFA_advance_loc1:
+    case DW_CFA_advance_loc2:
+    case DW_CFA_advance_loc4:
+      delta = DwarfReadU(&cursor, op == DW_CFA_advance_loc1   ? 1
+                                  : op == DW_CFA_advance_loc2 ? 2
+                                                              : 4);
+      if (rows) {
+        UnwindAddRow(table, location, *row, rows);
+      }
+      location += delta * cie.code_alignment;
+      break;
+    case DW_CFA_offset_extended: {
+      const DWORD64 index = DwarfReadUleb(&cursor);
+      UnwindSetRule(row, index, UnwindRule::OFFSET,
+                    (int64_t)DwarfReadUleb(&cursor) * cie.data_alignment);
+    } break;
+    case DW_CFA_offset_extended_sf: {
+      const DWORD64 index = DwarfReadUleb(&cursor);
+      UnwindSetRule(row, index, UnwindRule::OFFSET,
+                    DwarfReadSleb(&cursor) * cie.data_alignment);
+    } break;
+    case DW_CFA_GNU_negative_offset_extended: {
+      const DWORD64 index = DwarfReadUleb(&cursor);
+      UnwindSetRule(row, index, UnwindRule::OFFSET,
+                    -(int64_t)DwarfReadUleb(&cursor) * cie.data_alignment);
+    } break;
+    case DW_CFA_val_offset: {
+      const DWORD64 index = DwarfReadUleb(&cursor);
+      UnwindSetRule(row, index, UnwindRule::VAL_OFFSET,
+                    (int64_t)DwarfReadUleb(&cursor) * cie.data_alignment);
+    } break;
+    case DW_CFA_val_offset_sf: {
+      const DWORD64 index = DwarfReadUleb(&cursor);
+      UnwindSetRule(row, index, UnwindRule::VAL_OFFSET,
+                    DwarfReadSleb(&cursor) * cie.data_alignment);
+    } break;
+    case DW_CFA_restore_extended: {
+      const DWORD64 index = DwarfReadUleb(&cursor);
+      if (index < REGISTERS_DWARF_COUNT) {
+        row->registers[index] =
+            initial ? initial->registers[index] : UnwindRegisterRule{};
+      }
+    } break;
+    case DW_CFA_undefined:
+      UnwindSetRule(row, DwarfReadUleb(&cursor), UnwindRule::UNDEFINED, 0);
+      break;
+    case DW_CFA_same_value:
+      UnwindSetRule(row, DwarfReadUleb(&cursor), UnwindRule::SAME, 0);
+      break;
+    case DW_CFA_register: {
+      const DWORD64 index = DwarfReadUleb(&cursor);
+      UnwindSetRule(row, index, UnwindRule::REGISTER,
+                    (int64_t)DwarfReadUleb(&cursor));
+    } break;
+    case DW_CFA_remember_state:
+      remembered.push_back(*row);
+      break;
+    case DW_CFA_restore_state:
+      if (remembered.empty()) {
+        return false;
+      }
+      *row = remembered.back();
+      remembered.pop_back();
+      break;
+    case DW_CFA_def_cfa:
+      row->cfa_register = (DWORD)DwarfReadUleb(&cursor);
+      row->cfa_offset = (int64_t)DwarfReadUleb(&cursor);
+      row->cfa_expression_size = 0;
+      break;
+    case DW_CFA_def_cfa_sf:
+      row->cfa_register = (DWORD)DwarfReadUleb(&cursor);
+      row->cfa_offset = DwarfReadSleb(&cursor) * cie.data_alignment;
+      row->cfa_expression_size = 0;
+      break;
+    case DW_CFA_def_cfa_register:
+      row->cfa_register = (DWORD)DwarfReadUleb(&cursor);
+      row->cfa_expression_size = 0;
+      break;
+    case DW_CFA_def_cfa_offset:
+      row->cfa_offset = (int64_t)DwarfReadUleb(&cursor);
+      break;
+    case DW_CFA_def_cfa_offset_sf:
+      row->cfa_offset = DwarfReadSleb(&cursor) * cie.data_alignment;
+      break;
+    case DW_CFA_def_cfa_expression: {
+      const DWORD64 size = DwarfReadUleb(&cursor);
+      if (size == 0 || size > (DWORD64)(cursor.end - cursor.at)) {
+        return false;
+      }
+      row->cfa_expression = (DWORD)(cursor.at - table->eh_frame.data());
+      row->cfa_expression_size = (DWORD)size;
+      cursor.at += size;
+    } break;
+    case DW_CFA_expression:
+    case DW_CFA_val_expression: {
+      const DWORD64 index = DwarfReadUleb(&cursor);
+      const DWORD64 size = DwarfReadUleb(&cursor);
+      if (size > (DWORD64)(cursor.end - cursor.at)) {
+        return false;
+      }
+      UnwindSetRule(row, index,
+                    op == DW_CFA_expression ? UnwindRule::EXPRESSION
+                                            : UnwindRule::VAL_EXPRESSION,
+                    cursor.at - table->eh_frame.data());
+      if (index < REGISTERS_DWARF_COUNT) {
+        row->registers[index].expression_size = (DWORD)size;
+      }
+      cursor.at += size;
+    } break;
+    case DW_CFA_GNU_args_size:
+      DwarfReadUleb(&cursor);
+      break;
+    default:
+      return false;
+    }
+  }
+  if (cursor.is_error) {
+    return false;
+  }
+
+  if (rows) {
+    UnwindAddRow(table, location, *row, rows);
+  }
+
+  return true;
+}
+
+// "registers" are the values in DWARF order
+static inline bool UnwindGetRegister(const DWORD64 *registers, DWORD64 index,
+                                     DWORD64 *value) {
+  if (index >= REGISTERS_DWARF_COUNT) {
+    return false;
+  }
+
+  *value = registers[index];
+
+  return true;
+}
+
+// DWARF expression of a CFI rule, "initial" is pushed first if it's given
+static bool UnwindEvaluate(const UnwindTable *table, DWORD offset,
+                           DWORD size, const DWORD64 *registers,
+                           MemoryCache *memory_cache, const DWORD64 *initial,
+                           DWORD64 *result) {
+  DWORD64 stack[UNWIND_MAX_EXPRESSION_STACK];
+  size_t depth = 0;
+  if (initial) {
+    stack[depth++] = *initial;
+  }
+
+  const BYTE *begin = table->eh_frame.data() + offset;
+  DwarfCursor cursor = {begin, begin + size, false};
+  while (cursor.at < cursor.end && !cursor.is_error) {
+    const BYTE op = (BYTE)DwarfReadU(&cursor, 1);
+
+    // Operations that only push
+    bool is_push = true;
+    DWORD64 value = 0;
+    if (op >= DW_OP_lit0 && op <= DW_OP_lit31) {
+      value = op - DW_OP_lit0;
+    } else if (op >= DW_OP_breg0 && op <= DW_OP_breg31) {
+      if (!UnwindGetRegister(registers, op - DW_OP_breg0, &value)) {
+        return false;
+      }
+      value += (DWORD64)DwarfReadSleb(&cursor);
+    } else {
+      switch (op) {
+      case DW_OP_addr:
+      case DW_OP_const8u:
+      case DW_OP_const8s:
+        value = DwarfReadU(&cursor, 8);
+        break;
+      case DW_OP_const1u:
+        value = DwarfReadU(&cursor, 1);
+        break;
+      case DW_OP_const1s:
+        value = (DWORD64)(int8_t)DwarfReadU(&cursor, 1);
+        break;
+      case DW_OP_const2u:
+        value = DwarfReadU(&cursor, 2);
+        break;
+      case DW_OP_const2s:
+        value = (DWORD64)(int16_t)DwarfReadU(&cursor, 2);
+        break;
+      case DW_OP_const4u:
+        value = DwarfReadU(&cursor, 4);
+        break;
+      case DW_OP_const4s:
+        value = (DWORD64)(int32_t)DwarfReadU(&cursor, 4);
+        break;
+      case DW_OP_constu:
+        value = DwarfReadUleb(&cursor);
+        break;
+      case DW_OP_consts:
+        value = (DWORD64)DwarfReadSleb(&cursor);
+        break;
+      case DW_OP_bregx: {
+        const DWORD64 index = DwarfReadUleb(&cursor);
+        if (!UnwindGetRegister(registers, index, &value)) {
+          return false;
+        }
+        value += (DWORD64)DwarfReadSleb(&cursor);
+      } break;
+      default:
+        is_push = false;
+        break;
+      }
+    }
+
+    if (is_push) {
+      if (depth == UNWIND_MAX_EXPRESSION_STACK) {
+        return false;
+      }
+      stack[depth++] = value;
+      continue;
+    }
+
+    // Rest works on the top of the stack
+    if (op == DW_OP_nop) {
+      continue;
+    }
+    if (op == DW_OP_skip || op == DW_OP_bra) {
+      const int16_t skip = (int16_t)DwarfReadU(&cursor, 2);
+      if (op == DW_OP_bra) {
+        if (depth == 0) {
+          return false;
+        }
+        if (stack[--depth] == 0) {
+          continue;
+        }
+      }
+      if (skip < begin - cursor.at || skip > cursor.end - cursor.at) {
+        return false;
+      }
+      cursor.at += skip;
+      continue;
+    }
+    if (depth == 0) {
+      return false;
+    }
+
+    DWORD64 &top = stack[depth - 1];
+    switch (op) {
+    case DW_OP_deref:
+    case DW_OP_deref_size: {
+      const DWORD64 value_size =
+          op == DW_OP_deref ? 8 : DwarfReadU(&cursor, 1);
+      DWORD64 loaded = 0;
+      if (value_size > 8 ||
+          !MemoryCacheRead(memory_cache, top, &loaded, value_size, NULL)) {
+        return false;
+      }
+      top = loaded;
+    } break;
+    case DW_OP_dup:
+    case DW_OP_over:
+      if (depth == UNWIND_MAX_EXPRESSION_STACK ||
+          (op == DW_OP_over && depth < 2)) {
+        return false;
+      }
+      stack[depth] = stack[depth - (op == DW_OP_dup ? 1 : 2)];
+      ++depth;
+      break;
+    case DW_OP_drop:
+      --depth;
+      break;
+    case DW_OP_neg:
+      top = (DWORD64)-(int64_t)top;
+      break;
+    case DW_OP_not:
+      top = ~top;
+      break;
+    case DW_OP_plus_uconst:
+      top += DwarfReadUleb(&cursor);
+      break;
+    default: {
+      // Binary ones, the second value is on top
+      if (depth < 2) {
+        return false;
+      }
+      const DWORD64 b = stack[--depth];
+      DWORD64 &a = stack[depth - 1];
+      switch (op) {
+      case DW_OP_swap:
+        stack[depth++] = a;
+        a = b;
+        break;
+      case DW_OP_and:
+        a &= b;
+        break;
+      case DW_OP_minus:
+        a -= b;
+        break;
+      case DW_OP_mul:
+        a *= b;
+        break;
+      case DW_OP_or:
+        a |= b;
+        break;
+      case DW_OP_plus:
+        a += b;
+        break;
+      case DW_OP_shl:
+        a = b < 64 ? a << b : 0;
+        break;
+      case DW_OP_shr:
+        a = b < 64 ? a >> b : 0;
+        break;
+      case DW_OP_shra:
+        a = (DWORD64)((int64_t)a >> (b < 63 ? b : 63));
+        break;
+      case DW_OP_xor:
+        a ^= b;
+        break;
+      case DW_OP_eq:
+        a = a == b;
+        break;
+      case DW_OP_ge:
+        a = (int64_t)a >= (int64_t)b;
+        break;
+      case DW_OP_gt:
+        a = (int64_t)a > (int64_t)b;
+        break;
+      case DW_OP_le:
+        a = (int64_t)a <= (int64_t)b;
+        break;
+      case DW_OP_lt:
+        a = (int64_t)a < (int64_t)b;
+        break;
+      case DW_OP_ne:
+        a = a != b;
+        break;
+      default:
+        return false; // Not used in CFI
+      }
+    } break;
+    }
+  }
+
+  if (cursor.is_error || depth == 0) {
+    return false;
+  }
+
+  *result = stack[depth - 1];
+
+  return true;
+}
+
+// Decoded rows of the FDE, the instructions only run the first time
+static const UnwindFdeRows *UnwindGetRows(UnwindTable *table,
+                                          const UnwindFde *fde) {
+  const DWORD index = (DWORD)(fde - table->fdes.data());
+  auto it = table->rows.find(index);
+  if (it != table->rows.end()) {
+    return &it->second;
+  }
+
+  UnwindFdeRows &rows = table->rows[index];
+  rows.is_valid = false;
+
+  UnwindCie cie;
+  DWORD64 start;
+  DWORD64 size;
+  DwarfCursor instructions;
+  if (!UnwindReadFde(table, fde->offset, &cie, &start, &size,
+                     &instructions)) {
+    return &rows;
+  }
+
+  UnwindRow initial = {};
+  if (!UnwindRunInstructions(table, cie, cie.instructions, 0, NULL, &initial,
+                             NULL)) {
+    return &rows;
+  }
+  UnwindRow row = initial;
+  if (!UnwindRunInstructions(table, cie, instructions, start, &initial, &row,
+                             &rows)) {
+    rows.start_rvas.clear();
+    rows.rows.clear();
+    return &rows;
+  }
+
+  rows.is_valid = true;
+  rows.is_signal_frame = cie.is_signal_frame;
+  rows.return_register = cie.return_register;
+
+  return &rows;
+}
+
+// Caller's registers in place of the callee's, "fde" covers the pc.
+// "is_return_address" tells that the pc is one, the call before it is what's
+// looked up then.
+static UnwindStepResult UnwindStep(UnwindTable *table, DWORD64 base,
+                                   const UnwindFde *fde,
+                                   MemoryCache *memory_cache,
+                                   bool is_return_address,
+                                   Registers *registers, DWORD64 *cfa,
+                                   bool *is_signal_frame) {
+  const UnwindFdeRows *rows = UnwindGetRows(table, fde);
+  if (!rows->is_valid) {
+    return UnwindStepResult::ERROR;
+  }
+
+  const DWORD64 rva = registers->Rip - (is_return_address ? 1 : 0) - base;
+  const auto &start_rvas = rows->start_rvas;
+  const size_t index =
+      std::upper_bound(start_rvas.begin(), start_rvas.end(), rva) -
+      start_rvas.begin();
+  if (index == 0) {
+    return UnwindStepResult::ERROR;
+  }
+  const UnwindRow &row = rows->rows[index - 1];
+
+  // Rules refer to the callee's values, only the ones CFI knows are kept
+  DWORD64 callee[REGISTERS_DWARF_COUNT];
+  for (DWORD i = 0; i < REGISTERS_DWARF_COUNT; ++i) {
+    callee[i] = registers->*Global_RegistersDwarf[i];
+  }
+  if (row.cfa_expression_size) {
+    if (!UnwindEvaluate(table, row.cfa_expression, row.cfa_expression_size,
+                        callee, memory_cache, NULL, cfa)) {
+      return UnwindStepResult::ERROR;
+    }
+  } else {
+    DWORD64 value;
+    if (!UnwindGetRegister(callee, row.cfa_register, &value)) {
+      return UnwindStepResult::ERROR;
+    }
+    *cfa = value + row.cfa_offset;
+  }
+
+  // Stack pointer of the caller is the CFA, unless a rule says otherwise
+  registers->Rsp = *cfa;
+
+  bool is_outermost = rows->return_register >= REGISTERS_DWARF_COUNT;
+  for (DWORD i = 0; i < REGISTERS_DWARF_COUNT; ++i) {
+    const UnwindRegisterRule &rule = row.registers[i];
+    DWORD64 &value = registers->*Global_RegistersDwarf[i];
+
+    DWORD64 address;
+    switch (rule.rule) {
+    case UnwindRule::SAME:
+      break;
+    case UnwindRule::UNDEFINED:
+      is_outermost |= i == rows->return_register;
+      break;
+    case UnwindRule::OFFSET:
+      if (!MemoryCacheRead(memory_cache, *cfa + rule.value, &value,
+                           sizeof(value), NULL)) {
+        return UnwindStepResult::ERROR;
+      }
+      break;
+    case UnwindRule::VAL_OFFSET:
+      value = *cfa + rule.value;
+      break;
+    case UnwindRule::REGISTER:
+      if (!UnwindGetRegister(callee, rule.value, &value)) {
+        return UnwindStepResult::ERROR;
+      }
+      break;
+    case UnwindRule::EXPRESSION:
+    case UnwindRule::VAL_EXPRESSION:
+      if (!UnwindEvaluate(table, (DWORD)rule.value, rule.expression_size,
+                          callee, memory_cache, cfa, &address)) {
+        return UnwindStepResult::ERROR;
+      }
+      if (rule.rule == UnwindRule::VAL_EXPRESSION) {
+        value = address;
+      } else if (!MemoryCacheRead(memory_cache, address, &value,
+                                  sizeof(value), NULL)) {
+        return UnwindStepResult::ERROR;
+      }
+      break;
+    }
+  }
+
+  if (is_outermost) {
+    return UnwindStepResult::OUTERMOST;
+  }
+
+  registers->Rip = registers->*Global_RegistersDwarf[rows->return_register];
+  *is_signal_frame = rows->is_signal_frame;
+
+  return UnwindStepResult::CALLER;
+}
+
+// Without CFI the frame pointer chain is followed, that is what the usual
+// prologue sets up
+static UnwindStepResult UnwindStepFramePointer(MemoryCache *memory_cache,
+                                               Registers *registers) {
+  DWORD64 saved[2]; // rbp, return address
+  if (registers->Rbp < registers->Rsp ||
+      !MemoryCacheRead(memory_cache, registers->Rbp, saved, sizeof(saved),
+                       NULL)) {
+    return UnwindStepResult::ERROR;
+  }
+
+  registers->Rsp = registers->Rbp + sizeof(saved);
+  registers->Rbp = saved[0];
+  registers->Rip = saved[1];
+
+  return saved[1] ? UnwindStepResult::CALLER : UnwindStepResult::OUTERMOST;
+}
+
+// Module with CFI for the location and the FDE that covers it, NULL if there
+// is none. Modules are sorted by base, only the one with the highest base at
+// or below the location can have it.
+static Module *UnwindFindModule(std::vector<Module> &modules, DWORD64 pc,
+                                const UnwindFde **fde) {
+  auto it = std::upper_bound(
+      modules.begin(), modules.end(), pc,
+      [](DWORD64 address, const Module &module) {
+        return address < module.base;
+      });
+  if (it == modules.begin()) {
+    return NULL;
+  }
+
+  Module *module = &*(it - 1);
+  *fde = UnwindFindFde(&module->unwind_table, pc - module->base);
+
+  return *fde ? module : NULL;
+}
+
+// Frames of the stack from the registers of the innermost one, up to
+// "max_count" of them, x86-64 only. Each module's CFI unwinds it's own
+// functions.
+static void UnwindWalk(std::vector<Module> &modules,
+                       MemoryCache *memory_cache, const Registers &registers,
+                       size_t max_count, std::vector<UnwindFrame> *frames) {
+  Registers current = registers;
+  bool is_return_address = false;
+
+  // Recursion and loops unwind through the same function again and again
+  Module *module = NULL;
+  const UnwindFde *fde = NULL;
+
+  while (current.Rip && frames->size() < max_count) {
+    UnwindFrame frame = {current.Rip, current.Rsp, 0, current.Rbp};
+    const DWORD64 sp = current.Rsp;
+
+    const DWORD64 pc = current.Rip - (is_return_address ? 1 : 0);
+    if (!module || pc - module->base < fde->start_rva ||
+        pc - module->base >= fde->end_rva) {
+      module = UnwindFindModule(modules, pc, &fde);
+    }
+    UnwindStepResult result = UnwindStepResult::NO_INFO;
+    bool is_signal_frame = false;
+    if (module) {
+      result = UnwindStep(&module->unwind_table, module->base, fde,
+                          memory_cache, is_return_address, &current,
+                          &frame.cfa, &is_signal_frame);
+    }
+    if (result == UnwindStepResult::NO_INFO) {
+      result = UnwindStepFramePointer(memory_cache, &current);
+    }
+
+    frames->push_back(frame);
+    if (result != UnwindStepResult::CALLER) {
+      break;
+    }
+
+    // Stack grows down, a caller below it's callee is a broken walk. Signal
+    // handlers may run on their own stack.
+    if (current.Rsp <= sp && !is_signal_frame) {
+      break;
+    }
+    is_return_address = !is_signal_frame;
+  }
+}
\ No newline at end of file
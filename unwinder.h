@@ -0,0 +1,78 @@
+#define UNWIND_MAX_FRAMES 65536 // Deeper stacks are cut
+
+// Frame description entry of .eh_frame
+struct UnwindFde {
+  DWORD start_rva;
+  DWORD end_rva; // Exclusive
+  DWORD offset;  // Into UnwindTable::eh_frame
+};
+
+enum class UnwindRule : BYTE {
+  SAME, // Value of the callee, the default
+  UNDEFINED,
+  OFFSET,     // Saved at CFA + offset
+  VAL_OFFSET, // Is CFA + offset
+  REGISTER,   // In another register
+  EXPRESSION, // Saved at the address the expression gives
+  VAL_EXPRESSION
+};
+
+struct UnwindRegisterRule {
+  int64_t value; // Offset, register or expression offset into "eh_frame"
+  DWORD expression_size;
+  UnwindRule rule;
+};
+
+// Rules that hold at one location of a function
+struct UnwindRow {
+  DWORD cfa_register; // DWARF number
+  int64_t cfa_offset;
+  DWORD cfa_expression; // Offset into "eh_frame", used if the size isn't 0
+  DWORD cfa_expression_size;
+  UnwindRegisterRule registers[REGISTERS_DWARF_COUNT];
+};
+
+// Rows of one FDE, the instructions run once the first time a pc in it is
+// unwound. Row "i" holds from "start_rvas[i]" up to the next one.
+struct UnwindFdeRows {
+  bool is_valid; // Broken CFI is remembered too
+  bool is_signal_frame;
+  DWORD return_register;
+  std::vector<DWORD> start_rvas;
+  std::vector<UnwindRow> rows;
+};
+
+// Call frame information of one module, copied out of it's file. Addresses
+// are relative to the module base like in the module index.
+struct UnwindTable {
+  std::vector<BYTE> eh_frame;
+  DWORD64 eh_frame_address; // Link time, pc relative pointers need it
+  DWORD64 load_address;     // Link time address of the module base
+  std::vector<UnwindFde> fdes; // Sorted by start
+  std::unordered_map<DWORD, UnwindFdeRows> rows; // By index into "fdes"
+};
+
+enum class UnwindStepResult {
+  CALLER,     // Registers are of the caller now
+  OUTERMOST,  // Return address is undefined, nothing called the function
+  NO_INFO,    // Location isn't covered by the table
+  ERROR       // Broken CFI or unreadable stack
+};
+
+// One frame of a walked stack, the innermost first
+struct UnwindFrame {
+  DWORD64 pc;  // Return address for the callers
+  DWORD64 sp;  // Stack pointer in the frame
+  DWORD64 cfa; // Stack pointer before the call, 0 - unknown
+  DWORD64 frame_pointer;
+};
+// Common information entry, shared by the FDEs of a compilation unit
+struct UnwindCie {
+  DWORD64 code_alignment;
+  int64_t data_alignment;
+  DWORD return_register; // DWARF number of the return address column
+  BYTE pointer_encoding; // Of the FDE addresses, DW_EH_PE_*
+  bool has_augmentation_data;
+  bool is_signal_frame; // Caller's pc isn't a return address
+  DwarfCursor instructions;
+};
\ No newline at end of file
@@ -88,4 +88,18 @@ static std::string GetFilenameFromPath(const std::string& path) {
   }
 
   return result;
-}
\ No newline at end of file
+}
+
+static std::string GetStringFromWString(const std::wstring &wstring) {
+  std::string result;
+
+  const int size = WideCharToMultiByte(CP_UTF8, 0, wstring.c_str(),
+                                       (int)wstring.size(), NULL, 0, NULL, NULL);
+  if (size > 0) {
+    result.resize(size);
+    WideCharToMultiByte(CP_UTF8, 0, wstring.c_str(), (int)wstring.size(),
+                        &result[0], size, NULL, NULL);
+  }
+
+  return result;
+}